@@ -0,0 +1,140 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "NativeJIT/CodeGen/ExecutionBuffer.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/Function.h"
+#include "NativeJIT/TreeEnsemble.h"
+#include "Temporary/Allocator.h"
+
+using NativeJIT::Allocator;
+using NativeJIT::DecisionTreeNode;
+using NativeJIT::ExecutionBuffer;
+using NativeJIT::Function;
+using NativeJIT::FunctionBuffer;
+using NativeJIT::TreeEnsemble;
+
+
+const unsigned c_treeCount = 200;
+const unsigned c_treeDepth = 6;
+const unsigned c_featureCount = 64;
+const unsigned c_vectorCount = 10000;
+const unsigned c_passCount = 20;
+
+
+// Appends a complete tree of the specified depth in preorder and returns
+// the index of its root.
+uint32_t AddRandomSubtree(std::vector<DecisionTreeNode>& nodes,
+                          std::mt19937& random,
+                          std::uniform_real_distribution<float>& values,
+                          unsigned depth)
+{
+    const uint32_t index = static_cast<uint32_t>(nodes.size());
+    const DecisionTreeNode leaf = { 0, 0, 0, 0, values(random) };
+
+    nodes.push_back(leaf);
+
+    if (depth > 0)
+    {
+        nodes[index].m_feature = random() % c_featureCount;
+        nodes[index].m_threshold = values(random);
+
+        const uint32_t left = AddRandomSubtree(nodes, random, values, depth - 1);
+        nodes[index].m_left = left;
+
+        const uint32_t right = AddRandomSubtree(nodes, random, values, depth - 1);
+        nodes[index].m_right = right;
+    }
+
+    return index;
+}
+
+
+// Returns the sum over all vectors and passes and prints the time per
+// evaluation in nanoseconds.
+template <typename EVALUATE>
+float Benchmark(char const * name, std::vector<float> const & features, EVALUATE evaluate)
+{
+    float sum = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for (unsigned pass = 0; pass < c_passCount; ++pass)
+    {
+        for (unsigned i = 0; i < c_vectorCount; ++i)
+        {
+            sum += evaluate(&features[i * c_featureCount]);
+        }
+    }
+
+    const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << name << ": "
+              << elapsed.count() / (c_passCount * c_vectorCount)
+              << " ns per evaluation" << std::endl;
+
+    return sum;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// This example compiles an ensemble of random decision trees, such as a
+// gradient boosted model, into branches and compares the speed of the
+// compiled function with the TreeEnsemble::Evaluate() interpreter.
+//
+// Each split compiles to
+//
+//     movss  xmm1, dword ptr [FEATURES + 4 * feature]
+//     comiss xmm1, dword ptr [THRESHOLD]
+//     ja     RIGHT_SUBTREE
+//
+// and each leaf to an addss from the constant with its value followed by a
+// jump to the next tree.
+//
+///////////////////////////////////////////////////////////////////////////////
+int main()
+{
+    std::mt19937 random(12345);
+    std::uniform_real_distribution<float> values(-1.0f, 1.0f);
+
+    TreeEnsemble ensemble;
+
+    for (unsigned i = 0; i < c_treeCount; ++i)
+    {
+        std::vector<DecisionTreeNode> nodes;
+        AddRandomSubtree(nodes, random, values, c_treeDepth);
+        ensemble.AddTree(nodes.data(), static_cast<unsigned>(nodes.size()));
+    }
+
+    std::vector<float> features(c_vectorCount * c_featureCount);
+
+    for (auto & feature : features)
+    {
+        feature = values(random);
+    }
+
+    ExecutionBuffer codeAllocator(1 << 20);
+    Allocator allocator(8192);
+    FunctionBuffer code(codeAllocator, 1 << 20);
+
+    Function<float, float const *> expression(allocator, code);
+    auto function = expression.Compile(expression.EvaluateEnsemble(expression.GetP1(), ensemble));
+
+    const float interpreted = Benchmark("Interpreted", features, [&ensemble](float const * f)
+    {
+        return ensemble.Evaluate(f);
+    });
+    const float compiled = Benchmark("Compiled", features, function);
+
+    // Both add the trees in the same order, so the sums must be identical.
+    if (interpreted != compiled)
+    {
+        std::cout << "Mismatch: " << interpreted << " != " << compiled << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
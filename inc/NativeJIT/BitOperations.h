@@ -29,10 +29,7 @@
 #ifdef _MSC_VER
 #include <intrin.h>
 #else
-#include <nmmintrin.h>
-#include <smmintrin.h>
 #include <string.h>    // For ffsll()
-#include <x86intrin.h> // For __lzcnt64.
 #endif
 
 // http://stackoverflow.com/questions/2039861/how-to-get-gcc-to-generate-bts-instruction-for-x86-64-from-standard-c
@@ -80,23 +77,31 @@ namespace NativeJIT
 
 
         // Returns the count of 1 bits in the value.
-        // Requires SSE4 support.
+        // With VC++, requires POPCNT support. Other compilers use the POPCNT
+        // instruction only if the build enables it (e.g. with -mpopcnt).
         // See https://en.wikipedia.org/wiki/SSE4#POPCNT_and_LZCNT
-        // Note that processors from around 2008 and onwards support POPCNT,
+        // Note that processors from around 2008 and onwards support POPCNT.
         inline
         uint8_t GetNonZeroBitCount(uint32_t value)
         {
+#ifdef _MSC_VER
             return static_cast<uint8_t>(_mm_popcnt_u32(value));
+#else
+            return static_cast<uint8_t>(__builtin_popcount(value));
+#endif
         }
 
 
         // Returns the count of 1 bits in the value.
-        // Requires SSE4 support.
-        // See https://en.wikipedia.org/wiki/SSE4#POPCNT_and_LZCNT
+        // See GetNonZeroBitCount(uint32_t) for the instruction set requirements.
         inline
         uint8_t GetNonZeroBitCount(uint64_t value)
         {
+#ifdef _MSC_VER
             return static_cast<uint8_t>(_mm_popcnt_u64(value));
+#else
+            return static_cast<uint8_t>(__builtin_popcountll(value));
+#endif
         }
 
 
@@ -134,10 +139,17 @@ namespace NativeJIT
                    ? true
                    : false;
 #else
-            *highestBitSetIndex = __lzcnt64(value);
-            bool retval = *highestBitSetIndex != 64;
-            *highestBitSetIndex = 63 - *highestBitSetIndex;
-            return retval;
+            // __builtin_clzll() is undefined for zero. The index is still
+            // written so that callers which only read it when true is
+            // returned don't trip -Wmaybe-uninitialized once inlined.
+            if (value == 0)
+            {
+                *highestBitSetIndex = 0;
+                return false;
+            }
+
+            *highestBitSetIndex = 63 - __builtin_clzll(value);
+            return true;
 #endif
         }
 
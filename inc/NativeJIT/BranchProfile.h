@@ -0,0 +1,146 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Temporary/NonCopyable.h"
+
+
+namespace NativeJIT
+{
+    class ExecutionPreconditionTest;
+    class NodeBase;
+
+
+    // Outcome counters for a single two-way branch in the generated code. For
+    // conditional nodes, "taken" means that the condition was true. For
+    // precondition tests, "taken" means that the precondition was met and the
+    // regular flow continued.
+    struct BranchCounts
+    {
+        uint64_t m_taken;
+        uint64_t m_notTaken;
+    };
+
+
+    // The shape of the code generated for a two-way branch.
+    enum class BranchLayout
+    {
+        // The layout used when there is no profile information: the false
+        // path falls through and jumps over the true path.
+        Default,
+
+        // The false path is the fall-through path and takes no jumps.
+        FalseFallThrough,
+
+        // The true path is the fall-through path and takes no jumps.
+        TrueFallThrough,
+
+        // Both values are computed and selected with a conditional move.
+        Branchless
+    };
+
+
+    // The expected outcome of a condition, supplied when the tree is built.
+    // Used to lay out the branches when there is no profile information.
+    enum class BranchHint
+    {
+        None,
+        Likely,
+        Unlikely
+    };
+
+
+    // Specifies how ExpressionTree::Compile() uses a BranchProfile.
+    enum class BranchProfileMode
+    {
+        // Generated code updates the counters in the profile every time it
+        // executes a conditional node or a precondition test.
+        Instrument,
+
+        // Code generation uses the counters collected by an instrumented
+        // build to choose the branch layout and the precondition order.
+        Optimize
+    };
+
+
+    // A side table with branch outcome counters for a single expression tree.
+    //
+    // The branch sites are identified by the node ID of the conditional node
+    // and by the position in which the precondition test was added. The IDs
+    // are assigned in the order of construction, so the profile collected by
+    // an instrumented build of a tree can only be applied to a tree that was
+    // constructed by the same sequence of calls (i.e. recompilation builds the
+    // tree again with BranchProfileMode::Optimize).
+    //
+    // The instrumented code holds the absolute addresses of the counters, so
+    // the profile must outlive the compiled function. The counters are updated
+    // without synchronization; concurrent callers may lose some increments,
+    // which is acceptable for the purpose of the profile.
+    class BranchProfile : public NonCopyable
+    {
+    public:
+        BranchProfile();
+
+        // Sizes the counter tables for a tree. Called by the ExpressionTree
+        // before the code is generated. The sizes cannot be changed once set
+        // since the generated code refers to the counters directly.
+        void Initialize(unsigned nodeCount, unsigned preconditionCount);
+
+        bool IsInitialized() const;
+
+        // Sets all the counters to zero.
+        void Reset();
+
+        BranchCounts& GetCounts(NodeBase const & node);
+        BranchCounts const & GetCounts(NodeBase const & node) const;
+
+        BranchCounts& GetPreconditionCounts(unsigned position);
+        BranchCounts const & GetPreconditionCounts(unsigned position) const;
+
+        // Returns the layout that best fits the counts: if both outcomes
+        // are frequent enough that the branch is likely to be mispredicted
+        // the branchless layout is preferred, otherwise the more frequent
+        // outcome becomes the fall-through path.
+        static BranchLayout GetPreferredLayout(BranchCounts const & counts);
+
+        // Returns the fraction of executions in which the precondition was not
+        // met or zero if it has not been executed.
+        static double GetNotTakenRatio(BranchCounts const & counts);
+
+    private:
+        // A branch is considered unpredictable if the less frequent outcome
+        // happens at least in 1 out of c_branchlessMinorityDivisor cases.
+        static const unsigned c_branchlessMinorityDivisor = 8;
+
+        // Indexed by node ID and by precondition position respectively. Never
+        // resized after Initialize() so that the addresses remain stable.
+        std::vector<BranchCounts> m_nodeCounts;
+        std::vector<BranchCounts> m_preconditionCounts;
+
+        bool m_isInitialized;
+    };
+}
@@ -0,0 +1,624 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>          // For memcpy.
+#include <initializer_list>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "NativeJIT/CodeGen/X64CodeGenerator.h"     // JccType.
+#include "Temporary/Assert.h"
+#include "Temporary/NonCopyable.h"
+
+
+namespace NativeJIT
+{
+    class NodeBase;
+
+
+    // Bytecode is a compact representation of an expression tree which can be
+    // evaluated without generating any machine code. It is produced by lowering
+    // the nodes of a tree (see NodeBase::Lower()) and is used to run the
+    // functions which are not called often enough to justify the cost of the
+    // compilation (see TieredFunction).
+    //
+    // Every value is held in a 64-bit slot. The values that are narrower than
+    // a slot occupy its low-order bytes and the contents of the remaining bytes
+    // are unspecified. References are stored as pointers. Each node is lowered
+    // to at most one instruction which writes a new slot, except for the
+    // conditional nodes whose paths copy their value into a shared slot, so a
+    // slot is written at most once during an evaluation. The first
+    // c_maxParameterCount slots hold the parameters, followed by the slots
+    // that hold constants and stack variables and the slots written by the
+    // instructions.
+    //
+    // The instructions are executed in order, except that a conditional skip
+    // (see BeginSkip()) jumps over the instructions of the path which is not
+    // taken. Unlike in the generated code, which evaluates both values of a
+    // conditional node and only defers their loads (see ConditionalNode),
+    // only the selected value is evaluated. Since the generated code makes
+    // the stores and calls on both paths regardless of the condition, a tree
+    // which has them on one path only is not lowered (see IsInSkip()).
+    //
+    // Once lowered, the bytecode doesn't depend on the nodes, so it is safe to
+    // evaluate it while the expression tree is being compiled on another
+    // thread. Evaluate() can be called concurrently from multiple threads.
+    class Bytecode : public NonCopyable
+    {
+    public:
+        typedef uint64_t Slot;
+
+        static const unsigned c_maxParameterCount = 4;
+
+        // The call node with four parameters has the most operands: the
+        // function pointer and the parameters.
+        static const unsigned c_maxOperandCount = 5;
+
+        struct Instruction;
+
+        // Executes the instruction. Returns false if the evaluation should stop
+        // and return the value in the instruction's result slot.
+        typedef bool (*Handler)(Slot* slots, Instruction const & instruction);
+
+        // A conditional skip has no handler. Its immediate holds the number of
+        // instructions to skip, operand 0 the condition and operand 1 the
+        // value of the condition which causes the skip.
+        struct Instruction
+        {
+            Handler m_handler;
+            unsigned m_result;
+            unsigned m_operands[c_maxOperandCount];
+            Slot m_immediate;
+        };
+
+        Bytecode();
+
+        //
+        // Lowering.
+        //
+
+        // Returns true and sets the slot out parameter if the node has already
+        // been lowered.
+        bool TryGetSlot(NodeBase const & node, unsigned& slot) const;
+        void SetSlot(NodeBase const & node, unsigned slot);
+
+        unsigned GetParameterSlot(unsigned position) const;
+
+        // Allocates a slot initialized to the specified value.
+        template <typename T>
+        unsigned AddConstant(T value);
+
+        // Allocates a slot whose address is valid for the duration of a single
+        // evaluation, i.e. the equivalent of a stack variable.
+        unsigned AddVariable();
+
+        // Appends an instruction and allocates its result slot.
+        unsigned Emit(Handler handler,
+                      std::initializer_list<unsigned> operands,
+                      Slot immediate = 0);
+
+        unsigned Emit(Handler handler,
+                      unsigned const * operands,
+                      unsigned operandCount,
+                      Slot immediate = 0);
+
+        // Appends an instruction which copies the value of the source slot to
+        // the destination slot, f. ex. to merge the values computed by the
+        // paths of a conditional.
+        void EmitCopy(unsigned source, unsigned destination);
+
+        // Begins a sequence of instructions which is skipped if the bool in
+        // the condition slot is equal to skipIf. The sequence ends with the
+        // matching EndSkip() call and the sequences can be nested. The nodes
+        // lowered within the sequence are forgotten at its end, so that
+        // their later uses lower them again rather than read a slot which
+        // may not have been written.
+        void BeginSkip(unsigned condition, bool skipIf);
+        void EndSkip();
+
+        // Returns whether a sequence started by BeginSkip() is open, i.e.
+        // whether the instructions being appended run on one path only.
+        bool IsInSkip() const;
+
+        // Records that the node cannot be lowered. The bytecode cannot be
+        // evaluated once any such node is encountered.
+        void ReportUnsupportedNode(NodeBase const & node);
+
+        void SetResultSlot(unsigned slot);
+
+        //
+        // Evaluation.
+        //
+
+        // Returns whether all the nodes have been lowered successfully.
+        bool CanEvaluate() const;
+
+        // Returns the ID of the first node that could not be lowered. Valid
+        // only if CanEvaluate() returns false.
+        unsigned GetUnsupportedNodeId() const;
+
+        unsigned GetInstructionCount() const;
+        unsigned GetSlotCount() const;
+
+        // Runs the instructions with the specified values of the parameter
+        // slots and returns the value of the result.
+        template <typename R>
+        R Evaluate(Slot const (&parameters)[c_maxParameterCount]) const;
+
+        //
+        // Slot access for the instruction handlers.
+        //
+
+        // Reads or writes a value of type T. T can be a reference, in which
+        // case the slot holds the address of the referenced object.
+        template <typename T>
+        static T Read(Slot const * slots, unsigned index);
+
+        template <typename T>
+        static void Write(Slot* slots, unsigned index, T value);
+
+        // Computes the CPU flags which would be set by the "cmp left, right"
+        // instruction (comiss/comisd for floating point) and returns whether
+        // the condition specified by the JCC holds.
+        template <JccType JCC, typename T>
+        static bool Compare(T left, T right);
+
+        //
+        // Instruction handlers shared by multiple node types.
+        //
+
+        // Copies operand 0 to the result slot.
+        static bool Copy(Slot* slots, Instruction const & instruction);
+
+        // Adds the signed offset in the immediate to the pointer in operand 0.
+        static bool AddOffset(Slot* slots, Instruction const & instruction);
+
+        // Writes the address of the slot specified by the immediate.
+        static bool AddressOfVariable(Slot* slots, Instruction const & instruction);
+
+    private:
+        // The number of slots which Evaluate() allocates on the stack. Larger
+        // programs use a heap allocated copy of the slots.
+        static const unsigned c_maxStackSlotCount = 256;
+
+        static const unsigned c_invalidSlot = UINT32_MAX;
+
+        struct Flags
+        {
+            bool m_carry;
+            bool m_zero;
+            bool m_sign;
+            bool m_overflow;
+            bool m_parity;
+        };
+
+        template <typename T>
+        static Flags ComputeFlags(T left, T right, std::true_type /* isFloat */);
+
+        template <typename T>
+        static Flags ComputeFlags(T left, T right, std::false_type /* isFloat */);
+
+        static bool IsConditionMet(JccType jcc, Flags const & flags);
+
+        template <typename T>
+        struct SlotAccess;
+
+        template <typename T>
+        struct SlotAccess<T&>;
+
+        unsigned AllocateSlot(Slot initialValue);
+
+        void RunInstructions(Slot* slots, unsigned& result) const;
+
+        // The values of the slots at the start of every evaluation. Holds
+        // the constants and zeros for the other slots.
+        std::vector<Slot> m_initialSlots;
+        std::vector<Instruction> m_instructions;
+
+        // Indexed by node ID.
+        std::vector<unsigned> m_nodeSlots;
+
+        // The IDs of the nodes in the order in which they were lowered and,
+        // for each sequence started by BeginSkip() and not yet ended, the
+        // position of its skip instruction and the number of lowered nodes
+        // at its start.
+        std::vector<unsigned> m_loweredNodeIds;
+        std::vector<std::pair<unsigned, size_t>> m_openSkips;
+
+        unsigned m_resultSlot;
+        unsigned m_unsupportedNodeId;
+        bool m_canEvaluate;
+    };
+
+
+    // Implements the arithmetic performed by the instruction handlers for the
+    // binary operations. The operands have the canonical register type (see
+    // CanonicalRegisterStorageType), i.e. an unsigned integer of the register
+    // size or a floating point type. Like in the generated code, the integer
+    // operations wrap around and the shift counts are masked to 5 bits (6 for
+    // 64-bit operands).
+    template <OpCode OP>
+    struct BytecodeOperation
+    {
+        template <typename T>
+        static T Apply(T left, T right);
+    };
+
+
+    // Implements the arithmetic for the unary operations with the same
+    // conventions as BytecodeOperation.
+    template <OpCode OP>
+    struct BytecodeUnaryOperation
+    {
+        template <typename T>
+        static T Apply(T value);
+    };
+
+
+    // Integer operations are performed on uint64_t to prevent the promotion of
+    // narrow unsigned types to int, which could overflow. The result is
+    // truncated back to the register size.
+    template <typename T>
+    struct BytecodeArithmeticType
+    {
+        typedef typename std::conditional<std::is_floating_point<T>::value,
+                                          T,
+                                          uint64_t>::type Type;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for Bytecode.
+    //
+    //*************************************************************************
+
+    template <typename T>
+    struct Bytecode::SlotAccess
+    {
+        typedef typename std::remove_cv<T>::type Value;
+
+        static_assert(sizeof(Value) <= sizeof(Slot), "The value doesn't fit into a slot.");
+
+        static Value Read(Slot const * slots, unsigned index)
+        {
+            Value value;
+            memcpy(&value, slots + index, sizeof(Value));
+
+            return value;
+        }
+
+
+        static void Write(Slot* slots, unsigned index, Value value)
+        {
+            memcpy(slots + index, &value, sizeof(Value));
+        }
+    };
+
+
+    template <typename T>
+    struct Bytecode::SlotAccess<T&>
+    {
+        static T& Read(Slot const * slots, unsigned index)
+        {
+            return *SlotAccess<T*>::Read(slots, index);
+        }
+
+
+        static void Write(Slot* slots, unsigned index, T& value)
+        {
+            SlotAccess<T*>::Write(slots, index, &value);
+        }
+    };
+
+
+    template <typename T>
+    T Bytecode::Read(Slot const * slots, unsigned index)
+    {
+        return SlotAccess<T>::Read(slots, index);
+    }
+
+
+    template <typename T>
+    void Bytecode::Write(Slot* slots, unsigned index, T value)
+    {
+        SlotAccess<T>::Write(slots, index, value);
+    }
+
+
+    template <typename T>
+    unsigned Bytecode::AddConstant(T value)
+    {
+        Slot slot = 0;
+        SlotAccess<T>::Write(&slot, 0, value);
+
+        return AllocateSlot(slot);
+    }
+
+
+    template <typename R>
+    R Bytecode::Evaluate(Slot const (&parameters)[c_maxParameterCount]) const
+    {
+        LogThrowAssert(CanEvaluate(),
+                       "Node with ID %u cannot be evaluated by the interpreter",
+                       m_unsupportedNodeId);
+
+        const size_t slotCount = m_initialSlots.size();
+        Slot stackSlots[c_maxStackSlotCount];
+        std::vector<Slot> heapSlots;
+        Slot* slots = stackSlots;
+
+        if (slotCount > c_maxStackSlotCount)
+        {
+            heapSlots.resize(slotCount);
+            slots = heapSlots.data();
+        }
+
+        memcpy(slots, m_initialSlots.data(), slotCount * sizeof(Slot));
+        memcpy(slots, parameters, sizeof(parameters));
+
+        unsigned result = m_resultSlot;
+        RunInstructions(slots, result);
+
+        return Read<R>(slots, result);
+    }
+
+
+    template <JccType JCC, typename T>
+    bool Bytecode::Compare(T left, T right)
+    {
+        return IsConditionMet(JCC,
+                              ComputeFlags(left,
+                                           right,
+                                           std::is_floating_point<T>()));
+    }
+
+
+    template <typename T>
+    Bytecode::Flags Bytecode::ComputeFlags(T left, T right, std::true_type)
+    {
+        // Unordered comparison (i.e. with NaN) sets all three flags.
+        const bool isUnordered = left != left || right != right;
+        Flags flags;
+
+        flags.m_carry = isUnordered || left < right;
+        flags.m_zero = isUnordered || left == right;
+        flags.m_parity = isUnordered;
+        flags.m_sign = false;
+        flags.m_overflow = false;
+
+        return flags;
+    }
+
+
+    template <typename T>
+    Bytecode::Flags Bytecode::ComputeFlags(T left, T right, std::false_type)
+    {
+        static_assert(std::is_unsigned<T>::value,
+                      "Integer comparison expects the canonical unsigned register type");
+
+        const unsigned c_signBit = sizeof(T) * 8 - 1;
+        const T difference = static_cast<T>(left - right);
+        Flags flags;
+
+        flags.m_carry = left < right;
+        flags.m_zero = left == right;
+        flags.m_sign = ((difference >> c_signBit) & 1) != 0;
+        flags.m_overflow = ((((left ^ right) & (left ^ difference)) >> c_signBit) & 1) != 0;
+
+        // The parity flag is set if the least significant byte of the result
+        // has an even number of bits set.
+        uint8_t lowByte = static_cast<uint8_t>(difference);
+        lowByte ^= lowByte >> 4;
+        lowByte ^= lowByte >> 2;
+        lowByte ^= lowByte >> 1;
+        flags.m_parity = (lowByte & 1) == 0;
+
+        return flags;
+    }
+
+
+    //*************************************************************************
+    //
+    // Template definitions for BytecodeOperation.
+    //
+    //*************************************************************************
+
+#define DEFINE_BYTECODE_OPERATION(op, expression)                               \
+    template <>                                                                 \
+    template <typename T>                                                       \
+    T BytecodeOperation<OpCode::op>::Apply(T left, T right)                     \
+    {                                                                           \
+        typedef typename BytecodeArithmeticType<T>::Type A;                     \
+        const A l = static_cast<A>(left);                                       \
+        const A r = static_cast<A>(right);                                      \
+        const unsigned bitCount = sizeof(T) * 8;                                \
+        const unsigned countMask = bitCount == 64 ? 63 : 31;                    \
+        (void)bitCount;                                                         \
+        (void)countMask;                                                        \
+        return static_cast<T>(expression);                                      \
+    }
+
+    DEFINE_BYTECODE_OPERATION(Add, l + r);
+    DEFINE_BYTECODE_OPERATION(And, l & r);
+    // Used only for floating point, see DivisionNode for integers.
+    DEFINE_BYTECODE_OPERATION(Div, l / r);
+    DEFINE_BYTECODE_OPERATION(IMul, l * r);
+    DEFINE_BYTECODE_OPERATION(Or, l | r);
+    DEFINE_BYTECODE_OPERATION(Sub, l - r);
+    DEFINE_BYTECODE_OPERATION(Xor, l ^ r);
+    DEFINE_BYTECODE_OPERATION(Shl, l << (r & countMask));
+    DEFINE_BYTECODE_OPERATION(Shr, l >> (r & countMask));
+
+    // The rotation count is masked like the shift count and then reduced
+    // modulo the operand size.
+    DEFINE_BYTECODE_OPERATION(Rol,
+                              (r & countMask) % bitCount == 0
+                              ? l
+                              : (l << ((r & countMask) % bitCount))
+                                | (l >> (bitCount - (r & countMask) % bitCount)));
+
+#undef DEFINE_BYTECODE_OPERATION
+
+#define DEFINE_BYTECODE_UNARY_OPERATION(op, expression)                         \
+    template <>                                                                 \
+    template <typename T>                                                       \
+    T BytecodeUnaryOperation<OpCode::op>::Apply(T value)                        \
+    {                                                                           \
+        typedef typename BytecodeArithmeticType<T>::Type A;                     \
+        const A v = static_cast<A>(value);                                      \
+        return static_cast<T>(expression);                                      \
+    }
+
+    // Multiplying the unsigned value by all ones wraps around to the two's
+    // complement negation without applying unary minus to an unsigned type.
+    // Not is defined only for integers.
+    DEFINE_BYTECODE_UNARY_OPERATION(Neg, v * static_cast<A>(-1));
+    DEFINE_BYTECODE_UNARY_OPERATION(Not, ~v);
+
+#undef DEFINE_BYTECODE_UNARY_OPERATION
+
+
+    // The bit manipulation instructions are evaluated one bit at a time so
+    // that the interpreter does not depend on the instruction set extensions
+    // for which it stands in. The counts of zero bits are the operand size
+    // for zero, like lzcnt and tzcnt.
+    template <>
+    template <typename T>
+    T BytecodeUnaryOperation<OpCode::Popcnt>::Apply(T value)
+    {
+        T count = 0;
+
+        for (T v = value; v != 0; v &= static_cast<T>(v - 1))
+        {
+            ++count;
+        }
+
+        return count;
+    }
+
+
+    template <>
+    template <typename T>
+    T BytecodeUnaryOperation<OpCode::Lzcnt>::Apply(T value)
+    {
+        const unsigned bitCount = sizeof(T) * 8;
+        T count = 0;
+
+        while (count < bitCount && ((value >> (bitCount - 1 - count)) & 1) == 0)
+        {
+            ++count;
+        }
+
+        return count;
+    }
+
+
+    template <>
+    template <typename T>
+    T BytecodeUnaryOperation<OpCode::Tzcnt>::Apply(T value)
+    {
+        const unsigned bitCount = sizeof(T) * 8;
+        T count = 0;
+
+        while (count < bitCount && ((value >> count) & 1) == 0)
+        {
+            ++count;
+        }
+
+        return count;
+    }
+
+
+    // The control operand holds the start bit in bits 0-7 and the length in
+    // bits 8-15.
+    template <>
+    template <typename T>
+    T BytecodeOperation<OpCode::Bextr>::Apply(T value, T control)
+    {
+        const unsigned bitCount = sizeof(T) * 8;
+        const unsigned start = control & 0xff;
+        const unsigned length = (control >> 8) & 0xff;
+
+        if (start >= bitCount)
+        {
+            return 0;
+        }
+
+        const T shifted = static_cast<T>(value >> start);
+
+        return length >= bitCount
+            ? shifted
+            : static_cast<T>(shifted & ((static_cast<T>(1) << length) - 1));
+    }
+
+
+    // Deposits the low bits of the value at the positions of the bits set in
+    // the mask.
+    template <>
+    template <typename T>
+    T BytecodeOperation<OpCode::Pdep>::Apply(T value, T mask)
+    {
+        T result = 0;
+        T bit = 1;
+
+        for (T m = mask; m != 0; m &= static_cast<T>(m - 1))
+        {
+            if ((value & bit) != 0)
+            {
+                result |= static_cast<T>(m & (0 - m));
+            }
+
+            bit = static_cast<T>(bit << 1);
+        }
+
+        return result;
+    }
+
+
+    // Gathers the bits of the value at the positions of the bits set in the
+    // mask into the low bits of the result.
+    template <>
+    template <typename T>
+    T BytecodeOperation<OpCode::Pext>::Apply(T value, T mask)
+    {
+        T result = 0;
+        T bit = 1;
+
+        for (T m = mask; m != 0; m &= static_cast<T>(m - 1))
+        {
+            if ((value & m & (0 - m)) != 0)
+            {
+                result |= bit;
+            }
+
+            bit = static_cast<T>(bit << 1);
+        }
+
+        return result;
+    }
+}
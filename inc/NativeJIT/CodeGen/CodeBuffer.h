@@ -117,6 +117,11 @@ namespace NativeJIT
     protected:
         void EmitCallSite(Label label, unsigned size);
 
+        // Used by the derived classes which rewrite code that has already been
+        // emitted. SetCurrentPosition() can only move the write position back.
+        JumpTable& GetJumpTable();
+        void SetCurrentPosition(unsigned position);
+
     private:
         Allocators::IAllocator& m_codeAllocator;
         unsigned m_capacity;
@@ -0,0 +1,84 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include "Temporary/NonCopyable.h"
+
+
+namespace NativeJIT
+{
+    // CodeEpochs tells when code which has been unpublished, for example by
+    // replacing the target of a Trampoline, is no longer run by any thread
+    // and its memory can be reused.
+    //
+    // The calls which may run published code are made within the lifetime of
+    // a Guard. Synchronize() waits until all the guards that existed when it
+    // was called are gone. Guards created in the meantime see the new code
+    // and don't delay it.
+    //
+    // The guards of each epoch are counted in one of two counters. Starting
+    // a new epoch first waits for the counter of the epoch before the current
+    // one to drain and then makes new guards use it, so each counter only
+    // ever holds the guards of a single epoch.
+    class CodeEpochs : public NonCopyable
+    {
+    public:
+        CodeEpochs();
+
+        // Marks the calling thread as possibly running published code for
+        // the lifetime of the object.
+        class Guard : public NonCopyable
+        {
+        public:
+            Guard(CodeEpochs& epochs);
+            ~Guard();
+
+        private:
+            CodeEpochs& m_epochs;
+            unsigned m_counter;
+        };
+
+        // Waits for all the guards which exist at the time of the call to be
+        // destroyed. Must not be called while the calling thread holds a
+        // Guard of the same CodeEpochs, as it would wait for itself.
+        void Synchronize();
+
+        // Returns the number of epochs started by Synchronize().
+        uint64_t GetEpoch() const;
+
+    private:
+        // Waits until the counter drops to zero.
+        void Drain(unsigned counter) const;
+
+        std::atomic<uint64_t> m_epoch;
+        std::atomic<uint64_t> m_guardCounts[2];
+
+        // Serializes the calls to Synchronize().
+        std::mutex m_synchronizeLock;
+    };
+}
@@ -0,0 +1,79 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+
+
+namespace NativeJIT
+{
+    // WARNING: When modifying CpuFeature, be sure to also modify the function
+    // CpuFeatures::GetName().
+    enum class CpuFeature : unsigned
+    {
+        PopCnt,     // popcnt.
+        LzCnt,      // lzcnt (AMD ABM).
+        Bmi1,       // bextr, tzcnt.
+        Bmi2,       // pdep, pext.
+        Sse41,      // SSE4.1 (roundsd, pinsrq, ...).
+        Avx,        // VEX encoded SSE instructions and ymm registers.
+        Avx2,       // 256-bit integer instructions, vpgather.
+        Fma,        // vfmadd and related fused multiply-add instructions.
+        F16c,       // vcvtph2ps and vcvtps2ph half precision conversions.
+        Avx512F,    // EVEX encoding and zmm registers.
+        // The following value must be the last one.
+        FeatureCount
+    };
+
+
+    // The set of the optional instruction set extensions which the code
+    // generator may use. The extensions outside of the set are replaced by
+    // sequences of the baseline x64 instructions.
+    class CpuFeatures
+    {
+    public:
+        // Constructs an empty set, i.e. the baseline x64 processor.
+        CpuFeatures();
+
+        // Returns the features supported by the processor the code is running
+        // on, as reported by cpuid. The AVX family is reported only if the
+        // operating system also saves the corresponding register state.
+        static CpuFeatures const & GetHost();
+
+        static char const * GetName(CpuFeature feature);
+
+        bool IsSupported(CpuFeature feature) const;
+
+        // Adding a feature which the target processor doesn't support makes
+        // the generated code raise an invalid opcode exception or, for lzcnt
+        // and tzcnt which decode as bsr and bsf, return wrong results.
+        CpuFeatures& Add(CpuFeature feature);
+        CpuFeatures& Remove(CpuFeature feature);
+
+    private:
+        static uint32_t GetMask(CpuFeature feature);
+
+        uint32_t m_features;
+    };
+}
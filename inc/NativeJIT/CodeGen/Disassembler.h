@@ -0,0 +1,126 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+
+
+namespace NativeJIT
+{
+    class FunctionBuffer;
+
+
+    // An operand of a decoded instruction.
+    struct Operand
+    {
+        enum class Kind : uint8_t
+        {
+            None,
+            Direct,         // Register.
+            Indirect,       // Memory at [base + index * scale + displacement].
+            Immediate,
+            Target          // Destination of a relative jump.
+        };
+
+        static Operand Direct(unsigned size, bool isFloat, unsigned registerId);
+
+        // For RIP-relative addressing, the base register is rip (i.e. ID 16)
+        // and the value is the offset of the target within the code rather
+        // than the displacement, the same as for X64CodeGenerator.
+        static Operand Indirect(unsigned size, unsigned baseRegisterId, int64_t value);
+
+        static Operand Indirect(unsigned size,
+                                unsigned baseRegisterId,
+                                unsigned indexRegisterId,
+                                unsigned scale,
+                                int64_t value);
+
+        // The value is the immediate sign extended from its encoded size. The
+        // size is the size of the operation, which may be larger.
+        static Operand Immediate(unsigned size, int64_t value);
+
+        static Operand Target(unsigned offset);
+
+        bool operator==(Operand const & other) const;
+        bool operator!=(Operand const & other) const;
+
+        Kind m_kind;
+
+        // Size in bytes of the register, of the memory being accessed or of
+        // the operation for immediates.
+        uint8_t m_size;
+
+        // Whether a direct register is an XMM register.
+        bool m_isFloat;
+
+        // The register for direct operands, the base register for indirect
+        // ones.
+        uint8_t m_registerId;
+
+        // The index register and scale (1, 2, 4 or 8) for indirect operands.
+        // Scale is zero if there is no index.
+        uint8_t m_indexRegisterId;
+        uint8_t m_scale;
+
+        // Displacement, immediate value or target offset, see above.
+        int64_t m_value;
+    };
+
+
+    struct Instruction
+    {
+        static const unsigned c_maxOperandCount = 3;
+
+        // Prints the instruction in the syntax of the ML64 listings, f. ex.
+        // "mov rax, qword ptr [rbx + 10h]".
+        void Print(std::ostream& out) const;
+
+        // Offset of the instruction within the code and its length in bytes.
+        unsigned m_offset;
+        unsigned m_length;
+
+        char const * m_mnemonic;
+
+        unsigned m_operandCount;
+        Operand m_operands[c_maxOperandCount];
+    };
+
+
+    // Decodes the instruction at the offset, reading no further than the end
+    // offset. Only the subset of x64 which X64CodeGenerator emits is
+    // supported, in the same encodings, so the decoder also verifies the
+    // generated code. Returns false if the bytes are not such an instruction.
+    bool DecodeInstruction(uint8_t const * code,
+                           unsigned offset,
+                           unsigned endOffset,
+                           Instruction& instruction);
+
+    // Writes a listing of the function's code, from the start of the prolog
+    // to the end of the epilog, in the format used by the diagnostics output
+    // of X64CodeGenerator. Bytes which cannot be decoded are listed with
+    // "db". Returns whether all of the code was decoded. The function must
+    // have been completed with EndFunctionBodyGeneration().
+    bool Disassemble(FunctionBuffer const & code, std::ostream& out);
+}
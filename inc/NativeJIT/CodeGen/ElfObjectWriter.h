@@ -0,0 +1,81 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+
+namespace NativeJIT
+{
+    class FunctionBuffer;
+
+
+    // Writes the function compiled into a FunctionBuffer as an x86-64 ELF
+    // relocatable object file, so that it can be linked into a binary instead
+    // of being compiled at run time.
+    //
+    // The object file has a single .text section with the contents of the
+    // buffer up to the end of the function, which keeps the RIP-relative data
+    // at the same distance from the code. The function is exported as a global
+    // symbol. The absolute addresses within the code are emitted as
+    // R_X86_64_64 relocations against undefined symbols, which the linker
+    // resolves. Since the relocations are in .text, the object must be linked
+    // into a non-PIE binary or with text relocations allowed.
+    //
+    // The .eh_frame section describes the prolog built by FunctionSpecification
+    // so that exceptions can propagate through the function. The epilog is not
+    // described. Only the general purpose registers are, since System V has no
+    // non-volatile XMM registers.
+    class ElfObjectWriter
+    {
+    public:
+        // The function must have been completed with EndFunctionBodyGeneration().
+        ElfObjectWriter(FunctionBuffer const & code, std::string const & functionName);
+
+        // Records that the eight bytes at the offset in the buffer hold the
+        // absolute address of the named symbol.
+        void AddExternalReference(unsigned offset, std::string const & symbolName);
+
+        void Write(std::ostream& out) const;
+
+    private:
+        // Builds the contents of the .eh_frame section. The location of the
+        // function in the FDE is relative and is left as zero. Its offset is
+        // returned in the out parameter.
+        std::vector<uint8_t> BuildEhFrame(unsigned& functionLocationOffset) const;
+
+        struct ExternalReference
+        {
+            unsigned m_offset;
+            std::string m_symbolName;
+        };
+
+        FunctionBuffer const & m_code;
+        std::string m_functionName;
+        std::vector<ExternalReference> m_externalReferences;
+    };
+}
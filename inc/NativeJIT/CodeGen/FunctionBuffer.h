@@ -47,6 +47,13 @@ namespace NativeJIT
     class FunctionBuffer : public X64CodeGenerator
     {
     public:
+        // Specifies whether EndFunctionBodyGeneration() optimizes the layout
+        // of the body, i.e. shortens the jumps and pads the loop heads and the
+        // join labels for code alignment. Skipping it saves compilation time.
+        // The cold blocks are moved behind the epilog in either case since
+        // the body is not executable without that.
+        enum class LayoutOptimization { Enabled, Disabled };
+
         // Sets up a code buffer with specified capacity and registers a
         // callback to facilitate stack unwinding on exception. See the
         // CodeBuffer constructor for more details on the allocator.
@@ -83,12 +90,18 @@ namespace NativeJIT
         // the space previously reserved by BeginFunctionBodyGeneration().
         // Then, epilog is written after the function body and all call sites
         // patched with the actual values.
-        void EndFunctionBodyGeneration(FunctionSpecification const & spec);
+        void EndFunctionBodyGeneration(FunctionSpecification const & spec,
+                                       LayoutOptimization layoutOptimization
+                                           = LayoutOptimization::Enabled);
 
         // Resets the buffer to the same state it had after its construction.
         virtual void Reset() override;
 
     private:
+        // The code after the data emitted in front of the function (f. ex.
+        // the constant pool) starts on a new cache line of this size.
+        static const unsigned c_cacheLineSize = 64;
+
         // Structure used to register stack unwind information with Windows.
         RUNTIME_FUNCTION m_runtimeFunction;
 
@@ -47,6 +47,14 @@ namespace NativeJIT
         // first instruction of the prolog started executing.
         enum class BaseRegisterType { Unused, SetRbpToOriginalRsp };
 
+        // Specifies the frame of a leaf function, i.e. one which makes no
+        // calls, uses no stack slots, saves no registers and has no base
+        // register. Aligned allocates a slot to keep the stack 16-byte aligned
+        // like in any other function. Omitted leaves out the prolog and the
+        // unwind codes, so the epilog is a single ret and the stack remains
+        // misaligned by the return address, which is fine without calls.
+        enum class LeafFrameType { Aligned, Omitted };
+
         // The maximum size for the unwind buffer that needs to be reserved
         // if the number of unwind codes is not known in advance.
         // DESIGN NOTE: not defined inline to avoid inclusion of UnwindCode.h.
@@ -87,7 +95,8 @@ namespace NativeJIT
                               unsigned savedRxxNonVolatilesMask,
                               unsigned savedXmmNonVolatilesMask,
                               BaseRegisterType baseRegisterType,
-                              std::ostream* diagnosticStream);
+                              std::ostream* diagnosticStream,
+                              LeafFrameType leafFrameType = LeafFrameType::Aligned);
 
         // Returns the offset that can be added to the current RSP to get the
         // value of RSP that was effective before the prolog started executing.
@@ -123,6 +132,7 @@ namespace NativeJIT
                                              unsigned savedRxxNonVolatilesMask,
                                              unsigned savedXmmNonVolatilesMask,
                                              BaseRegisterType baseRegisterType,
+                                             LeafFrameType leafFrameType,
                                              // Out parameters:
                                              X64CodeGenerator& prologCode,
                                              AllocatorVector<uint8_t>& unwindInfoBuffer,
@@ -70,6 +70,16 @@ namespace NativeJIT
         bool LabelIsDefined(Label label) const;
         const uint8_t* AddressOfLabel(Label label) const;
 
+        // Access to the labels and call sites for the passes which move code
+        // around after it has been emitted (see X64CodeGenerator::ShortenJumps()).
+        // MoveLabel() rebinds a label which has already been placed.
+        size_t GetLabelCount() const;
+        void MoveLabel(Label label, const uint8_t* address);
+
+        size_t GetCallSiteCount() const;
+        CallSite const & GetCallSite(size_t index) const;
+        void ReplaceCallSite(size_t index, CallSite const & site);
+
     private:
         // DESIGN NOTE: JumpTable is a part of CodeBuffer which is designed to
         // be allocated once and reused multiple times during the program lifetime.
@@ -0,0 +1,85 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "Temporary/NonCopyable.h"
+
+
+namespace Allocators
+{
+    class IAllocator;
+}
+
+
+namespace NativeJIT
+{
+    // Trampoline is a stub in executable memory which jumps to a target that
+    // can be replaced while other threads are calling the stub. The address of
+    // the stub never changes, so callers may cache it in place of the address
+    // of the target.
+    //
+    // The stub is an indirect jmp through an 8-byte aligned slot placed right
+    // behind it, so replacing the target is a single atomic store and the
+    // code itself is never modified.
+    class Trampoline : public NonCopyable
+    {
+    public:
+        // Allocates the stub from the code allocator, which must provide
+        // executable and writable memory such as ExecutionBuffer.
+        Trampoline(Allocators::IAllocator& codeAllocator, void const * target);
+
+        ~Trampoline();
+
+        // Returns the address of the stub.
+        void const * GetEntryPoint() const;
+
+        void const * GetTarget() const;
+
+        // Makes the subsequent calls jump to the new target and returns the
+        // previous one. Calls which have already passed the stub keep running
+        // the previous target, see CodeEpochs for waiting until they return.
+        void const * Exchange(void const * target);
+
+    private:
+        // The layout of the stub in memory.
+        struct Stub
+        {
+            Stub(void const * target);
+
+            // jmp qword ptr [rip + 2] followed by two int3 to align m_target.
+            uint8_t m_jmp[8];
+            std::atomic<void const *> m_target;
+        };
+
+        Allocators::IAllocator& m_codeAllocator;
+
+        // The block allocated for the stub, which is larger than the stub to
+        // allow for the alignment.
+        void* m_block;
+        Stub* m_stub;
+    };
+}
@@ -44,12 +44,31 @@ namespace NativeJIT
     // Cast using a static_cast for convertible immediates.
     template <typename TO, typename FROM>
     TO ForcedCast(FROM from,
-                  typename std::enable_if<std::is_convertible<FROM, TO>::value>::type* = nullptr)
+                  typename std::enable_if<std::is_convertible<FROM, TO>::value
+                                          && !(std::is_floating_point<FROM>::value
+                                               && std::is_unsigned<TO>::value
+                                               && !std::is_same<TO, bool>::value)>::type* = nullptr)
     {
         return static_cast<TO>(from);
     }
 
 
+    // Floating point to unsigned integer conversion of a negative value is
+    // undefined in C++ and the result depends on the instructions the C++
+    // compiler picks. Convert through int64_t in the range that cvttss2si and
+    // cvttsd2si handle so that the result matches the code NativeJIT emits.
+    template <typename TO, typename FROM>
+    TO ForcedCast(FROM from,
+                  typename std::enable_if<std::is_floating_point<FROM>::value
+                                          && std::is_unsigned<TO>::value
+                                          && !std::is_same<TO, bool>::value>::type* = nullptr)
+    {
+        return from < static_cast<FROM>(9223372036854775808.0)
+            ? static_cast<TO>(static_cast<int64_t>(from))
+            : static_cast<TO>(from);
+    }
+
+
     // Cast using a reinterpret_cast for non-convertible immediates of the
     // same size.
     template <typename TO, typename FROM>
@@ -27,10 +27,14 @@
 // http://ref.x86asm.net/coder64.html
 // http://felixcloutier.com/x86/
 
+#include <functional>                           // std::function parameter.
 #include <ostream>                              // Debugging output.
+#include <utility>                              // std::pair member.
+#include <vector>                               // Embedded member.
 
 #include "NativeJIT/BitOperations.h"
 #include "NativeJIT/CodeGen/CodeBuffer.h"       // Inherits from CodeBuffer.
+#include "NativeJIT/CodeGen/CpuFeatures.h"      // Embedded member.
 #include "NativeJIT/CodeGen/ValuePredicates.h"  // Called by template code.
 #include "NativeJIT/CodeGen/Register.h"         // Register parameter.
 #include "Temporary/NonCopyable.h"              // Inherits from NonCopyable.
@@ -75,32 +79,92 @@ namespace NativeJIT
     };
 
 
+    // Provides the condition code which is satisfied exactly when JCC is not.
+    // The condition codes come in pairs which differ only in the lowest bit.
+    template <JccType JCC>
+    struct InverseJcc
+    {
+        static const JccType c_value = static_cast<JccType>(static_cast<unsigned>(JCC) ^ 1);
+    };
+
+
+    // The cache level hint of the prefetch instructions. The values are the
+    // ModR/M.reg opcode extensions of 0F 18 /r.
+    enum class PrefetchLocality : uint8_t
+    {
+        NonTemporal = 0,    // prefetchnta: bring the line close, minimize pollution.
+        AllLevels = 1,      // prefetcht0: into all cache levels.
+        Level2 = 2,         // prefetcht1: into L2 and higher.
+        Level3 = 3          // prefetcht2: into L3 and higher.
+    };
+
+
+    // The alignment in bytes of the code positions which are sensitive to the
+    // instruction fetch and decoded instruction cache boundaries. The padding
+    // consists of multi-byte nops. The alignments must be powers of two up to
+    // 64. The default of 1 leaves the code unaligned.
+    struct CodeAlignment
+    {
+        CodeAlignment()
+            : m_entry(1),
+              m_loopHead(1),
+              m_join(1)
+        {
+        }
+
+        // The function entry point, see FunctionBuffer.
+        unsigned m_entry;
+
+        // The first instruction of a loop body, i.e. the target of the
+        // backward jump.
+        unsigned m_loopHead;
+
+        // The labels where the frequently executed paths of a branch join.
+        unsigned m_join;
+    };
+
+
     // WARNING: When modifying OpCode, be sure to also modify the function OpCodeName().
     enum class OpCode : unsigned
     {
         Add,
         And,
+        Bextr,      // BMI1 bit field extract.
+        Bsf,
+        Bsr,
         Call,
         Cmp,
         CvtFP2FP,
         CvtFP2SI,
         CvtSI2FP,
+        Div,        // Unsigned div for integers, DivSS/DivSD for floats.
+        IDiv,
         IMul,
         Lea,
+        Lzcnt,      // Requires CpuFeature::LzCnt, decodes as bsr otherwise.
         Mov,
         MovSX,
         MovZX,
         MovAP,      // Aligned 128-bit SSE move.
+        Mul,        // One operand unsigned multiplication into rdx:rax.
+        Neg,
         Nop,
+        Not,
         Or,
+        Pdep,       // BMI2 parallel bits deposit.
+        Pext,       // BMI2 parallel bits extract.
         Pop,
+        Popcnt,
         Push,
         Ret,
         Rol,
+        Sar,
         Shl,        // Note: Shl and Sal are aliases, unlike Shr and Sar.
         Shld,
         Shr,
         Sub,
+        Tzcnt,      // Requires CpuFeature::Bmi1, decodes as bsf otherwise.
+        Vfmadd231,  // Fused dest += src1 * src2 (VFMADD231SS/SD), requires CpuFeature::Fma.
         Xor,
         // The following value must be the last one.
         OpCodeCount
@@ -121,12 +185,72 @@ namespace NativeJIT
         bool IsDiagnosticsStreamAvailable() const;
         std::ostream& GetDiagnosticsStream() const;
 
+        // The instruction set extensions available to the generated code.
+        // Defaults to the features of the host processor. The nodes consult
+        // the features to choose between the extended instructions and their
+        // baseline replacements.
+        CpuFeatures const & GetCpuFeatures() const;
+        void SetCpuFeatures(CpuFeatures const & features);
+
+        // The alignment of the function entry, loop heads and join labels.
+        // The nodes pass the corresponding value to AlignCode().
+        CodeAlignment const & GetCodeAlignment() const;
+        void SetCodeAlignment(CodeAlignment const & alignment);
+
         // This override allows for printing of debugging information.
         virtual void PlaceLabel(Label l) override;
 
         void Jmp(Label l);
         void Jmp(void* functionPtr);
 
+        // Jmp() and EmitConditionalJump() always emit the rel32 forms since the
+        // distance to the target is not known at that time. Once all labels
+        // within the code starting at the start position have been placed,
+        // ShortenJumps() replaces the jumps whose targets turn out to be
+        // within reach with the 2-byte rel8 forms and moves the following
+        // code, labels and RIP-relative displacements back accordingly. The
+        // method must be called before PatchCallSites() and it is invoked by
+        // FunctionBuffer::EndFunctionBodyGeneration(). Returns the number of
+        // bytes saved.
+        unsigned ShortenJumps(unsigned start);
+
+        // The code emitted between BeginColdBlock() and EndColdBlock() is
+        // expected to execute rarely. MoveColdBlocks() moves such blocks
+        // behind the rest of the code so that the frequently executed code is
+        // contiguous and denser in the instruction cache. A cold block must
+        // be entered only through jumps to the labels placed within it and it
+        // must end with an unconditional jump. Once the block is moved, the
+        // code before it falls through to the code after it. Cold blocks
+        // cannot be nested.
+        void BeginColdBlock();
+        void EndColdBlock();
+
+        // Moves the cold blocks to the end of the code starting at the start
+        // position, preserving their order, and adjusts the labels, call sites
+        // and RIP-relative displacements accordingly. The method must be
+        // called before ShortenJumps() and it is invoked by
+        // FunctionBuffer::EndFunctionBodyGeneration(). Returns the number of
+        // bytes moved.
+        unsigned MoveColdBlocks(unsigned start);
+
+        // Requests that the code emitted next starts at an address which is
+        // a multiple of the alignment. The padding is not emitted right away
+        // since the code may still move: ApplyCodeAlignment() inserts the
+        // nops once the layout is final and moves the following code, labels
+        // and RIP-relative displacements. ShortenJumps() accounts for the
+        // largest possible padding, so the short jumps remain in reach. The
+        // method must be called after ShortenJumps() and before
+        // PatchCallSites() and it is invoked by
+        // FunctionBuffer::EndFunctionBodyGeneration(). Returns the number of
+        // bytes inserted.
+        void AlignCode(unsigned alignment);
+        unsigned ApplyCodeAlignment();
+
+        // Drops the alignment requests without inserting any padding.
+        void DiscardCodeAlignment();
+
+        virtual void Reset() override;
+
         // These two methods are public in order to allow access for BinaryNode debugging text.
         static char const * OpCodeName(OpCode op);
         static char const * JccName(JccType jcc);
@@ -141,11 +265,86 @@ namespace NativeJIT
         template <JccType JCC>
         void EmitConditionalJump(Label l);
 
+        // Conditional move (cmovcc) from a register or from memory. The
+        // instruction does not support 8-bit operands.
+        template <JccType JCC, unsigned SIZE>
+        void EmitConditionalMove(Register<SIZE, false> dest, Register<SIZE, false> src);
+
+        template <JccType JCC, unsigned SIZE>
+        void EmitConditionalMove(Register<SIZE, false> dest, Register<8, false> src, int32_t srcOffset);
+
+        // Sign extends the accumulator into the data register, i.e. ax into
+        // dx:ax, eax into edx:eax or rax into rdx:rax (cwd, cdq or cqo). This
+        // sets up the dividend for the idiv instruction.
+        template <unsigned SIZE>
+        void EmitSignExtendAccumulator();
+
+        // AVX, AVX2 and F16C vector instructions used to look up several
+        // table entries at once (see ModelGatherNode) and to expand half
+        // precision values (see HalfToFloatNode). A float register stands
+        // for the whole ymm register with the same number. The 128-bit forms
+        // zero the upper half of their destination, as all VEX encoded
+        // instructions do. The callers check the CpuFeatures and, after
+        // using the 256-bit forms, emit vzeroupper before any legacy SSE
+        // instruction executes in order to avoid the SSE/AVX transition
+        // penalty.
+
+        // vmovd xmm, r32 sets the lowest dword lane and zeroes the others.
+        // vpinsrd xmm, xmm, r32, lane replaces one of the lower four lanes.
+        void EmitVectorMoveDword(Register<4, true> dest, Register<4, false> src);
+        void EmitVectorInsertDword(Register<4, true> dest, Register<4, false> src, uint8_t lane);
+
+        // vinserti128 ymm, ymm, xmm, 1 replaces the upper half of dest and
+        // vextractf128 xmm, ymm, 1 copies the upper half of src into dest.
+        void EmitVectorInsertHigh(Register<4, true> dest, Register<4, true> src);
+        void EmitVectorExtractHigh(Register<4, true> dest, Register<4, true> src);
+
+        // vxorps xmm, xmm, xmm zeroes the register, vpcmpeqd ymm, ymm, ymm
+        // sets all of its bits.
+        void EmitVectorZero(Register<4, true> dest);
+        void EmitVectorAllOnes(Register<4, true> dest);
+
+        // vpblendd ymm, ymm, ymm, lanes copies the dword lanes whose bits are
+        // set in lanes from src to dest.
+        void EmitVectorBlendDwords(Register<4, true> dest, Register<4, true> src, uint8_t lanes);
+
+        // vaddps xmm, xmm, xmm and vhaddps xmm, xmm, xmm on the lower four
+        // float lanes.
+        void EmitVectorAddFloats(Register<4, true> dest, Register<4, true> src);
+        void EmitVectorHorizontalAddFloats(Register<4, true> dest, Register<4, true> src);
+
+        // vcvtph2ps xmm, xmm converts the four half precision values in the
+        // lower 64 bits of src to floats. Requires CpuFeature::F16c.
+        void EmitConvertHalfToFloat(Register<4, true> dest, Register<4, true> src);
+
+        // vgatherdps ymm, [base + indices*4 + offset], mask loads the float
+        // lanes whose mask has the sign bit set, leaves the other lanes of
+        // dest unchanged and clears the mask. The three vector registers must
+        // be distinct.
+        void EmitGatherFloats(Register<4, true> dest,
+                              Register<8, false> base,
+                              Register<4, true> indices,
+                              int32_t offset,
+                              Register<4, true> mask);
+
+        void EmitVzeroupper();
+
+        // Emits length bytes of padding as the recommended multi-byte nop
+        // forms (nop, 66 nop, nop dword ptr [...]), at most 9 bytes each.
+        void EmitNops(unsigned length);
+
+        // prefetcht0/t1/t2/nta byte ptr [base + offset] hints the processor
+        // to bring the cache line containing the address closer. It does not
+        // fault on invalid addresses and does not modify any registers.
+        void EmitPrefetch(PrefetchLocality locality, Register<8, false> base, int32_t offset);
+
         // No operand (e.g nop, ret)
         template <OpCode OP>
         void Emit();
 
-        // One register operand (e.g. call, neg, not, push, pop)
+        // One register operand (e.g. call, neg, not, push, pop). For div,
+        // idiv, mul and imul the register is the source operand and the
+        // implicit destination is the accumulator and the data register.
         template <OpCode OP, unsigned SIZE, bool ISFLOAT>
         void Emit(Register<SIZE, ISFLOAT> dest);
 
@@ -157,6 +356,11 @@ namespace NativeJIT
         template <OpCode OP, unsigned SIZE1, bool ISFLOAT1, unsigned SIZE2, bool ISFLOAT2>
         void Emit(Register<SIZE1, ISFLOAT1> dest, Register<SIZE2, ISFLOAT2> src);
 
+        // Three register operands with the same type and size (f. ex. the
+        // BMI instructions, pdep eax, ebx, ecx).
+        template <OpCode OP, unsigned SIZE, bool ISFLOAT>
+        void Emit(Register<SIZE, ISFLOAT> dest, Register<SIZE, ISFLOAT> src1, Register<SIZE, ISFLOAT> src2);
+
         // Two operands - register destination and indirect source with the same
         // type and size.
         template <OpCode OP, unsigned SIZE, bool ISFLOAT>
@@ -191,7 +395,88 @@ namespace NativeJIT
         template <OpCode OP, unsigned SIZE, bool ISFLOAT, typename T>
         void EmitImmediate(Register<SIZE, ISFLOAT> dest, Register<SIZE, ISFLOAT> src, T value);
 
+        // Two operands - indirect destination and immediate source (f. ex.
+        // add qword ptr [rax + 8], 1). The SIZE parameter specifies the size
+        // of the memory being modified. RIP-relative destination is not
+        // supported.
+        template <OpCode OP, unsigned SIZE, typename T>
+        void EmitImmediate(Register<8, false> dest, int32_t destOffset, T value);
+
+        // Indexed flavors of the indirect Emit() methods above. The memory
+        // operand is [base + index * scale + offset], where scale is 1, 2, 4
+        // or 8 and index is any general purpose register other than rsp.
+        // RIP-relative base is not supported.
+
+        // Two operands - register destination and indexed source with the
+        // same type and size.
+        template <OpCode OP, unsigned SIZE, bool ISFLOAT>
+        void Emit(Register<SIZE, ISFLOAT> dest,
+                  Register<8, false> src,
+                  Register<8, false> srcIndex,
+                  uint8_t srcScale,
+                  int32_t srcOffset);
+
+        // Two operands - register destination and indexed source of a
+        // different type and/or size (f. ex. movzx).
+        template <OpCode OP, unsigned SIZE1, bool ISFLOAT1, unsigned SIZE2, bool ISFLOAT2>
+        void Emit(Register<SIZE1, ISFLOAT1> dest,
+                  Register<8, false> src,
+                  Register<8, false> srcIndex,
+                  uint8_t srcScale,
+                  int32_t srcOffset);
+
+        // Two operands - indexed destination and register source with the
+        // same type and size.
+        template <OpCode OP, unsigned SIZE, bool ISFLOAT>
+        void Emit(Register<8, false> dest,
+                  Register<8, false> destIndex,
+                  uint8_t destScale,
+                  int32_t destOffset,
+                  Register<SIZE, ISFLOAT> src);
+
+    protected:
+        // Inserts a gap of the given length at each position, fills it with
+        // nops and moves the following code, labels, call sites, RIP-relative
+        // displacements and pending alignment requests. Code at the position
+        // of a gap ends up after the gap. The positions must be sorted.
+        void InsertNops(std::vector<std::pair<unsigned, unsigned>> const & gaps);
+
+        // Removes the given number of bytes at the position and moves the
+        // following code, labels, call sites, RIP-relative displacements and
+        // pending alignment requests back. Nothing may refer to the removed
+        // bytes.
+        void RemoveBytes(unsigned position, unsigned length);
+
     private:
+        // Moves the labels, call sites, RIP-relative displacements, pending
+        // alignment requests and cold blocks within the code between the
+        // start and the end positions to the positions returned by the
+        // mapping. The displacements are updated in the buffer, so the method
+        // must be called before the code itself moves. Shared by the methods
+        // above, ShortenJumps() and MoveColdBlocks().
+        void RelocatePositions(unsigned start,
+                               unsigned end,
+                               std::function<unsigned(unsigned)> const & mapping);
+
+        // The index register and the scale of a [base + index * scale + offset]
+        // memory operand. The per opcode helpers for the [base + offset]
+        // operands take it as an argument and pass it on to EmitRex() and
+        // EmitModRMOffset(). A default constructed object describes an
+        // operand without an index.
+        struct ScaledIndex
+        {
+            ScaledIndex();
+
+            // Verifies that the registers and the scale can be encoded.
+            ScaledIndex(Register<8, false> base,
+                        Register<8, false> index,
+                        uint8_t scale);
+
+            // Scale 0 means that there is no index.
+            Register<8, false> m_index;
+            uint8_t m_scale;
+        };
+
         void Call(Register<8, false> r);
 
         template <unsigned SIZE>
@@ -201,7 +486,8 @@ namespace NativeJIT
         template <unsigned SIZE>
         void IMul(Register<SIZE, false> dest,
                   Register<8, false> src,
-                  int32_t srcOffset);
+                  int32_t srcOffset,
+                  ScaledIndex index);
 
         template <unsigned SIZE, typename T>
         void IMulImmediate(Register<SIZE, false> dest,
@@ -210,7 +496,8 @@ namespace NativeJIT
         template <unsigned SIZE>
         void Lea(Register<SIZE, false> dest,
                  Register<8, false> src,
-                 int32_t srcOffset);
+                 int32_t srcOffset,
+                 ScaledIndex index);
 
         template <unsigned SIZE, typename T>
         void MovImmediate(Register<SIZE, false> dest,
@@ -232,13 +519,13 @@ namespace NativeJIT
         void MovSX(Register<SIZE1, false> dest, Register<SIZE2, false> src);
 
         template <unsigned SIZE1, unsigned SIZE2>
-        void MovSX(Register<SIZE1, false> dest, Register<8, false> src, int32_t srcOffset);
+        void MovSX(Register<SIZE1, false> dest, Register<8, false> src, int32_t srcOffset, ScaledIndex index);
 
         template <unsigned SIZE1, unsigned SIZE2>
         void MovZX(Register<SIZE1, false> dest, Register<SIZE2, false> src);
 
         template <unsigned SIZE1, unsigned SIZE2>
-        void MovZX(Register<SIZE1, false> dest, Register<8, false> src, int32_t srcOffset);
+        void MovZX(Register<SIZE1, false> dest, Register<8, false> src, int32_t srcOffset, ScaledIndex index);
 
         template <unsigned SIZE>
         void Shld(Register<SIZE, false> dest, Register<SIZE, false> src, uint8_t bitCount);
@@ -246,6 +533,47 @@ namespace NativeJIT
         template <unsigned SIZE>
         void Shld(Register<SIZE, false> dest, Register<SIZE, false> src);
 
+        // Bit scan and count instructions encoded as [PREFIX] 0F OPCODE, where
+        // the optional PREFIX is 0xF3 (f. ex. bsr vs lzcnt).
+        template <uint8_t PREFIX, uint8_t OPCODE, unsigned SIZE>
+        void BitScan(Register<SIZE, false> dest, Register<SIZE, false> src);
+
+        template <uint8_t PREFIX, uint8_t OPCODE, unsigned SIZE>
+        void BitScan(Register<SIZE, false> dest, Register<8, false> src, int32_t srcOffset, ScaledIndex index);
+
+        // VEX encoded scalar instructions from the 0F 38 opcode map (BMI1,
+        // BMI2 and FMA). PREFIX is the implied legacy prefix (0, 0x66, 0xF3
+        // or 0xF2). The reg and rm operands correspond to the ModR/M fields
+        // and vvvv to the operand encoded in the VEX prefix. VEX.W selects
+        // the 64-bit general purpose registers or the double precision
+        // variant of the floating point instructions.
+        // Reference: Intel SDM vol. 2A, 2.3 Intel AVX and VEX encoding.
+        template <uint8_t PREFIX, uint8_t OPCODE, unsigned SIZE, bool ISFLOAT>
+        void Vex0F38(Register<SIZE, ISFLOAT> reg, Register<SIZE, ISFLOAT> vvvv, Register<SIZE, ISFLOAT> rm);
+
+        // Three byte VEX prefix and opcode of the vector instructions above
+        // (VEX.W is always 0). The map is 1 for 0F, 2 for 0F 38 and 3 for
+        // 0F 3A and pp encodes the implied prefix: 0 for none, 1 for 0x66, 2
+        // for 0xF3 and 3 for 0xF2. reg, index and rm are the IDs of the
+        // registers encoded in ModR/M.reg, SIB.index and ModR/M.rm.
+        void EmitVex(uint8_t map,
+                     uint8_t pp,
+                     bool is256,
+                     unsigned reg,
+                     unsigned vvvv,
+                     unsigned index,
+                     unsigned rm,
+                     uint8_t opCode);
+
+        // EmitVex() followed by the ModR/M byte of three direct registers.
+        void EmitVexDirect(uint8_t map,
+                           uint8_t pp,
+                           bool is256,
+                           uint8_t opCode,
+                           unsigned reg,
+                           unsigned vvvv,
+                           unsigned rm);
+
         // Scalar SSE instructions are encoded as XX 0F OPCODE, where XX is
         // either 0xF2 or 0xF3 depending on the register size. Used for
         // instructions operating on scalars (f. ex. MovSS/SD, AddSS/SD) rather
@@ -272,10 +600,10 @@ namespace NativeJIT
         void ScalarSSE(Register<SIZE1, ISFLOAT1> dest, Register<SIZE2, ISFLOAT2> src);
 
         template <uint8_t OPCODE, unsigned SIZE1, bool ISFLOAT1, unsigned SIZE2, bool ISFLOAT2>
-        void ScalarSSE(Register<SIZE1, ISFLOAT1> dest, Register<8, false> src, int32_t srcOffset);
+        void ScalarSSE(Register<SIZE1, ISFLOAT1> dest, Register<8, false> src, int32_t srcOffset, ScaledIndex index);
 
         template <uint8_t OPCODE, unsigned SIZE1, bool ISFLOAT1, unsigned SIZE2, bool ISFLOAT2>
-        void ScalarSSE(Register<8, false> dest, int32_t destOffset, Register<SIZE2, ISFLOAT2> src);
+        void ScalarSSE(Register<8, false> dest, int32_t destOffset, Register<SIZE2, ISFLOAT2> src, ScaledIndex index);
 
         // SSEx66 methods emit SSE instructions that are encoded as
         // [0x66] 0F OPCODE, where 0x66 prefix is present only if the source is
@@ -305,12 +633,12 @@ namespace NativeJIT
         void SSEx66(Register<SIZE1, ISFLOAT1> dest, Register<SIZE2, ISFLOAT2> src);
 
         template <uint8_t OPCODE, unsigned SIZE1, bool ISFLOAT1, unsigned SIZE2, bool ISFLOAT2>
-        void SSEx66(Register<SIZE1, ISFLOAT1> dest, Register<8, false> src, int32_t srcOffset);
+        void SSEx66(Register<SIZE1, ISFLOAT1> dest, Register<8, false> src, int32_t srcOffset, ScaledIndex index);
 
         template <uint8_t OPCODE, unsigned SIZE1, bool ISFLOAT1, unsigned SIZE2, bool ISFLOAT2>
-        void SSEx66(Register<8, false> dest, int32_t destOffset, Register<SIZE2, ISFLOAT2> src);
+        void SSEx66(Register<8, false> dest, int32_t destOffset, Register<SIZE2, ISFLOAT2> src, ScaledIndex index);
 
-        // Group 1/2 instructions.
+        // Group 1/2/3 instructions.
 
         template <unsigned SIZE>
         void Group1(uint8_t baseOpCode,
@@ -321,13 +649,15 @@ namespace NativeJIT
         void Group1(uint8_t baseOpCode,
                     Register<SIZE, false> dest,
                     Register<8, false> src,
-                    int32_t srcOffset);
+                    int32_t srcOffset,
+                    ScaledIndex index);
 
         template <unsigned SIZE>
         void Group1(uint8_t baseOpCode,
                     Register<8, false> dest,
                     int32_t destOffset,
-                    Register<SIZE, false> src);
+                    Register<SIZE, false> src,
+                    ScaledIndex index);
 
         template <unsigned SIZE, typename T>
         void Group1(uint8_t baseOpCode,
@@ -335,6 +665,12 @@ namespace NativeJIT
                     Register<SIZE, false> dest,
                     T value);
 
+        template <unsigned SIZE, typename T>
+        void Group1(uint8_t extensionOpCode,
+                    Register<8, false> dest,
+                    int32_t destOffset,
+                    T value);
+
         template <unsigned SIZE>
         void Group2(uint8_t extensionOpCode,
                     Register<SIZE, false> dest);
@@ -344,6 +680,10 @@ namespace NativeJIT
                     uint8_t shift,
                     Register<SIZE, false> dest);
 
+        template <unsigned SIZE>
+        void Group3(uint8_t extensionOpCode,
+                    Register<SIZE, false> dest);
+
         // Methods for emitting the 0x66 operand size override prefix if
         // size of either operand is 16-bit. Note: for indirect addressing, the
         // size of the operand is the size of the memory being accessed, not the
@@ -386,7 +726,9 @@ namespace NativeJIT
         template <unsigned RMSIZE, bool RMISFLOAT,
                   unsigned REGSIZE, bool REGISFLOAT,
                   unsigned RMREGSIZE, bool RMREGISFLOAT>
-        void EmitRex(Register<REGSIZE, REGISFLOAT> reg, Register<RMREGSIZE, RMREGISFLOAT> rm);
+        void EmitRex(Register<REGSIZE, REGISFLOAT> reg,
+                     Register<RMREGSIZE, RMREGISFLOAT> rm,
+                     ScaledIndex index = ScaledIndex());
 
         // Single direct register.
         template <unsigned SIZE, bool ISFLOAT>
@@ -400,9 +742,12 @@ namespace NativeJIT
         template <unsigned RMSIZE, bool RMISFLOAT>
         void EmitRexIndirect(Register<8, false> rm);
 
-        // Two registers, the one corresponding to R/M is indirect.
+        // Two registers, the one corresponding to R/M is indirect and
+        // optionally indexed.
         template <unsigned RMSIZE, bool RMISFLOAT, unsigned REGSIZE, bool REGISFLOAT>
-        void EmitRexIndirect(Register<REGSIZE, REGISFLOAT> reg, Register<8, false> rm);
+        void EmitRexIndirect(Register<REGSIZE, REGISFLOAT> reg,
+                             Register<8, false> rm,
+                             ScaledIndex index = ScaledIndex());
 
         // Methods for emitting the ModR/M byte.
         // Reference: http://wiki.osdev.org/X86-64_Instruction_Encoding#ModR.2FM
@@ -413,8 +758,14 @@ namespace NativeJIT
         template <unsigned SIZE>
         void EmitModRM(uint8_t extensionOpCode, Register<SIZE, false> dest);
 
+        // Emits the ModR/M byte for the [src + srcOffset] operand or, if the
+        // index is present, for [src + index * scale + srcOffset] followed by
+        // the SIB byte.
         template <unsigned SIZE, bool ISFLOAT>
-        void EmitModRMOffset(Register<SIZE, ISFLOAT> dest, Register<8, false> src, int32_t srcOffset);
+        void EmitModRMOffset(Register<SIZE, ISFLOAT> dest,
+                             Register<8, false> src,
+                             int32_t srcOffset,
+                             ScaledIndex index = ScaledIndex());
 
         // Helper class used to provide partial specializations by OpCode,
         // ISFLOAT and SIZE for the Emit() methods.
@@ -436,16 +787,22 @@ namespace NativeJIT
                 static void Emit(X64CodeGenerator& code, Register<SIZE, ISFLOAT> dest, Register<SIZE, ISFLOAT> src);
 
                 template <unsigned SIZE>
-                static void Emit(X64CodeGenerator& code, Register<SIZE, ISFLOAT> dest, Register<8, false> src, int32_t srcOffset);
+                static void Emit(X64CodeGenerator& code, Register<SIZE, ISFLOAT> dest, Register<SIZE, ISFLOAT> src1, Register<SIZE, ISFLOAT> src2);
+
+                template <unsigned SIZE>
+                static void Emit(X64CodeGenerator& code, Register<SIZE, ISFLOAT> dest, Register<8, false> src, int32_t srcOffset, ScaledIndex index);
 
                 template <unsigned SIZE>
-                static void Emit(X64CodeGenerator& code, Register<8, false> dest, int32_t destOffset, Register<SIZE, ISFLOAT> src);
+                static void Emit(X64CodeGenerator& code, Register<8, false> dest, int32_t destOffset, Register<SIZE, ISFLOAT> src, ScaledIndex index);
 
                 template <unsigned SIZE, typename T>
                 static void EmitImmediate(X64CodeGenerator& code, Register<SIZE, ISFLOAT> dest, T value);
 
                 template <unsigned SIZE, typename T>
                 static void EmitImmediate(X64CodeGenerator& code, Register<SIZE, ISFLOAT> dest, Register<SIZE, ISFLOAT> src, T value);
+
+                template <unsigned SIZE, typename T>
+                static void EmitImmediate(X64CodeGenerator& code, Register<8, false> dest, int32_t destOffset, T value);
             };
 
 
@@ -457,10 +814,10 @@ namespace NativeJIT
                 static void Emit(X64CodeGenerator& code, Register<SIZE1, ISFLOAT1> dest, Register<SIZE2, ISFLOAT2> src);
 
                 template <unsigned SIZE1, unsigned SIZE2>
-                static void Emit(X64CodeGenerator& code, Register<SIZE1, ISFLOAT1> dest, Register<8, false> src, int32_t srcOffset);
+                static void Emit(X64CodeGenerator& code, Register<SIZE1, ISFLOAT1> dest, Register<8, false> src, int32_t srcOffset, ScaledIndex index);
 
                 template <unsigned SIZE1, unsigned SIZE2>
-                static void Emit(X64CodeGenerator& code, Register<8, false> dest, int32_t destOffset, Register<SIZE2, ISFLOAT2> src);
+                static void Emit(X64CodeGenerator& code, Register<8, false> dest, int32_t destOffset, Register<SIZE2, ISFLOAT2> src, ScaledIndex index);
             };
         };
 
@@ -502,18 +859,53 @@ namespace NativeJIT
             template <unsigned SIZE1, bool ISFLOAT1, unsigned SIZE2, bool ISFLOAT2>
             void Print(OpCode op, Register<SIZE1, ISFLOAT1> dest, Register<SIZE2, ISFLOAT2> src);
 
+            template <unsigned SIZE, bool ISFLOAT>
+            void Print(OpCode op, Register<SIZE, ISFLOAT> dest, Register<SIZE, ISFLOAT> src1, Register<SIZE, ISFLOAT> src2);
+
             template <unsigned SIZE1, bool ISFLOAT1, unsigned SIZE2, bool ISFLOAT2>
             void Print(OpCode op, Register<SIZE1, ISFLOAT1> dest, Register<8, false> src, int32_t srcOffset);
 
             template <unsigned SIZE1, bool ISFLOAT1, unsigned SIZE2, bool ISFLOAT2>
             void Print(OpCode op, Register<8, false> dest, int32_t destOffset, Register<SIZE2, ISFLOAT2> src);
 
+            template <unsigned SIZE1, bool ISFLOAT1, unsigned SIZE2, bool ISFLOAT2>
+            void Print(OpCode op,
+                       Register<SIZE1, ISFLOAT1> dest,
+                       Register<8, false> src,
+                       Register<8, false> srcIndex,
+                       uint8_t srcScale,
+                       int32_t srcOffset);
+
+            template <unsigned SIZE1, bool ISFLOAT1, unsigned SIZE2, bool ISFLOAT2>
+            void Print(OpCode op,
+                       Register<8, false> dest,
+                       Register<8, false> destIndex,
+                       uint8_t destScale,
+                       int32_t destOffset,
+                       Register<SIZE2, ISFLOAT2> src);
+
             template <unsigned SIZE, bool ISFLOAT, typename T>
             void PrintImmediate(OpCode op, Register<SIZE, ISFLOAT> dest, T value);
 
             template <unsigned SIZE, bool ISFLOAT, typename T>
             void PrintImmediate(OpCode op, Register<SIZE, ISFLOAT> dest, Register<SIZE, ISFLOAT> src, T value);
 
+            template <unsigned SIZE, typename T>
+            void PrintImmediate(OpCode op, Register<8, false> dest, int32_t destOffset, T value);
+
+            template <JccType JCC, unsigned SIZE>
+            void PrintConditionalMove(Register<SIZE, false> dest, Register<SIZE, false> src);
+
+            void PrintSignExtendAccumulator(unsigned size);
+
+            // Prints the encoded bytes and the mnemonic of an instruction
+            // which isn't described by an OpCode. Returns the stream to print
+            // the operands to or nullptr if the diagnostics are disabled.
+            std::ostream* PrintMnemonic(char const * mnemonic);
+
+            template <JccType JCC, unsigned SIZE>
+            void PrintConditionalMove(Register<SIZE, false> dest, Register<8, false> src, int32_t srcOffset);
+
         private:
             X64CodeGenerator& m_code;
             unsigned m_startPosition;
@@ -522,6 +914,20 @@ namespace NativeJIT
             // Returns "byte" for 1, "word" for 2 etc.
             static char const * GetPointerName(unsigned pointerSize);
 
+            // Prints "size ptr [base +/- offset]".
+            static void PrintIndirect(std::ostream& out,
+                                      unsigned pointerSize,
+                                      Register<8, false> base,
+                                      int32_t offset);
+
+            // Prints "size ptr [base + index*scale +/- offset]".
+            static void PrintIndirect(std::ostream& out,
+                                      unsigned pointerSize,
+                                      Register<8, false> base,
+                                      Register<8, false> index,
+                                      uint8_t scale,
+                                      int32_t offset);
+
             template <typename T>
             static void PrintImmediate(std::ostream& out, T value);
 
@@ -546,6 +952,23 @@ namespace NativeJIT
         };
 
         std::ostream* m_diagnosticsStream;
+
+        CpuFeatures m_cpuFeatures;
+
+        // Positions of the 32-bit displacements of the RIP-relative operands,
+        // which ShortenJumps() and MoveColdBlocks() need to adjust when they
+        // move code.
+        std::vector<unsigned> m_ripRelativeSites;
+
+        // The start and end positions of the cold blocks in the order of
+        // emission, see BeginColdBlock().
+        std::vector<std::pair<unsigned, unsigned>> m_coldBlocks;
+        bool m_isInColdBlock;
+
+        CodeAlignment m_codeAlignment;
+
+        // The positions and alignments requested by AlignCode().
+        std::vector<std::pair<unsigned, unsigned>> m_alignmentRequests;
     };
 
 
@@ -613,6 +1036,25 @@ namespace NativeJIT
     }
 
 
+    template <unsigned SIZE, bool ISFLOAT>
+    void X64CodeGenerator::CodePrinter::Print(OpCode op,
+                                              Register<SIZE, ISFLOAT> dest,
+                                              Register<SIZE, ISFLOAT> src1,
+                                              Register<SIZE, ISFLOAT> src2)
+    {
+        if (m_out != nullptr)
+        {
+            PrintBytes(m_startPosition, m_code.CurrentPosition());
+
+            *m_out << OpCodeName(op)
+                   << ' ' << dest.GetName()
+                   << ", " << src1.GetName()
+                   << ", " << src2.GetName()
+                   << std::endl;
+        }
+    }
+
+
     template <unsigned SIZE1, bool ISFLOAT1, unsigned SIZE2, bool ISFLOAT2>
     void X64CodeGenerator::CodePrinter::Print(OpCode op,
                                               Register<SIZE1, ISFLOAT1> dest,
@@ -682,6 +1124,44 @@ namespace NativeJIT
     }
 
 
+    template <unsigned SIZE1, bool ISFLOAT1, unsigned SIZE2, bool ISFLOAT2>
+    void X64CodeGenerator::CodePrinter::Print(OpCode op,
+                                              Register<SIZE1, ISFLOAT1> dest,
+                                              Register<8, false> src,
+                                              Register<8, false> srcIndex,
+                                              uint8_t srcScale,
+                                              int32_t srcOffset)
+    {
+        if (m_out != nullptr)
+        {
+            PrintBytes(m_startPosition, m_code.CurrentPosition());
+
+            *m_out << OpCodeName(op) << ' ' << dest.GetName() << ", ";
+            PrintIndirect(*m_out, SIZE2, src, srcIndex, srcScale, srcOffset);
+            *m_out << std::endl;
+        }
+    }
+
+
+    template <unsigned SIZE1, bool ISFLOAT1, unsigned SIZE2, bool ISFLOAT2>
+    void X64CodeGenerator::CodePrinter::Print(OpCode op,
+                                              Register<8, false> dest,
+                                              Register<8, false> destIndex,
+                                              uint8_t destScale,
+                                              int32_t destOffset,
+                                              Register<SIZE2, ISFLOAT2> src)
+    {
+        if (m_out != nullptr)
+        {
+            PrintBytes(m_startPosition, m_code.CurrentPosition());
+
+            *m_out << OpCodeName(op) << ' ';
+            PrintIndirect(*m_out, SIZE1, dest, destIndex, destScale, destOffset);
+            *m_out << ", " << src.GetName() << std::endl;
+        }
+    }
+
+
     template <typename T, bool ISSIGNED>
     T X64CodeGenerator::CodePrinter::IntegralAbs<T, ISSIGNED>::operator()(T value)
     {
@@ -759,6 +1239,62 @@ namespace NativeJIT
     }
 
 
+    template <unsigned SIZE, typename T>
+    void X64CodeGenerator::CodePrinter::PrintImmediate(OpCode op,
+                                                       Register<8, false> dest,
+                                                       int32_t destOffset,
+                                                       T value)
+    {
+        if (m_out != nullptr)
+        {
+            PrintBytes(m_startPosition, m_code.CurrentPosition());
+
+            *m_out << OpCodeName(op) << ' ';
+            PrintIndirect(*m_out, SIZE, dest, destOffset);
+            *m_out << ", ";
+
+            PrintImmediate(*m_out, value);
+
+            *m_out << std::endl;
+        }
+    }
+
+
+    template <JccType JCC, unsigned SIZE>
+    void X64CodeGenerator::CodePrinter::PrintConditionalMove(Register<SIZE, false> dest,
+                                                             Register<SIZE, false> src)
+    {
+        if (m_out != nullptr)
+        {
+            PrintBytes(m_startPosition, m_code.CurrentPosition());
+
+            // Condition code names are shared with the jumps, so skip the 'j'.
+            *m_out << "cmov" << JccName(JCC) + 1
+                   << ' ' << dest.GetName()
+                   << ", " << src.GetName()
+                   << std::endl;
+        }
+    }
+
+
+    template <JccType JCC, unsigned SIZE>
+    void X64CodeGenerator::CodePrinter::PrintConditionalMove(Register<SIZE, false> dest,
+                                                             Register<8, false> src,
+                                                             int32_t srcOffset)
+    {
+        if (m_out != nullptr)
+        {
+            PrintBytes(m_startPosition, m_code.CurrentPosition());
+
+            *m_out << "cmov" << JccName(JCC) + 1
+                   << ' ' << dest.GetName()
+                   << ", ";
+            PrintIndirect(*m_out, SIZE, src, srcOffset);
+            *m_out << std::endl;
+        }
+    }
+
+
     //*************************************************************************
     //
     // Template definitions for X64CodeGenerator - public methods.
@@ -777,6 +1313,63 @@ namespace NativeJIT
     }
 
 
+    template <JccType JCC, unsigned SIZE>
+    void X64CodeGenerator::EmitConditionalMove(Register<SIZE, false> dest, Register<SIZE, false> src)
+    {
+        static_assert(SIZE != 1, "8-bit conditional move is not supported.");
+
+        CodePrinter printer(*this);
+
+        EmitOpSizeOverrideDirect(dest, src);
+        EmitRexDirect(dest, src);
+        Emit8(0x0f);
+        Emit8(0x40 + static_cast<uint8_t>(JCC));
+        EmitModRM(dest, src);
+
+        printer.PrintConditionalMove<JCC>(dest, src);
+    }
+
+
+    template <JccType JCC, unsigned SIZE>
+    void X64CodeGenerator::EmitConditionalMove(Register<SIZE, false> dest,
+                                               Register<8, false> src,
+                                               int32_t srcOffset)
+    {
+        static_assert(SIZE != 1, "8-bit conditional move is not supported.");
+
+        CodePrinter printer(*this);
+
+        EmitOpSizeOverrideIndirect<SIZE, false>(dest, src);
+        EmitRexIndirect<SIZE, false>(dest, src);
+        Emit8(0x0f);
+        Emit8(0x40 + static_cast<uint8_t>(JCC));
+        EmitModRMOffset(dest, src, srcOffset);
+
+        printer.PrintConditionalMove<JCC>(dest, src, srcOffset);
+    }
+
+
+    template <unsigned SIZE>
+    void X64CodeGenerator::EmitSignExtendAccumulator()
+    {
+        static_assert(SIZE != 1, "Use movsx to sign extend al into ax.");
+
+        CodePrinter printer(*this);
+
+        if (SIZE == 2)
+        {
+            Emit8(0x66);
+        }
+        else if (SIZE == 8)
+        {
+            Emit8(0x48);
+        }
+        Emit8(0x99);
+
+        printer.PrintSignExtendAccumulator(SIZE);
+    }
+
+
     template <OpCode OP>
     void X64CodeGenerator::Emit()
     {
@@ -821,12 +1414,25 @@ namespace NativeJIT
     }
 
 
+    template <OpCode OP, unsigned SIZE, bool ISFLOAT>
+    void X64CodeGenerator::Emit(Register<SIZE, ISFLOAT> dest,
+                                Register<SIZE, ISFLOAT> src1,
+                                Register<SIZE, ISFLOAT> src2)
+    {
+        CodePrinter printer(*this);
+
+        Helper<OP>::template ArgTypes1<ISFLOAT>::template Emit<SIZE>(*this, dest, src1, src2);
+
+        printer.Print(OP, dest, src1, src2);
+    }
+
+
     template <OpCode OP, unsigned SIZE, bool ISFLOAT>
     void X64CodeGenerator::Emit(Register<SIZE, ISFLOAT> dest, Register<8, false> src, int32_t srcOffset)
     {
         CodePrinter printer(*this);
 
-        Helper<OP>::template ArgTypes1<ISFLOAT>::template Emit<SIZE>(*this, dest, src, srcOffset);
+        Helper<OP>::template ArgTypes1<ISFLOAT>::template Emit<SIZE>(*this, dest, src, srcOffset, ScaledIndex());
 
         printer.Print<SIZE, ISFLOAT, SIZE, ISFLOAT>(OP, dest, src, srcOffset);
     }
@@ -837,7 +1443,7 @@ namespace NativeJIT
     {
         CodePrinter printer(*this);
 
-        Helper<OP>::template ArgTypes2<ISFLOAT1, ISFLOAT2>::template Emit<SIZE1, SIZE2>(*this, dest, src, srcOffset);
+        Helper<OP>::template ArgTypes2<ISFLOAT1, ISFLOAT2>::template Emit<SIZE1, SIZE2>(*this, dest, src, srcOffset, ScaledIndex());
 
         printer.Print<SIZE1, ISFLOAT1, SIZE2, ISFLOAT2>(OP, dest, src, srcOffset);
     }
@@ -848,7 +1454,7 @@ namespace NativeJIT
     {
         CodePrinter printer(*this);
 
-        Helper<OP>::template ArgTypes1<ISFLOAT>::template Emit<SIZE>(*this, dest, destOffset, src);
+        Helper<OP>::template ArgTypes1<ISFLOAT>::template Emit<SIZE>(*this, dest, destOffset, src, ScaledIndex());
 
         printer.Print<SIZE, ISFLOAT, SIZE, ISFLOAT>(OP, dest, destOffset, src);
     }
@@ -859,12 +1465,60 @@ namespace NativeJIT
     {
         CodePrinter printer(*this);
 
-        Helper<OP>::template ArgTypes2<ISFLOAT1, ISFLOAT2>::template Emit<SIZE1, SIZE2>(*this, dest, destOffset, src);
+        Helper<OP>::template ArgTypes2<ISFLOAT1, ISFLOAT2>::template Emit<SIZE1, SIZE2>(*this, dest, destOffset, src, ScaledIndex());
 
         printer.Print<SIZE1, ISFLOAT1, SIZE2, ISFLOAT2>(OP, dest, destOffset, src);
     }
 
 
+    template <OpCode OP, unsigned SIZE, bool ISFLOAT>
+    void X64CodeGenerator::Emit(Register<SIZE, ISFLOAT> dest,
+                                Register<8, false> src,
+                                Register<8, false> srcIndex,
+                                uint8_t srcScale,
+                                int32_t srcOffset)
+    {
+        CodePrinter printer(*this);
+
+        Helper<OP>::template ArgTypes1<ISFLOAT>::template Emit<SIZE>(
+            *this, dest, src, srcOffset, ScaledIndex(src, srcIndex, srcScale));
+
+        printer.Print<SIZE, ISFLOAT, SIZE, ISFLOAT>(OP, dest, src, srcIndex, srcScale, srcOffset);
+    }
+
+
+    template <OpCode OP, unsigned SIZE1, bool ISFLOAT1, unsigned SIZE2, bool ISFLOAT2>
+    void X64CodeGenerator::Emit(Register<SIZE1, ISFLOAT1> dest,
+                                Register<8, false> src,
+                                Register<8, false> srcIndex,
+                                uint8_t srcScale,
+                                int32_t srcOffset)
+    {
+        CodePrinter printer(*this);
+
+        Helper<OP>::template ArgTypes2<ISFLOAT1, ISFLOAT2>::template Emit<SIZE1, SIZE2>(
+            *this, dest, src, srcOffset, ScaledIndex(src, srcIndex, srcScale));
+
+        printer.Print<SIZE1, ISFLOAT1, SIZE2, ISFLOAT2>(OP, dest, src, srcIndex, srcScale, srcOffset);
+    }
+
+
+    template <OpCode OP, unsigned SIZE, bool ISFLOAT>
+    void X64CodeGenerator::Emit(Register<8, false> dest,
+                                Register<8, false> destIndex,
+                                uint8_t destScale,
+                                int32_t destOffset,
+                                Register<SIZE, ISFLOAT> src)
+    {
+        CodePrinter printer(*this);
+
+        Helper<OP>::template ArgTypes1<ISFLOAT>::template Emit<SIZE>(
+            *this, dest, destOffset, src, ScaledIndex(dest, destIndex, destScale));
+
+        printer.Print<SIZE, ISFLOAT, SIZE, ISFLOAT>(OP, dest, destIndex, destScale, destOffset, src);
+    }
+
+
     template <OpCode OP, unsigned SIZE, bool ISFLOAT, typename T>
     void X64CodeGenerator::EmitImmediate(Register<SIZE, ISFLOAT> dest, T value)
     {
@@ -891,6 +1545,19 @@ namespace NativeJIT
     }
 
 
+    template <OpCode OP, unsigned SIZE, typename T>
+    void X64CodeGenerator::EmitImmediate(Register<8, false> dest, int32_t destOffset, T value)
+    {
+        static_assert(!std::is_floating_point<T>::value, "Floating point values cannot be used as immediates.");
+
+        CodePrinter printer(*this);
+
+        Helper<OP>::template ArgTypes1<false>::template EmitImmediate<SIZE, T>(*this, dest, destOffset, value);
+
+        printer.template PrintImmediate<SIZE>(OP, dest, destOffset, value);
+    }
+
+
     //*************************************************************************
     //
     // Template definitions for X64CodeGenerator - private methods.
@@ -915,13 +1582,14 @@ namespace NativeJIT
     template <unsigned SIZE>
     void X64CodeGenerator::IMul(Register<SIZE, false> dest,
                                 Register<8, false> src,
-                                int32_t srcOffset)
+                                int32_t srcOffset,
+                                ScaledIndex index)
     {
         EmitOpSizeOverrideIndirect<SIZE, false>(dest, src);
-        EmitRexIndirect<SIZE, false>(dest, src);
+        EmitRexIndirect<SIZE, false>(dest, src, index);
         Emit8(0x0f);
         Emit8(0xAF);
-        EmitModRMOffset(dest, src, srcOffset);
+        EmitModRMOffset(dest, src, srcOffset, index);
     }
 
 
@@ -969,11 +1637,12 @@ namespace NativeJIT
     template <unsigned SIZE>
     void X64CodeGenerator::Lea(Register<SIZE, false> dest,
                                Register<8, false> src,
-                               int32_t srcOffset)
+                               int32_t srcOffset,
+                               ScaledIndex index)
     {
-        EmitRexIndirect<SIZE, false>(dest, src);
+        EmitRexIndirect<SIZE, false>(dest, src, index);
         Emit8(0x8d);
-        EmitModRMOffset(dest, src, srcOffset);
+        EmitModRMOffset(dest, src, srcOffset, index);
     }
 
 
@@ -1064,7 +1733,7 @@ namespace NativeJIT
 
 
     template <unsigned SIZE1, unsigned SIZE2>
-    void X64CodeGenerator::MovZX(Register<SIZE1, false> dest, Register<8, false> src, int32_t srcOffset)
+    void X64CodeGenerator::MovZX(Register<SIZE1, false> dest, Register<8, false> src, int32_t srcOffset, ScaledIndex index)
     {
         static_assert(SIZE2 == 1 || SIZE2 == 2, "Invalid source size.");
         static_assert(SIZE1 > SIZE2, "Target size must be larger than the source size.");
@@ -1075,10 +1744,10 @@ namespace NativeJIT
         {
             EmitOpSizeOverrideIndirect<SIZE2, false>(dest, src);
         }
-        EmitRexIndirect<SIZE2, false>(dest, src);
+        EmitRexIndirect<SIZE2, false>(dest, src, index);
         Emit8(0x0f);
         Emit8(twoByteSource ? 0xb7 : 0xb6);
-        EmitModRMOffset(dest, src, srcOffset);
+        EmitModRMOffset(dest, src, srcOffset, index);
     }
 
 
@@ -1115,7 +1784,7 @@ namespace NativeJIT
 
 
     template <unsigned SIZE1, unsigned SIZE2>
-    void X64CodeGenerator::MovSX(Register<SIZE1, false> dest, Register<8, false> src, int32_t srcOffset)
+    void X64CodeGenerator::MovSX(Register<SIZE1, false> dest, Register<8, false> src, int32_t srcOffset, ScaledIndex index)
     {
         static_assert(SIZE2 < 8, "Invalid source size.");
         static_assert(SIZE1 > SIZE2, "Target size must be larger than the source size.");
@@ -1123,14 +1792,14 @@ namespace NativeJIT
         if (SIZE2 == 1)
         {
             EmitOpSizeOverrideIndirect<SIZE2, false>(dest, src);
-            EmitRexIndirect<SIZE2, false>(dest, src);
+            EmitRexIndirect<SIZE2, false>(dest, src, index);
             Emit8(0x0f);
             Emit8(0xbe);
         }
         else if (SIZE2 == 2)
         {
             // No size override since 16-bit is default operand size; different opcode.
-            EmitRexIndirect<SIZE2, false>(dest, src);
+            EmitRexIndirect<SIZE2, false>(dest, src, index);
             Emit8(0x0f);
             Emit8(0xbf);
         }
@@ -1138,11 +1807,11 @@ namespace NativeJIT
         {
             // No size override since neither operand can be 16-bit.
             // No prefix, different opcode.
-            EmitRexIndirect<SIZE2, false>(dest, src);
+            EmitRexIndirect<SIZE2, false>(dest, src, index);
             Emit8(0x63);
         }
 
-        EmitModRMOffset(dest, src, srcOffset);
+        EmitModRMOffset(dest, src, srcOffset, index);
     }
 
 
@@ -1173,6 +1842,72 @@ namespace NativeJIT
     }
 
 
+    template <uint8_t PREFIX, uint8_t OPCODE, unsigned SIZE>
+    void X64CodeGenerator::BitScan(Register<SIZE, false> dest, Register<SIZE, false> src)
+    {
+        static_assert(SIZE != 1, "8-bit operands are not supported.");
+
+        // The operand size override must precede the mandatory prefix and
+        // REX must come last.
+        EmitOpSizeOverrideDirect(dest, src);
+        if (PREFIX != 0)
+        {
+            Emit8(PREFIX);
+        }
+        EmitRexDirect(dest, src);
+        Emit8(0x0f);
+        Emit8(OPCODE);
+        EmitModRM(dest, src);
+    }
+
+
+    template <uint8_t PREFIX, uint8_t OPCODE, unsigned SIZE>
+    void X64CodeGenerator::BitScan(Register<SIZE, false> dest,
+                                   Register<8, false> src,
+                                   int32_t srcOffset,
+                                   ScaledIndex index)
+    {
+        static_assert(SIZE != 1, "8-bit operands are not supported.");
+
+        EmitOpSizeOverrideIndirect<SIZE, false>(dest, src);
+        if (PREFIX != 0)
+        {
+            Emit8(PREFIX);
+        }
+        EmitRexIndirect<SIZE, false>(dest, src, index);
+        Emit8(0x0f);
+        Emit8(OPCODE);
+        EmitModRMOffset(dest, src, srcOffset, index);
+    }
+
+
+    template <uint8_t PREFIX, uint8_t OPCODE, unsigned SIZE, bool ISFLOAT>
+    void X64CodeGenerator::Vex0F38(Register<SIZE, ISFLOAT> reg,
+                                   Register<SIZE, ISFLOAT> vvvv,
+                                   Register<SIZE, ISFLOAT> rm)
+    {
+        static_assert(SIZE == 4 || SIZE == 8, "Only 32 and 64-bit operands are supported.");
+        static_assert(PREFIX == 0 || PREFIX == 0x66 || PREFIX == 0xf3 || PREFIX == 0xf2,
+                      "Invalid implied prefix.");
+
+        // The three byte form: C4, then inverted REX.R, REX.X, REX.B and the
+        // opcode map (2 is 0F 38), then REX.W, inverted vvvv, vector length
+        // (always 0 here) and the implied prefix.
+        const uint8_t prefixBits = PREFIX == 0 ? 0 : (PREFIX == 0x66 ? 1 : (PREFIX == 0xf3 ? 2 : 3));
+
+        Emit8(0xc4);
+        Emit8(static_cast<uint8_t>((reg.IsExtended() ? 0 : 0x80)
+                                   | 0x40
+                                   | (rm.IsExtended() ? 0 : 0x20)
+                                   | 0x02));
+        Emit8(static_cast<uint8_t>((SIZE == 8 ? 0x80 : 0)
+                                   | ((~vvvv.GetId() & 0xf) << 3)
+                                   | prefixBits));
+        Emit8(OPCODE);
+        EmitModRM(reg, rm);
+    }
+
+
     //
     // Scalar SSE instructions
     //
@@ -1227,28 +1962,30 @@ namespace NativeJIT
     template <uint8_t OPCODE, unsigned SIZE1, bool ISFLOAT1, unsigned SIZE2, bool ISFLOAT2>
     void X64CodeGenerator::ScalarSSE(Register<SIZE1, ISFLOAT1> dest,
                                      Register<8, false> src,
-                                     int32_t srcOffset)
+                                     int32_t srcOffset,
+                                     ScaledIndex index)
     {
         EmitScalarSSEPrefixIndirect<SIZE2, ISFLOAT2>(dest, src);
-        EmitRexIndirect<SIZE2, ISFLOAT2>(dest, src);
+        EmitRexIndirect<SIZE2, ISFLOAT2>(dest, src, index);
         Emit8(0x0f);
         Emit8(OPCODE);
-        EmitModRMOffset(dest, src, srcOffset);
+        EmitModRMOffset(dest, src, srcOffset, index);
     }
 
 
     template <uint8_t OPCODE, unsigned SIZE1, bool ISFLOAT1, unsigned SIZE2, bool ISFLOAT2>
     void X64CodeGenerator::ScalarSSE(Register<8, false> dest,
                                      int32_t destOffset,
-                                     Register<SIZE2, ISFLOAT2> src)
+                                     Register<SIZE2, ISFLOAT2> src,
+                                     ScaledIndex index)
     {
         // Note: operand encoding is MR, so the order of arguments for the
         // Emit*() methods is reversed.
         EmitScalarSSEPrefixIndirect<SIZE1, ISFLOAT1>(src, dest);
-        EmitRexIndirect<SIZE1, ISFLOAT1>(src, dest);
+        EmitRexIndirect<SIZE1, ISFLOAT1>(src, dest, index);
         Emit8(0x0f);
         Emit8(OPCODE);
-        EmitModRMOffset(src, dest, destOffset);
+        EmitModRMOffset(src, dest, destOffset, index);
     }
 
 
@@ -1304,28 +2041,30 @@ namespace NativeJIT
     template <uint8_t OPCODE, unsigned SIZE1, bool ISFLOAT1, unsigned SIZE2, bool ISFLOAT2>
     void X64CodeGenerator::SSEx66(Register<SIZE1, ISFLOAT1> dest,
                                   Register<8, false> src,
-                                  int32_t srcOffset)
+                                  int32_t srcOffset,
+                                  ScaledIndex index)
     {
         EmitSSEx66PrefixIndirect<SIZE2, ISFLOAT2>(dest, src);
-        EmitRexIndirect<SIZE2, ISFLOAT2>(dest, src);
+        EmitRexIndirect<SIZE2, ISFLOAT2>(dest, src, index);
         Emit8(0x0f);
         Emit8(OPCODE);
-        EmitModRMOffset(dest, src, srcOffset);
+        EmitModRMOffset(dest, src, srcOffset, index);
     }
 
 
     template <uint8_t OPCODE, unsigned SIZE1, bool ISFLOAT1, unsigned SIZE2, bool ISFLOAT2>
     void X64CodeGenerator::SSEx66(Register<8, false> dest,
                                   int32_t destOffset,
-                                  Register<SIZE2, ISFLOAT2> src)
+                                  Register<SIZE2, ISFLOAT2> src,
+                                  ScaledIndex index)
     {
         // Note: operand encoding is MR, so the order of arguments for the
         // Emit*() methods is reversed.
         EmitSSEx66PrefixIndirect<SIZE1, ISFLOAT1>(src, dest);
-        EmitRexIndirect<SIZE1, ISFLOAT1>(src, dest);
+        EmitRexIndirect<SIZE1, ISFLOAT1>(src, dest, index);
         Emit8(0x0f);
         Emit8(OPCODE);
-        EmitModRMOffset(src, dest, destOffset);
+        EmitModRMOffset(src, dest, destOffset, index);
     }
 
 
@@ -1356,10 +2095,11 @@ namespace NativeJIT
     void X64CodeGenerator::Group1(uint8_t baseOpCode,
                                   Register<SIZE, false> dest,
                                   Register<8, false> src,
-                                  int32_t srcOffset)
+                                  int32_t srcOffset,
+                                  ScaledIndex index)
     {
         EmitOpSizeOverrideIndirect<SIZE, false>(dest, src);
-        EmitRexIndirect<SIZE, false>(dest, src);
+        EmitRexIndirect<SIZE, false>(dest, src, index);
         if (SIZE == 1)
         {
             Emit8(baseOpCode + 0x2);
@@ -1368,7 +2108,7 @@ namespace NativeJIT
         {
             Emit8(baseOpCode + 0x3);
         }
-        EmitModRMOffset(dest, src, srcOffset);
+        EmitModRMOffset(dest, src, srcOffset, index);
     }
 
 
@@ -1376,12 +2116,13 @@ namespace NativeJIT
     void X64CodeGenerator::Group1(uint8_t baseOpCode,
                                   Register<8, false> dest,
                                   int32_t destOffset,
-                                  Register<SIZE, false> src)
+                                  Register<SIZE, false> src,
+                                  ScaledIndex index)
     {
         // Note: operand encoding is MR, so the order of arguments for the
         // Emit*() methods is reversed.
         EmitOpSizeOverrideIndirect<SIZE, false>(src, dest);
-        EmitRexIndirect<SIZE, false>(src, dest);
+        EmitRexIndirect<SIZE, false>(src, dest, index);
         if (SIZE == 1)
         {
             Emit8(baseOpCode);
@@ -1390,7 +2131,7 @@ namespace NativeJIT
         {
             Emit8(baseOpCode + 0x1);
         }
-        EmitModRMOffset(src, dest, destOffset);
+        EmitModRMOffset(src, dest, destOffset, index);
     }
 
 
@@ -1481,6 +2222,65 @@ namespace NativeJIT
     }
 
 
+    template <unsigned SIZE, typename T>
+    void X64CodeGenerator::Group1(uint8_t extensionOpCode,
+                                  Register<8, false> dest,
+                                  int32_t destOffset,
+                                  T value)
+    {
+        static_assert(std::is_integral<T>::value, "Group1 opcodes work only with integral values.");
+        static_assert(sizeof(T) <= SIZE, "Invalid size of the immediate.");
+        static_assert(sizeof(T) < 8, "Group1 instructions don't support 64-bit immediates.");
+        static_assert(!(SIZE == 8 && sizeof(T) == 4 && std::is_unsigned<T>::value),
+                      "Cannot safely use 32-bit unsigned immediate with 64-bit target, "
+                      "sign extension would have been used.");
+
+        // The immediate is placed after the displacement, which the RIP-relative
+        // displacement calculation in EmitModRMOffset() does not account for.
+        LogThrowAssert(!dest.IsRIP(), "RIP-relative target is not supported with an immediate source");
+
+        // See the comment in the register flavor of the method for the
+        // conditions under which the sign-extended 8-bit immediate is used.
+        const bool isByteImmediate
+            = Size(value) <= 1
+              && (SIZE == 1
+                  || (static_cast<int64_t>(value) < 0
+                      || !BitOp::TestBit(static_cast<uint64_t>(value), 7)));
+
+        EmitOpSizeOverrideIndirect<SIZE, false>(dest);
+        EmitRexIndirect<SIZE, false>(dest);
+
+        if (SIZE == 1)
+        {
+            Emit8(0x80);
+        }
+        else if (isByteImmediate)
+        {
+            Emit8(0x83);
+        }
+        else
+        {
+            Emit8(0x81);
+        }
+
+        // The extension opcode takes the place of the register operand.
+        EmitModRMOffset(Register<8, false>(extensionOpCode), dest, destOffset);
+
+        if (isByteImmediate)
+        {
+            Emit8(static_cast<uint8_t>(value));
+        }
+        else if (SIZE == 2)
+        {
+            Emit16(static_cast<uint16_t>(value));
+        }
+        else
+        {
+            Emit32(static_cast<uint32_t>(value));
+        }
+    }
+
+
     //
     // X64 group2 opcodes
     //
@@ -1524,6 +2324,28 @@ namespace NativeJIT
     }
 
 
+    //
+    // X64 group3 opcodes
+    //
+
+    template <unsigned SIZE>
+    void X64CodeGenerator::Group3(uint8_t extensionOpCode,
+                                  Register<SIZE, false> dest)
+    {
+        EmitOpSizeOverride(dest);
+        EmitRex(dest);
+        if (SIZE == 1)
+        {
+            Emit8(0xf6);
+        }
+        else
+        {
+            Emit8(0xf7);
+        }
+        EmitModRM(extensionOpCode, dest);
+    }
+
+
     //
     // X64 opcode encoding - operand size override.
     //
@@ -1587,17 +2409,17 @@ namespace NativeJIT
               unsigned REGSIZE, bool REGISFLOAT,
               unsigned RMREGSIZE, bool RMREGISFLOAT>
     void X64CodeGenerator::EmitRex(Register<REGSIZE, REGISFLOAT> reg,
-                                   Register<RMREGSIZE, RMREGISFLOAT> rm)
+                                   Register<RMREGSIZE, RMREGISFLOAT> rm,
+                                   ScaledIndex index)
     {
         static_assert((RMSIZE == RMREGSIZE && RMISFLOAT == RMREGISFLOAT)
                       || (RMREGSIZE == 8 && !RMREGISFLOAT),
                       "Only direct addressing or indirect addresing with 64-bit "
                       "general purpose base register can be used.");
 
-        // This code currently doesn't support the REX.X bit.
         // REX.X is an extra bit for the SIB index field. SIB is scale index
-        // base (think `lea`). We don't currently support this addressing
-        // mode. The old assembler might support SIB?
+        // base (think `lea`). The index is only present for the memory
+        // operands of the indexed Emit() methods.
         //
         // Note that the REX.W bit is never set when two floating point operands
         // are used.
@@ -1614,12 +2436,15 @@ namespace NativeJIT
         const bool forceRex = (reg == spl || reg == bpl || reg == sil || reg == dil)
                               || (rm == spl || rm == bpl || rm == sil || rm == dil);
 
-        if (forceRex || w || reg.IsExtended() || rm.IsExtended())
+        const bool x = index.m_scale != 0 && index.m_index.IsExtended();
+
+        if (forceRex || w || x || reg.IsExtended() || rm.IsExtended())
         {
             // WRXB
             Emit8(0x40
                   | (w ? 8 : 0)
                   | (reg.IsExtended() ? 4 : 0)
+                  | (x ? 2 : 0)
                   | (rm.IsExtended() ? 1 : 0));
         }
     }
@@ -1649,9 +2474,11 @@ namespace NativeJIT
 
 
     template <unsigned RMSIZE, bool RMISFLOAT, unsigned REGSIZE, bool REGISFLOAT>
-    void X64CodeGenerator::EmitRexIndirect(Register<REGSIZE, REGISFLOAT> reg, Register<8, false> rm)
+    void X64CodeGenerator::EmitRexIndirect(Register<REGSIZE, REGISFLOAT> reg,
+                                           Register<8, false> rm,
+                                           ScaledIndex index)
     {
-        EmitRex<RMSIZE, RMISFLOAT>(reg, rm);
+        EmitRex<RMSIZE, RMISFLOAT>(reg, rm, index);
     }
 
 
@@ -1696,8 +2523,18 @@ namespace NativeJIT
     }
 
 
+    // Returns the SS field of the SIB byte for a scale of 1, 2, 4 or 8.
+    inline uint8_t ScaleField(uint8_t scale)
+    {
+        return scale == 8 ? 3 : scale / 2;
+    }
+
+
     template <unsigned SIZE, bool ISFLOAT>
-    void X64CodeGenerator::EmitModRMOffset(Register<SIZE, ISFLOAT> reg, Register<8, false> rm, int32_t offset)
+    void X64CodeGenerator::EmitModRMOffset(Register<SIZE, ISFLOAT> reg,
+                                           Register<8, false> rm,
+                                           int32_t offset,
+                                           ScaledIndex index)
     {
         if (rm.IsRIP())
         {
@@ -1708,6 +2545,7 @@ namespace NativeJIT
 
             Emit8((mod << 6) | (regField << 3) | rmField);
 
+            m_ripRelativeSites.push_back(CurrentPosition());
             Emit32(offset - CurrentPosition() - 4);
         }
         else
@@ -1725,15 +2563,26 @@ namespace NativeJIT
                 mod = 1;
             }
 
-            Emit8((mod << 6) | (regField << 3) | rmField);
-
-            if (rmField == 4)
+            if (index.m_scale != 0)
             {
-                // When rm is RSP or R12 or XMM4 or XMM12, rmField == 4, which
-                // is a special case used for SIB addressing. Emit an SIB byte
-                // which encodes the same register with no scaled index.
-                // Want SS = 00, Index = 100 (none), and Base = 100 (4).
-                Emit8(0x24);
+                // Indexed addressing: rmField == 4 selects the SIB byte, which
+                // encodes the base, the index and the scale. The mod == 0
+                // special case above applies to the SIB base as well.
+                Emit8((mod << 6) | (regField << 3) | 4);
+                Emit8((ScaleField(index.m_scale) << 6) | (index.m_index.GetId8() << 3) | rmField);
+            }
+            else
+            {
+                Emit8((mod << 6) | (regField << 3) | rmField);
+
+                if (rmField == 4)
+                {
+                    // When rm is RSP or R12 or XMM4 or XMM12, rmField == 4, which
+                    // is a special case used for SIB addressing. Emit an SIB byte
+                    // which encodes the same register with no scaled index.
+                    // Want SS = 00, Index = 100 (none), and Base = 100 (4).
+                    Emit8(0x24);
+                }
             }
 
             if (mod == 1)
@@ -1761,9 +2610,10 @@ namespace NativeJIT
         X64CodeGenerator& code,
         Register<SIZE, false> dest,
         Register<8, false> src,
-        int32_t srcOffset)
+        int32_t srcOffset,
+        ScaledIndex index)
     {
-        code.Lea(dest, src, srcOffset);
+        code.Lea(dest, src, srcOffset, index);
     }
 
 
@@ -1790,9 +2640,10 @@ namespace NativeJIT
         X64CodeGenerator& code,
         Register<SIZE, false> dest,
         Register<8, false> src,
-        int32_t srcOffset)
+        int32_t srcOffset,
+        ScaledIndex index)
     {
-        code.Group1(0x88, dest, src, srcOffset);
+        code.Group1(0x88, dest, src, srcOffset, index);
     }
 
 
@@ -1803,9 +2654,10 @@ namespace NativeJIT
         X64CodeGenerator& code,
         Register<8, false> dest,
         int32_t destOffset,
-        Register<SIZE, false> src)
+        Register<SIZE, false> src,
+        ScaledIndex index)
     {
-        code.Group1(0x88, dest, destOffset, src);
+        code.Group1(0x88, dest, destOffset, src, index);
     }
 
 
@@ -1840,10 +2692,11 @@ namespace NativeJIT
         X64CodeGenerator& code,
         Register<8, false> dest,
         int32_t destOffset,
-        Register<SIZE, true> src)
+        Register<SIZE, true> src,
+        ScaledIndex index)
     {
         // MovSS/SD.
-        code.ScalarSSE<0x11, SIZE, true, SIZE, true>(dest, destOffset, src);
+        code.ScalarSSE<0x11, SIZE, true, SIZE, true>(dest, destOffset, src, index);
     }
 
 
@@ -1870,9 +2723,10 @@ namespace NativeJIT
         X64CodeGenerator& code,
         Register<SIZE, false> dest,
         Register<8, false> src,
-        int32_t srcOffset)
+        int32_t srcOffset,
+        ScaledIndex index)
     {
-        code.IMul(dest, src, srcOffset);
+        code.IMul(dest, src, srcOffset, index);
     }
 
 
@@ -1911,9 +2765,10 @@ namespace NativeJIT
         X64CodeGenerator& code,
         Register<SIZE1, false> dest,
         Register<8, false> src,
-        int32_t srcOffset)
+        int32_t srcOffset,
+        ScaledIndex index)
     {
-        code.MovSX<SIZE1, SIZE2>(dest, src, srcOffset);
+        code.MovSX<SIZE1, SIZE2>(dest, src, srcOffset, index);
     }
 
 
@@ -1951,9 +2806,10 @@ namespace NativeJIT
         X64CodeGenerator& code,
         Register<SIZE1, false> dest,
         Register<8, false> src,
-        int32_t srcOffset)
+        int32_t srcOffset,
+        ScaledIndex index)
     {
-        code.MovZX<SIZE1, SIZE2>(dest, src, srcOffset);
+        code.MovZX<SIZE1, SIZE2>(dest, src, srcOffset, index);
     }
 
 
@@ -1964,7 +2820,8 @@ namespace NativeJIT
         X64CodeGenerator& code,
         Register<8, false> dest,
         Register<8, false> src,
-        int32_t srcOffset);
+        int32_t srcOffset,
+        ScaledIndex index);
 
 
     //
@@ -2016,9 +2873,10 @@ namespace NativeJIT
         X64CodeGenerator& code,                                                                 \
         Register<SIZE, false> dest,                                                             \
         Register<8, false> src,                                                                 \
-        int32_t srcOffset)                                                                      \
+        int32_t srcOffset,                                                                      \
+        ScaledIndex index)                                                                      \
     {                                                                                           \
-        code.Group1(baseOpCode, dest, src, srcOffset);                                          \
+        code.Group1(baseOpCode, dest, src, srcOffset, index);                                   \
     }                                                                                           \
                                                                                                 \
                                                                                                 \
@@ -2029,9 +2887,10 @@ namespace NativeJIT
         X64CodeGenerator& code,                                                                 \
         Register<8, false> dest,                                                                \
         int32_t destOffset,                                                                     \
-        Register<SIZE, false> src)                                                              \
+        Register<SIZE, false> src,                                                              \
+        ScaledIndex index)                                                                      \
     {                                                                                           \
-        code.Group1(baseOpCode, dest, destOffset, src);                                         \
+        code.Group1(baseOpCode, dest, destOffset, src, index);                                  \
     }                                                                                           \
                                                                                                 \
                                                                                                 \
@@ -2044,6 +2903,19 @@ namespace NativeJIT
         T value)                                                                                \
     {                                                                                           \
         code.Group1(baseOpCode, extensionOpCode, dest, value);                                  \
+    }                                                                                           \
+                                                                                                \
+                                                                                                \
+    template <>                                                                                 \
+    template <>                                                                                 \
+    template <unsigned SIZE, typename T>                                                        \
+    void X64CodeGenerator::Helper<OpCode::name>::ArgTypes1<false>::EmitImmediate(               \
+        X64CodeGenerator& code,                                                                 \
+        Register<8, false> dest,                                                                \
+        int32_t destOffset,                                                                     \
+        T value)                                                                                \
+    {                                                                                           \
+        code.template Group1<SIZE>(extensionOpCode, dest, destOffset, value);                   \
     }
 
     DEFINE_GROUP1(Add, 0, 0);
@@ -2080,12 +2952,110 @@ namespace NativeJIT
     }
 
     DEFINE_GROUP2(Rol, 0);
+    DEFINE_GROUP2(Sar, 7);
     DEFINE_GROUP2(Shl, 4);
     DEFINE_GROUP2(Shr, 5);
 
 #undef DEFINE_GROUP2
 
 
+#define DEFINE_GROUP3(name, extensionOpCode)                                                    \
+    template <>                                                                                 \
+    template <>                                                                                 \
+    template <unsigned SIZE>                                                                    \
+    void X64CodeGenerator::Helper<OpCode::name>::ArgTypes1<false>::Emit(                        \
+        X64CodeGenerator& code,                                                                 \
+        Register<SIZE, false> dest)                                                             \
+    {                                                                                           \
+        code.Group3(extensionOpCode, dest);                                                     \
+    }
+
+    DEFINE_GROUP3(Div, 6);
+    DEFINE_GROUP3(IDiv, 7);
+    DEFINE_GROUP3(IMul, 5);     // One operand form, rdx:rax = rax * dest.
+    DEFINE_GROUP3(Mul, 4);
+    DEFINE_GROUP3(Neg, 3);
+    DEFINE_GROUP3(Not, 2);
+
+#undef DEFINE_GROUP3
+
+
+// Bit scan and count instructions, register or memory source.
+#define DEFINE_BIT_SCAN(name, prefix, opcode)                                                   \
+    template <>                                                                                 \
+    template <>                                                                                 \
+    template <unsigned SIZE>                                                                    \
+    void X64CodeGenerator::Helper<OpCode::name>::ArgTypes1<false>::Emit(                        \
+        X64CodeGenerator& code,                                                                 \
+        Register<SIZE, false> dest,                                                             \
+        Register<SIZE, false> src)                                                              \
+    {                                                                                           \
+        code.BitScan<prefix, opcode>(dest, src);                                                \
+    }                                                                                           \
+                                                                                                \
+                                                                                                \
+    template <>                                                                                 \
+    template <>                                                                                 \
+    template <unsigned SIZE>                                                                    \
+    void X64CodeGenerator::Helper<OpCode::name>::ArgTypes1<false>::Emit(                        \
+        X64CodeGenerator& code,                                                                 \
+        Register<SIZE, false> dest,                                                             \
+        Register<8, false> src,                                                                 \
+        int32_t srcOffset,                                                                      \
+        ScaledIndex index)                                                                      \
+    {                                                                                           \
+        code.BitScan<prefix, opcode>(dest, src, srcOffset, index);                              \
+    }
+
+    DEFINE_BIT_SCAN(Bsf,    0,    0xbc);
+    DEFINE_BIT_SCAN(Bsr,    0,    0xbd);
+    DEFINE_BIT_SCAN(Lzcnt,  0xf3, 0xbd);
+    DEFINE_BIT_SCAN(Popcnt, 0xf3, 0xb8);
+    DEFINE_BIT_SCAN(Tzcnt,  0xf3, 0xbc);
+
+#undef DEFINE_BIT_SCAN
+
+
+// VEX encoded BMI instructions with three register operands. The operands
+// are in the Intel order, f. ex. bextr dest, src, control and pdep dest, src,
+// mask, which maps onto the ModR/M and VEX.vvvv fields differently for
+// different instructions.
+#define DEFINE_BMI(name, prefix, opcode, vvvvOperand, rmOperand)                                \
+    template <>                                                                                 \
+    template <>                                                                                 \
+    template <unsigned SIZE>                                                                    \
+    void X64CodeGenerator::Helper<OpCode::name>::ArgTypes1<false>::Emit(                        \
+        X64CodeGenerator& code,                                                                 \
+        Register<SIZE, false> dest,                                                             \
+        Register<SIZE, false> src1,                                                             \
+        Register<SIZE, false> src2)                                                             \
+    {                                                                                           \
+        code.Vex0F38<prefix, opcode>(dest, vvvvOperand, rmOperand);                             \
+    }
+
+    DEFINE_BMI(Bextr, 0,    0xf7, src2, src1);
+    DEFINE_BMI(Pdep,  0xf2, 0xf5, src1, src2);
+    DEFINE_BMI(Pext,  0xf3, 0xf5, src1, src2);
+
+#undef DEFINE_BMI
+
+
+    // VFMADD231SS/SD dest, src1, src2 computes dest + src1 * src2 with a
+    // single rounding. The 231 form accumulates into the destination, which
+    // matches how the nodes reuse the register of the addend.
+    template <>
+    template <>
+    template <unsigned SIZE>
+    void X64CodeGenerator::Helper<OpCode::Vfmadd231>::ArgTypes1<true>::Emit(
+        X64CodeGenerator& code,
+        Register<SIZE, true> dest,
+        Register<SIZE, true> src1,
+        Register<SIZE, true> src2)
+    {
+        code.Vex0F38<0x66, 0xb9>(dest, src1, src2);
+    }
+
+
 // SSE instruction, both arguments of the same type and size.
 #define DEFINE_SSE_ARGS1(name, emitMethod, opcode) \
     template <>                                                                         \
@@ -2107,13 +3077,15 @@ namespace NativeJIT
         X64CodeGenerator& code,                                                         \
         Register<SIZE, true> dest,                                                      \
         Register<8, false> src,                                                         \
-        int32_t srcOffset)                                                              \
+        int32_t srcOffset,                                                              \
+        ScaledIndex index)                                                              \
     {                                                                                   \
-        code.emitMethod<opcode, SIZE, true, SIZE, true>(dest, src, srcOffset);          \
+        code.emitMethod<opcode, SIZE, true, SIZE, true>(dest, src, srcOffset, index);   \
     }                                                                                   \
 
     DEFINE_SSE_ARGS1(Add,            ScalarSSE, 0x58);  // AddSS/AddSD.
     DEFINE_SSE_ARGS1(Cmp,            SSEx66,    0x2f);  // ComISS/ComISD.
+    DEFINE_SSE_ARGS1(Div,            ScalarSSE, 0x5e);  // DivSS/DivSD.
     DEFINE_SSE_ARGS1(IMul,           ScalarSSE, 0x59);  // MulSS/MulSD.
     DEFINE_SSE_ARGS1(Mov,            ScalarSSE, 0x10);  // MovSS/MovSD.
     DEFINE_SSE_ARGS1(MovAP,          SSEx66,    0x28);  // MovAPS/MovAPD.
@@ -2130,9 +3102,24 @@ namespace NativeJIT
         X64CodeGenerator& code,
         Register<8, false> dest,
         int32_t destOffset,
+        Register<SIZE, true> src,
+        ScaledIndex index)
+    {
+        code.SSEx66<0x29, SIZE, true, SIZE, true>(dest, destOffset, src, index);
+    }
+
+
+    // XorPS/XorPD operate on the whole 128-bit register and their memory
+    // operand must be 16-byte aligned, so only the register form is provided.
+    template <>
+    template <>
+    template <unsigned SIZE>
+    void X64CodeGenerator::Helper<OpCode::Xor>::ArgTypes1<true>::Emit(
+        X64CodeGenerator& code,
+        Register<SIZE, true> dest,
         Register<SIZE, true> src)
     {
-        code.SSEx66<0x29, SIZE, true, SIZE, true>(dest, destOffset, src);
+        code.SSEx66<0x57>(dest, src);
     }
 
 
@@ -2159,11 +3146,12 @@ namespace NativeJIT
         X64CodeGenerator& code,                                                         \
         Register<SIZE1, type1> dest,                                                    \
         Register<8, false> src,                                                         \
-        int32_t srcOffset)                                                              \
+        int32_t srcOffset,                                                              \
+        ScaledIndex index)                                                              \
     {                                                                                   \
         static_assert(validityCondition,                                                \
                       "Invalid " #name " instruction, must be " #validityCondition);    \
-        code.emitMethod<opcode, SIZE1, type1, SIZE2, type2>(dest, src, srcOffset);      \
+        code.emitMethod<opcode, SIZE1, type1, SIZE2, type2>(dest, src, srcOffset, index);\
     }                                                                                   \
 
     DEFINE_SSE_ARGS2(CvtSI2FP, ScalarSSE, 0x2A, true,  false, SIZE2 >= 4);       // CvtSI2SD/CvtSI2SS (convert signed int to floating point).
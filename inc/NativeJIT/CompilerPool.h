@@ -0,0 +1,237 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "NativeJIT/CodeGen/ExecutionBuffer.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/Function.h"
+#include "Temporary/Allocator.h"
+#include "Temporary/Assert.h"
+#include "Temporary/NonCopyable.h"
+
+
+namespace NativeJIT
+{
+    // The executable memory holding the code of one compiled function.
+    class CompiledCode : public NonCopyable
+    {
+    public:
+        CompiledCode(unsigned capacity);
+
+        FunctionBuffer& GetCode();
+
+    private:
+        ExecutionBuffer m_codeAllocator;
+        FunctionBuffer m_code;
+    };
+
+
+    // A function compiled by the CompilerPool. Shares the ownership of the
+    // memory holding the code with its copies, so the entry point is valid
+    // as long as any of them exists.
+    template <typename R, typename P1 = void, typename P2 = void, typename P3 = void, typename P4 = void>
+    class CompiledFunction
+    {
+    public:
+        typedef typename Function<R, P1, P2, P3, P4>::FunctionType FunctionType;
+
+        CompiledFunction(std::shared_ptr<CompiledCode> code, FunctionType entryPoint);
+
+        FunctionType GetEntryPoint() const;
+
+        template <typename... ARGS>
+        R operator()(ARGS... args) const;
+
+    private:
+        std::shared_ptr<CompiledCode> m_code;
+        FunctionType m_entryPoint;
+    };
+
+
+    // CompilerPool compiles functions on a fixed number of worker threads,
+    // so that the threads which need the functions don't block for the
+    // duration of the compilation.
+    //
+    // Each worker has its own general allocator, which holds the expression
+    // trees while they are being built and compiled and is reset after each
+    // function. The code of each function is placed in its own CompiledCode,
+    // which is handed over to the caller along with the entry point.
+    class CompilerPool : public NonCopyable
+    {
+    public:
+        struct Statistics
+        {
+            // The number of functions waiting for a worker and the largest
+            // number observed so far.
+            size_t m_queueDepth;
+            size_t m_maxQueueDepth;
+
+            // The number of functions built and compiled, successfully or not.
+            uint64_t m_completedCount;
+
+            // The time from the call to Compile() to the completion of the
+            // function, summed over all completed functions and the longest one.
+            std::chrono::microseconds m_totalLatency;
+            std::chrono::microseconds m_maxLatency;
+        };
+
+        // Starts the workers. Each worker allocates allocatorCapacity bytes
+        // for its general allocator, each function gets codeCapacity bytes of
+        // executable memory.
+        CompilerPool(unsigned workerCount,
+                     size_t allocatorCapacity,
+                     unsigned codeCapacity);
+
+        // Completes the queued functions and stops the workers.
+        ~CompilerPool();
+
+        // Queues the function for compilation and returns immediately. The
+        // builder is invoked on one of the workers as
+        // Node<R>& builder(Function<R, P1, P2, P3, P4>& function) to build the
+        // expression, which the worker then compiles. Any exception thrown by
+        // the builder or the compiler is stored in the future, as is the
+        // failure of a compilation abandoned because of the compile budget
+        // the builder set (see CompilationTier::NotCompiled).
+        template <typename R,
+                  typename P1 = void,
+                  typename P2 = void,
+                  typename P3 = void,
+                  typename P4 = void,
+                  typename BUILDER>
+        std::future<CompiledFunction<R, P1, P2, P3, P4>>
+        Compile(BUILDER builder);
+
+        Statistics GetStatistics() const;
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+        // Builds and compiles a function. Returns the callable which stores
+        // the result in the future, so that the statistics are updated by the
+        // time the caller sees the result.
+        typedef std::function<std::function<void()>(Allocators::IAllocator& allocator)> Job;
+
+        struct QueuedJob
+        {
+            Job m_job;
+            Clock::time_point m_queueTime;
+        };
+
+        void Enqueue(Job job);
+        void RunWorker(size_t allocatorCapacity);
+
+        unsigned const m_codeCapacity;
+
+        // Protects the members below.
+        mutable std::mutex m_lock;
+        std::condition_variable m_jobAvailable;
+        std::deque<QueuedJob> m_queue;
+        bool m_isStopping;
+        Statistics m_statistics;
+
+        std::vector<std::thread> m_workers;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for CompiledFunction and CompilerPool.
+    //
+    //*************************************************************************
+    template <typename R, typename P1, typename P2, typename P3, typename P4>
+    CompiledFunction<R, P1, P2, P3, P4>::CompiledFunction(std::shared_ptr<CompiledCode> code,
+                                                          FunctionType entryPoint)
+        : m_code(std::move(code)),
+          m_entryPoint(entryPoint)
+    {
+    }
+
+
+    template <typename R, typename P1, typename P2, typename P3, typename P4>
+    typename CompiledFunction<R, P1, P2, P3, P4>::FunctionType
+    CompiledFunction<R, P1, P2, P3, P4>::GetEntryPoint() const
+    {
+        return m_entryPoint;
+    }
+
+
+    template <typename R, typename P1, typename P2, typename P3, typename P4>
+    template <typename... ARGS>
+    R CompiledFunction<R, P1, P2, P3, P4>::operator()(ARGS... args) const
+    {
+        return m_entryPoint(args...);
+    }
+
+
+    template <typename R, typename P1, typename P2, typename P3, typename P4, typename BUILDER>
+    std::future<CompiledFunction<R, P1, P2, P3, P4>>
+    CompilerPool::Compile(BUILDER builder)
+    {
+        auto promise = std::make_shared<std::promise<CompiledFunction<R, P1, P2, P3, P4>>>();
+        auto result = promise->get_future();
+        const unsigned codeCapacity = m_codeCapacity;
+
+        Enqueue([promise, builder, codeCapacity](Allocators::IAllocator& allocator)
+                -> std::function<void()>
+        {
+            try
+            {
+                std::shared_ptr<CompiledCode> code(new CompiledCode(codeCapacity));
+                typename Function<R, P1, P2, P3, P4>::FunctionType entryPoint;
+
+                {
+                    Function<R, P1, P2, P3, P4> function(allocator, code->GetCode());
+                    entryPoint = function.Compile(builder(function));
+
+                    LogThrowAssert(function.GetCompilationTier() != CompilationTier::NotCompiled,
+                                   "Compilation exceeded the compile budget");
+                }
+
+                return [promise, code, entryPoint]
+                {
+                    promise->set_value(CompiledFunction<R, P1, P2, P3, P4>(code, entryPoint));
+                };
+            }
+            catch (...)
+            {
+                std::exception_ptr exception = std::current_exception();
+
+                return [promise, exception] { promise->set_exception(exception); };
+            }
+        });
+
+        return result;
+    }
+}
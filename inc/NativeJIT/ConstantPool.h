@@ -0,0 +1,96 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+
+#include "NativeJIT/AllocatorVector.h"      // Embedded member.
+#include "Temporary/NonCopyable.h"          // Base class.
+
+
+namespace NativeJIT
+{
+    class ExpressionTree;
+
+
+    // Collects the constants which the generated code reads through
+    // RIP-relative operands and lays them out in the code buffer in front of
+    // the function. Constants with the same bytes, alignment and kind share
+    // a single copy and the copies are packed in the order of decreasing
+    // alignment, so only the first one may need padding. FunctionBuffer
+    // starts the function on a new cache line after the pool, so the pool
+    // doesn't share a cache line with the function body.
+    //
+    // The constants are added during pass 0 of the compilation and are
+    // placed once all of them are known. Emit() then stores the offset of
+    // each constant into the variable provided by Add().
+    class ConstantPool : public NonCopyable
+    {
+    public:
+        ConstantPool(Allocators::StlAllocator<void*> const & allocator);
+
+        void Clear();
+
+        // Adds a copy of the size bytes of data, which need to be aligned to
+        // a multiple of alignment. Emit() sets offset to the code buffer
+        // offset of the constant, so the variable must outlive the call to
+        // Emit(). If isAddress is true, the bytes hold an absolute address
+        // (see ExpressionTree::AddAbsoluteAddress()).
+        void Add(void const * data,
+                 unsigned size,
+                 unsigned alignment,
+                 bool isAddress,
+                 int32_t& offset);
+
+        // Emits the distinct constants at the current position of the code
+        // buffer of the tree, sets the offsets and records the offsets of the
+        // addresses.
+        void Emit(ExpressionTree& tree);
+
+        // The number of constants added and the number of bytes emitted.
+        unsigned GetConstantCount() const;
+        unsigned GetByteCount() const;
+
+    private:
+        struct Entry
+        {
+            unsigned m_start;       // Start of the bytes in m_data.
+            unsigned m_size;
+            unsigned m_alignment;
+            bool m_isAddress;
+            int32_t* m_offset;      // Set by Emit().
+        };
+
+        // Returns whether the entry with index left goes before the one with
+        // index right in the pool. Identical entries end up adjacent.
+        bool IsLess(unsigned left, unsigned right) const;
+        bool IsSame(unsigned left, unsigned right) const;
+
+        AllocatorVector<uint8_t> m_data;
+        AllocatorVector<Entry> m_entries;
+        AllocatorVector<unsigned> m_order;
+
+        unsigned m_byteCount;
+    };
+}
@@ -23,6 +23,10 @@
 
 #pragma once
 
+#include <cstddef>      // For offsetof.
+
+#include "NativeJIT/BranchProfile.h"
+#include "NativeJIT/Bytecode.h"
 #include "NativeJIT/CodeGen/X64CodeGenerator.h"
 #include "NativeJIT/ExpressionTree.h"
 #include "NativeJIT/Nodes/ConditionalNode.h"
@@ -31,6 +35,21 @@
 
 namespace NativeJIT
 {
+    // Tells whether a precondition test may be evaluated ahead of the tests
+    // added before it when the tests are ordered by a branch profile.
+    enum class PreconditionOrder
+    {
+        // The test is evaluated after all the tests added before it. Used
+        // when the condition relies on an earlier test, e.g. dereferences a
+        // pointer that an earlier test checks for null.
+        Fixed,
+
+        // The condition is safe to evaluate regardless of the outcome of
+        // the earlier tests.
+        Independent
+    };
+
+
     // A base class for statements that check whether a precondition for executing
     // the full expression has been met and cause a fixed value to be returned
     // if not.
@@ -41,6 +60,19 @@ namespace NativeJIT
         // condition is satisfied. Otherwise, places an alternative fixed value
         // into the return register and jumps to function's epilog.
         virtual void Evaluate(ExpressionTree& tree) = 0;
+
+        // Appends the bytecode equivalent of Evaluate(): an instruction that
+        // stops the interpreter with the alternative value if the test fails.
+        virtual void Lower(Bytecode& code) = 0;
+
+        // Returns the node with the value returned when the precondition is
+        // not met. Two tests returning the same node can be evaluated in either
+        // order without changing the result of the function.
+        virtual NodeBase const & GetOtherwiseValue() const = 0;
+
+        // Returns PreconditionOrder::Independent if the test may be moved
+        // ahead of the tests added before it.
+        virtual PreconditionOrder GetOrder() const = 0;
     };
 
 
@@ -56,21 +88,42 @@ namespace NativeJIT
     // code may be executed needlessly at runtime. This is an issue in cases
     // when the function is executed a large number of times for different
     // inputs where the vast majority of them is expected to return early.
+    //
+    // By default the early return path follows the test inline. If the
+    // condition is hinted as likely, the early return path is placed in a
+    // cold block at the end of the function instead and the regular flow
+    // falls through the test.
+    //
+    // The tests are evaluated in the order in which they were added unless
+    // the test is marked as PreconditionOrder::Independent, in which case a
+    // branch profile may move it ahead of the tests that fail less often.
     template <typename T, JccType JCC>
     class ExecuteOnlyIfStatement : public ExecutionPreconditionTest
     {
     public:
         ExecuteOnlyIfStatement(FlagExpressionNode<JCC>& condition,
-                               ImmediateNode<T>& otherwiseValue);
+                               ImmediateNode<T>& otherwiseValue,
+                               BranchHint hint,
+                               PreconditionOrder order);
 
         //
         // Overrides of ExecutionPreconditionTest.
         //
         virtual void Evaluate(ExpressionTree& tree) override;
+        virtual void Lower(Bytecode& code) override;
+        virtual NodeBase const & GetOtherwiseValue() const override;
+        virtual PreconditionOrder GetOrder() const override;
 
     private:
+        // Bytecode handler. Operands are the slots of the condition and of
+        // the otherwise value.
+        static bool Interpret(Bytecode::Slot* slots,
+                              Bytecode::Instruction const & instruction);
+
         FlagExpressionNode<JCC>& m_condition;
         ImmediateNode<T>& m_otherwiseValue;
+        const BranchHint m_hint;
+        const PreconditionOrder m_order;
     };
 
 
@@ -81,9 +134,13 @@ namespace NativeJIT
     template <typename T, JccType JCC>
     ExecuteOnlyIfStatement<T, JCC>::ExecuteOnlyIfStatement(
         FlagExpressionNode<JCC>& condition,
-        ImmediateNode<T>& otherwiseValue)
+        ImmediateNode<T>& otherwiseValue,
+        BranchHint hint,
+        PreconditionOrder order)
         : m_condition(condition),
-          m_otherwiseValue(otherwiseValue)
+          m_otherwiseValue(otherwiseValue),
+          m_hint(hint),
+          m_order(order)
     {
         m_otherwiseValue.IncrementParentCount();
 
@@ -97,11 +154,43 @@ namespace NativeJIT
     {
         X64CodeGenerator& code = tree.GetCodeGenerator();
         Label continueWithRegularFlow = code.AllocateLabel();
+        Label returnEarly = code.AllocateLabel();
+        const bool isReturnCold = m_hint == BranchHint::Likely;
+        BranchCounts* counts = tree.GetInstrumentationCounts(*this);
+        Storage<BranchCounts*> countsBase;
 
         // Evaluate the condition to update the CPU flags. If condition is
         // satisfied, continue with the regular flow.
         m_condition.CodeGenFlags(tree);
-        code.EmitConditionalJump<JCC>(continueWithRegularFlow);
+
+        if (counts != nullptr)
+        {
+            // Load the address of the counters before the jump so that any
+            // register spills apply to both paths. Neither the spilling nor
+            // the MOV instruction affect the flags.
+            countsBase = tree.Direct<BranchCounts*>();
+            code.EmitImmediate<OpCode::Mov>(countsBase.GetDirectRegister(), counts);
+        }
+
+        if (isReturnCold)
+        {
+            // The early return is a cold block, which is entered only if the
+            // condition is not satisfied. The regular flow falls through.
+            code.EmitConditionalJump<InverseJcc<JCC>::c_value>(returnEarly);
+            code.BeginColdBlock();
+            code.PlaceLabel(returnEarly);
+        }
+        else
+        {
+            code.EmitConditionalJump<JCC>(continueWithRegularFlow);
+        }
+
+        if (counts != nullptr)
+        {
+            code.EmitImmediate<OpCode::Add, 8>(countsBase.GetDirectRegister(),
+                                               static_cast<int32_t>(offsetof(BranchCounts, m_notTaken)),
+                                               1);
+        }
 
         // Otherwise, return early with the constant value: move the constant
         // into the return register and jump to epilog.
@@ -130,6 +219,60 @@ namespace NativeJIT
         // of the function (except temporarily for function calls).
         code.Jmp(tree.GetStartOfEpilogue());
 
-        code.PlaceLabel(continueWithRegularFlow);
+        if (isReturnCold)
+        {
+            code.EndColdBlock();
+        }
+        else
+        {
+            code.AlignCode(code.GetCodeAlignment().m_join);
+            code.PlaceLabel(continueWithRegularFlow);
+        }
+
+        if (counts != nullptr)
+        {
+            code.EmitImmediate<OpCode::Add, 8>(countsBase.GetDirectRegister(),
+                                               static_cast<int32_t>(offsetof(BranchCounts, m_taken)),
+                                               1);
+        }
+    }
+
+
+    template <typename T, JccType JCC>
+    void ExecuteOnlyIfStatement<T, JCC>::Lower(Bytecode& code)
+    {
+        unsigned const condition = m_condition.Lower(code);
+        unsigned const otherwiseValue = m_otherwiseValue.Lower(code);
+
+        code.Emit(&Interpret, { condition, otherwiseValue });
+    }
+
+
+    template <typename T, JccType JCC>
+    bool ExecuteOnlyIfStatement<T, JCC>::Interpret(Bytecode::Slot* slots,
+                                                   Bytecode::Instruction const & instruction)
+    {
+        if (Bytecode::Read<bool>(slots, instruction.m_operands[0]))
+        {
+            return true;
+        }
+
+        slots[instruction.m_result] = slots[instruction.m_operands[1]];
+
+        return false;
+    }
+
+
+    template <typename T, JccType JCC>
+    NodeBase const & ExecuteOnlyIfStatement<T, JCC>::GetOtherwiseValue() const
+    {
+        return m_otherwiseValue;
+    }
+
+
+    template <typename T, JccType JCC>
+    PreconditionOrder ExecuteOnlyIfStatement<T, JCC>::GetOrder() const
+    {
+        return m_order;
     }
 }
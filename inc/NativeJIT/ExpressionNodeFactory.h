@@ -31,25 +31,43 @@
 //
 // Implementation includes
 //
+#include <algorithm>    // For std::min.
 #include <cstdint>
+#include <type_traits>
 
 #include "NativeJIT/BitOperations.h"
+#include "NativeJIT/Nodes/AssociativeNode.h"
 #include "NativeJIT/Nodes/BinaryImmediateNode.h"
 #include "NativeJIT/Nodes/BinaryNode.h"
+#include "NativeJIT/Nodes/BitCountNode.h"
+#include "NativeJIT/Nodes/BitExtractNode.h"
 #include "NativeJIT/Nodes/CallNode.h"
 #include "NativeJIT/Nodes/CastNode.h"
 #include "NativeJIT/Nodes/ConditionalNode.h"
 #include "NativeJIT/Nodes/DependentNode.h"
+#include "NativeJIT/Nodes/DivisionImmediateNode.h"
+#include "NativeJIT/Nodes/DivisionNode.h"
 #include "NativeJIT/Nodes/FieldPointerNode.h"
+#include "NativeJIT/Nodes/FusedMultiplyAddNode.h"
+#include "NativeJIT/Nodes/HalfToFloatNode.h"
 #include "NativeJIT/Nodes/ImmediateNode.h"
+#include "NativeJIT/Nodes/IndexedPointerNode.h"
 #include "NativeJIT/Nodes/IndirectNode.h"
+#include "NativeJIT/Nodes/ModelGatherNode.h"
 #include "NativeJIT/Nodes/Node.h"
+#include "NativeJIT/Nodes/PackedInsertNode.h"
 #include "NativeJIT/Nodes/PackedMinMaxNode.h"
+#include "NativeJIT/Nodes/ParallelBitsNode.h"
 #include "NativeJIT/Nodes/ParameterNode.h"
+#include "NativeJIT/Nodes/PrefetchNode.h"
 #include "NativeJIT/Nodes/ReturnNode.h"
+#include "NativeJIT/Nodes/SequenceNode.h"
 #include "NativeJIT/Nodes/ShldNode.h"
 #include "NativeJIT/Nodes/StackVariableNode.h"
+#include "NativeJIT/Nodes/StoreNode.h"
+#include "NativeJIT/Nodes/UnaryNode.h"
 #include "Temporary/Allocator.h"
+#include "Temporary/Assert.h"
 
 
 namespace NativeJIT
@@ -191,6 +209,27 @@ namespace NativeJIT
     }
 
 
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::Store(Node<T*>& pointer, Node<T>& value)
+    {
+        return PlacementConstruct<StoreNode<T>>(*this, pointer, value);
+    }
+
+
+    template <typename T1, typename T2>
+    Node<T2>& ExpressionNodeFactory::Sequence(Node<T1>& first, Node<T2>& second)
+    {
+        return PlacementConstruct<SequenceNode<T1, T2>>(*this, first, second);
+    }
+
+
+    template <typename T>
+    Node<T*>& ExpressionNodeFactory::Prefetch(Node<T*>& pointer, PrefetchLocality locality)
+    {
+        return PlacementConstruct<PrefetchNode<T>>(*this, pointer, locality);
+    }
+
+
     template <typename T>
     NodeBase& ExpressionNodeFactory::Return(Node<T>& value)
     {
@@ -204,14 +243,18 @@ namespace NativeJIT
     template <typename L, typename R>
     Node<L>& ExpressionNodeFactory::Add(Node<L>& left, Node<R>& right)
     {
-        return Binary<OpCode::Add>(left, right);
+        return Addition(left,
+                        right,
+                        std::integral_constant<bool,
+                                               std::is_floating_point<L>::value
+                                               && std::is_same<L, R>::value>());
     }
 
 
     template <typename L, typename R>
     Node<L>& ExpressionNodeFactory::And(Node<L>& left, Node<R>& right)
     {
-        return Binary<OpCode::And>(left, right);
+        return Associative<OpCode::And>(left, right);
     }
 
 
@@ -225,7 +268,7 @@ namespace NativeJIT
     template <typename L, typename R>
     Node<L>& ExpressionNodeFactory::Mul(Node<L>& left, Node<R>& right)
     {
-        return Binary<OpCode::IMul>(left, right);
+        return Associative<OpCode::IMul>(left, right);
     }
 
 
@@ -260,10 +303,48 @@ namespace NativeJIT
     }
 
 
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::Div(Node<T>& left, Node<T>& right)
+    {
+        return Division<false>(left, right, std::is_floating_point<T>());
+    }
+
+
+    template <typename L, typename R>
+    Node<L>& ExpressionNodeFactory::DivImmediate(Node<L>& left, R right)
+    {
+        static_assert(std::is_integral<L>::value && std::is_integral<R>::value,
+                      "DivImmediate requires integral values.");
+
+        return DivisionImmediate<false>(left,
+                                        static_cast<L>(right),
+                                        std::integral_constant<bool, (sizeof(L) < 4)>());
+    }
+
+
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::Mod(Node<T>& left, Node<T>& right)
+    {
+        return Division<true>(left, right, std::is_floating_point<T>());
+    }
+
+
+    template <typename L, typename R>
+    Node<L>& ExpressionNodeFactory::ModImmediate(Node<L>& left, R right)
+    {
+        static_assert(std::is_integral<L>::value && std::is_integral<R>::value,
+                      "ModImmediate requires integral values.");
+
+        return DivisionImmediate<true>(left,
+                                       static_cast<L>(right),
+                                       std::integral_constant<bool, (sizeof(L) < 4)>());
+    }
+
+
     template <typename L, typename R>
     Node<L>& ExpressionNodeFactory::Or(Node<L>& left, Node<R>& right)
     {
-        return Binary<OpCode::Or>(left, right);
+        return Associative<OpCode::Or>(left, right);
     }
 
 
@@ -288,6 +369,99 @@ namespace NativeJIT
     }
 
 
+    template <typename L, typename R>
+    Node<L>& ExpressionNodeFactory::Xor(Node<L>& left, Node<R>& right)
+    {
+        static_assert(std::is_integral<L>::value, "Xor requires integral values.");
+
+        return Associative<OpCode::Xor>(left, right);
+    }
+
+
+    //
+    // Unary arithmetic operators
+    //
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::Neg(Node<T>& value)
+    {
+        return PlacementConstruct<UnaryNode<OpCode::Neg, T>>(*this, value);
+    }
+
+
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::Not(Node<T>& value)
+    {
+        return PlacementConstruct<UnaryNode<OpCode::Not, T>>(*this, value);
+    }
+
+
+    //
+    // Bit manipulation
+    //
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::Popcnt(Node<T>& value)
+    {
+        return BitCount<OpCode::Popcnt>(value, std::integral_constant<bool, (sizeof(T) < 4)>());
+    }
+
+
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::Lzcnt(Node<T>& value)
+    {
+        return BitCount<OpCode::Lzcnt>(value, std::integral_constant<bool, (sizeof(T) < 4)>());
+    }
+
+
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::Tzcnt(Node<T>& value)
+    {
+        return BitCount<OpCode::Tzcnt>(value, std::integral_constant<bool, (sizeof(T) < 4)>());
+    }
+
+
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::Bextr(Node<T>& value, uint8_t start, uint8_t length)
+    {
+        static_assert(std::is_integral<T>::value && !std::is_same<T, bool>::value,
+                      "Bextr requires an integral value.");
+
+        const unsigned bitCount = sizeof(T) * 8;
+
+        if (length == 0 || start >= bitCount)
+        {
+            return Immediate<T>(0);
+        }
+
+        if (start == 0 && length >= bitCount)
+        {
+            return value;
+        }
+
+        const uint8_t clampedLength = length < bitCount - start
+                                      ? length
+                                      : static_cast<uint8_t>(bitCount - start);
+
+        return BitExtract(value,
+                          start,
+                          clampedLength,
+                          std::integral_constant<bool, (sizeof(T) < 4)>());
+    }
+
+
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::Pdep(Node<T>& value, Node<T>& mask)
+    {
+        return ParallelBits<OpCode::Pdep>(value, mask, std::integral_constant<bool, (sizeof(T) < 4)>());
+    }
+
+
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::Pext(Node<T>& value, Node<T>& mask)
+    {
+        return ParallelBits<OpCode::Pext>(value, mask, std::integral_constant<bool, (sizeof(T) < 4)>());
+    }
+
+
     template <typename T>
     Node<T>& ExpressionNodeFactory::Shld(Node<T>& shiftee, Node<T>& filler, uint8_t bitCount)
     {
@@ -299,24 +473,20 @@ namespace NativeJIT
     Node<T*>& ExpressionNodeFactory::Add(Node<T*>& array, Node<INDEX>& index)
     {
         // Cast the index to UInt64 to make sure that the calculated offset
-        // will not overflow. This will also make it possible to use OpCode::Add
-        // on the result regardless of sizeof(INDEX) since both T* and UInt64
-        // use the same register size.
+        // will not overflow. This also makes the index usable in the same
+        // memory operand as the 64-bit array pointer.
         auto & index64 = Cast<uint64_t>(index);
 
-        // The IMul instruction doesn't suport 64-bit immediates, but there's
-        // also no need to support types whose size is larger than UINT32_MAX.
-        static_assert(sizeof(T) <= UINT32_MAX, "Unsupported type");
-        auto & offset = MulImmediate(index64, static_cast<uint32_t>(sizeof(T)));
-
-        return Binary<OpCode::Add>(array, offset);
+        return PlacementConstruct<IndexedPointerNode<T>>(*this, array, index64);
     }
 
 
     template <typename T, size_t SIZE, typename INDEX>
     Node<T*>& ExpressionNodeFactory::Add(Node<T(*)[SIZE]>& array, Node<INDEX>& index)
     {
-        return Add(Cast<T*>(array), index);
+        auto & index64 = Cast<uint64_t>(index);
+
+        return PlacementConstruct<IndexedPointerNode<T>>(*this, array, index64);
     }
 
 
@@ -331,6 +501,100 @@ namespace NativeJIT
     }
 
 
+    template <typename PACKED, typename ENTRY>
+    Node<float>& ExpressionNodeFactory::ApplyModel(Node<QuantizedModel<PACKED, ENTRY>*>& model,
+                                                   Node<PACKED>& packed)
+    {
+        typedef QuantizedModel<PACKED, ENTRY> ModelType;
+
+        auto & array = FieldPointer(model, &ModelType::m_data);
+        auto & entry = Cast<float>(Deref(Add(array, packed)));
+        auto & scale = Deref(FieldPointer(model, &ModelType::m_scale));
+        auto & offset = Deref(FieldPointer(model, &ModelType::m_offset));
+
+        return Add(offset, Mul(scale, entry));
+    }
+
+
+    template <typename PACKED, HalfFormat FORMAT>
+    Node<float>& ExpressionNodeFactory::ApplyModel(Node<HalfModel<PACKED, FORMAT>*>& model,
+                                                   Node<PACKED>& packed)
+    {
+        auto & array = FieldPointer(model, &HalfModel<PACKED, FORMAT>::m_data);
+        return HalfToFloat<FORMAT>(Deref(Add(array, packed)));
+    }
+
+
+    template <HalfFormat FORMAT>
+    Node<float>& ExpressionNodeFactory::HalfToFloat(Node<uint16_t>& value)
+    {
+        if (FORMAT == HalfFormat::Half && !GetCpuFeatures().IsSupported(CpuFeature::F16c))
+        {
+            return Call(Immediate(&HalfPrecision<FORMAT>::ToFloat), value);
+        }
+
+        return PlacementConstruct<HalfToFloatNode<FORMAT>>(*this, Cast<uint32_t>(value));
+    }
+
+
+    template <typename PACKED>
+    Node<float>& ExpressionNodeFactory::ApplyModelSum(Node<Model<PACKED>*>& model,
+                                                      Node<PACKED>* const * keys,
+                                                      unsigned keyCount)
+    {
+        LogThrowAssert(keyCount > 0, "ApplyModelSum() requires at least one key");
+
+        const unsigned c_groupSize = ModelGatherNode<PACKED>::c_maxKeyCount;
+        const bool useGather = GetCpuFeatures().IsSupported(CpuFeature::Avx2);
+        Node<float>* sum = nullptr;
+
+        for (unsigned start = 0; start < keyCount; start += c_groupSize)
+        {
+            const unsigned count = (std::min)(c_groupSize, keyCount - start);
+
+            auto & group = useGather
+                ? static_cast<Node<float>&>(
+                    PlacementConstruct<ModelGatherNode<PACKED>>(*this, model, keys + start, count))
+                : ApplyModelPairwise(model, keys + start, count);
+
+            sum = sum == nullptr ? &group : &Add(*sum, group);
+        }
+
+        return *sum;
+    }
+
+
+    template <typename PACKED>
+    Node<float>& ExpressionNodeFactory::ApplyModelPairwise(Node<Model<PACKED>*>& model,
+                                                           Node<PACKED>* const * keys,
+                                                           unsigned keyCount)
+    {
+        // Mirrors the lanes of the gather: the entry of key i is added to the
+        // entry of key i + 4, then the four partial sums are added pairwise.
+        // The missing keys are skipped rather than added as zeros.
+        Node<float>* lanes[4] = { nullptr, nullptr, nullptr, nullptr };
+
+        for (unsigned i = 0; i < keyCount; ++i)
+        {
+            auto & entry = ApplyModel(model, *keys[i]);
+            lanes[i % 4] = lanes[i % 4] == nullptr ? &entry : &Add(*lanes[i % 4], entry);
+        }
+
+        for (unsigned step = 1; step < 4; step *= 2)
+        {
+            for (unsigned i = 0; i + step < 4; i += 2 * step)
+            {
+                if (lanes[i + step] != nullptr)
+                {
+                    lanes[i] = &Add(*lanes[i], *lanes[i + step]);
+                }
+            }
+        }
+
+        return *lanes[0];
+    }
+
+
     //
     // Relational operators
     //
@@ -348,9 +612,14 @@ namespace NativeJIT
     template <typename T, JccType JCC>
     Node<T>& ExpressionNodeFactory::Conditional(FlagExpressionNode<JCC>& condition,
                                                 Node<T>& trueValue,
-                                                Node<T>& falseValue)
+                                                Node<T>& falseValue,
+                                                BranchHint hint)
     {
-        return PlacementConstruct<ConditionalNode<T, JCC>>(*this, condition, trueValue, falseValue);
+        return PlacementConstruct<ConditionalNode<T, JCC>>(*this,
+                                                           condition,
+                                                           trueValue,
+                                                           falseValue,
+                                                           hint);
     }
 
 
@@ -436,6 +705,64 @@ namespace NativeJIT
     }
 
 
+    template <unsigned INDEX, typename PACKED>
+    Node<PackedUnderlyingType>& ExpressionNodeFactory::PackedComponent(Node<PACKED>& packed)
+    {
+        typedef PackedComponentPosition<PACKED, INDEX> Position;
+
+        unsigned index;
+        NodeBase* insertedInto;
+        NodeBase* inserted;
+
+        if (packed.GetInsertedComponent(index, insertedInto, inserted))
+        {
+            // The insertion is not evaluated by this node, so it's marked as
+            // referenced in order to allow it to be optimized away.
+            packed.MarkReferenced();
+
+            return index == INDEX
+                ? Bextr(*static_cast<Node<PackedUnderlyingType>*>(inserted),
+                        0,
+                        static_cast<uint8_t>(Position::c_bitCount))
+                : PackedComponent<INDEX>(*static_cast<Node<PACKED>*>(insertedInto));
+        }
+
+        if (Position::c_startBit == 0)
+        {
+            const PackedUnderlyingType mask = static_cast<PackedUnderlyingType>(
+                (1ull << Position::c_bitCount) - 1);
+
+            return And(Cast<PackedUnderlyingType>(packed),
+                       Immediate<PackedUnderlyingType>(mask));
+        }
+
+        return Bextr(Cast<PackedUnderlyingType>(packed),
+                     static_cast<uint8_t>(Position::c_startBit),
+                     static_cast<uint8_t>(Position::c_bitCount));
+    }
+
+
+    template <unsigned INDEX, typename PACKED>
+    Node<PACKED>& ExpressionNodeFactory::PackedWithComponent(Node<PACKED>& packed,
+                                                             Node<PackedUnderlyingType>& value)
+    {
+        unsigned index;
+        NodeBase* insertedInto;
+        NodeBase* inserted;
+
+        if (packed.GetInsertedComponent(index, insertedInto, inserted) && index == INDEX)
+        {
+            // Like in PackedComponent(), the overwritten insertion can be
+            // optimized away.
+            packed.MarkReferenced();
+
+            return PackedWithComponent<INDEX>(*static_cast<Node<PACKED>*>(insertedInto), value);
+        }
+
+        return PlacementConstruct<PackedInsertNode<PACKED, INDEX>>(*this, packed, value);
+    }
+
+
     //
     // Private methods.
     //
@@ -451,4 +778,264 @@ namespace NativeJIT
     {
         return PlacementConstruct<BinaryImmediateNode<OP, L, R>>(*this, left, right);
     }
+
+
+    template <OpCode OP, typename L, typename R>
+    Node<L>& ExpressionNodeFactory::Associative(Node<L>& left, Node<R>& right)
+    {
+        return Associative<OP>(left, right, std::is_same<L, R>());
+    }
+
+
+    template <OpCode OP, typename T>
+    Node<T>& ExpressionNodeFactory::Associative(Node<T>& left,
+                                                Node<T>& right,
+                                                std::true_type /* isSameType */)
+    {
+        const bool isEnabled = std::is_floating_point<T>::value
+            ? GetReassociationMode() == ReassociationMode::FastMath
+            : GetReassociationMode() != ReassociationMode::Disabled;
+
+        if (isEnabled)
+        {
+            return PlacementConstruct<AssociativeNode<OP, T>>(*this, left, right);
+        }
+
+        return Binary<OP>(left, right);
+    }
+
+
+    template <OpCode OP, typename L, typename R>
+    Node<L>& ExpressionNodeFactory::Associative(Node<L>& left,
+                                                Node<R>& right,
+                                                std::false_type /* isSameType */)
+    {
+        return Binary<OP>(left, right);
+    }
+
+
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::Addition(Node<T>& left,
+                                             Node<T>& right,
+                                             std::true_type /* isFloat */)
+    {
+        if (GetCpuFeatures().IsSupported(CpuFeature::Fma)
+            && GetReassociationMode() != ReassociationMode::FastMath)
+        {
+            NodeBase* factor1;
+            NodeBase* factor2;
+
+            // Prefer the right operand as the product to fuse since the usual
+            // accumulation is Add(sum, Mul(weight, value)).
+            if (right.GetFactors(factor1, factor2))
+            {
+                return PlacementConstruct<FusedMultiplyAddNode<T>>(*this, left, right);
+            }
+            else if (left.GetFactors(factor1, factor2))
+            {
+                return PlacementConstruct<FusedMultiplyAddNode<T>>(*this, right, left);
+            }
+        }
+
+        return Associative<OpCode::Add>(left, right);
+    }
+
+
+    template <typename L, typename R>
+    Node<L>& ExpressionNodeFactory::Addition(Node<L>& left,
+                                             Node<R>& right,
+                                             std::false_type /* isFloat */)
+    {
+        return Associative<OpCode::Add>(left, right);
+    }
+
+
+    template <bool REMAINDER, typename T>
+    Node<T>& ExpressionNodeFactory::Division(Node<T>& left,
+                                             Node<T>& right,
+                                             std::true_type /* isFloat */)
+    {
+        static_assert(!REMAINDER, "Remainder is not supported for floating point values.");
+
+        return Binary<OpCode::Div>(left, right);
+    }
+
+
+    template <bool REMAINDER, typename T>
+    Node<T>& ExpressionNodeFactory::Division(Node<T>& left,
+                                             Node<T>& right,
+                                             std::false_type /* isFloat */)
+    {
+        return IntegerDivision<REMAINDER>(left,
+                                          right,
+                                          std::integral_constant<bool, (sizeof(T) < 4)>());
+    }
+
+
+    template <bool REMAINDER, typename T>
+    Node<T>& ExpressionNodeFactory::IntegerDivision(Node<T>& left,
+                                                    Node<T>& right,
+                                                    std::true_type /* isNarrow */)
+    {
+        // 8 and 16-bit values are divided as 32-bit values, see DivisionNode.
+        typedef typename std::conditional<std::is_signed<T>::value, int32_t, uint32_t>::type Wide;
+
+        auto & result = IntegerDivision<REMAINDER>(Cast<Wide>(left),
+                                                   Cast<Wide>(right),
+                                                   std::false_type());
+        return Cast<T>(result);
+    }
+
+
+    template <bool REMAINDER, typename T>
+    Node<T>& ExpressionNodeFactory::IntegerDivision(Node<T>& left,
+                                                    Node<T>& right,
+                                                    std::false_type /* isNarrow */)
+    {
+        return PlacementConstruct<DivisionNode<T, REMAINDER>>(*this, left, right);
+    }
+
+
+    template <bool REMAINDER, typename T>
+    Node<T>& ExpressionNodeFactory::DivisionImmediate(Node<T>& left,
+                                                      T right,
+                                                      std::true_type /* isNarrow */)
+    {
+        typedef typename std::conditional<std::is_signed<T>::value, int32_t, uint32_t>::type Wide;
+
+        auto & result = DivisionImmediate<REMAINDER>(Cast<Wide>(left),
+                                                     static_cast<Wide>(right),
+                                                     std::false_type());
+        return Cast<T>(result);
+    }
+
+
+    template <bool REMAINDER, typename T>
+    Node<T>& ExpressionNodeFactory::DivisionImmediate(Node<T>& left,
+                                                      T right,
+                                                      std::false_type /* isNarrow */)
+    {
+        LogThrowAssert(right != 0, "Division by zero");
+
+        Node<T>* result;
+
+        // The remainder of the division by 1 or -1 is zero. It's computed
+        // from left nevertheless, so that left remains referenced by the
+        // tree and is evaluated like any other dividend.
+        if (right == 1)
+        {
+            result = REMAINDER ? &And(left, Immediate<T>(0)) : &left;
+        }
+        else if (std::is_signed<T>::value && right == static_cast<T>(-1))
+        {
+            // Note: INT_MIN / -1 is undefined, neg leaves INT_MIN unchanged.
+            result = REMAINDER ? &And(left, Immediate<T>(0)) : &Neg(left);
+        }
+        else if (std::is_unsigned<T>::value
+                 && BitOp::GetNonZeroBitCount(static_cast<typename std::make_unsigned<T>::type>(right)) == 1)
+        {
+            // Note: not checking return value of GetLowestBitSet() as it's
+            // guaranteed to return an index when a bit is set.
+            unsigned bitIndex;
+            BitOp::GetLowestBitSet(right, &bitIndex);
+
+            result = REMAINDER
+                ? &And(left, Immediate<T>(right - 1))
+                : &Shr(left, static_cast<uint8_t>(bitIndex));
+        }
+        else
+        {
+            result = &PlacementConstruct<DivisionImmediateNode<T, REMAINDER>>(*this, left, right);
+        }
+
+        return *result;
+    }
+
+
+    template <OpCode OP, typename T>
+    Node<T>& ExpressionNodeFactory::BitCount(Node<T>& value, std::true_type /* isNarrow */)
+    {
+        static_assert(!std::is_same<T, bool>::value, "Bit counts require an integral value.");
+
+        typedef typename std::make_unsigned<T>::type Unsigned;
+
+        const uint32_t bitCount = sizeof(T) * 8;
+
+        // Zero extend the value to 32 bits and correct the counts for the
+        // extra zero bits: the leading ones are subtracted and a guard bit
+        // above the value stops the count of the trailing ones.
+        auto & wide = Cast<uint32_t>(Cast<Unsigned>(value));
+        Node<uint32_t>* result;
+
+        if (OP == OpCode::Lzcnt)
+        {
+            result = &Sub(BitCount<OP>(wide, std::false_type()),
+                          Immediate<uint32_t>(32 - bitCount));
+        }
+        else if (OP == OpCode::Tzcnt)
+        {
+            result = &BitCount<OP>(Or(wide, Immediate<uint32_t>(1u << bitCount)),
+                                   std::false_type());
+        }
+        else
+        {
+            result = &BitCount<OP>(wide, std::false_type());
+        }
+
+        return Cast<T>(*result);
+    }
+
+
+    template <OpCode OP, typename T>
+    Node<T>& ExpressionNodeFactory::BitCount(Node<T>& value, std::false_type /* isNarrow */)
+    {
+        return PlacementConstruct<BitCountNode<OP, T>>(*this, value);
+    }
+
+
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::BitExtract(Node<T>& value,
+                                               uint8_t start,
+                                               uint8_t length,
+                                               std::true_type /* isNarrow */)
+    {
+        typedef typename std::make_unsigned<T>::type Unsigned;
+
+        auto & wide = Cast<uint32_t>(Cast<Unsigned>(value));
+
+        return Cast<T>(BitExtract(wide, start, length, std::false_type()));
+    }
+
+
+    template <typename T>
+    Node<T>& ExpressionNodeFactory::BitExtract(Node<T>& value,
+                                               uint8_t start,
+                                               uint8_t length,
+                                               std::false_type /* isNarrow */)
+    {
+        return PlacementConstruct<BitExtractNode<T>>(*this, value, start, length);
+    }
+
+
+    template <OpCode OP, typename T>
+    Node<T>& ExpressionNodeFactory::ParallelBits(Node<T>& value,
+                                                 Node<T>& mask,
+                                                 std::true_type /* isNarrow */)
+    {
+        typedef typename std::make_unsigned<T>::type Unsigned;
+
+        auto & wide = ParallelBits<OP>(Cast<uint32_t>(Cast<Unsigned>(value)),
+                                       Cast<uint32_t>(Cast<Unsigned>(mask)),
+                                       std::false_type());
+        return Cast<T>(wide);
+    }
+
+
+    template <OpCode OP, typename T>
+    Node<T>& ExpressionNodeFactory::ParallelBits(Node<T>& value,
+                                                 Node<T>& mask,
+                                                 std::false_type /* isNarrow */)
+    {
+        return PlacementConstruct<ParallelBitsNode<OP, T>>(*this, value, mask);
+    }
 }
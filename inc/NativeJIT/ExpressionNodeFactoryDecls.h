@@ -24,11 +24,13 @@
 #pragma once
 
 #include <cstdint>
+#include <type_traits>
 
-#include "NativeJIT/CodeGen/X64CodeGenerator.h" // JccType.
+#include "NativeJIT/CodeGen/X64CodeGenerator.h" // JccType, PrefetchLocality.
 #include "NativeJIT/ExpressionTreeDecls.h"      // Base class.
 #include "NativeJIT/Model.h"                    // Parameter.
 #include "NativeJIT/Nodes/ImmediateNodeDecls.h" // Parameter too cumbersome to forward declare.
+#include "NativeJIT/Packed.h"                   // PackedUnderlyingType.
 
 
 namespace NativeJIT
@@ -43,6 +45,8 @@ namespace NativeJIT
 
     class ParameterSlotAllocator;
 
+    class TreeEnsemble;
+
     template <typename T>
     class ParameterNode;
 
@@ -102,12 +106,37 @@ namespace NativeJIT
         template <typename T> Node<T>& Dependent(Node<T>& dependentNode,
                                                  NodeBase& prerequisiteNode);
 
+        // Stores the value through the pointer and evaluates to the value. See
+        // StoreNode for the ordering of stores and loads.
+        template <typename T> Node<T>& Store(Node<T*>& pointer, Node<T>& value);
+
+        // Evaluates the first node, discards its value and evaluates to the
+        // second node. Used to order side effects such as Store().
+        template <typename T1, typename T2> Node<T2>& Sequence(Node<T1>& first, Node<T2>& second);
+
+        // Evaluates to the pointer and prefetches the cache line it points
+        // to. Combine with Sequence() to prefetch data that a later call
+        // will use, f. ex. the next document.
+        template <typename T>
+        Node<T*>& Prefetch(Node<T*>& pointer,
+                           PrefetchLocality locality = PrefetchLocality::AllLevels);
+
         template <typename T> NodeBase& Return(Node<T>& value);
 
 
         //
         // Binary arithmetic operators
         //
+
+        // When the CPU features of the tree include CpuFeature::Fma at the
+        // time of the call, the floating point addition of a product created
+        // by Mul() is fused into a single multiply-add instruction. The fused
+        // result is rounded once, so it may differ from the separate
+        // operations in the last bit.
+        //
+        // Add(), And(), Mul(), Or() and Xor() build an AssociativeNode
+        // instead of a BinaryNode if enabled by the reassociation mode of
+        // the tree.
         template <typename L, typename R> Node<L>& Add(Node<L>& left, Node<R>& right);
         template <typename L, typename R> Node<L>& And(Node<L>& left, Node<R>& right);
         template <typename L, typename R> Node<L>& Mul(Node<L>& left, Node<R>& right);
@@ -117,12 +146,54 @@ namespace NativeJIT
         template <typename L, typename R> Node<L>& Shl(Node<L>& left, R right);
         template <typename L, typename R> Node<L>& Shr(Node<L>& left, R right);
         template <typename L, typename R> Node<L>& Sub(Node<L>& left, Node<R>& right);
+        template <typename L, typename R> Node<L>& Xor(Node<L>& left, Node<R>& right);
+
+        // Integer division and remainder truncate towards zero like the C++
+        // operators and have the same preconditions: the divisor must not be
+        // zero and the quotient must be representable. Mod is not available
+        // for floating point values.
+        template <typename T> Node<T>& Div(Node<T>& left, Node<T>& right);
+        template <typename T> Node<T>& Mod(Node<T>& left, Node<T>& right);
+
+        // Division by a constant is turned into shifts and multiplications.
+        template <typename L, typename R> Node<L>& DivImmediate(Node<L>& left, R right);
+        template <typename L, typename R> Node<L>& ModImmediate(Node<L>& left, R right);
 
         template <typename T, size_t SIZE, typename INDEX>
         Node<T*>& Add(Node<T(*)[SIZE]>& array, Node<INDEX>& index);
 
         template <typename T, typename INDEX> Node<T*>& Add(Node<T*>& array, Node<INDEX>& index);
 
+        //
+        // Unary arithmetic operators
+        //
+        template <typename T> Node<T>& Neg(Node<T>& value);
+        template <typename T> Node<T>& Not(Node<T>& value);
+
+        //
+        // Bit manipulation
+        //
+        // The operations use popcnt, lzcnt, tzcnt (BMI1), bextr (BMI1), pdep
+        // and pext (BMI2) when the CpuFeatures of the code generator allow
+        // it and fall back to the baseline x64 instructions otherwise.
+        // 8 and 16-bit values are zero extended to 32 bits.
+
+        // The number of set bits and of the leading and trailing zero bits.
+        // The counts of the zero bits are the size of T in bits for zero.
+        template <typename T> Node<T>& Popcnt(Node<T>& value);
+        template <typename T> Node<T>& Lzcnt(Node<T>& value);
+        template <typename T> Node<T>& Tzcnt(Node<T>& value);
+
+        // Returns the length bits starting at the start bit, zero extended.
+        // The field is truncated at the most significant bit of T.
+        template <typename T> Node<T>& Bextr(Node<T>& value, uint8_t start, uint8_t length);
+
+        // Pdep deposits the low bits of the value at the positions of the set
+        // bits of the mask, pext gathers the bits of the value at these
+        // positions into the low bits of the result.
+        template <typename T> Node<T>& Pdep(Node<T>& value, Node<T>& mask);
+        template <typename T> Node<T>& Pext(Node<T>& value, Node<T>& mask);
+
         //
         // Ternary arithmetic operators
         template <typename T>
@@ -133,6 +204,42 @@ namespace NativeJIT
         //
         template <typename PACKED> Node<float>& ApplyModel(Node<Model<PACKED>*>& model, Node<PACKED>& packed);
 
+        // The quantized entry is dequantized inline: zero extended, converted
+        // to float, then scaled and offset with a fused multiply-add if the
+        // CpuFeatures of the tree allow it.
+        template <typename PACKED, typename ENTRY>
+        Node<float>& ApplyModel(Node<QuantizedModel<PACKED, ENTRY>*>& model, Node<PACKED>& packed);
+
+        template <typename PACKED, HalfFormat FORMAT>
+        Node<float>& ApplyModel(Node<HalfModel<PACKED, FORMAT>*>& model, Node<PACKED>& packed);
+
+        // Converts a 16-bit floating point encoding to float (see
+        // HalfToFloatNode). Without F16C, IEEE halves are converted by a call
+        // to HalfPrecision<HalfFormat::Half>::ToFloat().
+        template <HalfFormat FORMAT> Node<float>& HalfToFloat(Node<uint16_t>& value);
+
+
+        //
+        // Decision tree ensembles.
+        //
+
+        // Returns the sum of the leaves the features reach in the trees of
+        // the ensemble, compiled into branches by TreeEnsembleNode. The
+        // features array must have at least ensemble.GetFeatureCount()
+        // entries.
+        Node<float>& EvaluateEnsemble(Node<float const *>& features, TreeEnsemble const & ensemble);
+
+        // Returns the sum of the model's entries for the keys. Each group of
+        // up to eight keys is looked up with a single AVX2 gather if the
+        // CpuFeatures of the tree allow it and with scalar loads otherwise.
+        // Both add the entries of a group in the same order (see
+        // ModelGatherNode), so the result doesn't depend on the instruction
+        // set.
+        template <typename PACKED>
+        Node<float>& ApplyModelSum(Node<Model<PACKED>*>& model,
+                                   Node<PACKED>* const * keys,
+                                   unsigned keyCount);
+
 
         //
         // Relational operators
@@ -148,8 +255,13 @@ namespace NativeJIT
         // WARNING: Both trueValue and falseValue are evaluated before testing the
         // condition so both must be legal to evaluate regardless of the result
         // of the condition. See the TODO note in ConditionalNode::CodeGenValue.
+        // Unless there is a branch profile, the hint moves the code for the
+        // unlikely value into a cold block at the end of the function.
         template <typename T, JccType JCC>
-        Node<T>& Conditional(FlagExpressionNode<JCC>& condition, Node<T>& trueValue, Node<T>& falseValue);
+        Node<T>& Conditional(FlagExpressionNode<JCC>& condition,
+                             Node<T>& trueValue,
+                             Node<T>& falseValue,
+                             BranchHint hint = BranchHint::None);
 
         // WARNING: Both trueValue and falseValue are evaluated before testing the
         // condition so both must be legal to evaluate regardless of the result
@@ -199,8 +311,89 @@ namespace NativeJIT
         template <typename PACKED>
         Node<PACKED>& PackedMin(Node<PACKED>& left, Node<PACKED>& right);
 
+        // Returns the component at INDEX, counting from the leftmost one (see
+        // Packed::FromComponents()). Lowers to a single bextr with BMI1, the
+        // rightmost component to a single and. A component extracted from
+        // the result of PackedWithComponent() is taken from the inserted
+        // value (or, for another index, from the original packed) without
+        // evaluating the insertion.
+        template <unsigned INDEX, typename PACKED>
+        Node<PackedUnderlyingType>& PackedComponent(Node<PACKED>& packed);
+
+        // Returns the packed with the component at INDEX replaced by the low
+        // bits of the value (see PackedInsertNode). Replacing the same
+        // component twice in a row skips the first replacement.
+        template <unsigned INDEX, typename PACKED>
+        Node<PACKED>& PackedWithComponent(Node<PACKED>& packed, Node<PackedUnderlyingType>& value);
+
     private:
         template <OpCode OP, typename L, typename R> Node<L>& Binary(Node<L>& left, Node<R>& right);
         template <OpCode OP, typename L, typename R> Node<L>& BinaryImmediate(Node<L>& left, R right);
+
+        // Builds an AssociativeNode if the reassociation mode of the tree
+        // allows it for the operand type or a BinaryNode otherwise.
+        template <OpCode OP, typename L, typename R>
+        Node<L>& Associative(Node<L>& left, Node<R>& right);
+
+        template <OpCode OP, typename T>
+        Node<T>& Associative(Node<T>& left, Node<T>& right, std::true_type /* isSameType */);
+
+        template <OpCode OP, typename L, typename R>
+        Node<L>& Associative(Node<L>& left, Node<R>& right, std::false_type /* isSameType */);
+
+        // Addition helpers, dispatched on whether the operands are floating
+        // point values of the same type, which makes them candidates for
+        // the fused multiply-add.
+        template <typename T>
+        Node<T>& Addition(Node<T>& left, Node<T>& right, std::true_type /* isFloat */);
+
+        template <typename L, typename R>
+        Node<L>& Addition(Node<L>& left, Node<R>& right, std::false_type /* isFloat */);
+
+        // The scalar replacement of ModelGatherNode for up to eight keys.
+        template <typename PACKED>
+        Node<float>& ApplyModelPairwise(Node<Model<PACKED>*>& model,
+                                        Node<PACKED>* const * keys,
+                                        unsigned keyCount);
+
+        // Division helpers, dispatched on whether T is a floating point type
+        // and, for integers, on whether it is narrower than 32 bits.
+        template <bool REMAINDER, typename T>
+        Node<T>& Division(Node<T>& left, Node<T>& right, std::true_type /* isFloat */);
+
+        template <bool REMAINDER, typename T>
+        Node<T>& Division(Node<T>& left, Node<T>& right, std::false_type /* isFloat */);
+
+        template <bool REMAINDER, typename T>
+        Node<T>& IntegerDivision(Node<T>& left, Node<T>& right, std::true_type /* isNarrow */);
+
+        template <bool REMAINDER, typename T>
+        Node<T>& IntegerDivision(Node<T>& left, Node<T>& right, std::false_type /* isNarrow */);
+
+        template <bool REMAINDER, typename T>
+        Node<T>& DivisionImmediate(Node<T>& left, T right, std::true_type /* isNarrow */);
+
+        template <bool REMAINDER, typename T>
+        Node<T>& DivisionImmediate(Node<T>& left, T right, std::false_type /* isNarrow */);
+
+        // Bit manipulation helpers, dispatched on whether T is narrower than
+        // 32 bits.
+        template <OpCode OP, typename T>
+        Node<T>& BitCount(Node<T>& value, std::true_type /* isNarrow */);
+
+        template <OpCode OP, typename T>
+        Node<T>& BitCount(Node<T>& value, std::false_type /* isNarrow */);
+
+        template <typename T>
+        Node<T>& BitExtract(Node<T>& value, uint8_t start, uint8_t length, std::true_type /* isNarrow */);
+
+        template <typename T>
+        Node<T>& BitExtract(Node<T>& value, uint8_t start, uint8_t length, std::false_type /* isNarrow */);
+
+        template <OpCode OP, typename T>
+        Node<T>& ParallelBits(Node<T>& value, Node<T>& mask, std::true_type /* isNarrow */);
+
+        template <OpCode OP, typename T>
+        Node<T>& ParallelBits(Node<T>& value, Node<T>& mask, std::false_type /* isNarrow */);
     };
 }
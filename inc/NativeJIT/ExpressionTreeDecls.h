@@ -24,12 +24,16 @@
 #pragma once
 
 #include <array>                // For arrays in FreeList.
+#include <chrono>               // For CompileBudget.
 #include <cstdint>
 #include <iosfwd>               // For debugging output.
 
 #include "NativeJIT/AllocatorVector.h"                  // Embedded member.
+#include "NativeJIT/BranchProfile.h"                    // BranchLayout and BranchProfileMode used as values.
+#include "NativeJIT/CodeGen/CpuFeatures.h"              // Embedded member.
 #include "NativeJIT/CodeGen/JumpTable.h"                // ExpressionTree embeds Label.
 #include "NativeJIT/CodeGen/Register.h"
+#include "NativeJIT/ConstantPool.h"                     // Embedded member.
 #include "NativeJIT/TypePredicates.h"                   // RegisterStorage used in typedef.
 #include "Temporary/NonCopyable.h"
 
@@ -42,6 +46,7 @@ namespace Allocators
 
 namespace NativeJIT
 {
+    class Bytecode;
     class ExecutionPreconditionTest;
     class FunctionBuffer;
     class NodeBase;
@@ -88,6 +93,64 @@ namespace NativeJIT
 
     enum class StorageClass {Direct, Indirect, Immediate};
 
+
+    // Specifies which chains of associative operations (Add, Mul, And, Or
+    // and Xor) ExpressionNodeFactory rebalances into trees of logarithmic
+    // depth, see AssociativeNode.
+    enum class ReassociationMode
+    {
+        // The operations are evaluated in the order the tree was built in.
+        Disabled,
+
+        // Integer operations are rebalanced. The result doesn't change since
+        // they wrap around like in the unbalanced order.
+        Integer,
+
+        // Floating point additions and multiplications are rebalanced as
+        // well. Like with the fast-math options of the compilers, the
+        // result may differ due to the different rounding of the partial
+        // results. Takes precedence over the fused multiply-add.
+        FastMath
+    };
+
+
+    // Describes how much code generation Compile() performed, see
+    // CompileBudget.
+    enum class CompilationTier
+    {
+        // The function was compiled with all optimizations.
+        Optimized,
+
+        // The function was compiled without the optional optimizations: the
+        // short jumps and the code alignment padding.
+        Baseline,
+
+        // The function was not compiled and has no entry point. The caller
+        // needs to fall back to another way of evaluating the expression,
+        // f. ex. to the bytecode interpreter.
+        NotCompiled
+    };
+
+
+    // Limits the node count and the duration of Compile(). When the soft
+    // limits are exceeded, the function is compiled in the Baseline tier.
+    // When the hard limits are exceeded, the compilation is abandoned. The
+    // node count is checked up front. The duration is checked between the
+    // passes and between the common subexpressions, so the compilation may
+    // run over the limit by the time it takes to compile the largest
+    // subexpression. The default budget is unlimited.
+    struct CompileBudget
+    {
+        CompileBudget();
+
+        unsigned m_baselineNodeCount;
+        std::chrono::microseconds m_baselineDuration;
+
+        unsigned m_maxNodeCount;
+        std::chrono::microseconds m_maxDuration;
+    };
+
+
     class ExpressionTree : public NonCopyable
     {
     private:
@@ -127,9 +190,87 @@ namespace NativeJIT
         void AddParameter(NodeBase& parameter, unsigned position);
 
         void AddRIPRelative(RIPRelativeImmediate& node);
+
+        // Adds a constant to the pool which is placed in front of the
+        // compiled function (see ConstantPool). Called by the
+        // RIPRelativeImmediate nodes from EmitStaticData(). The code buffer
+        // offset of the constant is stored into offset by the end of pass 0.
+        void AddConstant(void const * data,
+                         unsigned size,
+                         unsigned alignment,
+                         bool isAddress,
+                         int32_t& offset);
+        ConstantPool const & GetConstantPool() const;
+
+        // Records that the eight bytes at the offset in the code buffer hold
+        // an absolute address, which needs to be relocated if the compiled
+        // code is loaded into another process (see ObjectFile).
+        void AddAbsoluteAddress(unsigned offset);
+        AllocatorVector<unsigned> const & GetAbsoluteAddresses() const;
         void ReportFunctionCallNode(unsigned parameterCount);
+
+        // Associates a branch profile with the tree. With
+        // BranchProfileMode::Instrument, the compiled code counts the outcomes
+        // of conditional nodes and precondition tests in the profile. With
+        // BranchProfileMode::Optimize, the counts collected by an instrumented
+        // build of an identically constructed tree are used to lay out the
+        // branches and to order the precondition tests. Must be called before
+        // Compile().
+        void SetBranchProfile(BranchProfile& profile, BranchProfileMode mode);
+
+        // The instruction set extensions which the nodes may use when they are
+        // compiled. Defaults to the features of the code generator, i.e. to the
+        // host processor, so that the same binary generates the best code the
+        // processor supports. Restricting the set allows generating code for
+        // an older processor. Must be called before creating the nodes since
+        // some of the choices are made during construction (see
+        // ExpressionNodeFactory::Add()).
+        CpuFeatures const & GetCpuFeatures() const;
+        void SetCpuFeatures(CpuFeatures const & features);
+
+        // Opt-in rebalancing of long chains of associative operations, which
+        // exposes instruction level parallelism in f. ex. sums of hundreds of
+        // terms. Defaults to ReassociationMode::Disabled. Like CPU features,
+        // must be set before creating the nodes.
+        ReassociationMode GetReassociationMode() const;
+        void SetReassociationMode(ReassociationMode mode);
+
+        // The budget for the subsequent calls to Compile() and the tier of
+        // the most recent one. The tier is Optimized before the first call.
+        CompileBudget const & GetCompileBudget() const;
+        void SetCompileBudget(CompileBudget const & budget);
+        CompilationTier GetCompilationTier() const;
+
+        // Compiles the tree. If the compilation exceeds the hard limit of the
+        // compile budget, the code buffer is reset and the tree can't be
+        // compiled again. Lower() the tree beforehand if the bytecode is the
+        // fallback.
         void Compile();
 
+        // Lowers the precondition tests and the expression into bytecode which
+        // evaluates to the same value as the compiled function. Unlike
+        // Compile(), doesn't modify the state of the nodes, so it can be called
+        // before the tree is compiled.
+        void Lower(Bytecode& code, NodeBase& expression);
+
+        //
+        // Profile-guided code generation.
+        //
+
+        // Return the counters which the code generated for the node or for the
+        // precondition test needs to update or nullptr if the tree is not
+        // being instrumented.
+        BranchCounts* GetInstrumentationCounts(NodeBase const & node);
+        BranchCounts* GetInstrumentationCounts(ExecutionPreconditionTest const & test);
+
+        // Returns the preferred layout of the branch generated by the node
+        // based on the profile. Returns BranchLayout::Default if the tree
+        // is not compiled with profile feedback.
+        BranchLayout GetBranchLayout(NodeBase const & node) const;
+
+        // Returns true if the code updates the counters of a branch profile.
+        bool IsInstrumented() const;
+
         //
         // Storage allocation.
         //
@@ -305,9 +446,22 @@ namespace NativeJIT
         // parameter. Returns false otherwise.
         bool TemporaryOffsetToSlot(int32_t temporaryOffset, unsigned& temporarySlot);
 
+        // Fills in m_preconditionOrder so that the tests which fail most
+        // often according to the profile are evaluated first. A test can
+        // only move ahead of another if it is marked as independent and both
+        // return the same value.
+        void OrderPreconditionTestsByProfile();
+
+        // Returns true if Compile() has been running for at least the
+        // duration.
+        bool HasCompileTimeExceeded(std::chrono::microseconds duration) const;
+
         void Pass0();
         void Pass1();
-        void Pass2();
+
+        // Returns false if the compilation has exceeded the hard time limit.
+        bool Pass2();
+
         void Pass3();
         void Print() const;
 
@@ -326,18 +480,41 @@ namespace NativeJIT
 
         FunctionBuffer & m_code;
 
+        // See SetCpuFeatures() and SetReassociationMode().
+        CpuFeatures m_cpuFeatures;
+        ReassociationMode m_reassociationMode;
+
+        // See SetCompileBudget(). The start time of the current Compile().
+        CompileBudget m_compileBudget;
+        CompilationTier m_compilationTier;
+        std::chrono::steady_clock::time_point m_compileStartTime;
+
         // Stream used to print diagnostics or nullptr if disabled.
         std::ostream* m_diagnosticsStream;
 
         AllocatorVector<NodeBase*> m_topologicalSort;
         AllocatorVector<NodeBase*> m_parameters;
         AllocatorVector<RIPRelativeImmediate*> m_ripRelatives;
+        ConstantPool m_constantPool;
+
+        // Code buffer offsets of the absolute addresses in the compiled code.
+        AllocatorVector<unsigned> m_absoluteAddresses;
 
         // Preconditions for evaluating the whole expression. The preconditions
         // are evaluated right after the parameters and will cause the function
         // to return early if any of them is not met.
         AllocatorVector<ExecutionPreconditionTest*> m_preconditionTests;
 
+        // Positions in m_preconditionTests in the order in which the tests
+        // are evaluated by the compiled code. m_preconditionTests itself keeps
+        // the order in which the tests were added since the profile counters
+        // are indexed by that position.
+        AllocatorVector<unsigned> m_preconditionOrder;
+
+        // Optional branch profile and the way it's used. See SetBranchProfile().
+        BranchProfile* m_branchProfile;
+        BranchProfileMode m_branchProfileMode;
+
         FreeList<RegisterBase::c_maxIntegerRegisterID + 1, false> m_rxxFreeList;
         FreeList<RegisterBase::c_maxFloatRegisterID + 1, true> m_xmmFreeList;
 
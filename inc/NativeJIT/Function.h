@@ -36,9 +36,15 @@ namespace NativeJIT
     public:
         FunctionBase(Allocators::IAllocator& allocator, FunctionBuffer& code);
 
+        // The hint tells how likely the condition is to be satisfied, i.e.
+        // for the function to continue past the statement. See
+        // ExecuteOnlyIfStatement. The order tells whether a branch profile
+        // may move the test ahead of the tests added before it.
         template <JccType JCC>
         void AddExecuteOnlyIfStatement(FlagExpressionNode<JCC>& condition,
-                                       ImmediateNode<R>& otherwiseValue);
+                                       ImmediateNode<R>& otherwiseValue,
+                                       BranchHint hint = BranchHint::None,
+                                       PreconditionOrder order = PreconditionOrder::Fixed);
 
     private:
         Allocators::IAllocator& m_allocator;
@@ -165,9 +171,14 @@ namespace NativeJIT
     template <typename R>
     template <JccType JCC>
     void FunctionBase<R>::AddExecuteOnlyIfStatement(FlagExpressionNode<JCC>& condition,
-                                                    ImmediateNode<R>& otherwiseValue)
-    {
-        auto & test = PlacementConstruct<ExecuteOnlyIfStatement<R, JCC>>(condition, otherwiseValue);
+                                                    ImmediateNode<R>& otherwiseValue,
+                                                    BranchHint hint,
+                                                    PreconditionOrder order)
+    {
+        auto & test = PlacementConstruct<ExecuteOnlyIfStatement<R, JCC>>(condition,
+                                                                          otherwiseValue,
+                                                                          hint,
+                                                                          order);
 
         AddExecutionPreconditionTest(test);
     }
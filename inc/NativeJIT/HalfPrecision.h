@@ -0,0 +1,191 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>      // For memcpy.
+
+
+namespace NativeJIT
+{
+    // The 16-bit floating point formats. Half is the IEEE 754 binary16 format
+    // with 5 exponent and 10 mantissa bits, BFloat16 is the upper half of a
+    // float, i.e. 8 exponent and 7 mantissa bits.
+    enum class HalfFormat
+    {
+        Half,
+        BFloat16
+    };
+
+
+    // Converts between the 16-bit formats and float.
+    template <HalfFormat FORMAT>
+    struct HalfPrecision
+    {
+        // Returns the float with the value of the 16-bit encoding. The
+        // conversion is exact.
+        static float ToFloat(uint16_t bits);
+
+        // Returns the encoding closest to the value, ties rounded to even.
+        // Values beyond the range of the format become infinities.
+        static uint16_t FromFloat(float value);
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for HalfPrecision
+    //
+    //*************************************************************************
+    template <>
+    inline float HalfPrecision<HalfFormat::Half>::ToFloat(uint16_t bits)
+    {
+        const uint32_t sign = static_cast<uint32_t>(bits & 0x8000) << 16;
+        const uint32_t exponent = (bits >> 10) & 0x1f;
+        uint32_t mantissa = bits & 0x3ff;
+        uint32_t result;
+
+        if (exponent == 0x1f)
+        {
+            // Infinity or NaN, the NaN payload is preserved.
+            result = sign | 0x7f800000 | (mantissa << 13);
+        }
+        else if (exponent != 0)
+        {
+            // Normal value, the exponent bias changes from 15 to 127.
+            result = sign | ((exponent + 112) << 23) | (mantissa << 13);
+        }
+        else if (mantissa == 0)
+        {
+            result = sign;
+        }
+        else
+        {
+            // Subnormal value, mantissa * 2^-24, becomes a normal float.
+            uint32_t floatExponent = 113;
+
+            while ((mantissa & 0x400) == 0)
+            {
+                mantissa <<= 1;
+                --floatExponent;
+            }
+
+            result = sign | (floatExponent << 23) | ((mantissa & 0x3ff) << 13);
+        }
+
+        float value;
+        memcpy(&value, &result, sizeof(value));
+
+        return value;
+    }
+
+
+    template <>
+    inline uint16_t HalfPrecision<HalfFormat::Half>::FromFloat(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+
+        const uint32_t sign = (bits >> 16) & 0x8000;
+        const uint32_t magnitude = bits & 0x7fffffff;
+        uint32_t result;
+
+        if (magnitude >= 0x7f800000)
+        {
+            // Infinity or NaN, which is kept quiet.
+            result = 0x7c00 | (magnitude > 0x7f800000 ? 0x200 | ((magnitude >> 13) & 0x3ff) : 0);
+        }
+        else if (magnitude >= 0x477ff000)
+        {
+            // 65520 and above round to infinity.
+            result = 0x7c00;
+        }
+        else if (magnitude >= 0x38800000)
+        {
+            // Normal value: rebias the exponent and round off 13 bits. A
+            // carry out of the mantissa correctly increments the exponent.
+            result = (magnitude - 0x38000000) >> 13;
+
+            const uint32_t remainder = magnitude & 0x1fff;
+
+            if (remainder > 0x1000 || (remainder == 0x1000 && (result & 1) != 0))
+            {
+                ++result;
+            }
+        }
+        else if (magnitude > 0x33000000)
+        {
+            // Subnormal value in units of 2^-24. Values up to 2^-25 round
+            // to zero.
+            const uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+            const uint32_t shift = 126 - (magnitude >> 23);
+            const uint32_t remainder = mantissa & ((1u << shift) - 1);
+            const uint32_t halfway = 1u << (shift - 1);
+
+            result = mantissa >> shift;
+
+            if (remainder > halfway || (remainder == halfway && (result & 1) != 0))
+            {
+                ++result;
+            }
+        }
+        else
+        {
+            result = 0;
+        }
+
+        return static_cast<uint16_t>(sign | result);
+    }
+
+
+    template <>
+    inline float HalfPrecision<HalfFormat::BFloat16>::ToFloat(uint16_t bits)
+    {
+        const uint32_t result = static_cast<uint32_t>(bits) << 16;
+
+        float value;
+        memcpy(&value, &result, sizeof(value));
+
+        return value;
+    }
+
+
+    template <>
+    inline uint16_t HalfPrecision<HalfFormat::BFloat16>::FromFloat(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+
+        if ((bits & 0x7fffffff) > 0x7f800000)
+        {
+            // Rounding could turn a NaN into an infinity, so it's truncated
+            // and kept quiet instead.
+            return static_cast<uint16_t>((bits >> 16) | 0x40);
+        }
+
+        // Round to nearest, ties to even. Values which round beyond the
+        // largest finite value carry into the exponent and become infinity.
+        return static_cast<uint16_t>((bits + 0x7fff + ((bits >> 16) & 1)) >> 16);
+    }
+}
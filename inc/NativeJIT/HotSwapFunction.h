@@ -0,0 +1,145 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <mutex>
+
+#include "NativeJIT/CodeGen/CodeEpochs.h"
+#include "NativeJIT/CodeGen/Trampoline.h"
+#include "NativeJIT/Function.h"
+#include "Temporary/NonCopyable.h"
+
+
+namespace NativeJIT
+{
+    // HotSwapFunction publishes a compiled function through a Trampoline so
+    // that it can be replaced, for example by a version recompiled on a
+    // background thread, while other threads are calling it.
+    //
+    // GetEntryPoint() returns the address of the trampoline, which remains
+    // valid for the lifetime of the HotSwapFunction. The calls made through
+    // operator() are guarded, so Swap() can tell when the replaced code is no
+    // longer running and return it for reuse. Callers which cache the entry
+    // point must make the calls within the lifetime of a Guard for the same
+    // to hold for them.
+    template <typename R, typename P1 = void, typename P2 = void, typename P3 = void, typename P4 = void>
+    class HotSwapFunction : public NonCopyable
+    {
+    public:
+        typedef typename Function<R, P1, P2, P3, P4>::FunctionType FunctionType;
+
+        // Marks the calling thread as possibly running the published code.
+        class Guard : public CodeEpochs::Guard
+        {
+        public:
+            Guard(HotSwapFunction& function);
+        };
+
+        // The trampoline is allocated from the code allocator, which must
+        // provide executable memory such as ExecutionBuffer.
+        HotSwapFunction(Allocators::IAllocator& codeAllocator,
+                        FunctionType entryPoint);
+
+        // Returns the stable entry point.
+        FunctionType GetEntryPoint() const;
+
+        // Returns the currently published code.
+        FunctionType GetTarget() const;
+
+        template <typename... ARGS>
+        R operator()(ARGS... args);
+
+        // Makes the subsequent calls run the new code. Waits for the calls
+        // which may still run the replaced code to return and then returns
+        // the replaced code, whose memory can then be reused. Must not be
+        // called from within a call to the function or a Guard.
+        FunctionType Swap(FunctionType entryPoint);
+
+    private:
+        Trampoline m_trampoline;
+        CodeEpochs m_epochs;
+
+        // Serializes the calls to Swap().
+        std::mutex m_swapLock;
+    };
+
+
+    //*************************************************************************
+    //
+    // HotSwapFunction template definitions.
+    //
+    //*************************************************************************
+    template <typename R, typename P1, typename P2, typename P3, typename P4>
+    HotSwapFunction<R, P1, P2, P3, P4>::Guard::Guard(HotSwapFunction& function)
+        : CodeEpochs::Guard(function.m_epochs)
+    {
+    }
+
+
+    template <typename R, typename P1, typename P2, typename P3, typename P4>
+    HotSwapFunction<R, P1, P2, P3, P4>::HotSwapFunction(Allocators::IAllocator& codeAllocator,
+                                                        FunctionType entryPoint)
+        : m_trampoline(codeAllocator, reinterpret_cast<void const *>(entryPoint))
+    {
+    }
+
+
+    template <typename R, typename P1, typename P2, typename P3, typename P4>
+    typename HotSwapFunction<R, P1, P2, P3, P4>::FunctionType
+    HotSwapFunction<R, P1, P2, P3, P4>::GetEntryPoint() const
+    {
+        return reinterpret_cast<FunctionType>(const_cast<void*>(m_trampoline.GetEntryPoint()));
+    }
+
+
+    template <typename R, typename P1, typename P2, typename P3, typename P4>
+    typename HotSwapFunction<R, P1, P2, P3, P4>::FunctionType
+    HotSwapFunction<R, P1, P2, P3, P4>::GetTarget() const
+    {
+        return reinterpret_cast<FunctionType>(const_cast<void*>(m_trampoline.GetTarget()));
+    }
+
+
+    template <typename R, typename P1, typename P2, typename P3, typename P4>
+    template <typename... ARGS>
+    R HotSwapFunction<R, P1, P2, P3, P4>::operator()(ARGS... args)
+    {
+        Guard guard(*this);
+
+        return GetEntryPoint()(args...);
+    }
+
+
+    template <typename R, typename P1, typename P2, typename P3, typename P4>
+    typename HotSwapFunction<R, P1, P2, P3, P4>::FunctionType
+    HotSwapFunction<R, P1, P2, P3, P4>::Swap(FunctionType entryPoint)
+    {
+        std::lock_guard<std::mutex> lock(m_swapLock);
+
+        void const * replaced = m_trampoline.Exchange(reinterpret_cast<void const *>(entryPoint));
+        m_epochs.Synchronize();
+
+        return reinterpret_cast<FunctionType>(const_cast<void*>(replaced));
+    }
+}
@@ -23,8 +23,13 @@
 
 #pragma once
 
+#include <cmath>                    // For std::lround.
+#include <cstdint>
+#include <limits>
 #include <type_traits>
 
+#include "NativeJIT/HalfPrecision.h"
+
 
 namespace NativeJIT
 {
@@ -52,6 +57,69 @@ namespace NativeJIT
     };
 
 
+    // A Model with entries quantized to 8 or 16 bits. The value of an entry
+    // is m_offset + m_scale * m_data[index], so the table takes a fourth or
+    // a half of the space of the float Model. The generated code computes
+    // the value with a fused multiply-add if the CpuFeatures allow it, which
+    // may differ from Apply() in the last bit.
+    template <typename PACKED, typename ENTRY>
+    class QuantizedModel
+    {
+    public:
+        static_assert(std::is_same<ENTRY, uint8_t>::value || std::is_same<ENTRY, uint16_t>::value,
+                      "The entries must be uint8_t or uint16_t.");
+
+        typedef PACKED PackedType;
+        typedef ENTRY EntryType;
+
+        // Sets all the entries to zero, the scale to 1 and the offset to 0.
+        QuantizedModel();
+
+        float Apply(PACKED packed) const;
+
+        // Sets the entry closest to the value given the current scale and
+        // offset, clamped to the range of ENTRY.
+        void Set(unsigned index, float value);
+
+        ENTRY& operator[](unsigned index);
+        ENTRY const & operator[](unsigned index) const;
+
+        // The fields must be public or friend of NativeJIT::ExpressionNodeFactory.
+        // Otherwise the JIT compiler cannot access them.
+
+        float m_scale;
+        float m_offset;
+
+        static const unsigned c_size = 1 << PACKED::c_totalBitCount;
+        ENTRY m_data[c_size];
+    };
+
+
+    // A Model with 16-bit floating point entries, see HalfFormat.
+    template <typename PACKED, HalfFormat FORMAT = HalfFormat::Half>
+    class HalfModel
+    {
+    public:
+        typedef PACKED PackedType;
+
+        HalfModel();
+
+        float Apply(PACKED packed) const;
+
+        // Sets the entry to the encoding closest to the value.
+        void Set(unsigned index, float value);
+
+        uint16_t& operator[](unsigned index);
+        uint16_t const & operator[](unsigned index) const;
+
+        // m_data must be public or friend of NativeJIT::ExpressionNodeFactory.
+        // Otherwise the JIT compiler cannot access m_data.
+
+        static const unsigned c_size = 1 << PACKED::c_totalBitCount;
+        uint16_t m_data[c_size];
+    };
+
+
     //*************************************************************************
     //
     // Template definitions for Model<PACKED>
@@ -97,4 +165,89 @@ namespace NativeJIT
     {
         return m_data[packed.m_bits];
     }
+
+
+    //*************************************************************************
+    //
+    // Template definitions for QuantizedModel<PACKED, ENTRY>
+    //
+    //*************************************************************************
+    template <typename PACKED, typename ENTRY>
+    QuantizedModel<PACKED, ENTRY>::QuantizedModel()
+        : m_scale(1),
+          m_offset(0),
+          m_data()
+    {
+    }
+
+
+    template <typename PACKED, typename ENTRY>
+    float QuantizedModel<PACKED, ENTRY>::Apply(PACKED packed) const
+    {
+        return m_offset + m_scale * static_cast<float>(m_data[packed.m_bits]);
+    }
+
+
+    template <typename PACKED, typename ENTRY>
+    void QuantizedModel<PACKED, ENTRY>::Set(unsigned index, float value)
+    {
+        const long entry = std::lround((value - m_offset) / m_scale);
+        const long maxEntry = std::numeric_limits<ENTRY>::max();
+
+        m_data[index] = static_cast<ENTRY>(entry < 0 ? 0 : (entry > maxEntry ? maxEntry : entry));
+    }
+
+
+    template <typename PACKED, typename ENTRY>
+    ENTRY& QuantizedModel<PACKED, ENTRY>::operator[](unsigned index)
+    {
+        return m_data[index];
+    }
+
+
+    template <typename PACKED, typename ENTRY>
+    ENTRY const & QuantizedModel<PACKED, ENTRY>::operator[](unsigned index) const
+    {
+        return m_data[index];
+    }
+
+
+    //*************************************************************************
+    //
+    // Template definitions for HalfModel<PACKED, FORMAT>
+    //
+    //*************************************************************************
+    template <typename PACKED, HalfFormat FORMAT>
+    HalfModel<PACKED, FORMAT>::HalfModel()
+        : m_data()
+    {
+    }
+
+
+    template <typename PACKED, HalfFormat FORMAT>
+    float HalfModel<PACKED, FORMAT>::Apply(PACKED packed) const
+    {
+        return HalfPrecision<FORMAT>::ToFloat(m_data[packed.m_bits]);
+    }
+
+
+    template <typename PACKED, HalfFormat FORMAT>
+    void HalfModel<PACKED, FORMAT>::Set(unsigned index, float value)
+    {
+        m_data[index] = HalfPrecision<FORMAT>::FromFloat(value);
+    }
+
+
+    template <typename PACKED, HalfFormat FORMAT>
+    uint16_t& HalfModel<PACKED, FORMAT>::operator[](unsigned index)
+    {
+        return m_data[index];
+    }
+
+
+    template <typename PACKED, HalfFormat FORMAT>
+    uint16_t const & HalfModel<PACKED, FORMAT>::operator[](unsigned index) const
+    {
+        return m_data[index];
+    }
 }
@@ -0,0 +1,279 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <vector>
+
+#include "NativeJIT/AllocatorVector.h"
+#include "NativeJIT/Bytecode.h"
+#include "NativeJIT/CodeGen/X64CodeGenerator.h"     // OpCode type.
+#include "NativeJIT/CodeGenHelpers.h"
+#include "NativeJIT/Nodes/Node.h"
+
+
+namespace NativeJIT
+{
+    // Applies an associative operation to the operands of a chain of
+    // operations. The operands are combined as a balanced tree rather than
+    // in sequence, so that the critical path of a chain of N operands is
+    // log2(N) operations long and the independent operations can execute in
+    // parallel.
+    //
+    // The node is created by ExpressionNodeFactory in place of BinaryNode
+    // when reassociation is enabled (see ExpressionTree::SetReassociationMode()).
+    // An operand which is itself an AssociativeNode for the same operation is
+    // absorbed, so building Add(Add(Add(a, b), c), d) yields a node which
+    // combines a, b, c and d. Like BinaryNode, each node references only its
+    // two direct operands, so building a chain takes time linear in its
+    // length. The chain is flattened once, when its root is evaluated. An
+    // absorbed node which has other parents is not descended into: it's
+    // evaluated once, like any other common subexpression, and its value
+    // becomes a single operand of the chain.
+    template <OpCode OP, typename T>
+    class AssociativeNode : public Node<T>
+    {
+    public:
+        AssociativeNode(ExpressionTree& tree, Node<T>& left, Node<T>& right);
+
+        virtual ExpressionTree::Storage<T> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
+
+        virtual bool GetAssociativeOperands(OpCode op, NodeBase*& left, NodeBase*& right) const override;
+        virtual void ReleaseReferencesToChildren() override;
+
+        virtual void Print(std::ostream& out) const override;
+
+    private:
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~AssociativeNode();
+
+        // Returns whether the operand is an AssociativeNode for the same
+        // operation which is used only by the chain and can be absorbed.
+        static bool IsAbsorbed(NodeBase& operand, NodeBase*& left, NodeBase*& right);
+
+        // Flattens the chain into m_operands in the left to right order. Only
+        // done for the nodes which are evaluated, which keeps the memory
+        // linear in the chain length.
+        void CollectOperands();
+
+        // Evaluate and lower the operands in the range [begin, end) as
+        // a balanced tree. The results of both halves of the range are
+        // combined in the same order in both cases, so that the rounding
+        // of the floating point operations matches.
+        ExpressionTree::Storage<T> CodeGenRange(ExpressionTree& tree, unsigned begin, unsigned end);
+        unsigned LowerRange(Bytecode& code, unsigned begin, unsigned end);
+
+        static bool Interpret(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+
+        Node<T>& m_left;
+        Node<T>& m_right;
+
+        AllocatorVector<Node<T>*> m_operands;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for AssociativeNode
+    //
+    //*************************************************************************
+    template <OpCode OP, typename T>
+    AssociativeNode<OP, T>::AssociativeNode(ExpressionTree& tree,
+                                            Node<T>& left,
+                                            Node<T>& right)
+        : Node<T>(tree),
+          m_left(left),
+          m_right(right),
+          m_operands(Allocators::StlAllocator<Node<T>*>(tree.GetAllocator()))
+    {
+        m_left.IncrementParentCount();
+        m_right.IncrementParentCount();
+    }
+
+
+    template <OpCode OP, typename T>
+    bool AssociativeNode<OP, T>::IsAbsorbed(NodeBase& operand, NodeBase*& left, NodeBase*& right)
+    {
+        return operand.GetParentCount() == 1
+               && operand.GetAssociativeOperands(OP, left, right);
+    }
+
+
+    template <OpCode OP, typename T>
+    void AssociativeNode<OP, T>::CollectOperands()
+    {
+        if (!m_operands.empty())
+        {
+            return;
+        }
+
+        // A chain built one operation at a time is as deep as it is long, so
+        // it's walked with an explicit stack rather than recursively.
+        std::vector<NodeBase*> pending;
+        pending.push_back(&m_right);
+        pending.push_back(&m_left);
+
+        while (!pending.empty())
+        {
+            NodeBase* node = pending.back();
+            NodeBase* left;
+            NodeBase* right;
+            pending.pop_back();
+
+            if (IsAbsorbed(*node, left, right))
+            {
+                pending.push_back(right);
+                pending.push_back(left);
+            }
+            else
+            {
+                // The operands of a chain of Node<T> are Node<T> as well.
+                m_operands.push_back(static_cast<Node<T>*>(node));
+            }
+        }
+    }
+
+
+    template <OpCode OP, typename T>
+    typename ExpressionTree::Storage<T> AssociativeNode<OP, T>::CodeGenValue(ExpressionTree& tree)
+    {
+        CollectOperands();
+
+        return CodeGenRange(tree, 0, static_cast<unsigned>(m_operands.size()));
+    }
+
+
+    template <OpCode OP, typename T>
+    typename ExpressionTree::Storage<T>
+    AssociativeNode<OP, T>::CodeGenRange(ExpressionTree& tree, unsigned begin, unsigned end)
+    {
+        if (end - begin == 1)
+        {
+            return m_operands[begin]->CodeGen(tree);
+        }
+
+        const unsigned middle = begin + (end - begin) / 2;
+
+        auto sLeft = CodeGenRange(tree, begin, middle);
+        auto sRight = CodeGenRange(tree, middle, end);
+
+        // See BinaryNode::CodeGenValue() for the case of the same storage.
+        if (sLeft == sRight)
+        {
+            sRight.Reset();
+            CodeGenHelpers::Emit<OP>(tree.GetCodeGenerator(),
+                                     sLeft.ConvertToDirect(true), sLeft);
+        }
+        else
+        {
+            CodeGenHelpers::Emit<OP>(tree.GetCodeGenerator(),
+                                     sLeft.ConvertToDirect(true), sRight);
+        }
+
+        return sLeft;
+    }
+
+
+    template <OpCode OP, typename T>
+    unsigned AssociativeNode<OP, T>::LowerValue(Bytecode& code)
+    {
+        CollectOperands();
+
+        return LowerRange(code, 0, static_cast<unsigned>(m_operands.size()));
+    }
+
+
+    template <OpCode OP, typename T>
+    unsigned AssociativeNode<OP, T>::LowerRange(Bytecode& code, unsigned begin, unsigned end)
+    {
+        if (end - begin == 1)
+        {
+            return m_operands[begin]->Lower(code);
+        }
+
+        const unsigned middle = begin + (end - begin) / 2;
+
+        const unsigned left = LowerRange(code, begin, middle);
+        const unsigned right = LowerRange(code, middle, end);
+
+        return code.Emit(&Interpret, { left, right });
+    }
+
+
+    template <OpCode OP, typename T>
+    bool AssociativeNode<OP, T>::Interpret(Bytecode::Slot* slots,
+                                           Bytecode::Instruction const & instruction)
+    {
+        typedef typename CanonicalRegisterStorageType<T>::Type RegisterValue;
+
+        Bytecode::Write<RegisterValue>(
+            slots,
+            instruction.m_result,
+            BytecodeOperation<OP>::Apply(
+                Bytecode::Read<RegisterValue>(slots, instruction.m_operands[0]),
+                Bytecode::Read<RegisterValue>(slots, instruction.m_operands[1])));
+
+        return true;
+    }
+
+
+    template <OpCode OP, typename T>
+    bool AssociativeNode<OP, T>::GetAssociativeOperands(OpCode op,
+                                                        NodeBase*& left,
+                                                        NodeBase*& right) const
+    {
+        if (op != OP)
+        {
+            return false;
+        }
+
+        left = &m_left;
+        right = &m_right;
+
+        return true;
+    }
+
+
+    template <OpCode OP, typename T>
+    void AssociativeNode<OP, T>::ReleaseReferencesToChildren()
+    {
+        m_left.DecrementParentCount();
+        m_right.DecrementParentCount();
+    }
+
+
+    template <OpCode OP, typename T>
+    void AssociativeNode<OP, T>::Print(std::ostream& out) const
+    {
+        const std::string name = std::string("Associative (")
+            + X64CodeGenerator::OpCodeName(OP)
+            + ") ";
+        this->PrintCoreProperties(out, name.c_str());
+
+        out << ", left = " << m_left.GetId();
+        out << ", right = " << m_right.GetId();
+    }
+}
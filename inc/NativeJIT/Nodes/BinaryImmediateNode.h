@@ -25,6 +25,7 @@
 
 #include <type_traits>
 
+#include "NativeJIT/Bytecode.h"
 #include "NativeJIT/CodeGen/X64CodeGenerator.h"     // OpCode type.
 #include "NativeJIT/Nodes/Node.h"
 
@@ -44,6 +45,7 @@ namespace NativeJIT
         BinaryImmediateNode(ExpressionTree& tree, Node<L>& left, R right);
 
         virtual Storage<L> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
 
         virtual void Print(std::ostream& out) const override;
 
@@ -53,6 +55,8 @@ namespace NativeJIT
         // resources other than memory from the arena allocator.
         ~BinaryImmediateNode();
 
+        static bool Interpret(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+
         Node<L>& m_left;
         const R m_right;
     };
@@ -87,6 +91,34 @@ namespace NativeJIT
     }
 
 
+    template <OpCode OP, typename L, typename R>
+    unsigned BinaryImmediateNode<OP, L, R>::LowerValue(Bytecode& code)
+    {
+        const unsigned left = m_left.Lower(code);
+
+        return code.Emit(&Interpret, { left }, static_cast<Bytecode::Slot>(m_right));
+    }
+
+
+    template <OpCode OP, typename L, typename R>
+    bool BinaryImmediateNode<OP, L, R>::Interpret(Bytecode::Slot* slots,
+                                                  Bytecode::Instruction const & instruction)
+    {
+        typedef typename CanonicalRegisterStorageType<L>::Type RegisterValue;
+
+        const R right = static_cast<R>(instruction.m_immediate);
+
+        Bytecode::Write<RegisterValue>(
+            slots,
+            instruction.m_result,
+            BytecodeOperation<OP>::Apply(
+                Bytecode::Read<RegisterValue>(slots, instruction.m_operands[0]),
+                static_cast<RegisterValue>(right)));
+
+        return true;
+    }
+
+
     template <OpCode OP, typename L, typename R>
     void BinaryImmediateNode<OP, L, R>::Print(std::ostream& out) const
     {
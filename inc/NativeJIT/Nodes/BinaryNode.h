@@ -23,6 +23,9 @@
 
 #pragma once
 
+#include <type_traits>
+
+#include "NativeJIT/Bytecode.h"
 #include "NativeJIT/CodeGen/X64CodeGenerator.h"     // OpCode type.
 #include "NativeJIT/CodeGenHelpers.h"
 #include "NativeJIT/Nodes/Node.h"
@@ -37,6 +40,10 @@ namespace NativeJIT
         BinaryNode(ExpressionTree& tree, Node<L>& left, Node<R>& right);
 
         virtual ExpressionTree::Storage<L> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
+
+        virtual bool GetFactors(NodeBase*& left, NodeBase*& right) const override;
+        virtual void ReleaseReferencesToChildren() override;
 
         virtual void Print(std::ostream& out) const override;
 
@@ -46,6 +53,8 @@ namespace NativeJIT
         // resources other than memory from the arena allocator.
         ~BinaryNode();
 
+        static bool Interpret(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+
         Node<L>& m_left;
         Node<R>& m_right;
     };
@@ -97,6 +106,61 @@ namespace NativeJIT
     }
 
 
+    template <OpCode OP, typename L, typename R>
+    unsigned BinaryNode<OP, L, R>::LowerValue(Bytecode& code)
+    {
+        const unsigned left = m_left.Lower(code);
+        const unsigned right = m_right.Lower(code);
+
+        return code.Emit(&Interpret, { left, right });
+    }
+
+
+    template <OpCode OP, typename L, typename R>
+    bool BinaryNode<OP, L, R>::Interpret(Bytecode::Slot* slots,
+                                         Bytecode::Instruction const & instruction)
+    {
+        // Both sides use the same register type, so the right side is read
+        // as the register type of the left side like in the generated code.
+        typedef typename CanonicalRegisterStorageType<L>::Type RegisterValue;
+
+        Bytecode::Write<RegisterValue>(
+            slots,
+            instruction.m_result,
+            BytecodeOperation<OP>::Apply(
+                Bytecode::Read<RegisterValue>(slots, instruction.m_operands[0]),
+                Bytecode::Read<RegisterValue>(slots, instruction.m_operands[1])));
+
+        return true;
+    }
+
+
+    template <OpCode OP, typename L, typename R>
+    bool BinaryNode<OP, L, R>::GetFactors(NodeBase*& left, NodeBase*& right) const
+    {
+        // Integer multiplication has no fused form.
+        if (OP != OpCode::IMul
+            || !std::is_floating_point<L>::value
+            || !std::is_same<L, R>::value)
+        {
+            return false;
+        }
+
+        left = &m_left;
+        right = &m_right;
+
+        return true;
+    }
+
+
+    template <OpCode OP, typename L, typename R>
+    void BinaryNode<OP, L, R>::ReleaseReferencesToChildren()
+    {
+        m_left.DecrementParentCount();
+        m_right.DecrementParentCount();
+    }
+
+
     template <OpCode OP, typename L, typename R>
     void BinaryNode<OP, L, R>::Print(std::ostream& out) const
     {
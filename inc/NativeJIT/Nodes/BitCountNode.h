@@ -0,0 +1,257 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <type_traits>
+
+#include "NativeJIT/Bytecode.h"
+#include "NativeJIT/CodeGen/CpuFeatures.h"
+#include "NativeJIT/CodeGen/X64CodeGenerator.h"     // OpCode type.
+#include "NativeJIT/Nodes/Node.h"
+
+
+namespace NativeJIT
+{
+    // Implements popcnt, lzcnt and tzcnt. The instructions are used when the
+    // code generator's CpuFeatures allow it, otherwise the node falls back to
+    // the baseline x64 equivalents: a SWAR bit count for popcnt, and bsr/bsf
+    // with a conditional move for the zero input for lzcnt/tzcnt.
+    //
+    // Note: the encodings of lzcnt and tzcnt are the ones of bsr and bsf with
+    // an extra prefix, so a processor without the extension silently executes
+    // the wrong instruction instead of faulting.
+    template <OpCode OP, typename T>
+    class BitCountNode : public Node<T>
+    {
+    public:
+        static_assert(OP == OpCode::Popcnt || OP == OpCode::Lzcnt || OP == OpCode::Tzcnt,
+                      "Unsupported bit count operation.");
+        static_assert(std::is_integral<T>::value && sizeof(T) >= 4,
+                      "BitCountNode requires a 32 or 64-bit integral type.");
+
+        BitCountNode(ExpressionTree& tree, Node<T>& child);
+
+        virtual Storage<T> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
+
+        virtual void Print(std::ostream& out) const override;
+
+    private:
+        typedef typename Storage<T>::DirectRegister DirectRegister;
+        typedef typename std::make_unsigned<T>::type Unsigned;
+
+        static const unsigned c_bitCount = sizeof(T) * 8;
+
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~BitCountNode();
+
+        static CpuFeature GetRequiredFeature();
+
+        // The baseline replacements, which compute the count in place.
+        static void EmitFallback(ExpressionTree& tree,
+                                 DirectRegister value,
+                                 std::integral_constant<OpCode, OpCode::Popcnt>);
+        static void EmitFallback(ExpressionTree& tree,
+                                 DirectRegister value,
+                                 std::integral_constant<OpCode, OpCode::Lzcnt>);
+        static void EmitFallback(ExpressionTree& tree,
+                                 DirectRegister value,
+                                 std::integral_constant<OpCode, OpCode::Tzcnt>);
+
+        static bool Interpret(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+
+        Node<T>& m_child;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for BitCountNode
+    //
+    //*************************************************************************
+    template <OpCode OP, typename T>
+    BitCountNode<OP, T>::BitCountNode(ExpressionTree& tree, Node<T>& child)
+        : Node<T>(tree),
+          m_child(child)
+    {
+        m_child.IncrementParentCount();
+    }
+
+
+    template <OpCode OP, typename T>
+    Storage<T> BitCountNode<OP, T>::CodeGenValue(ExpressionTree& tree)
+    {
+        auto & code = tree.GetCodeGenerator();
+        auto value = m_child.CodeGen(tree);
+
+        {
+            auto valueRegister = value.ConvertToDirect(true);
+            ReferenceCounter valuePin = value.GetPin();
+
+            if (tree.GetCpuFeatures().IsSupported(GetRequiredFeature()))
+            {
+                code.Emit<OP>(valueRegister, valueRegister);
+            }
+            else
+            {
+                EmitFallback(tree, valueRegister, std::integral_constant<OpCode, OP>());
+            }
+        }
+
+        return value;
+    }
+
+
+    template <OpCode OP, typename T>
+    CpuFeature BitCountNode<OP, T>::GetRequiredFeature()
+    {
+        // tzcnt is part of BMI1 rather than of the ABM extension which
+        // introduced popcnt and lzcnt.
+        return OP == OpCode::Popcnt
+            ? CpuFeature::PopCnt
+            : (OP == OpCode::Lzcnt ? CpuFeature::LzCnt : CpuFeature::Bmi1);
+    }
+
+
+    template <OpCode OP, typename T>
+    void BitCountNode<OP, T>::EmitFallback(ExpressionTree& tree,
+                                           DirectRegister value,
+                                           std::integral_constant<OpCode, OpCode::Popcnt>)
+    {
+        auto & code = tree.GetCodeGenerator();
+
+        // Hacker's Delight, 5-1: sum the bits in 2, 4 and 8-bit fields, then
+        // add up the bytes with a multiplication, which leaves the sum in the
+        // most significant byte. The 64-bit masks don't fit in an immediate
+        // operand, so they are always loaded into a register.
+        auto temp = tree.Direct<T>();
+        auto tempRegister = temp.GetDirectRegister();
+        ReferenceCounter tempPin = temp.GetPin();
+
+        auto mask = tree.Direct<T>();
+        auto maskRegister = mask.GetDirectRegister();
+
+        const Unsigned ones = static_cast<Unsigned>(-1);
+
+        code.Emit<OpCode::Mov>(tempRegister, value);
+        code.EmitImmediate<OpCode::Shr>(tempRegister, static_cast<uint8_t>(1));
+        code.EmitImmediate<OpCode::Mov>(maskRegister, static_cast<Unsigned>(ones / 3));
+        code.Emit<OpCode::And>(tempRegister, maskRegister);
+        code.Emit<OpCode::Sub>(value, tempRegister);
+
+        code.Emit<OpCode::Mov>(tempRegister, value);
+        code.EmitImmediate<OpCode::Shr>(tempRegister, static_cast<uint8_t>(2));
+        code.EmitImmediate<OpCode::Mov>(maskRegister, static_cast<Unsigned>(ones / 5));
+        code.Emit<OpCode::And>(tempRegister, maskRegister);
+        code.Emit<OpCode::And>(value, maskRegister);
+        code.Emit<OpCode::Add>(value, tempRegister);
+
+        code.Emit<OpCode::Mov>(tempRegister, value);
+        code.EmitImmediate<OpCode::Shr>(tempRegister, static_cast<uint8_t>(4));
+        code.Emit<OpCode::Add>(value, tempRegister);
+        code.EmitImmediate<OpCode::Mov>(maskRegister, static_cast<Unsigned>(ones / 17));
+        code.Emit<OpCode::And>(value, maskRegister);
+
+        code.EmitImmediate<OpCode::Mov>(maskRegister, static_cast<Unsigned>(ones / 255));
+        code.Emit<OpCode::IMul>(value, maskRegister);
+        code.EmitImmediate<OpCode::Shr>(value, static_cast<uint8_t>(c_bitCount - 8));
+    }
+
+
+    template <OpCode OP, typename T>
+    void BitCountNode<OP, T>::EmitFallback(ExpressionTree& tree,
+                                           DirectRegister value,
+                                           std::integral_constant<OpCode, OpCode::Lzcnt>)
+    {
+        auto & code = tree.GetCodeGenerator();
+
+        auto zero = tree.Direct<T>();
+        auto zeroRegister = zero.GetDirectRegister();
+
+        // bsr returns the index of the highest set bit, i.e. (N - 1) - lzcnt,
+        // and sets ZF for zero, in which case the destination is undefined.
+        // Substituting 2N - 1 for the index turns the final xor into N.
+        code.EmitImmediate<OpCode::Mov>(zeroRegister, static_cast<Unsigned>(2 * c_bitCount - 1));
+        code.Emit<OpCode::Bsr>(value, value);
+        code.EmitConditionalMove<JccType::JZ>(value, zeroRegister);
+        code.EmitImmediate<OpCode::Xor>(value, static_cast<int32_t>(c_bitCount - 1));
+    }
+
+
+    template <OpCode OP, typename T>
+    void BitCountNode<OP, T>::EmitFallback(ExpressionTree& tree,
+                                           DirectRegister value,
+                                           std::integral_constant<OpCode, OpCode::Tzcnt>)
+    {
+        auto & code = tree.GetCodeGenerator();
+
+        auto zero = tree.Direct<T>();
+        auto zeroRegister = zero.GetDirectRegister();
+
+        // bsf returns the index of the lowest set bit, which is tzcnt, except
+        // for zero.
+        code.EmitImmediate<OpCode::Mov>(zeroRegister, static_cast<Unsigned>(c_bitCount));
+        code.Emit<OpCode::Bsf>(value, value);
+        code.EmitConditionalMove<JccType::JZ>(value, zeroRegister);
+    }
+
+
+    template <OpCode OP, typename T>
+    unsigned BitCountNode<OP, T>::LowerValue(Bytecode& code)
+    {
+        const unsigned child = m_child.Lower(code);
+
+        return code.Emit(&Interpret, { child });
+    }
+
+
+    template <OpCode OP, typename T>
+    bool BitCountNode<OP, T>::Interpret(Bytecode::Slot* slots,
+                                        Bytecode::Instruction const & instruction)
+    {
+        typedef typename CanonicalRegisterStorageType<T>::Type RegisterValue;
+
+        Bytecode::Write<RegisterValue>(
+            slots,
+            instruction.m_result,
+            BytecodeUnaryOperation<OP>::Apply(
+                Bytecode::Read<RegisterValue>(slots, instruction.m_operands[0])));
+
+        return true;
+    }
+
+
+    template <OpCode OP, typename T>
+    void BitCountNode<OP, T>::Print(std::ostream& out) const
+    {
+        const std::string name = std::string("Operation (")
+            + X64CodeGenerator::OpCodeName(OP)
+            + ") ";
+        this->PrintCoreProperties(out, name.c_str());
+
+        out << ", child = " << m_child.GetId();
+    }
+}
@@ -0,0 +1,190 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <type_traits>
+
+#include "NativeJIT/Bytecode.h"
+#include "NativeJIT/CodeGen/CpuFeatures.h"
+#include "NativeJIT/CodeGen/X64CodeGenerator.h"     // OpCode type.
+#include "NativeJIT/Nodes/Node.h"
+#include "Temporary/Assert.h"
+
+
+namespace NativeJIT
+{
+    // Extracts the bit field of the specified length starting at the
+    // specified bit, zero extended. Uses the BMI1 bextr instruction when the
+    // code generator's CpuFeatures allow it, otherwise a pair of shifts which
+    // first discards the bits above the field and then the ones below it.
+    //
+    // The start bit must be inside the value and the field must not be
+    // empty, ExpressionNodeFactory::Bextr() handles the other cases. Fields
+    // extending past the most significant bit are truncated, like in bextr.
+    template <typename T>
+    class BitExtractNode : public Node<T>
+    {
+    public:
+        static_assert(std::is_integral<T>::value && sizeof(T) >= 4,
+                      "BitExtractNode requires a 32 or 64-bit integral type.");
+
+        BitExtractNode(ExpressionTree& tree, Node<T>& value, uint8_t start, uint8_t length);
+
+        virtual Storage<T> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
+
+        virtual void Print(std::ostream& out) const override;
+
+    private:
+        typedef typename std::make_unsigned<T>::type Unsigned;
+
+        static const unsigned c_bitCount = sizeof(T) * 8;
+
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~BitExtractNode();
+
+        // The bextr control operand: the start bit in bits 0-7 and the length
+        // in bits 8-15.
+        Unsigned GetControl() const;
+
+        static bool Interpret(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+
+        Node<T>& m_value;
+        const uint8_t m_start;
+        const uint8_t m_length;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for BitExtractNode
+    //
+    //*************************************************************************
+    template <typename T>
+    BitExtractNode<T>::BitExtractNode(ExpressionTree& tree,
+                                      Node<T>& value,
+                                      uint8_t start,
+                                      uint8_t length)
+        : Node<T>(tree),
+          m_value(value),
+          m_start(start),
+          m_length(length)
+    {
+        LogThrowAssert(start < c_bitCount && length > 0,
+                       "Invalid bit field: start %u, length %u",
+                       static_cast<unsigned>(start),
+                       static_cast<unsigned>(length));
+
+        m_value.IncrementParentCount();
+    }
+
+
+    template <typename T>
+    Storage<T> BitExtractNode<T>::CodeGenValue(ExpressionTree& tree)
+    {
+        auto & code = tree.GetCodeGenerator();
+        auto value = m_value.CodeGen(tree);
+
+        {
+            auto valueRegister = value.ConvertToDirect(true);
+            ReferenceCounter valuePin = value.GetPin();
+
+            if (tree.GetCpuFeatures().IsSupported(CpuFeature::Bmi1))
+            {
+                auto control = tree.Direct<T>();
+                auto controlRegister = control.GetDirectRegister();
+
+                code.EmitImmediate<OpCode::Mov>(controlRegister, GetControl());
+                code.Emit<OpCode::Bextr>(valueRegister, valueRegister, controlRegister);
+            }
+            else
+            {
+                const unsigned end = m_start + m_length < c_bitCount
+                                     ? m_start + m_length
+                                     : c_bitCount;
+                const unsigned length = end - m_start;
+
+                if (end < c_bitCount)
+                {
+                    code.EmitImmediate<OpCode::Shl>(valueRegister,
+                                                    static_cast<uint8_t>(c_bitCount - end));
+                }
+
+                if (length < c_bitCount)
+                {
+                    code.EmitImmediate<OpCode::Shr>(valueRegister,
+                                                    static_cast<uint8_t>(c_bitCount - length));
+                }
+            }
+        }
+
+        return value;
+    }
+
+
+    template <typename T>
+    typename BitExtractNode<T>::Unsigned BitExtractNode<T>::GetControl() const
+    {
+        return static_cast<Unsigned>(m_start | (m_length << 8));
+    }
+
+
+    template <typename T>
+    unsigned BitExtractNode<T>::LowerValue(Bytecode& code)
+    {
+        const unsigned value = m_value.Lower(code);
+
+        return code.Emit(&Interpret, { value }, GetControl());
+    }
+
+
+    template <typename T>
+    bool BitExtractNode<T>::Interpret(Bytecode::Slot* slots,
+                                      Bytecode::Instruction const & instruction)
+    {
+        typedef typename CanonicalRegisterStorageType<T>::Type RegisterValue;
+
+        Bytecode::Write<RegisterValue>(
+            slots,
+            instruction.m_result,
+            BytecodeOperation<OpCode::Bextr>::Apply(
+                Bytecode::Read<RegisterValue>(slots, instruction.m_operands[0]),
+                static_cast<RegisterValue>(instruction.m_immediate)));
+
+        return true;
+    }
+
+
+    template <typename T>
+    void BitExtractNode<T>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out, "BitExtract");
+
+        out << ", value = " << m_value.GetId()
+            << ", start = " << static_cast<unsigned>(m_start)
+            << ", length = " << static_cast<unsigned>(m_length);
+    }
+}
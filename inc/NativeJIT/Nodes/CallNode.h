@@ -26,6 +26,7 @@
 #include <iostream>                    // Accessed by template definition for Print().
 
 #include "NativeJIT/AllocatorVector.h" // Embedded member.
+#include "NativeJIT/Bytecode.h"
 #include "NativeJIT/CodeGenHelpers.h"
 #include "NativeJIT/Nodes/Node.h"      // Base class.
 #include "NativeJIT/TypePredicates.h"
@@ -87,6 +88,7 @@ namespace NativeJIT
         // Overrides of Node methods.
         //
         virtual ExpressionTree::Storage<R> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
         virtual void Print(std::ostream& out) const override;
 
     protected:
@@ -117,6 +119,9 @@ namespace NativeJIT
             // expression in Evaluate().
             virtual void Release() = 0;
 
+            // Lowers the expression inside the child and returns its slot.
+            virtual unsigned Lower(Bytecode& code) = 0;
+
             // Prints the contents of the child to standard output for debugging.
             virtual void Print(std::ostream& out) const = 0;
         };
@@ -132,6 +137,7 @@ namespace NativeJIT
             // Overrides of Child methods.
             //
             virtual void Release();
+            virtual unsigned Lower(Bytecode& code) override;
 
         protected:
             // Pins the storage register so that it cannot be spilled until
@@ -203,6 +209,10 @@ namespace NativeJIT
         // Pointer to function's two base classes.
         FunctionChildBase* m_functionBase;
         Child* m_functionChild;
+
+        // The bytecode handler which makes the call with the function pointer
+        // and the parameters in the operand slots in the order of m_children.
+        Bytecode::Handler m_interpreter;
     };
 
 
@@ -225,6 +235,8 @@ namespace NativeJIT
         // resources other than memory from the arena allocator.
         ~CallNode();
 
+        static bool Interpret(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+
         typename CallNodeBase<R, 0>::template FunctionChild<FunctionPointer> m_f;
     };
 
@@ -245,6 +257,8 @@ namespace NativeJIT
         // resources other than memory from the arena allocator.
         ~CallNode();
 
+        static bool Interpret(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+
         typename CallNodeBase<R, 1>::template FunctionChild<FunctionPointer> m_f;
         typename CallNodeBase<R, 1>::template ParameterChild<P1> m_p1;
     };
@@ -267,6 +281,8 @@ namespace NativeJIT
         // resources other than memory from the arena allocator.
         ~CallNode();
 
+        static bool Interpret(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+
         typename CallNodeBase<R, 2>::template FunctionChild<FunctionPointer> m_f;
         typename CallNodeBase<R, 2>::template ParameterChild<P1> m_p1;
         typename CallNodeBase<R, 2>::template ParameterChild<P2> m_p2;
@@ -291,6 +307,8 @@ namespace NativeJIT
         // resources other than memory from the arena allocator.
         ~CallNode();
 
+        static bool Interpret(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+
         typename CallNodeBase<R, 3>::template FunctionChild<FunctionPointer> m_f;
         typename CallNodeBase<R, 3>::template ParameterChild<P1> m_p1;
         typename CallNodeBase<R, 3>::template ParameterChild<P2> m_p2;
@@ -317,6 +335,8 @@ namespace NativeJIT
         // resources other than memory from the arena allocator.
         ~CallNode();
 
+        static bool Interpret(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+
         typename CallNodeBase<R, 4>::template FunctionChild<FunctionPointer> m_f;
         typename CallNodeBase<R, 4>::template ParameterChild<P1> m_p1;
         typename CallNodeBase<R, 4>::template ParameterChild<P2> m_p2;
@@ -409,6 +429,26 @@ namespace NativeJIT
     }
 
 
+    template <typename R, unsigned PARAMETERCOUNT>
+    unsigned CallNodeBase<R, PARAMETERCOUNT>::LowerValue(Bytecode& code)
+    {
+        // The function may have side effects, see StoreNode::LowerValue().
+        if (code.IsInSkip())
+        {
+            return NodeBase::LowerValue(code);
+        }
+
+        unsigned operands[c_childCount];
+
+        for (unsigned i = 0; i < c_childCount; ++i)
+        {
+            operands[i] = m_children[i]->Lower(code);
+        }
+
+        return code.Emit(m_interpreter, operands, c_childCount);
+    }
+
+
     template <typename R, unsigned PARAMETERCOUNT>
     void CallNodeBase<R, PARAMETERCOUNT>::Print(std::ostream& out) const
     {
@@ -447,6 +487,14 @@ namespace NativeJIT
     }
 
 
+    template <typename R, unsigned PARAMETERCOUNT>
+    template <typename T>
+    unsigned CallNodeBase<R, PARAMETERCOUNT>::TypedChild<T>::Lower(Bytecode& code)
+    {
+        return m_expression.Lower(code);
+    }
+
+
     template <typename R, unsigned PARAMETERCOUNT>
     template <typename T>
     void CallNodeBase<R, PARAMETERCOUNT>::TypedChild<T>::PinStorageRegister()
@@ -610,6 +658,7 @@ namespace NativeJIT
 
         this->m_functionBase = &m_f;
         this->m_functionChild = &m_f;
+        this->m_interpreter = &Interpret;
         this->m_children[0] = this->m_functionChild;
     }
 
@@ -627,6 +676,7 @@ namespace NativeJIT
 
         this->m_functionBase = &m_f;
         this->m_functionChild = &m_f;
+        this->m_interpreter = &Interpret;
         this->m_children[0] = this->m_functionChild;
         this->m_children[1] = &m_p1;
     }
@@ -648,6 +698,7 @@ namespace NativeJIT
 
         this->m_functionBase = &m_f;
         this->m_functionChild = &m_f;
+        this->m_interpreter = &Interpret;
         this->m_children[0] = this->m_functionChild;
         this->m_children[1] = &m_p1;
         this->m_children[2] = &m_p2;
@@ -673,6 +724,7 @@ namespace NativeJIT
 
         this->m_functionBase = &m_f;
         this->m_functionChild = &m_f;
+        this->m_interpreter = &Interpret;
         this->m_children[0] = this->m_functionChild;
         this->m_children[1] = &m_p1;
         this->m_children[2] = &m_p2;
@@ -702,10 +754,96 @@ namespace NativeJIT
 
         this->m_functionBase = &m_f;
         this->m_functionChild = &m_f;
+        this->m_interpreter = &Interpret;
         this->m_children[0] = this->m_functionChild;
         this->m_children[1] = &m_p1;
         this->m_children[2] = &m_p2;
         this->m_children[3] = &m_p3;
         this->m_children[4] = &m_p4;
     }
+
+
+    //*************************************************************************
+    //
+    // Template definitions for CallNode<R, ...>::Interpret().
+    //
+    //*************************************************************************
+    template <typename R>
+    bool CallNode<R>::Interpret(Bytecode::Slot* slots,
+                                Bytecode::Instruction const & instruction)
+    {
+        auto const & operands = instruction.m_operands;
+
+        Bytecode::Write<R>(slots,
+                           instruction.m_result,
+                           Bytecode::Read<FunctionPointer>(slots, operands[0])());
+
+        return true;
+    }
+
+
+    template <typename R, typename P1>
+    bool CallNode<R, P1>::Interpret(Bytecode::Slot* slots,
+                                    Bytecode::Instruction const & instruction)
+    {
+        auto const & operands = instruction.m_operands;
+
+        Bytecode::Write<R>(slots,
+                           instruction.m_result,
+                           Bytecode::Read<FunctionPointer>(slots, operands[0])(
+                               Bytecode::Read<P1>(slots, operands[1])));
+
+        return true;
+    }
+
+
+    template <typename R, typename P1, typename P2>
+    bool CallNode<R, P1, P2>::Interpret(Bytecode::Slot* slots,
+                                        Bytecode::Instruction const & instruction)
+    {
+        auto const & operands = instruction.m_operands;
+
+        Bytecode::Write<R>(slots,
+                           instruction.m_result,
+                           Bytecode::Read<FunctionPointer>(slots, operands[0])(
+                               Bytecode::Read<P1>(slots, operands[1]),
+                               Bytecode::Read<P2>(slots, operands[2])));
+
+        return true;
+    }
+
+
+    template <typename R, typename P1, typename P2, typename P3>
+    bool CallNode<R, P1, P2, P3>::Interpret(Bytecode::Slot* slots,
+                                            Bytecode::Instruction const & instruction)
+    {
+        auto const & operands = instruction.m_operands;
+
+        Bytecode::Write<R>(slots,
+                           instruction.m_result,
+                           Bytecode::Read<FunctionPointer>(slots, operands[0])(
+                               Bytecode::Read<P1>(slots, operands[1]),
+                               Bytecode::Read<P2>(slots, operands[2]),
+                               Bytecode::Read<P3>(slots, operands[3])));
+
+        return true;
+    }
+
+
+    template <typename R, typename P1, typename P2, typename P3, typename P4>
+    bool CallNode<R, P1, P2, P3, P4>::Interpret(Bytecode::Slot* slots,
+                                                Bytecode::Instruction const & instruction)
+    {
+        auto const & operands = instruction.m_operands;
+
+        Bytecode::Write<R>(slots,
+                           instruction.m_result,
+                           Bytecode::Read<FunctionPointer>(slots, operands[0])(
+                               Bytecode::Read<P1>(slots, operands[1]),
+                               Bytecode::Read<P2>(slots, operands[2]),
+                               Bytecode::Read<P3>(slots, operands[3]),
+                               Bytecode::Read<P4>(slots, operands[4])));
+
+        return true;
+    }
 }
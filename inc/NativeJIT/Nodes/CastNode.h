@@ -26,6 +26,7 @@
 #include <algorithm>    // For std::max
 #include <type_traits>
 
+#include "NativeJIT/Bytecode.h"
 #include "NativeJIT/ExpressionNodeFactory.h"
 #include "NativeJIT/Nodes/Node.h"
 
@@ -59,6 +60,16 @@ namespace NativeJIT
         };
 
 
+        // A class used to specialize the bytecode evaluation of the casts that
+        // the OneStepCastGenerator implements.
+        template <Cast TYPE>
+        struct OneStepCastInterpreter
+        {
+            template <typename TO, typename FROM>
+            static void Convert(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+        };
+
+
         // A class used to build a composite node needed to perform a cast
         // for casts that cannot be implemented directly using the X64 conversion
         // instructions.
@@ -193,6 +204,7 @@ namespace NativeJIT
         //
 
         virtual Storage<TO> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
         virtual void Print(std::ostream& out) const override;
 
     private:
@@ -203,6 +215,8 @@ namespace NativeJIT
 
         typedef Casting::Traits<TO, FROM> Traits;
 
+        static bool Interpret(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+
         Node<FROM>& m_from;
     };
 
@@ -219,6 +233,7 @@ namespace NativeJIT
         //
 
         virtual Storage<TO> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
         virtual void Print(std::ostream& out) const override;
 
     private:
@@ -261,6 +276,31 @@ namespace NativeJIT
     }
 
 
+    template <typename TO, typename FROM>
+    unsigned CastNode<TO, FROM, true>::LowerValue(Bytecode& code)
+    {
+        const unsigned source = m_from.Lower(code);
+
+        // A no-op cast observes the source value as the target type, which is
+        // exactly what reading the source slot as TO does.
+        return Traits::c_castType == Casting::Cast::NoOp
+            ? source
+            : code.Emit(&Interpret, { source });
+    }
+
+
+    template <typename TO, typename FROM>
+    bool CastNode<TO, FROM, true>::Interpret(Bytecode::Slot* slots,
+                                             Bytecode::Instruction const & instruction)
+    {
+        Casting
+            ::OneStepCastInterpreter<Traits::c_castType>
+            ::template Convert<TO, FROM>(slots, instruction);
+
+        return true;
+    }
+
+
     template <typename TO, typename FROM>
     void CastNode<TO, FROM, true>::Print(std::ostream& out) const
     {
@@ -294,6 +334,13 @@ namespace NativeJIT
     }
 
 
+    template <typename TO, typename FROM>
+    unsigned CastNode<TO, FROM, false>::LowerValue(Bytecode& code)
+    {
+        return m_conversionNode.Lower(code);
+    }
+
+
     template <typename TO, typename FROM>
     void CastNode<TO, FROM, false>::Print(std::ostream& out) const
     {
@@ -462,6 +509,52 @@ namespace NativeJIT
         }
 
 
+        //
+        // Template definitions for OneStepCastInterpreter.
+        //
+
+        // Casts between floating point types and between floating point and
+        // int32_t/int64_t behave like the matching conversion instructions.
+        template <Cast TYPE>
+        template <typename TO, typename FROM>
+        void OneStepCastInterpreter<TYPE>::Convert(Bytecode::Slot* slots,
+                                                   Bytecode::Instruction const & instruction)
+        {
+            Bytecode::Write<TO>(slots,
+                                instruction.m_result,
+                                static_cast<TO>(Bytecode::Read<FROM>(slots, instruction.m_operands[0])));
+        }
+
+
+        // No-op casts are not lowered to an instruction. Provided for
+        // completeness.
+        template <>
+        template <typename TO, typename FROM>
+        void OneStepCastInterpreter<Cast::NoOp>::Convert(Bytecode::Slot* slots,
+                                                         Bytecode::Instruction const & instruction)
+        {
+            slots[instruction.m_result] = slots[instruction.m_operands[0]];
+        }
+
+
+        // Integer extension fills the whole slot with the sign or zero
+        // extended value, matching the choice between movsx and movzx.
+        template <>
+        template <typename TO, typename FROM>
+        void OneStepCastInterpreter<Cast::IntToInt>::Convert(Bytecode::Slot* slots,
+                                                             Bytecode::Instruction const & instruction)
+        {
+            typedef typename std::conditional<std::is_signed<FROM>::value,
+                                              int64_t,
+                                              uint64_t>::type Extended;
+
+            Bytecode::Write<Extended>(
+                slots,
+                instruction.m_result,
+                static_cast<Extended>(Bytecode::Read<FROM>(slots, instruction.m_operands[0])));
+        }
+
+
         // A helper method to build two cast nodes which would convert from FROM
         // to TO by using one-step casts through an INTERMEDIATE.
         template <typename TO, typename INTERMEDIATE, typename FROM>
@@ -24,7 +24,11 @@
 #pragma once
 
 #include <algorithm>    // For std::max
+#include <cstddef>      // For offsetof.
+#include <type_traits>  // For std::integral_constant.
 
+#include "NativeJIT/BranchProfile.h"
+#include "NativeJIT/Bytecode.h"
 #include "NativeJIT/CodeGen/X64CodeGenerator.h"
 #include "NativeJIT/CodeGenHelpers.h"
 #include "NativeJIT/ExpressionTree.h"
@@ -76,7 +80,8 @@ namespace NativeJIT
         ConditionalNode(ExpressionTree& tree,
                         FlagExpressionNode<JCC>& condition,
                         Node<T>& trueExpression,
-                        Node<T>& falseExpression);
+                        Node<T>& falseExpression,
+                        BranchHint hint);
 
 
         //
@@ -88,6 +93,7 @@ namespace NativeJIT
         // Overrides of Node<T> methods.
         //
         virtual ExpressionTree::Storage<T> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
 
     private:
         // WARNING: This class is designed to be allocated by an arena allocator,
@@ -95,9 +101,67 @@ namespace NativeJIT
         // resources other than memory from the arena allocator.
         ~ConditionalNode();
 
+        // Returns whether the value can be read before the condition is
+        // known. An Indirect value may dereference a pointer which the
+        // condition guards, f. ex. against null, so only the layouts which
+        // read it on its own path can use it.
+        static bool CanReadEagerly(Storage<T>& value);
+
+        // Conditional move is available only for general purpose registers
+        // wider than 8 bits.
+        typedef std::integral_constant<bool,
+                                       !RegisterStorage<T>::c_isFloat
+                                       && RegisterStorage<T>::c_size != 1>
+            SupportsConditionalMove;
+
+        // Emits a branch for each of the values: the false branch falls
+        // through and the true branch is jumped to. If counts is not null,
+        // each branch also increments its counter.
+        Storage<T> CodeGenBranches(ExpressionTree& tree,
+                                   Storage<T>& trueValue,
+                                   Storage<T>& falseValue,
+                                   BranchCounts* counts);
+
+        // Loads skipValue into the result before the conditional jump, which
+        // is taken if SKIPJCC holds. Otherwise, the execution falls through
+        // to the code that replaces the result with fallThroughValue. The
+        // fall-through path executes no taken jumps. Requires that
+        // CanReadEagerly(skipValue).
+        template <JccType SKIPJCC>
+        Storage<T> CodeGenFallThrough(ExpressionTree& tree,
+                                      Storage<T>& skipValue,
+                                      Storage<T>& fallThroughValue);
+
+        // Jumps to a cold block that loads coldValue into the result if
+        // COLDJCC holds, otherwise loads hotValue. The hot path executes no
+        // taken jumps and the cold block is moved to the end of the
+        // function.
+        template <JccType COLDJCC>
+        Storage<T> CodeGenColdBranch(ExpressionTree& tree,
+                                     Storage<T>& coldValue,
+                                     Storage<T>& hotValue);
+
+        // Selects between the values with a conditional move. Requires that
+        // both values can be read eagerly.
+        Storage<T> CodeGenBranchless(ExpressionTree& tree,
+                                     Storage<T>& trueValue,
+                                     Storage<T>& falseValue,
+                                     std::true_type);
+
+        // Falls back to branches for the types which conditional move does
+        // not support.
+        Storage<T> CodeGenBranchless(ExpressionTree& tree,
+                                     Storage<T>& trueValue,
+                                     Storage<T>& falseValue,
+                                     std::false_type);
+
         FlagExpressionNode<JCC>& m_condition;
         Node<T>& m_trueExpression;
         Node<T>& m_falseExpression;
+
+        // The expected outcome of the condition, used when there is no
+        // profile.
+        const BranchHint m_hint;
     };
 
 
@@ -120,6 +184,7 @@ namespace NativeJIT
         // Overrides of Node<T> methods.
         //
         virtual ExpressionTree::Storage<bool> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
 
 
         //
@@ -133,6 +198,8 @@ namespace NativeJIT
         // resources other than memory from the arena allocator.
         ~RelationalOperatorNode();
 
+        static bool Interpret(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+
         Node<T>& m_left;
         Node<T>& m_right;
     };
@@ -177,11 +244,13 @@ namespace NativeJIT
     ConditionalNode<T, JCC>::ConditionalNode(ExpressionTree& tree,
                                              FlagExpressionNode<JCC>& condition,
                                              Node<T>& trueExpression,
-                                             Node<T>& falseExpression)
+                                             Node<T>& falseExpression,
+                                             BranchHint hint)
         : Node<T>(tree),
           m_condition(condition),
           m_trueExpression(trueExpression),
-          m_falseExpression(falseExpression)
+          m_falseExpression(falseExpression),
+          m_hint(hint)
     {
         m_trueExpression.IncrementParentCount();
         m_falseExpression.IncrementParentCount();
@@ -208,11 +277,6 @@ namespace NativeJIT
     template <typename T, JccType JCC>
     typename ExpressionTree::Storage<T> ConditionalNode<T, JCC>::CodeGenValue(ExpressionTree& tree)
     {
-        X64CodeGenerator& code = tree.GetCodeGenerator();
-
-        Label conditionIsTrue = code.AllocateLabel();
-        Label testCompleted = code.AllocateLabel();
-
         // TODO: Evaluating both expressions in advance of the test is
         // sub-optimal, but it is currently required to guarantee consistent
         // state: the execution in NativeJIT has a continuous flow regardless
@@ -241,11 +305,98 @@ namespace NativeJIT
                              m_trueExpression, trueValue,
                              m_falseExpression, falseValue);
 
+        BranchCounts* counts = tree.GetInstrumentationCounts(*this);
+
+        // The profile-driven layouts read the skipped value, or both values
+        // for the conditional move, before the jump. They fall back to the
+        // default layout if that is not safe.
+        switch (tree.GetBranchLayout(*this))
+        {
+        case BranchLayout::FalseFallThrough:
+            if (CanReadEagerly(trueValue))
+            {
+                return CodeGenFallThrough<JCC>(tree, trueValue, falseValue);
+            }
+            break;
+
+        case BranchLayout::TrueFallThrough:
+            if (CanReadEagerly(falseValue))
+            {
+                return CodeGenFallThrough<InverseJcc<JCC>::c_value>(tree, falseValue, trueValue);
+            }
+            break;
+
+        case BranchLayout::Branchless:
+            if (CanReadEagerly(trueValue) && CanReadEagerly(falseValue))
+            {
+                return CodeGenBranchless(tree, trueValue, falseValue, SupportsConditionalMove());
+            }
+            break;
+
+        default:
+            // Without a profile, the hint moves the unlikely value to a cold
+            // block. The instrumented code keeps the default layout.
+            if (counts == nullptr && m_hint == BranchHint::Likely)
+            {
+                return CodeGenColdBranch<InverseJcc<JCC>::c_value>(tree, falseValue, trueValue);
+            }
+            else if (counts == nullptr && m_hint == BranchHint::Unlikely)
+            {
+                return CodeGenColdBranch<JCC>(tree, trueValue, falseValue);
+            }
+            break;
+        }
+
+        return CodeGenBranches(tree, trueValue, falseValue, counts);
+    }
+
+
+    template <typename T, JccType JCC>
+    unsigned ConditionalNode<T, JCC>::LowerValue(Bytecode& code)
+    {
+        // Each value is evaluated only on its own path, so a value may
+        // dereference a pointer which the condition checks. The paths copy
+        // their value into the same slot.
+        const unsigned condition = m_condition.Lower(code);
+        const unsigned result = code.AddVariable();
+
+        code.BeginSkip(condition, false);
+        code.EmitCopy(m_trueExpression.Lower(code), result);
+        code.EndSkip();
+
+        code.BeginSkip(condition, true);
+        code.EmitCopy(m_falseExpression.Lower(code), result);
+        code.EndSkip();
+
+        return result;
+    }
+
+
+    template <typename T, JccType JCC>
+    bool ConditionalNode<T, JCC>::CanReadEagerly(Storage<T>& value)
+    {
+        return value.GetStorageClass() != StorageClass::Indirect;
+    }
+
+
+    template <typename T, JccType JCC>
+    typename ExpressionTree::Storage<T>
+    ConditionalNode<T, JCC>::CodeGenBranches(ExpressionTree& tree,
+                                             Storage<T>& trueValue,
+                                             Storage<T>& falseValue,
+                                             BranchCounts* counts)
+    {
+        X64CodeGenerator& code = tree.GetCodeGenerator();
+
+        Label conditionIsTrue = code.AllocateLabel();
+        Label testCompleted = code.AllocateLabel();
+
         // Enum that specifies whether the result storage currently holds the
         // true value, false value or neither of them.
         enum class ResultContents { NeitherValue, TrueValue, FalseValue };
         ResultContents resultContents;
         Storage<T> result;
+        Storage<BranchCounts*> countsBase;
 
         {
             // Evaluate the condition to update the CPU flags. No code in this
@@ -255,6 +406,19 @@ namespace NativeJIT
             // to stack) does not affect any flags.
             m_condition.CodeGenFlags(tree);
 
+            // The register with the address of the counters is allocated
+            // first and pinned so that allocating the result register cannot
+            // spill it. Like the result register, it must be set up before
+            // the conditional jump. MOV does not affect the flags.
+            ReferenceCounter countsBasePin;
+
+            if (counts != nullptr)
+            {
+                countsBase = tree.Direct<BranchCounts*>();
+                countsBasePin = countsBase.GetPin();
+                code.EmitImmediate<OpCode::Mov>(countsBase.GetDirectRegister(), counts);
+            }
+
             // Try to re-use a direct register from true/false expressions if
             // possible, otherwise allocate a register. The allocation must be
             // done before the conditional jump so that any register spills
@@ -282,6 +446,13 @@ namespace NativeJIT
 
         // Emit the code for the "condition is false" branch.
 
+        if (counts != nullptr)
+        {
+            code.EmitImmediate<OpCode::Add, 8>(countsBase.GetDirectRegister(),
+                                               static_cast<int32_t>(offsetof(BranchCounts, m_notTaken)),
+                                               1);
+        }
+
         // Move the false value to the result register unless it's already there.
         if (resultContents != ResultContents::FalseValue)
         {
@@ -289,8 +460,9 @@ namespace NativeJIT
         }
 
         // Jump behind the true branch, unless the true branch is empty. The true
-        // branch is empty only if the true value is already in the result storage.
-        if (!(resultContents == ResultContents::TrueValue))
+        // branch is empty only if the true value is already in the result
+        // storage and there is no counter to update.
+        if (!(resultContents == ResultContents::TrueValue && counts == nullptr))
         {
             code.Jmp(testCompleted);
         }
@@ -299,18 +471,181 @@ namespace NativeJIT
 
         code.PlaceLabel(conditionIsTrue);
 
+        if (counts != nullptr)
+        {
+            code.EmitImmediate<OpCode::Add, 8>(countsBase.GetDirectRegister(),
+                                               static_cast<int32_t>(offsetof(BranchCounts, m_taken)),
+                                               1);
+        }
+
         // Move the true value in the result register unless it's already there.
         if (resultContents != ResultContents::TrueValue)
         {
             CodeGenHelpers::Emit<OpCode::Mov>(code, result.GetDirectRegister(), trueValue);
         }
 
+        code.AlignCode(code.GetCodeAlignment().m_join);
+        code.PlaceLabel(testCompleted);
+
+        return result;
+    }
+
+
+    template <typename T, JccType JCC>
+    template <JccType SKIPJCC>
+    typename ExpressionTree::Storage<T>
+    ConditionalNode<T, JCC>::CodeGenFallThrough(ExpressionTree& tree,
+                                                Storage<T>& skipValue,
+                                                Storage<T>& fallThroughValue)
+    {
+        X64CodeGenerator& code = tree.GetCodeGenerator();
+
+        Label testCompleted = code.AllocateLabel();
+        Storage<T> result;
+
+        {
+            // No code in this block is allowed to modify the flags. See the
+            // comment in CodeGenBranches(). Neither the MOV instruction nor
+            // the spilling do.
+            m_condition.CodeGenFlags(tree);
+
+            if (skipValue.GetStorageClass() == StorageClass::Direct
+                && skipValue.IsSoleDataOwner())
+            {
+                result = skipValue;
+            }
+            else
+            {
+                result = tree.Direct<T>();
+                CodeGenHelpers::Emit<OpCode::Mov>(code, result.GetDirectRegister(), skipValue);
+            }
+
+            code.EmitConditionalJump<SKIPJCC>(testCompleted);
+        }
+
+        // The result register may have spilled the fall-through value, but
+        // the MOV below handles any storage class.
+        CodeGenHelpers::Emit<OpCode::Mov>(code, result.GetDirectRegister(), fallThroughValue);
+
+        code.AlignCode(code.GetCodeAlignment().m_join);
+        code.PlaceLabel(testCompleted);
+
+        return result;
+    }
+
+
+    template <typename T, JccType JCC>
+    template <JccType COLDJCC>
+    typename ExpressionTree::Storage<T>
+    ConditionalNode<T, JCC>::CodeGenColdBranch(ExpressionTree& tree,
+                                               Storage<T>& coldValue,
+                                               Storage<T>& hotValue)
+    {
+        X64CodeGenerator& code = tree.GetCodeGenerator();
+
+        Label coldPath = code.AllocateLabel();
+        Label testCompleted = code.AllocateLabel();
+        Storage<T> result;
+        bool isHotValueInResult;
+
+        {
+            // No code in this block is allowed to modify the flags. See the
+            // comment in CodeGenBranches().
+            m_condition.CodeGenFlags(tree);
+
+            isHotValueInResult = hotValue.GetStorageClass() == StorageClass::Direct
+                                 && hotValue.IsSoleDataOwner();
+            result = isHotValueInResult ? hotValue : tree.Direct<T>();
+
+            code.EmitConditionalJump<COLDJCC>(coldPath);
+        }
+
+        // The hot value is loaded only on the hot path since it may
+        // dereference a pointer which the condition guards. The MOV handles
+        // the hot value even if allocating the result register spilled it.
+        if (!isHotValueInResult)
+        {
+            CodeGenHelpers::Emit<OpCode::Mov>(code, result.GetDirectRegister(), hotValue);
+        }
+
+        // The cold block only replaces the result, so the register
+        // allocation is the same on both paths. The MOV handles the cold
+        // value even if allocating the result register spilled it.
+        code.BeginColdBlock();
+        code.PlaceLabel(coldPath);
+        CodeGenHelpers::Emit<OpCode::Mov>(code, result.GetDirectRegister(), coldValue);
+        code.Jmp(testCompleted);
+        code.EndColdBlock();
+
+        code.AlignCode(code.GetCodeAlignment().m_join);
         code.PlaceLabel(testCompleted);
 
         return result;
     }
 
 
+    template <typename T, JccType JCC>
+    typename ExpressionTree::Storage<T>
+    ConditionalNode<T, JCC>::CodeGenBranchless(ExpressionTree& tree,
+                                               Storage<T>& trueValue,
+                                               Storage<T>& falseValue,
+                                               std::true_type)
+    {
+        X64CodeGenerator& code = tree.GetCodeGenerator();
+
+        // CMOV cannot take an immediate source, so the true value needs to
+        // be in a register before the flags are set.
+        if (trueValue.GetStorageClass() == StorageClass::Immediate)
+        {
+            trueValue.ConvertToDirect(false);
+        }
+
+        Storage<T> result;
+
+        // No code between CodeGenFlags() and the CMOV is allowed to modify the
+        // flags. See the comment in CodeGenBranches().
+        m_condition.CodeGenFlags(tree);
+
+        if (falseValue.GetStorageClass() == StorageClass::Direct
+            && falseValue.IsSoleDataOwner())
+        {
+            result = falseValue;
+        }
+        else
+        {
+            result = tree.Direct<T>();
+            CodeGenHelpers::Emit<OpCode::Mov>(code, result.GetDirectRegister(), falseValue);
+        }
+
+        // The allocation of the result register may have spilled the true
+        // value, so check its storage class only now.
+        if (trueValue.GetStorageClass() == StorageClass::Direct)
+        {
+            code.EmitConditionalMove<JCC>(result.GetDirectRegister(),
+                                          trueValue.GetDirectRegister());
+        }
+        else
+        {
+            code.EmitConditionalMove<JCC>(result.GetDirectRegister(),
+                                          trueValue.GetBaseRegister(),
+                                          trueValue.GetOffset());
+        }
+
+        return result;
+    }
+
+
+    template <typename T, JccType JCC>
+    typename ExpressionTree::Storage<T>
+    ConditionalNode<T, JCC>::CodeGenBranchless(ExpressionTree& tree,
+                                               Storage<T>& trueValue,
+                                               Storage<T>& falseValue,
+                                               std::false_type)
+    {
+        return CodeGenFallThrough<JCC>(tree, trueValue, falseValue);
+    }
+
+
     //*************************************************************************
     //
     // Template definitions for RelationalOperator
@@ -365,12 +700,39 @@ namespace NativeJIT
         code.PlaceLabel(conditionIsTrue);
         code.EmitImmediate<OpCode::Mov>(result.GetDirectRegister(), true);
 
+        code.AlignCode(code.GetCodeAlignment().m_join);
         code.PlaceLabel(testCompleted);
 
         return result;
     }
 
 
+    template <typename T, JccType JCC>
+    unsigned RelationalOperatorNode<T, JCC>::LowerValue(Bytecode& code)
+    {
+        const unsigned left = m_left.Lower(code);
+        const unsigned right = m_right.Lower(code);
+
+        return code.Emit(&Interpret, { left, right });
+    }
+
+
+    template <typename T, JccType JCC>
+    bool RelationalOperatorNode<T, JCC>::Interpret(Bytecode::Slot* slots,
+                                                   Bytecode::Instruction const & instruction)
+    {
+        typedef typename CanonicalRegisterStorageType<T>::Type RegisterValue;
+
+        Bytecode::Write<bool>(
+            slots,
+            instruction.m_result,
+            Bytecode::Compare<JCC>(Bytecode::Read<RegisterValue>(slots, instruction.m_operands[0]),
+                                   Bytecode::Read<RegisterValue>(slots, instruction.m_operands[1])));
+
+        return true;
+    }
+
+
     template <typename T, JccType JCC>
     void RelationalOperatorNode<T, JCC>::CodeGenFlags(ExpressionTree& tree)
     {
@@ -46,6 +46,7 @@ namespace NativeJIT
         //
 
         virtual Storage<T> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
         virtual void Print(std::ostream& out) const override;
 
     private:
@@ -92,6 +93,15 @@ namespace NativeJIT
     }
 
 
+    template <typename T>
+    unsigned DependentNode<T>::LowerValue(Bytecode& code)
+    {
+        m_prerequisiteNode.Lower(code);
+
+        return m_dependentNode.Lower(code);
+    }
+
+
     template <typename T>
     void DependentNode<T>::Print(std::ostream& out) const
     {
@@ -0,0 +1,508 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <limits>
+#include <type_traits>
+
+#include "NativeJIT/BitOperations.h"
+#include "NativeJIT/Bytecode.h"
+#include "NativeJIT/CodeGen/X64CodeGenerator.h"     // OpCode type.
+#include "NativeJIT/Nodes/Node.h"
+#include "Temporary/Assert.h"
+
+
+namespace NativeJIT
+{
+    // The multiplier and the shift which replace the division by a constant
+    // with the multiplication by its scaled reciprocal, taking the high half
+    // of the product (T. Granlund and P. Montgomery, "Division by Invariant
+    // Integers using Multiplication", as presented in Hacker's Delight,
+    // chapter 10).
+    template <typename T>
+    struct DivisionMagic
+    {
+        static_assert(std::is_integral<T>::value && sizeof(T) >= 4,
+                      "DivisionMagic requires a 32 or 64-bit integral type.");
+
+        typedef typename std::make_unsigned<T>::type Unsigned;
+
+        static const unsigned c_bitCount = sizeof(T) * 8;
+
+        // Unsigned: q = mulhi(n, m_multiplier) >> m_shift if m_add is false,
+        // otherwise the multiplier needs one more bit than T has and
+        // q = (((n - t) >> 1) + t) >> (m_shift - 1) where t = mulhi(n, m_multiplier).
+        //
+        // Signed: t = mulhs(n, m_multiplier), plus n if the divisor is
+        // positive and the multiplier negative, minus n in the opposite
+        // case, q = (t >> m_shift) + 1 if t is negative.
+        //
+        // The divisor must not be zero, a power of two or, if signed, -1.
+        DivisionMagic(T divisor);
+
+        T m_multiplier;
+        unsigned m_shift;
+        bool m_add;
+
+    private:
+        void Compute(T divisor, std::false_type /* isSigned */);
+        void Compute(T divisor, std::true_type /* isSigned */);
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for DivisionMagic
+    //
+    //*************************************************************************
+    template <typename T>
+    DivisionMagic<T>::DivisionMagic(T divisor)
+        : m_multiplier(0),
+          m_shift(0),
+          m_add(false)
+    {
+        Compute(divisor, std::is_signed<T>());
+    }
+
+
+    template <typename T>
+    void DivisionMagic<T>::Compute(T divisor, std::false_type /* isSigned */)
+    {
+        const Unsigned d = divisor;
+        const Unsigned top = static_cast<Unsigned>(1) << (c_bitCount - 1);
+
+        LogThrowAssert(d > 1 && (d & (d - 1)) != 0,
+                       "Unexpected divisor %llu",
+                       static_cast<unsigned long long>(d));
+
+        // nc is the largest value such that nc % d == d - 1.
+        const Unsigned nc = static_cast<Unsigned>(-1) - static_cast<Unsigned>(0 - d) % d;
+        unsigned p = c_bitCount - 1;
+
+        // q1 / r1 = 2^p / nc, q2 / r2 = (2^p - 1) / d.
+        Unsigned q1 = top / nc;
+        Unsigned r1 = top - q1 * nc;
+        Unsigned q2 = (top - 1) / d;
+        Unsigned r2 = (top - 1) - q2 * d;
+        Unsigned delta;
+
+        do
+        {
+            ++p;
+
+            if (r1 >= nc - r1)
+            {
+                q1 = 2 * q1 + 1;
+                r1 = 2 * r1 - nc;
+            }
+            else
+            {
+                q1 = 2 * q1;
+                r1 = 2 * r1;
+            }
+
+            if (r2 + 1 >= d - r2)
+            {
+                m_add = m_add || q2 >= top - 1;
+                q2 = 2 * q2 + 1;
+                r2 = 2 * r2 + 1 - d;
+            }
+            else
+            {
+                m_add = m_add || q2 >= top;
+                q2 = 2 * q2;
+                r2 = 2 * r2 + 1;
+            }
+
+            delta = d - 1 - r2;
+        } while (p < 2 * c_bitCount && (q1 < delta || (q1 == delta && r1 == 0)));
+
+        m_multiplier = q2 + 1;
+        m_shift = p - c_bitCount;
+    }
+
+
+    template <typename T>
+    void DivisionMagic<T>::Compute(T divisor, std::true_type /* isSigned */)
+    {
+        const Unsigned top = static_cast<Unsigned>(1) << (c_bitCount - 1);
+        const Unsigned ad = divisor < 0
+                            ? static_cast<Unsigned>(0) - static_cast<Unsigned>(divisor)
+                            : static_cast<Unsigned>(divisor);
+
+        LogThrowAssert(ad > 1 && (ad & (ad - 1)) != 0,
+                       "Unexpected divisor %lld",
+                       static_cast<long long>(divisor));
+
+        // anc is the absolute value of the largest nc such that
+        // nc % |d| == |d| - 1 (smallest for negative divisors).
+        const Unsigned t = top + (static_cast<Unsigned>(divisor) >> (c_bitCount - 1));
+        const Unsigned anc = t - 1 - t % ad;
+        unsigned p = c_bitCount - 1;
+
+        // q1 / r1 = 2^p / anc, q2 / r2 = 2^p / |d|.
+        Unsigned q1 = top / anc;
+        Unsigned r1 = top - q1 * anc;
+        Unsigned q2 = top / ad;
+        Unsigned r2 = top - q2 * ad;
+        Unsigned delta;
+
+        do
+        {
+            ++p;
+
+            q1 = 2 * q1;
+            r1 = 2 * r1;
+            if (r1 >= anc)
+            {
+                ++q1;
+                r1 -= anc;
+            }
+
+            q2 = 2 * q2;
+            r2 = 2 * r2;
+            if (r2 >= ad)
+            {
+                ++q2;
+                r2 -= ad;
+            }
+
+            delta = ad - r2;
+        } while (q1 < delta || (q1 == delta && r1 == 0));
+
+        const Unsigned multiplier = divisor < 0
+                                    ? static_cast<Unsigned>(0) - (q2 + 1)
+                                    : q2 + 1;
+
+        m_multiplier = static_cast<T>(multiplier);
+        m_shift = p - c_bitCount;
+    }
+
+
+    // Implements integer division (REMAINDER == false) and remainder
+    // (REMAINDER == true) by a constant without div/idiv. The quotient is
+    // computed by a multiplication by the magic number from DivisionMagic
+    // followed by shifts, or by shifts alone when a signed divisor is a
+    // power of two (ExpressionNodeFactory reduces the unsigned powers of two
+    // as well as 0, 1 and -1 before creating the node). The remainder is
+    // then n - q * d.
+    //
+    // The multiplication places its result in rdx:rax, so, as with
+    // DivisionNode, the node claims these two registers from the allocator.
+    template <typename T, bool REMAINDER>
+    class DivisionImmediateNode : public Node<T>
+    {
+    public:
+        static_assert(std::is_integral<T>::value && sizeof(T) >= 4,
+                      "DivisionImmediateNode requires a 32 or 64-bit integral type.");
+
+        DivisionImmediateNode(ExpressionTree& tree, Node<T>& left, T right);
+
+        virtual Storage<T> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
+
+        virtual void Print(std::ostream& out) const override;
+
+    private:
+        typedef typename Storage<T>::DirectRegister DirectRegister;
+        typedef typename std::make_unsigned<T>::type Unsigned;
+
+        static const unsigned c_bitCount = sizeof(T) * 8;
+
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~DivisionImmediateNode();
+
+        // Returns |right| if it is a power of two, zero otherwise. Only used
+        // for the signed divisors.
+        static Unsigned GetPowerOfTwo(T right);
+
+        Storage<T> CodeGenPowerOfTwo(ExpressionTree& tree, Storage<T>& left);
+        Storage<T> CodeGenMagic(ExpressionTree& tree, Storage<T>& left);
+
+        // Turns the quotient into the remainder in place or in the scratch
+        // register. Returns the storage holding the remainder.
+        Storage<T> CodeGenRemainder(ExpressionTree& tree,
+                                    DirectRegister left,
+                                    Storage<T>& quotient,
+                                    Storage<T>& scratch);
+
+        static bool Interpret(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+
+        Node<T>& m_left;
+        const T m_right;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for DivisionImmediateNode
+    //
+    //*************************************************************************
+    template <typename T, bool REMAINDER>
+    DivisionImmediateNode<T, REMAINDER>::DivisionImmediateNode(ExpressionTree& tree,
+                                                               Node<T>& left,
+                                                               T right)
+        : Node<T>(tree),
+          m_left(left),
+          m_right(right)
+    {
+        m_left.IncrementParentCount();
+        // m_right is not a Node, so no IncrementParentCount() call.
+    }
+
+
+    template <typename T, bool REMAINDER>
+    Storage<T> DivisionImmediateNode<T, REMAINDER>::CodeGenValue(ExpressionTree& tree)
+    {
+        auto left = m_left.CodeGen(tree);
+
+        return GetPowerOfTwo(m_right) != 0
+            ? CodeGenPowerOfTwo(tree, left)
+            : CodeGenMagic(tree, left);
+    }
+
+
+    template <typename T, bool REMAINDER>
+    typename DivisionImmediateNode<T, REMAINDER>::Unsigned
+    DivisionImmediateNode<T, REMAINDER>::GetPowerOfTwo(T right)
+    {
+        if (!std::is_signed<T>::value)
+        {
+            return 0;
+        }
+
+        const Unsigned absolute = right < 0
+                                  ? static_cast<Unsigned>(0) - static_cast<Unsigned>(right)
+                                  : static_cast<Unsigned>(right);
+
+        return (absolute & (absolute - 1)) == 0 ? absolute : 0;
+    }
+
+
+    template <typename T, bool REMAINDER>
+    Storage<T> DivisionImmediateNode<T, REMAINDER>::CodeGenPowerOfTwo(
+        ExpressionTree& tree,
+        Storage<T>& left)
+    {
+        auto & code = tree.GetCodeGenerator();
+
+        unsigned shift;
+        BitOp::GetLowestBitSet(GetPowerOfTwo(m_right), &shift);
+
+        auto leftRegister = left.ConvertToDirect(false);
+        ReferenceCounter leftPin = left.GetPin();
+
+        auto result = tree.Direct<T>();
+        auto resultRegister = result.GetDirectRegister();
+
+        // Arithmetic shift rounds towards negative infinity, so the negative
+        // dividends are biased by |d| - 1 to round towards zero instead.
+        code.Emit<OpCode::Mov>(resultRegister, leftRegister);
+        code.EmitImmediate<OpCode::Sar>(resultRegister, static_cast<uint8_t>(c_bitCount - 1));
+        code.EmitImmediate<OpCode::Shr>(resultRegister, static_cast<uint8_t>(c_bitCount - shift));
+        code.Emit<OpCode::Add>(resultRegister, leftRegister);
+
+        if (REMAINDER)
+        {
+            // Clear the low bits to get q * |d|, then compute n - q * |d|.
+            // The sign of the divisor does not affect the remainder.
+            code.EmitImmediate<OpCode::Sar>(resultRegister, static_cast<uint8_t>(shift));
+            code.EmitImmediate<OpCode::Shl>(resultRegister, static_cast<uint8_t>(shift));
+            code.Emit<OpCode::Neg>(resultRegister);
+            code.Emit<OpCode::Add>(resultRegister, leftRegister);
+        }
+        else
+        {
+            code.EmitImmediate<OpCode::Sar>(resultRegister, static_cast<uint8_t>(shift));
+
+            if (m_right < 0)
+            {
+                code.Emit<OpCode::Neg>(resultRegister);
+            }
+        }
+
+        return result;
+    }
+
+
+    template <typename T, bool REMAINDER>
+    Storage<T> DivisionImmediateNode<T, REMAINDER>::CodeGenMagic(
+        ExpressionTree& tree,
+        Storage<T>& left)
+    {
+        auto & code = tree.GetCodeGenerator();
+        const DirectRegister accumulator(0);
+        const DirectRegister data(2);
+        const DivisionMagic<T> magic(m_right);
+
+        auto low = tree.Direct<T>(accumulator);
+        ReferenceCounter lowPin = low.GetPin();
+
+        auto high = tree.Direct<T>(data);
+        ReferenceCounter highPin = high.GetPin();
+
+        auto leftRegister = left.ConvertToDirect(false);
+        ReferenceCounter leftPin = left.GetPin();
+
+        code.EmitImmediate<OpCode::Mov>(accumulator, magic.m_multiplier);
+
+        if (std::is_signed<T>::value)
+        {
+            code.Emit<OpCode::IMul>(leftRegister);
+
+            if (m_right > 0 && magic.m_multiplier < 0)
+            {
+                code.Emit<OpCode::Add>(data, leftRegister);
+            }
+            else if (m_right < 0 && magic.m_multiplier > 0)
+            {
+                code.Emit<OpCode::Sub>(data, leftRegister);
+            }
+
+            if (magic.m_shift > 0)
+            {
+                code.EmitImmediate<OpCode::Sar>(data, static_cast<uint8_t>(magic.m_shift));
+            }
+
+            // Add one to the negative quotients to round towards zero.
+            code.Emit<OpCode::Mov>(accumulator, data);
+            code.EmitImmediate<OpCode::Shr>(accumulator, static_cast<uint8_t>(c_bitCount - 1));
+            code.Emit<OpCode::Add>(data, accumulator);
+
+            return REMAINDER
+                ? CodeGenRemainder(tree, leftRegister, high, low)
+                : high;
+        }
+        else
+        {
+            code.Emit<OpCode::Mul>(leftRegister);
+
+            if (!magic.m_add)
+            {
+                if (magic.m_shift > 0)
+                {
+                    code.EmitImmediate<OpCode::Shr>(data, static_cast<uint8_t>(magic.m_shift));
+                }
+
+                return REMAINDER
+                    ? CodeGenRemainder(tree, leftRegister, high, low)
+                    : high;
+            }
+            else
+            {
+                // The multiplier is 2^N + m_multiplier, compute
+                // (n + mulhi(n, m_multiplier)) >> m_shift without overflow.
+                code.Emit<OpCode::Mov>(accumulator, leftRegister);
+                code.Emit<OpCode::Sub>(accumulator, data);
+                code.EmitImmediate<OpCode::Shr>(accumulator, static_cast<uint8_t>(1));
+                code.Emit<OpCode::Add>(accumulator, data);
+
+                if (magic.m_shift > 1)
+                {
+                    code.EmitImmediate<OpCode::Shr>(accumulator, static_cast<uint8_t>(magic.m_shift - 1));
+                }
+
+                return REMAINDER
+                    ? CodeGenRemainder(tree, leftRegister, low, high)
+                    : low;
+            }
+        }
+    }
+
+
+    template <typename T, bool REMAINDER>
+    Storage<T> DivisionImmediateNode<T, REMAINDER>::CodeGenRemainder(
+        ExpressionTree& tree,
+        DirectRegister left,
+        Storage<T>& quotient,
+        Storage<T>& scratch)
+    {
+        auto & code = tree.GetCodeGenerator();
+        const auto quotientRegister = quotient.GetDirectRegister();
+        const auto scratchRegister = scratch.GetDirectRegister();
+
+        // The low half of the product is the same for signed and unsigned
+        // multiplication and imul sign extends its 32-bit immediate.
+        const int64_t right = static_cast<int64_t>(m_right);
+        Storage<T>* product = &quotient;
+
+        if (sizeof(T) == 4
+            || (right >= (std::numeric_limits<int32_t>::min)()
+                && right <= (std::numeric_limits<int32_t>::max)()))
+        {
+            code.EmitImmediate<OpCode::IMul>(quotientRegister, static_cast<int32_t>(m_right));
+        }
+        else
+        {
+            code.EmitImmediate<OpCode::Mov>(scratchRegister, m_right);
+            code.Emit<OpCode::IMul>(scratchRegister, quotientRegister);
+            product = &scratch;
+        }
+
+        const auto productRegister = product->GetDirectRegister();
+
+        code.Emit<OpCode::Neg>(productRegister);
+        code.Emit<OpCode::Add>(productRegister, left);
+
+        return *product;
+    }
+
+
+    template <typename T, bool REMAINDER>
+    unsigned DivisionImmediateNode<T, REMAINDER>::LowerValue(Bytecode& code)
+    {
+        const unsigned left = m_left.Lower(code);
+
+        return code.Emit(&Interpret, { left }, static_cast<Bytecode::Slot>(m_right));
+    }
+
+
+    template <typename T, bool REMAINDER>
+    bool DivisionImmediateNode<T, REMAINDER>::Interpret(Bytecode::Slot* slots,
+                                                        Bytecode::Instruction const & instruction)
+    {
+        typedef typename std::remove_cv<T>::type Value;
+
+        const Value left = Bytecode::Read<Value>(slots, instruction.m_operands[0]);
+        const Value right = static_cast<Value>(instruction.m_immediate);
+
+        Bytecode::Write<Value>(slots,
+                               instruction.m_result,
+                               REMAINDER ? left % right : left / right);
+
+        return true;
+    }
+
+
+    template <typename T, bool REMAINDER>
+    void DivisionImmediateNode<T, REMAINDER>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out, REMAINDER ? "Remainder (immediate)" : "Division (immediate)");
+
+        out << ", left = " << m_left.GetId()
+            << ", right = " << m_right;
+    }
+}
@@ -0,0 +1,187 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <type_traits>
+
+#include "NativeJIT/Bytecode.h"
+#include "NativeJIT/CodeGen/X64CodeGenerator.h"     // OpCode type.
+#include "NativeJIT/CodeGenHelpers.h"
+#include "NativeJIT/Nodes/Node.h"
+
+
+namespace NativeJIT
+{
+    // Implements integer division (REMAINDER == false) and remainder
+    // (REMAINDER == true) with div or idiv depending on the signedness of T.
+    // The dividend is placed into rdx:rax and the quotient and remainder are
+    // returned in rax and rdx respectively, so the node claims these two
+    // registers from the allocator, moving their previous contents elsewhere.
+    //
+    // As with the C++ operators, the divisor must not be zero and the
+    // quotient must be representable (f. ex. INT32_MIN / -1 is not); the
+    // generated code raises a divide error otherwise.
+    //
+    // 8-bit division uses ax rather than dx:ax and 16-bit division is not any
+    // faster than 32-bit, so ExpressionNodeFactory widens the operands
+    // narrower than 32 bits before creating the node.
+    template <typename T, bool REMAINDER>
+    class DivisionNode : public Node<T>
+    {
+    public:
+        static_assert(std::is_integral<T>::value && sizeof(T) >= 4,
+                      "DivisionNode requires a 32 or 64-bit integral type.");
+
+        DivisionNode(ExpressionTree& tree, Node<T>& left, Node<T>& right);
+
+        virtual Storage<T> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
+
+        virtual void Print(std::ostream& out) const override;
+
+    private:
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~DivisionNode();
+
+        static bool Interpret(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+
+        Node<T>& m_left;
+        Node<T>& m_right;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for DivisionNode
+    //
+    //*************************************************************************
+    template <typename T, bool REMAINDER>
+    DivisionNode<T, REMAINDER>::DivisionNode(ExpressionTree& tree,
+                                             Node<T>& left,
+                                             Node<T>& right)
+        : Node<T>(tree),
+          m_left(left),
+          m_right(right)
+    {
+        m_left.IncrementParentCount();
+        m_right.IncrementParentCount();
+    }
+
+
+    template <typename T, bool REMAINDER>
+    Storage<T> DivisionNode<T, REMAINDER>::CodeGenValue(ExpressionTree& tree)
+    {
+        typedef typename Storage<T>::DirectRegister DirectRegister;
+
+        auto & code = tree.GetCodeGenerator();
+        const DirectRegister accumulator(0);
+        const DirectRegister data(2);
+
+        Storage<T> dividend;
+        Storage<T> divisor;
+
+        this->CodeGenInOrder(tree,
+                             m_left, dividend,
+                             m_right, divisor);
+
+        Storage<T> high;
+
+        {
+            // Bring the dividend into the accumulator unless it is already
+            // there and can be modified. Claiming the register moves its
+            // current contents (possibly the dividend or the divisor)
+            // elsewhere.
+            if (dividend.GetStorageClass() != StorageClass::Direct
+                || !dividend.GetDirectRegister().IsSameHardwareRegister(accumulator)
+                || !dividend.IsSoleDataOwner())
+            {
+                auto target = tree.Direct<T>(accumulator);
+                CodeGenHelpers::Emit<OpCode::Mov>(code, accumulator, dividend);
+                dividend = target;
+            }
+
+            ReferenceCounter dividendPin = dividend.GetPin();
+
+            high = tree.Direct<T>(data);
+            ReferenceCounter highPin = high.GetPin();
+
+            // Neither div nor idiv accept an immediate.
+            auto divisorRegister = divisor.ConvertToDirect(false);
+
+            if (std::is_signed<T>::value)
+            {
+                code.EmitSignExtendAccumulator<sizeof(T)>();
+                code.Emit<OpCode::IDiv>(divisorRegister);
+            }
+            else
+            {
+                code.Emit<OpCode::Xor>(data, data);
+                code.Emit<OpCode::Div>(divisorRegister);
+            }
+        }
+
+        return REMAINDER ? high : dividend;
+    }
+
+
+    template <typename T, bool REMAINDER>
+    unsigned DivisionNode<T, REMAINDER>::LowerValue(Bytecode& code)
+    {
+        const unsigned left = m_left.Lower(code);
+        const unsigned right = m_right.Lower(code);
+
+        return code.Emit(&Interpret, { left, right });
+    }
+
+
+    template <typename T, bool REMAINDER>
+    bool DivisionNode<T, REMAINDER>::Interpret(Bytecode::Slot* slots,
+                                               Bytecode::Instruction const & instruction)
+    {
+        // Unlike the other arithmetic, the result depends on the signedness,
+        // so the operands are read as T rather than as the register type.
+        typedef typename std::remove_cv<T>::type Value;
+
+        const Value left = Bytecode::Read<Value>(slots, instruction.m_operands[0]);
+        const Value right = Bytecode::Read<Value>(slots, instruction.m_operands[1]);
+
+        Bytecode::Write<Value>(slots,
+                               instruction.m_result,
+                               REMAINDER ? left % right : left / right);
+
+        return true;
+    }
+
+
+    template <typename T, bool REMAINDER>
+    void DivisionNode<T, REMAINDER>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out, REMAINDER ? "Remainder" : "Division");
+
+        out << ", left = " << m_left.GetId();
+        out << ", right = " << m_right.GetId();
+    }
+}
@@ -23,6 +23,7 @@
 
 #pragma once
 
+#include "NativeJIT/Bytecode.h"
 #include "NativeJIT/Nodes/Node.h"
 
 
@@ -39,6 +40,7 @@ namespace NativeJIT
         //
 
         virtual ExpressionTree::Storage<FIELD*> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
         virtual void Print(std::ostream& out) const override;
 
         virtual void ReleaseReferencesToChildren() override;
@@ -124,6 +126,19 @@ namespace NativeJIT
     }
 
 
+    template <typename OBJECT, typename FIELD>
+    unsigned FieldPointerNode<OBJECT, FIELD>::LowerValue(Bytecode& code)
+    {
+        const unsigned base = m_collapsedBase->Lower(code);
+
+        return m_collapsedOffset == 0
+            ? base
+            : code.Emit(&Bytecode::AddOffset,
+                        { base },
+                        static_cast<Bytecode::Slot>(static_cast<int64_t>(m_collapsedOffset)));
+    }
+
+
     template <typename OBJECT, typename FIELD>
     bool FieldPointerNode<OBJECT, FIELD>::GetBaseAndOffset(NodeBase*& base, int32_t& offset) const
     {
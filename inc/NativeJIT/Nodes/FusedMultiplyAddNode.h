@@ -0,0 +1,177 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <cmath>                                    // For std::fma.
+#include <type_traits>
+
+#include "NativeJIT/Bytecode.h"
+#include "NativeJIT/CodeGen/X64CodeGenerator.h"     // OpCode type.
+#include "NativeJIT/Nodes/Node.h"
+#include "Temporary/Assert.h"
+
+
+namespace NativeJIT
+{
+    // Computes addend + left * right with a single rounding using the FMA
+    // instruction set extension. The node is created in place of an addition
+    // whose operand is a floating point multiplication (see
+    // NodeBase::GetFactors()), which is then optimized away unless it's used
+    // elsewhere. Besides the shorter instruction sequence, this saves the
+    // register which would hold the product.
+    template <typename T>
+    class FusedMultiplyAddNode : public Node<T>
+    {
+    public:
+        FusedMultiplyAddNode(ExpressionTree& tree, Node<T>& addend, Node<T>& product);
+
+        virtual ExpressionTree::Storage<T> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
+
+        virtual void Print(std::ostream& out) const override;
+
+    private:
+        static_assert(std::is_floating_point<T>::value,
+                      "Fused multiply-add is only available for floating point values.");
+
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~FusedMultiplyAddNode();
+
+        static bool Interpret(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+
+        Node<T>& m_addend;
+        Node<T>& m_product;
+
+        // The factors of m_product, which are evaluated directly.
+        Node<T>* m_left;
+        Node<T>* m_right;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for FusedMultiplyAddNode
+    //
+    //*************************************************************************
+    template <typename T>
+    FusedMultiplyAddNode<T>::FusedMultiplyAddNode(ExpressionTree& tree,
+                                                  Node<T>& addend,
+                                                  Node<T>& product)
+        : Node<T>(tree),
+          m_addend(addend),
+          m_product(product),
+          m_left(nullptr),
+          m_right(nullptr)
+    {
+        NodeBase* left;
+        NodeBase* right;
+
+        LogThrowAssert(product.GetFactors(left, right),
+                       "Node %u is not a multiplication",
+                       product.GetId());
+
+        // The factors have the type of the product.
+        m_left = static_cast<Node<T>*>(left);
+        m_right = static_cast<Node<T>*>(right);
+
+        // The product is not evaluated by this node, so it's marked as
+        // referenced in order to allow it to be optimized away.
+        product.MarkReferenced();
+
+        m_addend.IncrementParentCount();
+        m_left->IncrementParentCount();
+        m_right->IncrementParentCount();
+    }
+
+
+    template <typename T>
+    typename ExpressionTree::Storage<T> FusedMultiplyAddNode<T>::CodeGenValue(ExpressionTree& tree)
+    {
+        auto & code = tree.GetCodeGenerator();
+
+        // The addend is typically the longer chain of the accumulated terms,
+        // so it's evaluated first.
+        auto addend = m_addend.CodeGen(tree);
+
+        Storage<T> left;
+        Storage<T> right;
+
+        this->CodeGenInOrder(tree,
+                             *m_left, left,
+                             *m_right, right);
+
+        {
+            // The factors are only read. The addend accumulates the result.
+            auto leftRegister = left.ConvertToDirect(false);
+            ReferenceCounter leftPin = left.GetPin();
+            auto rightRegister = right.ConvertToDirect(false);
+            ReferenceCounter rightPin = right.GetPin();
+
+            auto addendRegister = addend.ConvertToDirect(true);
+
+            code.Emit<OpCode::Vfmadd231>(addendRegister, leftRegister, rightRegister);
+        }
+
+        return addend;
+    }
+
+
+    template <typename T>
+    unsigned FusedMultiplyAddNode<T>::LowerValue(Bytecode& code)
+    {
+        const unsigned addend = m_addend.Lower(code);
+        const unsigned left = m_left->Lower(code);
+        const unsigned right = m_right->Lower(code);
+
+        return code.Emit(&Interpret, { addend, left, right });
+    }
+
+
+    template <typename T>
+    bool FusedMultiplyAddNode<T>::Interpret(Bytecode::Slot* slots,
+                                            Bytecode::Instruction const & instruction)
+    {
+        Bytecode::Write<T>(slots,
+                           instruction.m_result,
+                           std::fma(Bytecode::Read<T>(slots, instruction.m_operands[1]),
+                                    Bytecode::Read<T>(slots, instruction.m_operands[2]),
+                                    Bytecode::Read<T>(slots, instruction.m_operands[0])));
+
+        return true;
+    }
+
+
+    template <typename T>
+    void FusedMultiplyAddNode<T>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out, "FusedMultiplyAdd");
+
+        out << ", addend = " << m_addend.GetId()
+            << ", product = " << m_product.GetId()
+            << ", left = " << m_left->GetId()
+            << ", right = " << m_right->GetId();
+    }
+}
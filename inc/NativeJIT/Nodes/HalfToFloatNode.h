@@ -0,0 +1,141 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+
+#include "NativeJIT/Bytecode.h"
+#include "NativeJIT/CodeGen/X64CodeGenerator.h"     // OpCode type.
+#include "NativeJIT/HalfPrecision.h"
+#include "NativeJIT/Nodes/Node.h"
+
+
+namespace NativeJIT
+{
+    // Converts the 16-bit floating point encoding held in the low bits of
+    // the child to a float. A bfloat16 is the upper half of a float, so it
+    // only takes a shift and a move to the float register. An IEEE half is
+    // converted with vcvtph2ps, which requires the F16C extension; the
+    // factory calls HalfPrecision<HalfFormat::Half>::ToFloat() instead when
+    // it's not available.
+    template <HalfFormat FORMAT>
+    class HalfToFloatNode : public Node<float>
+    {
+    public:
+        // The child holds the zero extended encoding.
+        HalfToFloatNode(ExpressionTree& tree, Node<uint32_t>& child);
+
+        virtual Storage<float> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
+
+        virtual void Print(std::ostream& out) const override;
+
+    private:
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~HalfToFloatNode();
+
+        static bool Interpret(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+
+        Node<uint32_t>& m_child;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for HalfToFloatNode
+    //
+    //*************************************************************************
+    template <HalfFormat FORMAT>
+    HalfToFloatNode<FORMAT>::HalfToFloatNode(ExpressionTree& tree, Node<uint32_t>& child)
+        : Node<float>(tree),
+          m_child(child)
+    {
+        m_child.IncrementParentCount();
+    }
+
+
+    template <HalfFormat FORMAT>
+    Storage<float> HalfToFloatNode<FORMAT>::CodeGenValue(ExpressionTree& tree)
+    {
+        auto & code = tree.GetCodeGenerator();
+        auto bits = m_child.CodeGen(tree);
+
+        auto result = tree.Direct<float>();
+        auto resultRegister = result.GetDirectRegister();
+
+        {
+            // The shift for bfloat16 modifies the bits.
+            auto bitsRegister = bits.ConvertToDirect(FORMAT == HalfFormat::BFloat16);
+            ReferenceCounter bitsPin = bits.GetPin();
+
+            if (FORMAT == HalfFormat::BFloat16)
+            {
+                code.EmitImmediate<OpCode::Shl>(bitsRegister, static_cast<uint8_t>(16));
+                code.EmitVectorMoveDword(resultRegister, bitsRegister);
+            }
+            else
+            {
+                code.EmitVectorMoveDword(resultRegister, bitsRegister);
+                code.EmitConvertHalfToFloat(resultRegister, resultRegister);
+            }
+        }
+
+        return result;
+    }
+
+
+    template <HalfFormat FORMAT>
+    unsigned HalfToFloatNode<FORMAT>::LowerValue(Bytecode& code)
+    {
+        const unsigned child = m_child.Lower(code);
+
+        return code.Emit(&Interpret, { child });
+    }
+
+
+    template <HalfFormat FORMAT>
+    bool HalfToFloatNode<FORMAT>::Interpret(Bytecode::Slot* slots,
+                                            Bytecode::Instruction const & instruction)
+    {
+        const uint32_t bits = Bytecode::Read<uint32_t>(slots, instruction.m_operands[0]);
+
+        Bytecode::Write<float>(slots,
+                               instruction.m_result,
+                               HalfPrecision<FORMAT>::ToFloat(static_cast<uint16_t>(bits)));
+
+        return true;
+    }
+
+
+    template <HalfFormat FORMAT>
+    void HalfToFloatNode<FORMAT>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out,
+                                  FORMAT == HalfFormat::Half ? "HalfToFloat" : "BFloat16ToFloat");
+
+        out << ", child = " << m_child.GetId();
+    }
+}
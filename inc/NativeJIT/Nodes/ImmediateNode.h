@@ -25,6 +25,7 @@
 
 #include <type_traits>
 
+#include "NativeJIT/Bytecode.h"
 #include "NativeJIT/CodeGen/ValuePredicates.h"
 #include "NativeJIT/Nodes/ImmediateNodeDecls.h"
 
@@ -61,6 +62,13 @@ namespace NativeJIT
     }
 
 
+    template <typename T>
+    unsigned ImmediateNode<T, ImmediateCategory::InlineImmediate>::LowerValue(Bytecode& code)
+    {
+        return code.AddConstant(m_value);
+    }
+
+
     //*************************************************************************
     //
     // Template specializations for ImmediateNode for RIPRelativeImmediate types.
@@ -75,7 +83,7 @@ namespace NativeJIT
         tree.AddRIPRelative(*this);
 
         // m_offset will be initialized with the correct value during pass0
-        // of compilation in the call to EmitStaticData().
+        // of compilation when the constant pool is emitted.
         m_offset = 0;
     }
 
@@ -97,17 +105,26 @@ namespace NativeJIT
     }
 
 
+    template <typename T>
+    unsigned ImmediateNode<T, ImmediateCategory::RIPRelativeImmediate>::LowerValue(Bytecode& code)
+    {
+        return code.AddConstant(m_value);
+    }
+
+
     template <typename T>
     void ImmediateNode<T, ImmediateCategory::RIPRelativeImmediate>::EmitStaticData(ExpressionTree& tree)
     {
-        auto & code = tree.GetCodeGenerator();
-        code.AdvanceToAlignment<T>();
-        m_offset = code.CurrentPosition();
-
-        // Emit the value using a canonical type since the EmitValueBytes
-        // method intentionally has a limited number of input types. Basic
-        // types will be unchanged, but f. ex. function pointers will be
-        // emitted as uint64_t.
-        code.EmitBytes(ForcedCast<typename CanonicalRegisterStorageType<T>::Type>(m_value));
+        // Add the value using a canonical type. Basic types will be
+        // unchanged, but f. ex. function pointers will be added as uint64_t,
+        // so that the same addresses share the constant regardless of their
+        // types.
+        const auto value = ForcedCast<typename CanonicalRegisterStorageType<T>::Type>(m_value);
+
+        tree.AddConstant(&value,
+                         sizeof(value),
+                         sizeof(value),
+                         std::is_pointer<T>::value || std::is_reference<T>::value,
+                         m_offset);
     }
 }
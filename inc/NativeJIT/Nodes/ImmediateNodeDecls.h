@@ -49,6 +49,7 @@ namespace NativeJIT
         //
         virtual void Print(std::ostream& out) const override;
         virtual ExpressionTree::Storage<T> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
 
     private:
         // WARNING: This class is designed to be allocated by an arena allocator,
@@ -66,6 +67,11 @@ namespace NativeJIT
     //
     //*************************************************************************
 
+    // Nodes with static data read through RIP-relative operands. Called
+    // during pass 0 of the compilation, before any code is generated.
+    // EmitStaticData() either adds the data to the constant pool (see
+    // ExpressionTree::AddConstant()) or emits it directly into the code
+    // buffer.
     class RIPRelativeImmediate
     {
     public:
@@ -86,6 +92,7 @@ namespace NativeJIT
         //
         virtual void Print(std::ostream& out) const override;
         virtual ExpressionTree::Storage<T> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
 
 
         //
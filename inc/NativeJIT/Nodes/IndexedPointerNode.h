@@ -0,0 +1,263 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+
+#include "NativeJIT/BitOperations.h"
+#include "NativeJIT/Bytecode.h"
+#include "NativeJIT/CodeGen/X64CodeGenerator.h"     // OpCode type.
+#include "NativeJIT/Nodes/Node.h"
+
+
+namespace NativeJIT
+{
+    // IndexedPointerNode implements the &array[index] operation, i.e.
+    // array + index * sizeof(T), when index is known only at runtime. The
+    // address is calculated with a single lea. When sizeof(T) is 1, 2, 4 or 8,
+    // an IndirectNode which dereferences the address folds the index into
+    // the memory operand of the load instead.
+    template <typename T>
+    class IndexedPointerNode : public Node<T*>
+    {
+    public:
+        IndexedPointerNode(ExpressionTree& tree, Node<T*>& array, Node<uint64_t>& index);
+
+        // Arrays with known size are indexed in place, which allows the
+        // offset of an array field to be collapsed into the address.
+        template <size_t SIZE>
+        IndexedPointerNode(ExpressionTree& tree, Node<T(*)[SIZE]>& array, Node<uint64_t>& index);
+
+        //
+        // Overrides of Node methods
+        //
+
+        virtual ExpressionTree::Storage<T*> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
+        virtual void Print(std::ostream& out) const override;
+
+        virtual void ReleaseReferencesToChildren() override;
+
+    protected:
+        virtual bool GetBaseIndexAndOffset(NodeBase*& base,
+                                           NodeBase*& index,
+                                           uint8_t& scale,
+                                           int32_t& offset) const override;
+
+    private:
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~IndexedPointerNode();
+
+        IndexedPointerNode(ExpressionTree& tree, NodeBase& array, Node<uint64_t>& index);
+
+        static bool Interpret(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+
+        // The IMul instruction doesn't support 64-bit immediates, but there's
+        // also no need to support types whose size is larger than INT32_MAX.
+        static_assert(sizeof(T) <= INT32_MAX, "Unsupported type");
+
+        // The largest scale supported by the SIB byte which divides sizeof(T)
+        // and the factor by which the index needs to be multiplied to account
+        // for the rest of the size.
+        static const uint8_t c_scale = sizeof(T) % 8 == 0 ? 8
+                                       : sizeof(T) % 4 == 0 ? 4
+                                       : sizeof(T) % 2 == 0 ? 2
+                                       : 1;
+        static const int32_t c_multiplier = static_cast<int32_t>(sizeof(T) / c_scale);
+
+        NodeBase& m_array;
+        Node<uint64_t>& m_index;
+
+        // If the array is a field of another object, m_collapsedArray and
+        // m_collapsedOffset refer to that object and the field's offset
+        // within it. Otherwise, they are the array and zero.
+        // IMPORTANT: the constructor depends on collapsed array/offset being
+        // listed after the original array.
+        NodeBase* m_collapsedArray;
+        int32_t m_collapsedOffset;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for IndexedPointerNode
+    //
+    //*************************************************************************
+    template <typename T>
+    IndexedPointerNode<T>::IndexedPointerNode(ExpressionTree& tree,
+                                              Node<T*>& array,
+                                              Node<uint64_t>& index)
+        : IndexedPointerNode(tree, static_cast<NodeBase&>(array), index)
+    {
+    }
+
+
+    template <typename T>
+    template <size_t SIZE>
+    IndexedPointerNode<T>::IndexedPointerNode(ExpressionTree& tree,
+                                              Node<T(*)[SIZE]>& array,
+                                              Node<uint64_t>& index)
+        : IndexedPointerNode(tree, static_cast<NodeBase&>(array), index)
+    {
+    }
+
+
+    template <typename T>
+    IndexedPointerNode<T>::IndexedPointerNode(ExpressionTree& tree,
+                                              NodeBase& array,
+                                              Node<uint64_t>& index)
+        : Node<T*>(tree),
+          m_array(array),
+          m_index(index),
+          // Note: there is constructor order dependency for these two.
+          m_collapsedArray(&m_array),
+          m_collapsedOffset(0)
+    {
+        NodeBase* grandparent;
+        int32_t parentOffset;
+
+        if (array.GetBaseAndOffset(grandparent, parentOffset))
+        {
+            m_collapsedArray = grandparent;
+            m_collapsedOffset = parentOffset;
+            array.MarkReferenced();
+        }
+
+        m_collapsedArray->IncrementParentCount();
+        m_index.IncrementParentCount();
+    }
+
+
+    template <typename T>
+    typename ExpressionTree::Storage<T*> IndexedPointerNode<T>::CodeGenValue(ExpressionTree& tree)
+    {
+        auto & code = tree.GetCodeGenerator();
+
+        auto array = m_collapsedArray->CodeGenAsBase(tree);
+        auto index = m_index.CodeGen(tree);
+
+        {
+            // The index is modified only if lea cannot scale it by itself.
+            auto indexRegister = index.ConvertToDirect(c_multiplier != 1);
+            ReferenceCounter indexPin = index.GetPin();
+
+            if (c_multiplier != 1)
+            {
+                unsigned bitIndex;
+
+                if (BitOp::GetNonZeroBitCount(static_cast<uint32_t>(c_multiplier)) == 1
+                    && BitOp::GetLowestBitSet(static_cast<uint64_t>(c_multiplier), &bitIndex))
+                {
+                    code.EmitImmediate<OpCode::Shl>(indexRegister, static_cast<uint8_t>(bitIndex));
+                }
+                else
+                {
+                    code.EmitImmediate<OpCode::IMul>(indexRegister, c_multiplier);
+                }
+            }
+
+            auto arrayRegister = array.ConvertToDirect(true);
+
+            code.Emit<OpCode::Lea>(arrayRegister,
+                                   arrayRegister,
+                                   indexRegister,
+                                   c_scale,
+                                   m_collapsedOffset);
+        }
+
+        // With the added index, the type changes from void* to T*.
+        return ExpressionTree::Storage<T*>(array);
+    }
+
+
+    template <typename T>
+    unsigned IndexedPointerNode<T>::LowerValue(Bytecode& code)
+    {
+        const unsigned array = m_collapsedArray->Lower(code);
+        const unsigned index = m_index.Lower(code);
+
+        return code.Emit(&Interpret,
+                         { array, index },
+                         static_cast<Bytecode::Slot>(static_cast<int64_t>(m_collapsedOffset)));
+    }
+
+
+    template <typename T>
+    bool IndexedPointerNode<T>::Interpret(Bytecode::Slot* slots,
+                                          Bytecode::Instruction const & instruction)
+    {
+        slots[instruction.m_result] = slots[instruction.m_operands[0]]
+                                      + slots[instruction.m_operands[1]] * sizeof(T)
+                                      + static_cast<int64_t>(instruction.m_immediate);
+
+        return true;
+    }
+
+
+    template <typename T>
+    bool IndexedPointerNode<T>::GetBaseIndexAndOffset(NodeBase*& base,
+                                                      NodeBase*& index,
+                                                      uint8_t& scale,
+                                                      int32_t& offset) const
+    {
+        if (c_multiplier != 1)
+        {
+            return false;
+        }
+
+        base = m_collapsedArray;
+        index = &m_index;
+        scale = c_scale;
+        offset = m_collapsedOffset;
+
+        return true;
+    }
+
+
+    template <typename T>
+    void IndexedPointerNode<T>::ReleaseReferencesToChildren()
+    {
+        m_collapsedArray->DecrementParentCount();
+        m_index.DecrementParentCount();
+    }
+
+
+    template <typename T>
+    void IndexedPointerNode<T>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out, "IndexedPointerNode");
+
+        out << ", array ID = " << m_array.GetId()
+            << ", index ID = " << m_index.GetId()
+            << ", element size = " << sizeof(T);
+
+        if (m_array.GetId() != m_collapsedArray->GetId())
+        {
+            out << ", collapsed array ID = " << m_collapsedArray->GetId()
+                << ", collapsed offset = " << m_collapsedOffset;
+        }
+    }
+}
@@ -23,6 +23,10 @@
 
 #pragma once
 
+#include <cstring>    // For memcpy.
+#include <utility>    // For std::move.
+
+#include "NativeJIT/Bytecode.h"
 #include "NativeJIT/Nodes/Node.h"
 
 
@@ -41,6 +45,8 @@ namespace NativeJIT
         //
 
         virtual ExpressionTree::Storage<T> CodeGenValue(ExpressionTree& tree) override;
+        virtual bool IsLoadedOnUse() const override;
+        virtual unsigned LowerValue(Bytecode& code) override;
         virtual void Print(std::ostream& out) const override;
 
         // Note: IndirectNode doesn't implement GetBaseAndOffset() method which
@@ -53,6 +59,10 @@ namespace NativeJIT
         // resources other than memory from the arena allocator.
         ~IndirectNode();
 
+        ExpressionTree::Storage<T> CodeGenIndexed(ExpressionTree& tree);
+
+        static bool Interpret(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+
         NodeBase& m_base;
         const int32_t m_index;
 
@@ -64,6 +74,13 @@ namespace NativeJIT
         // listed after the original base/offset.
         NodeBase* m_collapsedBase;
         int32_t m_collapsedOffset;
+
+        // If the collapsed base is an address with a scaled index (see
+        // NodeBase::GetBaseIndexAndOffset()), the address is computed with a
+        // single lea and m_collapsedBase/Offset refer to the base of that
+        // address. Otherwise, m_collapsedIndex is nullptr.
+        NodeBase* m_collapsedIndex;
+        uint8_t m_scale;
     };
 
 
@@ -79,7 +96,9 @@ namespace NativeJIT
           m_index(index),
           // Note: there is constructor order dependency for these two.
           m_collapsedBase(&m_base),
-          m_collapsedOffset(sizeof(T) * m_index)
+          m_collapsedOffset(sizeof(T) * m_index),
+          m_collapsedIndex(nullptr),
+          m_scale(0)
     {
         NodeBase* grandparent;
         int32_t parentOffset;
@@ -93,6 +112,24 @@ namespace NativeJIT
             base.MarkReferenced();
         }
 
+        NodeBase* indexedBase;
+        NodeBase* indexNode;
+        uint8_t scale;
+        int32_t indexedOffset;
+
+        // If the (collapsed) base is an indexed address such as &array[i],
+        // compute [array + i * scale + offset] with a single lea.
+        if (m_collapsedBase->GetBaseIndexAndOffset(indexedBase, indexNode, scale, indexedOffset))
+        {
+            m_collapsedBase->MarkReferenced();
+            m_collapsedBase = indexedBase;
+            m_collapsedOffset += indexedOffset;
+            m_collapsedIndex = indexNode;
+            m_scale = scale;
+
+            m_collapsedIndex->IncrementParentCount();
+        }
+
         m_collapsedBase->IncrementParentCount();
     }
 
@@ -100,6 +137,11 @@ namespace NativeJIT
     template <typename T>
     typename ExpressionTree::Storage<T> IndirectNode<T>::CodeGenValue(ExpressionTree& tree)
     {
+        if (m_collapsedIndex != nullptr)
+        {
+            return CodeGenIndexed(tree);
+        }
+
         // The base node's type ensures that the storage represent a T* rather
         // than the void* returned by CodeGenAsBase(). The local offset calculated
         // from the index skips the required number of T's, so it still represents
@@ -109,6 +151,72 @@ namespace NativeJIT
     }
 
 
+    template <typename T>
+    typename ExpressionTree::Storage<T> IndirectNode<T>::CodeGenIndexed(ExpressionTree& tree)
+    {
+        auto base = m_collapsedBase->CodeGenAsBase(tree);
+        auto index = m_collapsedIndex->CodeGenAsBase(tree);
+
+        {
+            // The index register must survive the conversion of the base.
+            auto indexRegister = index.ConvertToDirect(false);
+            ReferenceCounter indexPin = index.GetPin();
+            auto baseRegister = base.ConvertToDirect(true);
+
+            tree.GetCodeGenerator().Emit<OpCode::Lea>(baseRegister,
+                                                      baseRegister,
+                                                      indexRegister,
+                                                      m_scale,
+                                                      m_collapsedOffset);
+        }
+
+        // Like in CodeGenValue(), the storage refers to the value instead of
+        // loading it, so that the load happens only where the value is used,
+        // f. ex. only in the arm of a conditional which checks the index.
+        return ExpressionTree::Storage<T>(std::move(base), 0);
+    }
+
+
+    template <typename T>
+    bool IndirectNode<T>::IsLoadedOnUse() const
+    {
+        // The storage returned by CodeGenValue() refers to the value.
+        return true;
+    }
+
+
+    template <typename T>
+    unsigned IndirectNode<T>::LowerValue(Bytecode& code)
+    {
+        // The bytecode doesn't benefit from the folded index, so the address
+        // is evaluated through the original base node in that case.
+        const bool isIndexed = m_collapsedIndex != nullptr;
+        const unsigned base = isIndexed ? m_base.Lower(code) : m_collapsedBase->Lower(code);
+        const int32_t offset = isIndexed ? static_cast<int32_t>(sizeof(T) * m_index) : m_collapsedOffset;
+
+        return code.Emit(&Interpret,
+                         { base },
+                         static_cast<Bytecode::Slot>(static_cast<int64_t>(offset)));
+    }
+
+
+    template <typename T>
+    bool IndirectNode<T>::Interpret(Bytecode::Slot* slots,
+                                    Bytecode::Instruction const & instruction)
+    {
+        typedef typename std::remove_cv<T>::type Value;
+
+        auto address = Bytecode::Read<char const *>(slots, instruction.m_operands[0])
+                       + static_cast<int64_t>(instruction.m_immediate);
+        Value value;
+        memcpy(&value, address, sizeof(Value));
+
+        Bytecode::Write<Value>(slots, instruction.m_result, value);
+
+        return true;
+    }
+
+
     template <typename T>
     void IndirectNode<T>::Print(std::ostream& out) const
     {
@@ -123,5 +231,12 @@ namespace NativeJIT
                 << ", collapsed base ID = " << m_collapsedBase->GetId()
                 << ", collapsed offset = " << m_collapsedOffset;
         }
+
+        if (m_collapsedIndex != nullptr)
+        {
+            out
+                << ", index ID = " << m_collapsedIndex->GetId()
+                << ", scale = " << static_cast<unsigned>(m_scale);
+        }
     }
 }
@@ -0,0 +1,300 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <type_traits>
+
+#include "NativeJIT/Bytecode.h"
+#include "NativeJIT/CodeGen/X64CodeGenerator.h"
+#include "NativeJIT/Model.h"
+#include "NativeJIT/Nodes/Node.h"
+#include "Temporary/Assert.h"
+
+
+namespace NativeJIT
+{
+    // Sums the Model entries of up to eight Packed keys with a single AVX2
+    // gather rather than with one load per key. The entries are added in
+    // the order of the horizontal sum of the gathered vector, i.e.
+    // ((m0 + m4) + (m1 + m5)) + ((m2 + m6) + (m3 + m7)), where the missing
+    // keys contribute zero. See ExpressionNodeFactory::ApplyModelSum(), which
+    // creates the node only if CpuFeature::Avx2 is available.
+    template <typename PACKED>
+    class ModelGatherNode : public Node<float>
+    {
+    public:
+        static const unsigned c_maxKeyCount = 8;
+
+        ModelGatherNode(ExpressionTree& tree,
+                        Node<Model<PACKED>*>& model,
+                        Node<PACKED>* const * keys,
+                        unsigned keyCount);
+
+        //
+        // Overrides of Node methods.
+        //
+
+        virtual ExpressionTree::Storage<float> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
+        virtual void Print(std::ostream& out) const override;
+
+    private:
+        static_assert(sizeof(PACKED) == sizeof(int32_t),
+                      "The gather requires 32-bit indices.");
+
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~ModelGatherNode();
+
+        static int32_t DataOffset()
+        {
+            return static_cast<int32_t>(reinterpret_cast<uint64_t>(&(static_cast<Model<PACKED>*>(nullptr)->m_data)));
+        }
+
+        // Loads the entry of the key in operand 1 from the model in operand 0.
+        static bool InterpretLoad(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+        static bool InterpretAdd(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+
+        NodeBase& m_model;
+
+        // The model's address can sometimes be expressed as an offset from
+        // another object, see IndirectNode.
+        // IMPORTANT: the constructor depends on collapsed base/offset being
+        // listed after the original base.
+        NodeBase* m_collapsedBase;
+        int32_t m_collapsedOffset;
+
+        Node<PACKED>* m_keys[c_maxKeyCount];
+        const unsigned m_keyCount;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for ModelGatherNode
+    //
+    //*************************************************************************
+    template <typename PACKED>
+    ModelGatherNode<PACKED>::ModelGatherNode(ExpressionTree& tree,
+                                             Node<Model<PACKED>*>& model,
+                                             Node<PACKED>* const * keys,
+                                             unsigned keyCount)
+        : Node<float>(tree),
+          m_model(model),
+          // Note: there is constructor order dependency for these two.
+          m_collapsedBase(&m_model),
+          m_collapsedOffset(DataOffset()),
+          m_keyCount(keyCount)
+    {
+        LogThrowAssert(keyCount > 0 && keyCount <= c_maxKeyCount,
+                       "Invalid number of keys %u",
+                       keyCount);
+
+        NodeBase* grandparent;
+        int32_t parentOffset;
+
+        if (model.GetBaseAndOffset(grandparent, parentOffset))
+        {
+            m_collapsedBase = grandparent;
+            m_collapsedOffset += parentOffset;
+            model.MarkReferenced();
+        }
+
+        m_collapsedBase->IncrementParentCount();
+
+        for (unsigned i = 0; i < c_maxKeyCount; ++i)
+        {
+            m_keys[i] = i < keyCount ? keys[i] : nullptr;
+
+            if (m_keys[i] != nullptr)
+            {
+                m_keys[i]->IncrementParentCount();
+            }
+        }
+    }
+
+
+    template <typename PACKED>
+    typename ExpressionTree::Storage<float> ModelGatherNode<PACKED>::CodeGenValue(ExpressionTree& tree)
+    {
+        auto & code = tree.GetCodeGenerator();
+
+        Storage<PACKED> keys[c_maxKeyCount];
+
+        for (unsigned i = 0; i < m_keyCount; ++i)
+        {
+            keys[i] = m_keys[i]->CodeGen(tree);
+        }
+
+        auto base = m_collapsedBase->CodeGenAsBase(tree);
+
+        auto result = tree.Direct<float>();
+        ReferenceCounter resultPin = result.GetPin();
+        auto indices = tree.Direct<float>();
+        ReferenceCounter indicesPin = indices.GetPin();
+        auto mask = tree.Direct<float>();
+        ReferenceCounter maskPin = mask.GetPin();
+
+        auto resultRegister = result.GetDirectRegister();
+        auto indicesRegister = indices.GetDirectRegister();
+        auto maskRegister = mask.GetDirectRegister();
+
+        // The lower four indices are assembled in place, the upper four in
+        // the mask register which is set up only after that. The VEX encoded
+        // moves and inserts clear the rest of the vector, so the indices of
+        // the missing keys are zero.
+        for (unsigned i = 0; i < m_keyCount; ++i)
+        {
+            auto key = keys[i].ConvertToDirect(false);
+            auto vector = i < 4 ? indicesRegister : maskRegister;
+
+            if (i % 4 == 0)
+            {
+                code.EmitVectorMoveDword(vector, key);
+            }
+            else
+            {
+                code.EmitVectorInsertDword(vector, key, static_cast<uint8_t>(i % 4));
+            }
+
+            keys[i].Reset();
+        }
+
+        if (m_keyCount > 4)
+        {
+            code.EmitVectorInsertHigh(indicesRegister, maskRegister);
+        }
+
+        auto baseRegister = base.ConvertToDirect(false);
+
+        // Only the lanes of the present keys are loaded, the others keep the
+        // zero of the cleared result.
+        code.EmitVectorZero(resultRegister);
+        code.EmitVectorAllOnes(maskRegister);
+
+        if (m_keyCount < c_maxKeyCount)
+        {
+            code.EmitVectorBlendDwords(maskRegister,
+                                       resultRegister,
+                                       static_cast<uint8_t>(0xff << m_keyCount));
+        }
+
+        code.EmitGatherFloats(resultRegister,
+                              baseRegister,
+                              indicesRegister,
+                              m_collapsedOffset,
+                              maskRegister);
+
+        code.EmitVectorExtractHigh(indicesRegister, resultRegister);
+        code.EmitVectorAddFloats(resultRegister, indicesRegister);
+        code.EmitVectorHorizontalAddFloats(resultRegister, resultRegister);
+        code.EmitVectorHorizontalAddFloats(resultRegister, resultRegister);
+
+        // The rest of the function uses the legacy SSE encoding.
+        code.EmitVzeroupper();
+
+        return result;
+    }
+
+
+    template <typename PACKED>
+    unsigned ModelGatherNode<PACKED>::LowerValue(Bytecode& code)
+    {
+        const unsigned base = m_collapsedBase->Lower(code);
+        unsigned lanes[c_maxKeyCount];
+
+        for (unsigned i = 0; i < c_maxKeyCount; ++i)
+        {
+            lanes[i] = i < m_keyCount
+                ? code.Emit(&InterpretLoad,
+                            { base, m_keys[i]->Lower(code) },
+                            static_cast<Bytecode::Slot>(static_cast<int64_t>(m_collapsedOffset)))
+                : code.AddConstant(0.0f);
+        }
+
+        // Reproduce the additions of the generated code.
+        for (unsigned i = 0; i < 4; ++i)
+        {
+            lanes[i] = code.Emit(&InterpretAdd, { lanes[i], lanes[i + 4] });
+        }
+
+        return code.Emit(&InterpretAdd,
+                         { code.Emit(&InterpretAdd, { lanes[0], lanes[1] }),
+                           code.Emit(&InterpretAdd, { lanes[2], lanes[3] }) });
+    }
+
+
+    template <typename PACKED>
+    bool ModelGatherNode<PACKED>::InterpretLoad(Bytecode::Slot* slots,
+                                                Bytecode::Instruction const & instruction)
+    {
+        auto data = reinterpret_cast<float const *>(
+            Bytecode::Read<char const *>(slots, instruction.m_operands[0])
+            + static_cast<int64_t>(instruction.m_immediate));
+        auto key = Bytecode::Read<PACKED>(slots, instruction.m_operands[1]);
+
+        Bytecode::Write<float>(slots, instruction.m_result, data[key.m_bits]);
+
+        return true;
+    }
+
+
+    template <typename PACKED>
+    bool ModelGatherNode<PACKED>::InterpretAdd(Bytecode::Slot* slots,
+                                               Bytecode::Instruction const & instruction)
+    {
+        Bytecode::Write<float>(slots,
+                               instruction.m_result,
+                               Bytecode::Read<float>(slots, instruction.m_operands[0])
+                               + Bytecode::Read<float>(slots, instruction.m_operands[1]));
+
+        return true;
+    }
+
+
+    template <typename PACKED>
+    void ModelGatherNode<PACKED>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out, "ModelGatherNode");
+
+        out << ", model ID = " << m_model.GetId();
+
+        if (m_model.GetId() != m_collapsedBase->GetId())
+        {
+            out
+                << ", collapsed base ID = " << m_collapsedBase->GetId()
+                << ", collapsed offset = " << m_collapsedOffset;
+        }
+
+        out << ", keys = [";
+
+        for (unsigned i = 0; i < m_keyCount; ++i)
+        {
+            out << (i == 0 ? "" : ", ") << m_keys[i]->GetId();
+        }
+
+        out << "]";
+    }
+}
@@ -39,6 +39,7 @@
 
 namespace NativeJIT
 {
+    class Bytecode;
     class ExpressionTree;
 
     // Used in NodeBase as an argument.
@@ -82,6 +83,11 @@ namespace NativeJIT
         bool IsReferenced() const;
         void MarkReferenced();
 
+        // Lowers the node to bytecode and returns the slot which holds its
+        // value. Like with CodeGen(), a node with multiple parents is lowered
+        // only once.
+        unsigned Lower(Bytecode& code);
+
         //
         // Non-pure virtual methods.
         //
@@ -109,6 +115,59 @@ namespace NativeJIT
         // ReleaseReferencesToChildren().
         virtual bool GetBaseAndOffset(NodeBase*& base, int32_t& offset) const;
 
+        // For nodes that represent addresses of the form base + index * scale
+        // + offset, where scale is 1, 2, 4 or 8, populates the out parameters
+        // and returns true. Otherwise leaves the out parameters unchanged and
+        // returns false (default implementation).
+        // This allows to fold the index arithmetic into the memory operand of
+        // the instruction which dereferences the address. Like with
+        // GetBaseAndOffset(), callers that override this method also need to
+        // override ReleaseReferencesToChildren().
+        virtual bool GetBaseIndexAndOffset(NodeBase*& base,
+                                           NodeBase*& index,
+                                           uint8_t& scale,
+                                           int32_t& offset) const;
+
+        // For nodes that represent the floating point product of two nodes,
+        // populates the factors and returns true. Otherwise leaves the out
+        // parameters unchanged and returns false (default implementation).
+        // This allows to fuse the multiplication into the addition which
+        // consumes the product. Like with GetBaseAndOffset(), callers that
+        // override this method also need to override
+        // ReleaseReferencesToChildren().
+        virtual bool GetFactors(NodeBase*& left, NodeBase*& right) const;
+
+        // For nodes that apply the associative operation op to two operands,
+        // populates the operands and returns true. Otherwise leaves the out
+        // parameters unchanged and returns false (default implementation).
+        // This allows to flatten a chain of operations into a single list
+        // which can be evaluated as a balanced tree. Like with
+        // GetBaseAndOffset(), callers that override this method also need to
+        // override ReleaseReferencesToChildren().
+        virtual bool GetAssociativeOperands(OpCode op, NodeBase*& left, NodeBase*& right) const;
+
+        // For nodes that replace a component of a Packed<> with a value,
+        // populates the component index and the operands and returns true.
+        // Otherwise leaves the out parameters unchanged and returns false
+        // (default implementation). This allows to extract the component
+        // directly from the value. Like with GetBaseAndOffset(), callers
+        // that override this method also need to override
+        // ReleaseReferencesToChildren().
+        virtual bool GetInsertedComponent(unsigned& index, NodeBase*& packed, NodeBase*& value) const;
+
+        // Returns whether the value of the node is read from memory only where
+        // it is used (see IndirectNode), f. ex. only in the arm of a
+        // conditional which checks the pointer. Such a node is not evaluated
+        // ahead of the rest of the tree by ExpressionTree::Lower() even if it
+        // has several parents. Default implementation returns false.
+        virtual bool IsLoadedOnUse() const;
+
+        // Appends the instructions that evaluate the node to the bytecode and
+        // returns the result slot. Called once per node through Lower(). The
+        // default implementation reports the node as unsupported, so trees
+        // that contain it can only be compiled.
+        virtual unsigned LowerValue(Bytecode& code);
+
         //
         // Pure virtual methods.
         //
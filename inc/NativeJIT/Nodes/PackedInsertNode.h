@@ -0,0 +1,206 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <type_traits>
+
+#include "NativeJIT/Bytecode.h"
+#include "NativeJIT/CodeGen/X64CodeGenerator.h"     // OpCode type.
+#include "NativeJIT/Nodes/Node.h"
+#include "NativeJIT/Packed.h"
+
+
+namespace NativeJIT
+{
+    // Replaces the component at INDEX of a Packed<> with the low bits of a
+    // value. The shift and the masks are known from the PACKED type, so the
+    // node emits and/shl for the value and and/or to merge it, which doesn't
+    // depend on BMI2 pdep. The value bits which don't fit in the component
+    // are discarded.
+    //
+    // The node reports its operands through GetInsertedComponent() so that
+    // the factory can fold extracting a component from the result.
+    template <typename PACKED, unsigned INDEX>
+    class PackedInsertNode : public Node<PACKED>
+    {
+    public:
+        typedef PackedComponentPosition<PACKED, INDEX> Position;
+
+        // The mask of the component's bits in the packed.
+        static const PackedUnderlyingType c_mask = static_cast<PackedUnderlyingType>(
+            ((1ull << Position::c_bitCount) - 1) << Position::c_startBit);
+
+        PackedInsertNode(ExpressionTree& tree,
+                         Node<PACKED>& packed,
+                         Node<PackedUnderlyingType>& value);
+
+        //
+        // Overrides of Node methods
+        //
+        virtual Storage<PACKED> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
+
+        virtual void ReleaseReferencesToChildren() override;
+        virtual bool GetInsertedComponent(unsigned& index,
+                                          NodeBase*& packed,
+                                          NodeBase*& value) const override;
+
+        virtual void Print(std::ostream& out) const override;
+
+    private:
+        static const unsigned c_underlyingBitCount = sizeof(PackedUnderlyingType) * 8;
+
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~PackedInsertNode();
+
+        static bool Interpret(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+
+        Node<PACKED>& m_packed;
+        Node<PackedUnderlyingType>& m_value;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for PackedInsertNode
+    //
+    //*************************************************************************
+    template <typename PACKED, unsigned INDEX>
+    PackedInsertNode<PACKED, INDEX>::PackedInsertNode(ExpressionTree& tree,
+                                                      Node<PACKED>& packed,
+                                                      Node<PackedUnderlyingType>& value)
+        : Node<PACKED>(tree),
+          m_packed(packed),
+          m_value(value)
+    {
+        static_assert(std::is_pod<PACKED>::value, "PACKED must be a POD type.");
+
+        m_packed.IncrementParentCount();
+        m_value.IncrementParentCount();
+    }
+
+
+    template <typename PACKED, unsigned INDEX>
+    Storage<PACKED> PackedInsertNode<PACKED, INDEX>::CodeGenValue(ExpressionTree& tree)
+    {
+        auto & code = tree.GetCodeGenerator();
+
+        Storage<PACKED> packed;
+        Storage<PackedUnderlyingType> value;
+
+        this->CodeGenInOrder(tree,
+                             m_packed, packed,
+                             m_value, value);
+
+        {
+            auto packedRegister = packed.ConvertToDirect(true);
+            ReferenceCounter packedPin = packed.GetPin();
+            auto valueRegister = value.ConvertToDirect(true);
+            ReferenceCounter valuePin = value.GetPin();
+
+            // The shift discards the high bits of a component which ends at
+            // the most significant bit, the others need the mask.
+            if (Position::c_startBit + Position::c_bitCount < c_underlyingBitCount)
+            {
+                code.EmitImmediate<OpCode::And>(
+                    valueRegister,
+                    static_cast<int32_t>(c_mask >> Position::c_startBit));
+            }
+
+            if (Position::c_startBit > 0)
+            {
+                code.EmitImmediate<OpCode::Shl>(valueRegister,
+                                                static_cast<uint8_t>(Position::c_startBit));
+            }
+
+            code.EmitImmediate<OpCode::And>(packedRegister, static_cast<int32_t>(~c_mask));
+            code.Emit<OpCode::Or>(packedRegister, valueRegister);
+        }
+
+        return packed;
+    }
+
+
+    template <typename PACKED, unsigned INDEX>
+    unsigned PackedInsertNode<PACKED, INDEX>::LowerValue(Bytecode& code)
+    {
+        const unsigned packed = m_packed.Lower(code);
+        const unsigned value = m_value.Lower(code);
+
+        return code.Emit(&Interpret, { packed, value });
+    }
+
+
+    template <typename PACKED, unsigned INDEX>
+    bool PackedInsertNode<PACKED, INDEX>::Interpret(Bytecode::Slot* slots,
+                                                    Bytecode::Instruction const & instruction)
+    {
+        const PackedUnderlyingType packed = Bytecode::Read<PACKED>(slots, instruction.m_operands[0]).m_bits;
+        const PackedUnderlyingType value = Bytecode::Read<PackedUnderlyingType>(slots, instruction.m_operands[1]);
+
+        // The shift is done in 64 bits since the start bit of a single
+        // component packed can be zero with 32 bits in the component.
+        const PackedUnderlyingType bits = (packed & ~c_mask)
+            | static_cast<PackedUnderlyingType>((static_cast<uint64_t>(value) << Position::c_startBit) & c_mask);
+
+        Bytecode::Write<PACKED>(slots, instruction.m_result, PACKED::FromBits(bits));
+
+        return true;
+    }
+
+
+    template <typename PACKED, unsigned INDEX>
+    void PackedInsertNode<PACKED, INDEX>::ReleaseReferencesToChildren()
+    {
+        m_packed.DecrementParentCount();
+        m_value.DecrementParentCount();
+    }
+
+
+    template <typename PACKED, unsigned INDEX>
+    bool PackedInsertNode<PACKED, INDEX>::GetInsertedComponent(unsigned& index,
+                                                               NodeBase*& packed,
+                                                               NodeBase*& value) const
+    {
+        index = INDEX;
+        packed = &m_packed;
+        value = &m_value;
+
+        return true;
+    }
+
+
+    template <typename PACKED, unsigned INDEX>
+    void PackedInsertNode<PACKED, INDEX>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out, "PackedInsert");
+
+        out << ", packed = " << m_packed.GetId()
+            << ", value = " << m_value.GetId()
+            << ", start = " << Position::c_startBit
+            << ", length = " << Position::c_bitCount;
+    }
+}
@@ -0,0 +1,360 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <type_traits>
+
+#include "NativeJIT/BitOperations.h"
+#include "NativeJIT/Bytecode.h"
+#include "NativeJIT/CodeGen/CpuFeatures.h"
+#include "NativeJIT/CodeGen/X64CodeGenerator.h"     // OpCode type.
+#include "NativeJIT/Nodes/Node.h"
+#include "NativeJIT/TypePredicates.h"
+
+
+namespace NativeJIT
+{
+    // Implements the BMI2 pdep (deposit the low bits of the value at the
+    // positions of the mask bits) and pext (gather the value bits at the
+    // positions of the mask bits into the low bits) operations.
+    //
+    // Without BMI2, a mask which is an immediate with a single run of set
+    // bits turns into a shift and an and. Any other mask is processed one
+    // set bit at a time in a loop.
+    template <OpCode OP, typename T>
+    class ParallelBitsNode : public Node<T>
+    {
+    public:
+        static_assert(OP == OpCode::Pdep || OP == OpCode::Pext,
+                      "Unsupported parallel bits operation.");
+        static_assert(std::is_integral<T>::value && sizeof(T) >= 4,
+                      "ParallelBitsNode requires a 32 or 64-bit integral type.");
+
+        ParallelBitsNode(ExpressionTree& tree, Node<T>& value, Node<T>& mask);
+
+        virtual Storage<T> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
+
+        virtual void Print(std::ostream& out) const override;
+
+    private:
+        typedef typename Storage<T>::DirectRegister DirectRegister;
+        typedef typename std::make_unsigned<T>::type Unsigned;
+
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~ParallelBitsNode();
+
+        // Emits the shift and the and if the mask is an immediate with a
+        // single run of set bits (or no set bits at all) and returns true.
+        // Returns false without emitting any code otherwise. Only 32-bit
+        // values can be in immediate storage.
+        static bool TryEmitContiguous(ExpressionTree& tree,
+                                      DirectRegister value,
+                                      Storage<T>& mask,
+                                      std::true_type /* canBeImmediate */);
+        static bool TryEmitContiguous(ExpressionTree& tree,
+                                      DirectRegister value,
+                                      Storage<T>& mask,
+                                      std::false_type /* canBeImmediate */);
+
+        static Storage<T> EmitLoop(ExpressionTree& tree,
+                                   DirectRegister value,
+                                   DirectRegister mask,
+                                   std::integral_constant<OpCode, OpCode::Pdep>);
+        static Storage<T> EmitLoop(ExpressionTree& tree,
+                                   DirectRegister value,
+                                   DirectRegister mask,
+                                   std::integral_constant<OpCode, OpCode::Pext>);
+
+        static bool Interpret(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+
+        Node<T>& m_value;
+        Node<T>& m_mask;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for ParallelBitsNode
+    //
+    //*************************************************************************
+    template <OpCode OP, typename T>
+    ParallelBitsNode<OP, T>::ParallelBitsNode(ExpressionTree& tree,
+                                              Node<T>& value,
+                                              Node<T>& mask)
+        : Node<T>(tree),
+          m_value(value),
+          m_mask(mask)
+    {
+        m_value.IncrementParentCount();
+        m_mask.IncrementParentCount();
+    }
+
+
+    template <OpCode OP, typename T>
+    Storage<T> ParallelBitsNode<OP, T>::CodeGenValue(ExpressionTree& tree)
+    {
+        auto & code = tree.GetCodeGenerator();
+
+        Storage<T> value;
+        Storage<T> mask;
+
+        this->CodeGenInOrder(tree,
+                             m_value, value,
+                             m_mask, mask);
+
+        auto valueRegister = value.ConvertToDirect(true);
+        ReferenceCounter valuePin = value.GetPin();
+
+        if (tree.GetCpuFeatures().IsSupported(CpuFeature::Bmi2))
+        {
+            auto maskRegister = mask.ConvertToDirect(false);
+
+            code.Emit<OP>(valueRegister, valueRegister, maskRegister);
+        }
+        else if (!TryEmitContiguous(tree,
+                                    valueRegister,
+                                    mask,
+                                    std::integral_constant<bool,
+                                        ImmediateCategoryOf<T>::value == ImmediateCategory::InlineImmediate>()))
+        {
+            auto maskRegister = mask.ConvertToDirect(false);
+            ReferenceCounter maskPin = mask.GetPin();
+
+            return EmitLoop(tree,
+                            valueRegister,
+                            maskRegister,
+                            std::integral_constant<OpCode, OP>());
+        }
+
+        return value;
+    }
+
+
+    template <OpCode OP, typename T>
+    bool ParallelBitsNode<OP, T>::TryEmitContiguous(ExpressionTree& tree,
+                                                    DirectRegister value,
+                                                    Storage<T>& mask,
+                                                    std::true_type /* canBeImmediate */)
+    {
+        if (mask.GetStorageClass() != StorageClass::Immediate)
+        {
+            return false;
+        }
+
+        auto & code = tree.GetCodeGenerator();
+        const T maskValue = mask.GetImmediate();
+
+        unsigned shift;
+
+        if (!BitOp::GetLowestBitSet(static_cast<Unsigned>(maskValue), &shift))
+        {
+            code.Emit<OpCode::Xor>(value, value);
+            return true;
+        }
+
+        const Unsigned run = static_cast<Unsigned>(maskValue) >> shift;
+
+        if ((run & (run + 1)) != 0)
+        {
+            return false;
+        }
+
+        if (OP == OpCode::Pdep)
+        {
+            if (shift != 0)
+            {
+                code.EmitImmediate<OpCode::Shl>(value, static_cast<uint8_t>(shift));
+            }
+            code.EmitImmediate<OpCode::And>(value, maskValue);
+        }
+        else
+        {
+            code.EmitImmediate<OpCode::And>(value, maskValue);
+            if (shift != 0)
+            {
+                code.EmitImmediate<OpCode::Shr>(value, static_cast<uint8_t>(shift));
+            }
+        }
+
+        return true;
+    }
+
+
+    template <OpCode OP, typename T>
+    bool ParallelBitsNode<OP, T>::TryEmitContiguous(ExpressionTree& /* tree */,
+                                                    DirectRegister /* value */,
+                                                    Storage<T>& /* mask */,
+                                                    std::false_type /* canBeImmediate */)
+    {
+        return false;
+    }
+
+
+    template <OpCode OP, typename T>
+    Storage<T> ParallelBitsNode<OP, T>::EmitLoop(ExpressionTree& tree,
+                                                 DirectRegister value,
+                                                 DirectRegister mask,
+                                                 std::integral_constant<OpCode, OpCode::Pdep>)
+    {
+        auto & code = tree.GetCodeGenerator();
+
+        // All the registers are allocated up front so that nothing gets
+        // spilled inside the loop.
+        auto result = tree.Direct<T>();
+        auto resultRegister = result.GetDirectRegister();
+        ReferenceCounter resultPin = result.GetPin();
+
+        auto remaining = tree.Direct<T>();
+        auto remainingRegister = remaining.GetDirectRegister();
+        ReferenceCounter remainingPin = remaining.GetPin();
+
+        auto lowest = tree.Direct<T>();
+        auto lowestRegister = lowest.GetDirectRegister();
+
+        Label loop = code.AllocateLabel();
+        Label skip = code.AllocateLabel();
+        Label done = code.AllocateLabel();
+
+        // For each set bit of the mask, from the lowest one, shift the next
+        // bit out of the value and copy it to the position of the mask bit.
+        code.Emit<OpCode::Xor>(resultRegister, resultRegister);
+        code.Emit<OpCode::Mov>(remainingRegister, mask);
+        code.EmitImmediate<OpCode::Cmp>(remainingRegister, 0);
+        code.EmitConditionalJump<JccType::JZ>(done);
+
+        code.AlignCode(code.GetCodeAlignment().m_loopHead);
+        code.PlaceLabel(loop);
+        code.Emit<OpCode::Mov>(lowestRegister, remainingRegister);
+        code.Emit<OpCode::Neg>(lowestRegister);
+        code.Emit<OpCode::And>(lowestRegister, remainingRegister);
+        code.EmitImmediate<OpCode::Shr>(value, static_cast<uint8_t>(1));
+        code.EmitConditionalJump<JccType::JNC>(skip);
+        code.Emit<OpCode::Or>(resultRegister, lowestRegister);
+        code.PlaceLabel(skip);
+        code.Emit<OpCode::Sub>(remainingRegister, lowestRegister);
+        code.EmitConditionalJump<JccType::JNZ>(loop);
+
+        code.PlaceLabel(done);
+
+        return result;
+    }
+
+
+    template <OpCode OP, typename T>
+    Storage<T> ParallelBitsNode<OP, T>::EmitLoop(ExpressionTree& tree,
+                                                 DirectRegister value,
+                                                 DirectRegister mask,
+                                                 std::integral_constant<OpCode, OpCode::Pext>)
+    {
+        auto & code = tree.GetCodeGenerator();
+
+        auto result = tree.Direct<T>();
+        auto resultRegister = result.GetDirectRegister();
+        ReferenceCounter resultPin = result.GetPin();
+
+        auto remaining = tree.Direct<T>();
+        auto remainingRegister = remaining.GetDirectRegister();
+        ReferenceCounter remainingPin = remaining.GetPin();
+
+        auto bit = tree.Direct<T>();
+        auto bitRegister = bit.GetDirectRegister();
+        ReferenceCounter bitPin = bit.GetPin();
+
+        auto lowest = tree.Direct<T>();
+        auto lowestRegister = lowest.GetDirectRegister();
+
+        Label loop = code.AllocateLabel();
+        Label skip = code.AllocateLabel();
+        Label done = code.AllocateLabel();
+
+        // For each set bit of the mask, from the lowest one, set the next bit
+        // of the result if the value has the mask bit set.
+        code.Emit<OpCode::Xor>(resultRegister, resultRegister);
+        code.Emit<OpCode::Mov>(remainingRegister, mask);
+        code.EmitImmediate<OpCode::Mov>(bitRegister, static_cast<Unsigned>(1));
+        code.EmitImmediate<OpCode::Cmp>(remainingRegister, 0);
+        code.EmitConditionalJump<JccType::JZ>(done);
+
+        code.AlignCode(code.GetCodeAlignment().m_loopHead);
+        code.PlaceLabel(loop);
+        code.Emit<OpCode::Mov>(lowestRegister, remainingRegister);
+        code.Emit<OpCode::Neg>(lowestRegister);
+        code.Emit<OpCode::And>(lowestRegister, remainingRegister);
+        code.Emit<OpCode::Sub>(remainingRegister, lowestRegister);
+        code.Emit<OpCode::And>(lowestRegister, value);
+        code.EmitConditionalJump<JccType::JZ>(skip);
+        code.Emit<OpCode::Or>(resultRegister, bitRegister);
+        code.PlaceLabel(skip);
+        code.Emit<OpCode::Add>(bitRegister, bitRegister);
+        code.EmitImmediate<OpCode::Cmp>(remainingRegister, 0);
+        code.EmitConditionalJump<JccType::JNZ>(loop);
+
+        code.PlaceLabel(done);
+
+        return result;
+    }
+
+
+    template <OpCode OP, typename T>
+    unsigned ParallelBitsNode<OP, T>::LowerValue(Bytecode& code)
+    {
+        const unsigned value = m_value.Lower(code);
+        const unsigned mask = m_mask.Lower(code);
+
+        return code.Emit(&Interpret, { value, mask });
+    }
+
+
+    template <OpCode OP, typename T>
+    bool ParallelBitsNode<OP, T>::Interpret(Bytecode::Slot* slots,
+                                            Bytecode::Instruction const & instruction)
+    {
+        typedef typename CanonicalRegisterStorageType<T>::Type RegisterValue;
+
+        Bytecode::Write<RegisterValue>(
+            slots,
+            instruction.m_result,
+            BytecodeOperation<OP>::Apply(
+                Bytecode::Read<RegisterValue>(slots, instruction.m_operands[0]),
+                Bytecode::Read<RegisterValue>(slots, instruction.m_operands[1])));
+
+        return true;
+    }
+
+
+    template <OpCode OP, typename T>
+    void ParallelBitsNode<OP, T>::Print(std::ostream& out) const
+    {
+        const std::string name = std::string("Operation (")
+            + X64CodeGenerator::OpCodeName(OP)
+            + ") ";
+        this->PrintCoreProperties(out, name.c_str());
+
+        out << ", value = " << m_value.GetId()
+            << ", mask = " << m_mask.GetId();
+    }
+}
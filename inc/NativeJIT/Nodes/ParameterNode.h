@@ -23,6 +23,7 @@
 
 #pragma once
 
+#include "NativeJIT/Bytecode.h"
 #include "NativeJIT/ExpressionTree.h"
 #include "NativeJIT/Nodes/Node.h"
 #include "Temporary/Assert.h"
@@ -49,6 +50,7 @@ namespace NativeJIT
         // Overrides of Node methods.
         //
         virtual ExpressionTree::Storage<T> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
 
         virtual void Print(std::ostream& out) const override;
 
@@ -208,6 +210,13 @@ namespace NativeJIT
     }
 
 
+    template <typename T>
+    unsigned ParameterNode<T>::LowerValue(Bytecode& code)
+    {
+        return code.GetParameterSlot(m_position);
+    }
+
+
     template <typename T>
     void ParameterNode<T>::Print(std::ostream& out) const
     {
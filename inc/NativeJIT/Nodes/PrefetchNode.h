@@ -0,0 +1,116 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include "NativeJIT/Bytecode.h"
+#include "NativeJIT/CodeGen/X64CodeGenerator.h"     // PrefetchLocality type.
+#include "NativeJIT/Nodes/Node.h"
+
+
+namespace NativeJIT
+{
+    // PrefetchNode evaluates to its pointer operand and, as a side effect,
+    // issues a software prefetch for the cache line the pointer points to.
+    // Since each document is scored by a separate call, the typical use is
+    // to pass the pointer to the next document as a parameter and to
+    // prefetch it while the current one is scored, f. ex.
+    //
+    //   Sequence(Prefetch(nextDocument), score)
+    //
+    // The prefetch instructions never fault, so the pointer may be null or
+    // invalid. The interpreted tiers ignore the hint.
+    template <typename T>
+    class PrefetchNode : public Node<T*>
+    {
+    public:
+        PrefetchNode(ExpressionTree& tree, Node<T*>& pointer, PrefetchLocality locality);
+
+        //
+        // Overrides of Node methods.
+        //
+        virtual ExpressionTree::Storage<T*> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
+        virtual void Print(std::ostream& out) const override;
+
+    private:
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~PrefetchNode();
+
+        Node<T*>& m_pointer;
+        const PrefetchLocality m_locality;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for PrefetchNode
+    //
+    //*************************************************************************
+    template <typename T>
+    PrefetchNode<T>::PrefetchNode(ExpressionTree& tree,
+                                  Node<T*>& pointer,
+                                  PrefetchLocality locality)
+        : Node<T*>(tree),
+          m_pointer(pointer),
+          m_locality(locality)
+    {
+        m_pointer.IncrementParentCount();
+    }
+
+
+    template <typename T>
+    typename ExpressionTree::Storage<T*> PrefetchNode<T>::CodeGenValue(ExpressionTree& tree)
+    {
+        auto pointer = m_pointer.CodeGen(tree);
+
+        {
+            auto pointerRegister = pointer.ConvertToDirect(false);
+
+            tree.GetCodeGenerator().EmitPrefetch(m_locality, pointerRegister, 0);
+        }
+
+        return pointer;
+    }
+
+
+    template <typename T>
+    unsigned PrefetchNode<T>::LowerValue(Bytecode& code)
+    {
+        // The prefetch only affects timing, the bytecode simply forwards the
+        // pointer.
+        return m_pointer.Lower(code);
+    }
+
+
+    template <typename T>
+    void PrefetchNode<T>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out, "PrefetchNode");
+
+        out << ", pointer ID = " << m_pointer.GetId()
+            << ", locality = " << static_cast<unsigned>(m_locality);
+    }
+}
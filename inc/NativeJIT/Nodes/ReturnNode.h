@@ -39,6 +39,7 @@ namespace NativeJIT
         // Overrides of Node methods.
         //
         virtual ExpressionTree::Storage<T> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
         virtual void CompileAsRoot(ExpressionTree& tree) override;
         virtual void Print(std::ostream& out) const override;
 
@@ -80,6 +81,13 @@ namespace NativeJIT
     }
 
 
+    template <typename T>
+    unsigned ReturnNode<T>::LowerValue(Bytecode& code)
+    {
+        return m_child.Lower(code);
+    }
+
+
     template <typename T>
     void ReturnNode<T>::CompileAsRoot(ExpressionTree& tree)
     {
@@ -0,0 +1,106 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include "NativeJIT/Nodes/Node.h"
+
+
+namespace NativeJIT
+{
+    // SequenceNode evaluates the first node for its side effects (f. ex. a
+    // StoreNode or a CallNode), discards its value and then evaluates to the
+    // second node. Unlike with DependentNode, the first node doesn't need to
+    // be referenced elsewhere in the tree. Chaining the nodes fills in
+    // several outputs in a single pass over the inputs.
+    template <typename T1, typename T2>
+    class SequenceNode : public Node<T2>
+    {
+    public:
+        SequenceNode(ExpressionTree& tree, Node<T1>& first, Node<T2>& second);
+
+        //
+        // Overrides of Node methods.
+        //
+        virtual ExpressionTree::Storage<T2> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
+        virtual void Print(std::ostream& out) const override;
+
+    private:
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~SequenceNode();
+
+        Node<T1>& m_first;
+        Node<T2>& m_second;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for SequenceNode
+    //
+    //*************************************************************************
+    template <typename T1, typename T2>
+    SequenceNode<T1, T2>::SequenceNode(ExpressionTree& tree,
+                                       Node<T1>& first,
+                                       Node<T2>& second)
+        : Node<T2>(tree),
+          m_first(first),
+          m_second(second)
+    {
+        m_first.IncrementParentCount();
+        m_second.IncrementParentCount();
+    }
+
+
+    template <typename T1, typename T2>
+    typename ExpressionTree::Storage<T2> SequenceNode<T1, T2>::CodeGenValue(ExpressionTree& tree)
+    {
+        // The storage of the first value is released right away, so its
+        // registers are available to the second node.
+        m_first.CodeGen(tree);
+
+        return m_second.CodeGen(tree);
+    }
+
+
+    template <typename T1, typename T2>
+    unsigned SequenceNode<T1, T2>::LowerValue(Bytecode& code)
+    {
+        m_first.Lower(code);
+
+        return m_second.Lower(code);
+    }
+
+
+    template <typename T1, typename T2>
+    void SequenceNode<T1, T2>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out, "SequenceNode");
+
+        out << ", first = " << m_first.GetId()
+            << ", second = " << m_second.GetId();
+    }
+}
@@ -23,6 +23,7 @@
 
 #pragma once
 
+#include "NativeJIT/Bytecode.h"
 #include "NativeJIT/CodeGen/X64CodeGenerator.h"     // OpCode type.
 #include "NativeJIT/Nodes/Node.h"
 
@@ -37,6 +38,7 @@ namespace NativeJIT
         ShldNode(ExpressionTree& tree, Node<T>& shiftee, Node<T>& filler, uint8_t bitCount);
 
         virtual Storage<T> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
 
         virtual void Print(std::ostream& out) const override;
 
@@ -46,6 +48,8 @@ namespace NativeJIT
         // resources other than memory from the arena allocator.
         ~ShldNode();
 
+        static bool Interpret(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+
         Node<T>& m_shiftee;
         Node<T>& m_filler;
         const uint8_t m_bitCount;
@@ -98,6 +102,51 @@ namespace NativeJIT
     }
 
 
+    template <typename T>
+    unsigned ShldNode<T>::LowerValue(Bytecode& code)
+    {
+        const unsigned shiftee = m_shiftee.Lower(code);
+        const unsigned filler = m_filler.Lower(code);
+
+        return code.Emit(&Interpret, { shiftee, filler }, m_bitCount);
+    }
+
+
+    template <typename T>
+    bool ShldNode<T>::Interpret(Bytecode::Slot* slots,
+                                Bytecode::Instruction const & instruction)
+    {
+        typedef typename CanonicalRegisterStorageType<T>::Type RegisterValue;
+
+        const unsigned c_bitCount = sizeof(RegisterValue) * 8;
+        const unsigned count = static_cast<unsigned>(instruction.m_immediate)
+                               & (c_bitCount == 64 ? 63 : 31);
+
+        const uint64_t shiftee = Bytecode::Read<RegisterValue>(slots, instruction.m_operands[0]);
+        const uint64_t filler = Bytecode::Read<RegisterValue>(slots, instruction.m_operands[1]);
+
+        // The bits shifted in from the filler are its most significant ones.
+        // The result of the instruction is undefined for the counts larger
+        // than the operand size (possible only for 16-bit operands).
+        uint64_t result = 0;
+
+        if (count == 0)
+        {
+            result = shiftee;
+        }
+        else if (count <= c_bitCount)
+        {
+            result = (shiftee << count) | (filler >> (c_bitCount - count));
+        }
+
+        Bytecode::Write<RegisterValue>(slots,
+                                       instruction.m_result,
+                                       static_cast<RegisterValue>(result));
+
+        return true;
+    }
+
+
     template <typename T>
     void ShldNode<T>::Print(std::ostream& out) const
     {
@@ -23,6 +23,7 @@
 
 #pragma once
 
+#include "NativeJIT/Bytecode.h"
 #include "NativeJIT/Nodes/Node.h"
 
 
@@ -45,6 +46,7 @@ namespace NativeJIT
 
         virtual void Print(std::ostream& out) const override;
         virtual Storage<T&> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
 
     private:
         // WARNING: This class is designed to be allocated by an arena allocator,
@@ -102,4 +104,19 @@ namespace NativeJIT
         // Convert the pointer to a reference and return it.
         return Storage<T&>(addressOfStorage);
     }
+
+
+    template <typename T>
+    unsigned StackVariableNode<T>::LowerValue(Bytecode& code)
+    {
+        // The variable is held in a slot, so larger types are not supported.
+        if (sizeof(T) > sizeof(Bytecode::Slot) || alignof(T) > alignof(Bytecode::Slot))
+        {
+            return Node<T&>::LowerValue(code);
+        }
+
+        const unsigned variable = code.AddVariable();
+
+        return code.Emit(&Bytecode::AddressOfVariable, nullptr, 0, variable);
+    }
 }
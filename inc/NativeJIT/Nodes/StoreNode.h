@@ -0,0 +1,191 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <cstring>      // For memcpy.
+#include <type_traits>
+
+#include "NativeJIT/Bytecode.h"
+#include "NativeJIT/CodeGen/X64CodeGenerator.h"     // OpCode type.
+#include "NativeJIT/Nodes/Node.h"
+
+
+namespace NativeJIT
+{
+    // StoreNode implements *pointer = value and evaluates to the stored value.
+    // Like IndirectNode, it collapses the pointer to a base object and an
+    // offset (f. ex. a field of a parameter) and stores with a single mov.
+    //
+    // The store happens when the node is evaluated, so a StoreNode needs to
+    // be a part of the tree, typically as the first operand of a Sequence.
+    // A StoreNode must have a single parent: a common subexpression is
+    // evaluated before the rest of the tree, which would move its store
+    // ahead of the stores that precede it in the Sequence. Share the stored
+    // value instead. The tree must not read the memory it writes to since
+    // the loads are not ordered with respect to the stores.
+    template <typename T>
+    class StoreNode : public Node<T>
+    {
+    public:
+        StoreNode(ExpressionTree& tree, Node<T*>& pointer, Node<T>& value);
+
+        //
+        // Overrides of Node methods.
+        //
+        virtual ExpressionTree::Storage<T> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
+        virtual void Print(std::ostream& out) const override;
+
+    private:
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~StoreNode();
+
+        static bool Interpret(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+
+        NodeBase& m_pointer;
+        Node<T>& m_value;
+
+        // The base object and offset of the stored to address, see
+        // IndirectNode.
+        NodeBase* m_collapsedBase;
+        int32_t m_collapsedOffset;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for StoreNode
+    //
+    //*************************************************************************
+    template <typename T>
+    StoreNode<T>::StoreNode(ExpressionTree& tree, Node<T*>& pointer, Node<T>& value)
+        : Node<T>(tree),
+          m_pointer(pointer),
+          m_value(value),
+          m_collapsedBase(&pointer),
+          m_collapsedOffset(0)
+    {
+        static_assert(!std::is_const<T>::value, "Cannot store through a pointer to const.");
+        static_assert(std::is_same<typename RegisterStorage<T>::UnderlyingType, T>::value,
+                      "The stored type must fit in a register.");
+
+        NodeBase* grandparent;
+        int32_t parentOffset;
+
+        if (pointer.GetBaseAndOffset(grandparent, parentOffset))
+        {
+            m_collapsedBase = grandparent;
+            m_collapsedOffset = parentOffset;
+            pointer.MarkReferenced();
+        }
+
+        m_collapsedBase->IncrementParentCount();
+        m_value.IncrementParentCount();
+    }
+
+
+    template <typename T>
+    typename ExpressionTree::Storage<T> StoreNode<T>::CodeGenValue(ExpressionTree& tree)
+    {
+        LogThrowAssert(this->GetParentCount() == 1,
+                       "StoreNode %u has %u parents, stores cannot be shared",
+                       this->GetId(),
+                       this->GetParentCount());
+
+        auto value = m_value.CodeGen(tree);
+        auto base = m_collapsedBase->CodeGenAsBase(tree);
+
+        {
+            auto valueRegister = value.ConvertToDirect(false);
+            ReferenceCounter valuePin = value.GetPin();
+            auto baseRegister = base.ConvertToDirect(false);
+
+            tree.GetCodeGenerator().Emit<OpCode::Mov>(baseRegister,
+                                                      m_collapsedOffset,
+                                                      valueRegister);
+        }
+
+        return value;
+    }
+
+
+    template <typename T>
+    unsigned StoreNode<T>::LowerValue(Bytecode& code)
+    {
+        LogThrowAssert(this->GetParentCount() == 1,
+                       "StoreNode %u has %u parents, stores cannot be shared",
+                       this->GetId(),
+                       this->GetParentCount());
+
+        // The generated code makes a store on a path of a conditional
+        // whether or not that path is taken. Leave such trees to the
+        // compiled code so that both tiers store the same values.
+        if (code.IsInSkip())
+        {
+            return NodeBase::LowerValue(code);
+        }
+
+        const unsigned value = m_value.Lower(code);
+        const unsigned base = m_collapsedBase->Lower(code);
+
+        return code.Emit(&Interpret,
+                         { base, value },
+                         static_cast<Bytecode::Slot>(static_cast<int64_t>(m_collapsedOffset)));
+    }
+
+
+    template <typename T>
+    bool StoreNode<T>::Interpret(Bytecode::Slot* slots,
+                                 Bytecode::Instruction const & instruction)
+    {
+        auto address = Bytecode::Read<char*>(slots, instruction.m_operands[0])
+                       + static_cast<int64_t>(instruction.m_immediate);
+        const T value = Bytecode::Read<T>(slots, instruction.m_operands[1]);
+
+        memcpy(address, &value, sizeof(T));
+
+        Bytecode::Write<T>(slots, instruction.m_result, value);
+
+        return true;
+    }
+
+
+    template <typename T>
+    void StoreNode<T>::Print(std::ostream& out) const
+    {
+        this->PrintCoreProperties(out, "StoreNode");
+
+        out << ", pointer ID = " << m_pointer.GetId()
+            << ", value ID = " << m_value.GetId();
+
+        if (m_pointer.GetId() != m_collapsedBase->GetId())
+        {
+            out
+                << ", collapsed base ID = " << m_collapsedBase->GetId()
+                << ", collapsed offset = " << m_collapsedOffset;
+        }
+    }
+}
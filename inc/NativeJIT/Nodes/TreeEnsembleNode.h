@@ -0,0 +1,102 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+
+#include "NativeJIT/Bytecode.h"
+#include "NativeJIT/CodeGen/X64CodeGenerator.h"
+#include "NativeJIT/Nodes/ImmediateNodeDecls.h"     // RIPRelativeImmediate.
+#include "NativeJIT/Nodes/Node.h"
+
+
+namespace NativeJIT
+{
+    struct DecisionTreeNode;
+    class TreeEnsemble;
+
+    // Evaluates a TreeEnsemble for an array of float features. The node
+    // emits its own control flow: each split is a load of the feature, a
+    // comparison with the threshold and a jump to the right subtree, the
+    // left subtree falls through. Only the reached leaf of a tree is
+    // accumulated, unlike a tree built of ConditionalNodes, which evaluates
+    // both values of each condition. The thresholds and the leaves are
+    // emitted as RIP-relative static data, so the generated code doesn't
+    // refer to the ensemble.
+    //
+    // The bytecode calls TreeEnsemble::Evaluate(), so the ensemble must
+    // outlive the lowered expression.
+    class TreeEnsembleNode : public Node<float>, public RIPRelativeImmediate
+    {
+    public:
+        TreeEnsembleNode(ExpressionTree& tree,
+                         Node<float const *>& features,
+                         TreeEnsemble const & ensemble);
+
+        //
+        // Overrides of Node methods
+        //
+        virtual ExpressionTree::Storage<float> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
+
+        virtual void Print(std::ostream& out) const override;
+
+        //
+        // Overrides of RIPRelativeImmediate methods
+        //
+        virtual void EmitStaticData(ExpressionTree& tree) override;
+
+    private:
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~TreeEnsembleNode();
+
+        // Emits the subtree rooted at the node with the specified index,
+        // relative to treeStart. The leaf that is emitted last in a tree
+        // falls through to the next tree, the other ones jump to treeEnd.
+        void CodeGenSubtree(X64CodeGenerator& code,
+                            Register<8, false> features,
+                            Register<4, true> result,
+                            Register<4, true> value,
+                            unsigned treeStart,
+                            unsigned index,
+                            bool isFirstTree,
+                            bool isLastInTree,
+                            Label treeEnd) const;
+
+        // Returns the offset of the static data of the node with the
+        // specified index in TreeEnsemble::GetNodes(), which holds the
+        // threshold of a split and the value of a leaf.
+        int32_t GetConstantOffset(unsigned index) const;
+
+        static bool Interpret(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+
+        Node<float const *>& m_features;
+        TreeEnsemble const & m_ensemble;
+
+        // The offset of the static data, set by EmitStaticData().
+        int32_t m_offset;
+    };
+}
@@ -0,0 +1,162 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <type_traits>
+
+#include "NativeJIT/Bytecode.h"
+#include "NativeJIT/CodeGen/X64CodeGenerator.h"     // OpCode type.
+#include "NativeJIT/CodeGenHelpers.h"
+#include "NativeJIT/Nodes/Node.h"
+
+
+namespace NativeJIT
+{
+    // Implements neg and not. Floating point values are negated by flipping
+    // the sign bit with xorps/xorpd, which unlike subtraction from zero also
+    // gives the correct sign for zeros.
+    template <OpCode OP, typename T>
+    class UnaryNode : public Node<T>
+    {
+    public:
+        static_assert(OP == OpCode::Neg || OP == OpCode::Not, "Unsupported unary operation.");
+        static_assert(OP == OpCode::Neg || !std::is_floating_point<T>::value,
+                      "Not is not supported for floating point values.");
+
+        UnaryNode(ExpressionTree& tree, Node<T>& child);
+
+        virtual Storage<T> CodeGenValue(ExpressionTree& tree) override;
+        virtual unsigned LowerValue(Bytecode& code) override;
+
+        virtual void Print(std::ostream& out) const override;
+
+    private:
+        // WARNING: This class is designed to be allocated by an arena allocator,
+        // so its destructor will never be called. Therefore, it should hold no
+        // resources other than memory from the arena allocator.
+        ~UnaryNode();
+
+        typedef typename Storage<T>::DirectRegister DirectRegister;
+
+        static void Emit(ExpressionTree& tree, DirectRegister value, std::false_type /* isFloat */);
+        static void Emit(ExpressionTree& tree, DirectRegister value, std::true_type /* isFloat */);
+
+        static bool Interpret(Bytecode::Slot* slots, Bytecode::Instruction const & instruction);
+
+        Node<T>& m_child;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for UnaryNode
+    //
+    //*************************************************************************
+    template <OpCode OP, typename T>
+    UnaryNode<OP, T>::UnaryNode(ExpressionTree& tree, Node<T>& child)
+        : Node<T>(tree),
+          m_child(child)
+    {
+        m_child.IncrementParentCount();
+    }
+
+
+    template <OpCode OP, typename T>
+    Storage<T> UnaryNode<OP, T>::CodeGenValue(ExpressionTree& tree)
+    {
+        auto value = m_child.CodeGen(tree);
+
+        {
+            auto valueRegister = value.ConvertToDirect(true);
+            ReferenceCounter valuePin = value.GetPin();
+
+            Emit(tree, valueRegister, std::is_floating_point<T>());
+        }
+
+        return value;
+    }
+
+
+    template <OpCode OP, typename T>
+    void UnaryNode<OP, T>::Emit(ExpressionTree& tree,
+                                DirectRegister value,
+                                std::false_type /* isFloat */)
+    {
+        tree.GetCodeGenerator().Emit<OP>(value);
+    }
+
+
+    template <OpCode OP, typename T>
+    void UnaryNode<OP, T>::Emit(ExpressionTree& tree,
+                                DirectRegister value,
+                                std::true_type /* isFloat */)
+    {
+        typedef typename std::remove_cv<T>::type FloatType;
+
+        auto signMask = tree.Direct<T>();
+        auto signMaskRegister = signMask.GetDirectRegister();
+
+        CodeGenHelpers::MovThroughTemporary(tree,
+                                            signMaskRegister,
+                                            static_cast<FloatType>(-0.0));
+        tree.GetCodeGenerator().Emit<OpCode::Xor>(value, signMaskRegister);
+    }
+
+
+    template <OpCode OP, typename T>
+    unsigned UnaryNode<OP, T>::LowerValue(Bytecode& code)
+    {
+        const unsigned child = m_child.Lower(code);
+
+        return code.Emit(&Interpret, { child });
+    }
+
+
+    template <OpCode OP, typename T>
+    bool UnaryNode<OP, T>::Interpret(Bytecode::Slot* slots,
+                                     Bytecode::Instruction const & instruction)
+    {
+        typedef typename CanonicalRegisterStorageType<T>::Type RegisterValue;
+
+        Bytecode::Write<RegisterValue>(
+            slots,
+            instruction.m_result,
+            BytecodeUnaryOperation<OP>::Apply(
+                Bytecode::Read<RegisterValue>(slots, instruction.m_operands[0])));
+
+        return true;
+    }
+
+
+    template <OpCode OP, typename T>
+    void UnaryNode<OP, T>::Print(std::ostream& out) const
+    {
+        const std::string name = std::string("Operation (")
+            + X64CodeGenerator::OpCodeName(OP)
+            + ") ";
+        this->PrintCoreProperties(out, name.c_str());
+
+        out << ", child = " << m_child.GetId();
+    }
+}
@@ -0,0 +1,202 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "NativeJIT/CodeGen/FunctionBuffer.h"       // RUNTIME_FUNCTION embedded.
+#include "Temporary/NonCopyable.h"
+
+
+namespace NativeJIT
+{
+    class ExpressionTree;
+
+
+    // Associates names with the addresses of the functions and objects that
+    // compiled code refers to. The addresses typically change between runs
+    // of a process, while the names do not.
+    class SymbolTable
+    {
+    public:
+        // Registers the address of a function or an object. Neither the name
+        // nor the address can be registered twice.
+        template <typename T>
+        void Add(std::string const & name, T* address);
+
+        void Add(std::string const & name, uint64_t address);
+
+        // Returns the name registered for the address or nullptr if there is
+        // none.
+        std::string const * FindName(uint64_t address) const;
+
+        // Returns true and sets the address if the name has been registered.
+        bool TryGetAddress(std::string const & name, uint64_t& address) const;
+
+    private:
+        std::unordered_map<std::string, uint64_t> m_addresses;
+        std::unordered_map<uint64_t, std::string> m_names;
+    };
+
+
+    // ObjectFile saves a compiled function to a file and loads it back, so
+    // that a process can reuse the code compiled by an earlier run without
+    // invoking the compiler.
+    //
+    // The file contains the image of the function buffer up to the end of the
+    // function's code, i.e. the RIP-relative data, the unwind information and
+    // the code itself. Jumps, calls within the buffer and RIP-relative
+    // accesses are relative to the instruction pointer, so the image is
+    // position independent except for the absolute addresses of functions and
+    // objects in the process, such as the ones passed to Immediate(). Every
+    // absolute address must be registered in the SymbolTable. The file refers
+    // to it by name and the loader patches in the address which has the same
+    // name in the SymbolTable of the loading process.
+    //
+    // The format is only meant to be read by the same version of NativeJIT on
+    // the same platform.
+    class ObjectFile : public NonCopyable
+    {
+    public:
+        // Writes the function most recently compiled by the tree. Throws if
+        // an absolute address in the code has no name in the symbol table or
+        // if the function was compiled with instrumentation.
+        static void Write(std::ostream& out,
+                          ExpressionTree const & tree,
+                          SymbolTable const & symbols);
+
+        // Writes the function most recently compiled by the tree as an
+        // x86-64 ELF relocatable object which defines a global function with
+        // the specified name, so that it can be linked into a program built
+        // ahead of time. The names in the symbol table are used as the names
+        // of the external symbols and must be the linker names of the
+        // functions and objects. The same restrictions as for Write() apply.
+        // See ElfObjectWriter.
+        static void WriteElf(std::ostream& out,
+                             ExpressionTree const & tree,
+                             SymbolTable const & symbols,
+                             std::string const & functionName);
+
+        // Maps the file into memory and relocates the absolute addresses using
+        // the symbol table. Throws if the file is not a valid object file or
+        // if it refers to a name which is not in the symbol table.
+        ObjectFile(char const * path, SymbolTable const & symbols);
+
+        // Unmaps the file. The function must not be called afterwards.
+        ~ObjectFile();
+
+        // Returns the entry point to the function.
+        void const * GetEntryPoint() const;
+
+        // Returns the entry point as a function pointer. The type must be the
+        // same as the type of the function which was written to the file.
+        template <typename FUNCTION>
+        FUNCTION GetFunction() const;
+
+    private:
+        struct Header
+        {
+            uint32_t m_magic;
+            uint32_t m_version;
+            uint32_t m_relocationCount;
+            uint32_t m_namesByteLength;
+
+            // Offsets within the image, see FunctionBuffer.
+            uint32_t m_codeStartOffset;
+            uint32_t m_codeEndOffset;
+            uint32_t m_unwindInfoStartOffset;
+
+            // File offset and length of the image.
+            uint32_t m_imageOffset;
+            uint32_t m_imageByteLength;
+        };
+
+        // An eight byte absolute address in the image. The name offset is
+        // relative to the start of the null terminated names which follow the
+        // relocation records.
+        struct Relocation
+        {
+            uint32_t m_imageOffset;
+            uint32_t m_nameOffset;
+        };
+
+        static const uint32_t c_magic;
+        static const uint32_t c_version;
+
+        // The alignment of the image within the file. The file is mapped at
+        // a page boundary, so the image is at least as aligned as the code
+        // buffer it was copied from.
+        static const unsigned c_imageAlignment = 16;
+
+        // The offsets of the absolute addresses in the function buffer which
+        // need to be relocated and the names of the symbols they refer to.
+        typedef std::vector<std::pair<unsigned, std::string const *>> References;
+
+        static References FindReferences(ExpressionTree const & tree,
+                                         SymbolTable const & symbols);
+
+        void Load(SymbolTable const & symbols);
+        void Unmap();
+
+        uint8_t* m_file;
+        size_t m_fileByteLength;
+        uint8_t const * m_image;
+
+#ifdef NATIVEJIT_PLATFORM_WINDOWS
+        void* m_mapping;
+#endif
+
+        // Describes the function to the stack unwinder on Windows.
+        RUNTIME_FUNCTION m_runtimeFunction;
+    };
+
+
+    //*************************************************************************
+    //
+    // Template definitions for SymbolTable and ObjectFile.
+    //
+    //*************************************************************************
+    template <typename T>
+    void SymbolTable::Add(std::string const & name, T* address)
+    {
+        Add(name, reinterpret_cast<uint64_t>(address));
+    }
+
+
+    template <typename FUNCTION>
+    FUNCTION ObjectFile::GetFunction() const
+    {
+        static_assert(std::is_pointer<FUNCTION>::value
+                      && std::is_function<typename std::remove_pointer<FUNCTION>::type>::value,
+                      "FUNCTION must be a function pointer.");
+
+        return reinterpret_cast<FUNCTION>(const_cast<void*>(GetEntryPoint()));
+    }
+}
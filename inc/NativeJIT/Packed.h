@@ -84,6 +84,31 @@ namespace NativeJIT
     };
 
 
+    // Retrieves the number of bits and the position of the lowest bit of the
+    // component at INDEX, counting from the leftmost (first) component of the
+    // Packed<> type.
+    template <typename PACKED, unsigned INDEX>
+    struct PackedComponentPosition
+    {
+        static_assert(INDEX < PACKED::c_componentCount, "Invalid component index.");
+
+        // Defer the answer to the right portion of the packed.
+        typedef PackedComponentPosition<typename PACKED::Right, INDEX - 1> RightPosition;
+
+        static const unsigned c_bitCount = RightPosition::c_bitCount;
+        static const unsigned c_startBit = RightPosition::c_startBit;
+    };
+
+
+    // Base case.
+    template <typename PACKED>
+    struct PackedComponentPosition<PACKED, 0>
+    {
+        static const unsigned c_bitCount = PACKED::c_leftmostBitCount;
+        static const unsigned c_startBit = PACKED::c_totalBitCount - PACKED::c_leftmostBitCount;
+    };
+
+
     // Packed<> with two or more components.
     template <unsigned LEFT, unsigned... RIGHT>
     struct Packed
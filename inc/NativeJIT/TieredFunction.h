@@ -0,0 +1,220 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <future>
+
+#include "NativeJIT/Bytecode.h"
+#include "NativeJIT/Function.h"
+#include "Temporary/Assert.h"
+#include "Temporary/NonCopyable.h"
+
+
+namespace NativeJIT
+{
+    // TieredFunction runs a function in two tiers. The expression is lowered
+    // into bytecode up front, which is cheap, and the first calls run in the
+    // bytecode interpreter. Once the function has been called
+    // promotionThreshold times, the expression is compiled on a background
+    // thread and the subsequent calls use the native code as soon as it is
+    // ready. Functions which are called only a few times therefore never pay
+    // for the compilation.
+    //
+    // If the expression contains nodes which cannot be lowered, such as a
+    // store or a call on one path of a conditional (see Bytecode), or if the
+    // threshold is zero, the function is compiled in the constructor. If the
+    // compilation is abandoned because it exceeds the compile budget of the
+    // function (see CompileBudget), the calls keep running in the interpreter.
+    //
+    // Calls may be made concurrently from multiple threads. The Function must
+    // not be used directly while the TieredFunction exists.
+    template <typename R, typename P1 = void, typename P2 = void, typename P3 = void, typename P4 = void>
+    class TieredFunction : public NonCopyable
+    {
+    public:
+        typedef typename Function<R, P1, P2, P3, P4>::FunctionType FunctionType;
+
+        TieredFunction(Function<R, P1, P2, P3, P4>& function,
+                       Node<R>& expression,
+                       uint64_t promotionThreshold);
+
+        // Waits for the background compilation, if any, to finish.
+        ~TieredFunction();
+
+        template <typename... ARGS>
+        R operator()(ARGS... args);
+
+        // Returns true if the calls are made to the compiled code.
+        bool IsCompiled() const;
+
+        uint64_t GetCallCount() const;
+
+        Bytecode const & GetBytecode() const;
+
+        // Waits for the compilation triggered by reaching the promotion
+        // threshold to finish. Rethrows any exception thrown by the compiler.
+        // Must not be called concurrently with the calls to the function.
+        void WaitForPromotion();
+
+    private:
+        template <typename... PARAMS, typename... ARGS>
+        R Interpret(R (*)(PARAMS...), ARGS... args) const;
+
+        void Promote();
+
+        Function<R, P1, P2, P3, P4>& m_function;
+        Node<R>& m_expression;
+        uint64_t const m_promotionThreshold;
+
+        Bytecode m_bytecode;
+
+        std::atomic<FunctionType> m_entryPoint;
+        std::atomic<uint64_t> m_callCount;
+
+        // Set by the only call which reaches the promotion threshold.
+        std::future<void> m_promotion;
+    };
+
+
+    //*************************************************************************
+    //
+    // TieredFunction template definitions.
+    //
+    //*************************************************************************
+    template <typename R, typename P1, typename P2, typename P3, typename P4>
+    TieredFunction<R, P1, P2, P3, P4>::TieredFunction(Function<R, P1, P2, P3, P4>& function,
+                                                      Node<R>& expression,
+                                                      uint64_t promotionThreshold)
+        : m_function(function),
+          m_expression(expression),
+          m_promotionThreshold(promotionThreshold),
+          m_entryPoint(nullptr),
+          m_callCount(0)
+    {
+        m_function.Lower(m_bytecode, m_expression);
+
+        if (m_promotionThreshold == 0 || !m_bytecode.CanEvaluate())
+        {
+            Promote();
+        }
+    }
+
+
+    template <typename R, typename P1, typename P2, typename P3, typename P4>
+    TieredFunction<R, P1, P2, P3, P4>::~TieredFunction()
+    {
+        if (m_promotion.valid())
+        {
+            m_promotion.wait();
+        }
+    }
+
+
+    template <typename R, typename P1, typename P2, typename P3, typename P4>
+    template <typename... ARGS>
+    R TieredFunction<R, P1, P2, P3, P4>::operator()(ARGS... args)
+    {
+        FunctionType entryPoint = m_entryPoint.load(std::memory_order_acquire);
+
+        if (entryPoint != nullptr)
+        {
+            return entryPoint(args...);
+        }
+
+        // Exactly one call observes the count just below the threshold.
+        if (m_callCount.fetch_add(1, std::memory_order_relaxed) + 1 == m_promotionThreshold)
+        {
+            m_promotion = std::async(std::launch::async, [this] { Promote(); });
+        }
+
+        return Interpret(static_cast<FunctionType>(nullptr), args...);
+    }
+
+
+    template <typename R, typename P1, typename P2, typename P3, typename P4>
+    bool TieredFunction<R, P1, P2, P3, P4>::IsCompiled() const
+    {
+        return m_entryPoint.load(std::memory_order_acquire) != nullptr;
+    }
+
+
+    template <typename R, typename P1, typename P2, typename P3, typename P4>
+    uint64_t TieredFunction<R, P1, P2, P3, P4>::GetCallCount() const
+    {
+        return m_callCount.load(std::memory_order_relaxed);
+    }
+
+
+    template <typename R, typename P1, typename P2, typename P3, typename P4>
+    Bytecode const & TieredFunction<R, P1, P2, P3, P4>::GetBytecode() const
+    {
+        return m_bytecode;
+    }
+
+
+    template <typename R, typename P1, typename P2, typename P3, typename P4>
+    void TieredFunction<R, P1, P2, P3, P4>::WaitForPromotion()
+    {
+        if (m_promotion.valid())
+        {
+            m_promotion.get();
+        }
+    }
+
+
+    template <typename R, typename P1, typename P2, typename P3, typename P4>
+    template <typename... PARAMS, typename... ARGS>
+    R TieredFunction<R, P1, P2, P3, P4>::Interpret(R (*)(PARAMS...), ARGS... args) const
+    {
+        static_assert(sizeof...(PARAMS) == sizeof...(ARGS),
+                      "Wrong number of arguments.");
+
+        Bytecode::Slot parameters[Bytecode::c_maxParameterCount] = {};
+        unsigned position = 0;
+
+        // The braced initializer guarantees left to right evaluation.
+        int writes[] = { 0, (Bytecode::Write<PARAMS>(parameters, position++, args), 0)... };
+        static_cast<void>(writes);
+        static_cast<void>(position);
+
+        return m_bytecode.template Evaluate<R>(parameters);
+    }
+
+
+    template <typename R, typename P1, typename P2, typename P3, typename P4>
+    void TieredFunction<R, P1, P2, P3, P4>::Promote()
+    {
+        // If the compilation exceeds the compile budget of the function, the
+        // calls remain in the interpreter.
+        FunctionType entryPoint = m_function.Compile(m_expression);
+
+        LogThrowAssert(entryPoint != nullptr || m_bytecode.CanEvaluate(),
+                       "Node %u can only be compiled, but the compile budget was exceeded",
+                       m_bytecode.GetUnsupportedNodeId());
+
+        m_entryPoint.store(entryPoint, std::memory_order_release);
+    }
+}
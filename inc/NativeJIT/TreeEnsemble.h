@@ -0,0 +1,94 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Temporary/NonCopyable.h"
+
+
+namespace NativeJIT
+{
+    // A node of a decision tree. The nodes of a tree are stored in a flat
+    // array with the root at index zero and the children of a node after the
+    // node itself. Since the root cannot be a child, a left child index of
+    // zero marks a leaf.
+    struct DecisionTreeNode
+    {
+        // The split: the evaluation continues with the right child if the
+        // feature is greater than the threshold and with the left child
+        // otherwise, including when the feature is NaN.
+        uint32_t m_feature;
+        float m_threshold;
+        uint32_t m_left;
+        uint32_t m_right;
+
+        // The value of a leaf.
+        float m_leaf;
+
+        bool IsLeaf() const;
+    };
+
+
+    // An ensemble of decision trees (e.g. a gradient boosted model) whose
+    // value is the sum of the values of the leaves reached in each tree.
+    // ExpressionNodeFactory::EvaluateEnsemble() compiles the ensemble into
+    // branches (see TreeEnsembleNode), Evaluate() is the reference
+    // interpreter.
+    class TreeEnsemble : public NonCopyable
+    {
+    public:
+        // The features are addressed with a 32-bit displacement.
+        static const uint32_t c_maxFeatureCount = 1u << 28;
+
+        TreeEnsemble();
+
+        // Copies the nodes of a tree into the ensemble. Throws if the child
+        // indices are out of range or don't follow their parent.
+        void AddTree(DecisionTreeNode const * nodes, unsigned nodeCount);
+
+        unsigned GetTreeCount() const;
+
+        // The nodes of all trees, concatenated in the order of AddTree() calls.
+        DecisionTreeNode const * GetNodes() const;
+        unsigned GetNodeCount() const;
+
+        // Returns the index of the root of the tree in GetNodes(). The child
+        // indices of the tree's nodes are relative to its root.
+        unsigned GetTreeStart(unsigned tree) const;
+
+        // One more than the highest feature index used by a split.
+        unsigned GetFeatureCount() const;
+
+        // Returns the sum of the leaves reached in each tree, adding the trees
+        // in order like the generated code.
+        float Evaluate(float const * features) const;
+
+    private:
+        std::vector<DecisionTreeNode> m_nodes;
+        std::vector<unsigned> m_treeStarts;
+        unsigned m_featureCount;
+    };
+}
@@ -157,6 +157,23 @@ namespace NativeJIT
     }
 
 
+    JumpTable& CodeBuffer::GetJumpTable()
+    {
+        return m_localJumpTable;
+    }
+
+
+    void CodeBuffer::SetCurrentPosition(unsigned position)
+    {
+        LogThrowAssert(position <= CurrentPosition(),
+                       "Cannot move the write position forward from %u to %u",
+                       CurrentPosition(),
+                       position);
+
+        m_current = m_bufferStart + position;
+    }
+
+
     void CodeBuffer::EmitCallSite(Label label, unsigned size)
     {
         m_localJumpTable.AddCallSite(label, m_current, size);
@@ -0,0 +1,105 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <thread>
+
+#include "NativeJIT/CodeGen/CodeEpochs.h"
+
+
+namespace NativeJIT
+{
+    //
+    // CodeEpochs::Guard
+    //
+
+    CodeEpochs::Guard::Guard(CodeEpochs& epochs)
+        : m_epochs(epochs)
+    {
+        // Count the guard in the counter of the current epoch. If the epoch
+        // changes in the meantime, Synchronize() may have already checked the
+        // counter, so retry with the new epoch.
+        for (;;)
+        {
+            const uint64_t epoch = m_epochs.m_epoch.load();
+            m_counter = static_cast<unsigned>(epoch & 1);
+
+            m_epochs.m_guardCounts[m_counter].fetch_add(1);
+
+            if (m_epochs.m_epoch.load() == epoch)
+            {
+                break;
+            }
+
+            m_epochs.m_guardCounts[m_counter].fetch_sub(1);
+        }
+    }
+
+
+    CodeEpochs::Guard::~Guard()
+    {
+        m_epochs.m_guardCounts[m_counter].fetch_sub(1, std::memory_order_release);
+    }
+
+
+    //
+    // CodeEpochs
+    //
+
+    CodeEpochs::CodeEpochs()
+        : m_epoch(0)
+    {
+        m_guardCounts[0] = 0;
+        m_guardCounts[1] = 0;
+    }
+
+
+    void CodeEpochs::Synchronize()
+    {
+        std::lock_guard<std::mutex> lock(m_synchronizeLock);
+
+        const uint64_t epoch = m_epoch.load();
+
+        // The guards of the previous epoch must be gone before their counter
+        // is reused for the next one.
+        Drain(static_cast<unsigned>((epoch + 1) & 1));
+        m_epoch.store(epoch + 1);
+
+        // New guards now use the other counter, so this one only drains.
+        Drain(static_cast<unsigned>(epoch & 1));
+    }
+
+
+    uint64_t CodeEpochs::GetEpoch() const
+    {
+        return m_epoch.load();
+    }
+
+
+    void CodeEpochs::Drain(unsigned counter) const
+    {
+        while (m_guardCounts[counter].load(std::memory_order_acquire) != 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+}
@@ -0,0 +1,242 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+#include "NativeJIT/CodeGen/CpuFeatures.h"
+#include "Temporary/Assert.h"
+
+
+namespace NativeJIT
+{
+    namespace
+    {
+        // Returns eax, ebx, ecx and edx of the cpuid leaf or zeros if the
+        // leaf is not supported.
+        void Cpuid(uint32_t leaf, uint32_t (&registers)[4])
+        {
+            registers[0] = registers[1] = registers[2] = registers[3] = 0;
+
+#ifdef _MSC_VER
+            int values[4];
+
+            __cpuid(values, static_cast<int>(leaf & 0x80000000));
+
+            if (static_cast<uint32_t>(values[0]) >= leaf)
+            {
+                __cpuidex(values, static_cast<int>(leaf), 0);
+
+                for (unsigned i = 0; i < 4; ++i)
+                {
+                    registers[i] = static_cast<uint32_t>(values[i]);
+                }
+            }
+#else
+            if (__get_cpuid_max(leaf & 0x80000000, nullptr) >= leaf)
+            {
+                __cpuid_count(leaf, 0, registers[0], registers[1], registers[2], registers[3]);
+            }
+#endif
+        }
+
+
+        // Returns the XCR0 register, i.e. the processor state components which
+        // the operating system saves on context switches. Must only be called
+        // if cpuid reports OSXSAVE.
+        uint64_t GetEnabledStateComponents()
+        {
+#ifdef _MSC_VER
+            return _xgetbv(0);
+#else
+            uint32_t eax;
+            uint32_t edx;
+
+            // xgetbv is emitted as bytes to not depend on -mxsave.
+            __asm__ (".byte 0x0f, 0x01, 0xd0" : "=a" (eax), "=d" (edx) : "c" (0));
+
+            return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+        }
+
+
+        CpuFeatures DetectHostFeatures()
+        {
+            // References: Intel SDM vol. 2A, CPUID, and AMD APM vol. 3, E.4.
+            const unsigned ebx = 1;
+            const unsigned ecx = 2;
+
+            uint32_t basic[4];
+            uint32_t extended[4];
+            uint32_t structured[4];
+
+            Cpuid(1, basic);
+            Cpuid(7, structured);
+            Cpuid(0x80000001, extended);
+
+            CpuFeatures features;
+
+            if ((basic[ecx] & (1 << 23)) != 0)
+            {
+                features.Add(CpuFeature::PopCnt);
+            }
+
+            if ((extended[ecx] & (1 << 5)) != 0)
+            {
+                features.Add(CpuFeature::LzCnt);
+            }
+
+            if ((structured[ebx] & (1 << 3)) != 0)
+            {
+                features.Add(CpuFeature::Bmi1);
+            }
+
+            if ((structured[ebx] & (1 << 8)) != 0)
+            {
+                features.Add(CpuFeature::Bmi2);
+            }
+
+            if ((basic[ecx] & (1 << 19)) != 0)
+            {
+                features.Add(CpuFeature::Sse41);
+            }
+
+            // The AVX family additionally requires the operating system to
+            // preserve the xmm/ymm (XCR0 bits 1-2) and, for AVX-512, the
+            // opmask and zmm (XCR0 bits 5-7) registers.
+            const uint64_t ymmState = 0x6;
+            const uint64_t zmmState = 0xe6;
+            const uint64_t enabledState = (basic[ecx] & (1 << 27)) != 0
+                ? GetEnabledStateComponents()
+                : 0;
+
+            if ((enabledState & ymmState) == ymmState)
+            {
+                if ((basic[ecx] & (1 << 28)) != 0)
+                {
+                    features.Add(CpuFeature::Avx);
+
+                    if ((structured[ebx] & (1 << 5)) != 0)
+                    {
+                        features.Add(CpuFeature::Avx2);
+                    }
+
+                    if ((basic[ecx] & (1 << 12)) != 0)
+                    {
+                        features.Add(CpuFeature::Fma);
+                    }
+
+                    if ((basic[ecx] & (1 << 29)) != 0)
+                    {
+                        features.Add(CpuFeature::F16c);
+                    }
+                }
+
+                if ((enabledState & zmmState) == zmmState
+                    && (structured[ebx] & (1 << 16)) != 0)
+                {
+                    features.Add(CpuFeature::Avx512F);
+                }
+            }
+
+            return features;
+        }
+    }
+
+
+    CpuFeatures::CpuFeatures()
+        : m_features(0)
+    {
+    }
+
+
+    CpuFeatures const & CpuFeatures::GetHost()
+    {
+        static const CpuFeatures c_host = DetectHostFeatures();
+
+        return c_host;
+    }
+
+
+    char const * CpuFeatures::GetName(CpuFeature feature)
+    {
+        static char const * const c_names[] =
+        {
+            "popcnt",
+            "lzcnt",
+            "bmi1",
+            "bmi2",
+            "sse4.1",
+            "avx",
+            "avx2",
+            "fma",
+            "f16c",
+            "avx512f"
+        };
+
+        static_assert(sizeof(c_names) / sizeof(c_names[0])
+                      == static_cast<unsigned>(CpuFeature::FeatureCount),
+                      "Unexpected number of CPU feature names.");
+
+        LogThrowAssert(feature < CpuFeature::FeatureCount,
+                       "Invalid CPU feature %u",
+                       static_cast<unsigned>(feature));
+
+        return c_names[static_cast<unsigned>(feature)];
+    }
+
+
+    bool CpuFeatures::IsSupported(CpuFeature feature) const
+    {
+        return (m_features & GetMask(feature)) != 0;
+    }
+
+
+    CpuFeatures& CpuFeatures::Add(CpuFeature feature)
+    {
+        m_features |= GetMask(feature);
+
+        return *this;
+    }
+
+
+    CpuFeatures& CpuFeatures::Remove(CpuFeature feature)
+    {
+        m_features &= ~GetMask(feature);
+
+        return *this;
+    }
+
+
+    uint32_t CpuFeatures::GetMask(CpuFeature feature)
+    {
+        LogThrowAssert(feature < CpuFeature::FeatureCount,
+                       "Invalid CPU feature %u",
+                       static_cast<unsigned>(feature));
+
+        return 1u << static_cast<unsigned>(feature);
+    }
+}
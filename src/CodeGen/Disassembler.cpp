@@ -0,0 +1,1352 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <cctype>           // For isdigit.
+#include <cstring>          // For memcpy.
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+
+#include "NativeJIT/CodeGen/Disassembler.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/CodeGen/Register.h"
+#include "NativeJIT/CodeGen/X64CodeGenerator.h"
+#include "Temporary/Assert.h"
+
+
+// Reference: Intel 64 and IA-32 Architectures Software Developer's Manual,
+// Volume 2, Appendix A (opcode map) and
+// http://wiki.osdev.org/X86-64_Instruction_Encoding
+
+
+namespace NativeJIT
+{
+    //*************************************************************************
+    //
+    // Operand
+    //
+    //*************************************************************************
+    Operand Operand::Direct(unsigned size, bool isFloat, unsigned registerId)
+    {
+        Operand operand = {};
+
+        operand.m_kind = Kind::Direct;
+        operand.m_size = static_cast<uint8_t>(size);
+        operand.m_isFloat = isFloat;
+        operand.m_registerId = static_cast<uint8_t>(registerId);
+
+        return operand;
+    }
+
+
+    Operand Operand::Indirect(unsigned size, unsigned baseRegisterId, int64_t value)
+    {
+        Operand operand = {};
+
+        operand.m_kind = Kind::Indirect;
+        operand.m_size = static_cast<uint8_t>(size);
+        operand.m_registerId = static_cast<uint8_t>(baseRegisterId);
+        operand.m_value = value;
+
+        return operand;
+    }
+
+
+    Operand Operand::Indirect(unsigned size,
+                              unsigned baseRegisterId,
+                              unsigned indexRegisterId,
+                              unsigned scale,
+                              int64_t value)
+    {
+        Operand operand = Indirect(size, baseRegisterId, value);
+
+        operand.m_indexRegisterId = static_cast<uint8_t>(indexRegisterId);
+        operand.m_scale = static_cast<uint8_t>(scale);
+
+        return operand;
+    }
+
+
+    Operand Operand::Immediate(unsigned size, int64_t value)
+    {
+        Operand operand = {};
+
+        operand.m_kind = Kind::Immediate;
+        operand.m_size = static_cast<uint8_t>(size);
+        operand.m_value = value;
+
+        return operand;
+    }
+
+
+    Operand Operand::Target(unsigned offset)
+    {
+        Operand operand = {};
+
+        operand.m_kind = Kind::Target;
+        operand.m_value = offset;
+
+        return operand;
+    }
+
+
+    bool Operand::operator==(Operand const & other) const
+    {
+        return m_kind == other.m_kind
+               && m_size == other.m_size
+               && m_isFloat == other.m_isFloat
+               && m_registerId == other.m_registerId
+               && m_indexRegisterId == other.m_indexRegisterId
+               && m_scale == other.m_scale
+               && m_value == other.m_value;
+    }
+
+
+    bool Operand::operator!=(Operand const & other) const
+    {
+        return !(*this == other);
+    }
+
+
+    //*************************************************************************
+    //
+    // Instruction printing
+    //
+    //*************************************************************************
+    namespace
+    {
+        char const * GetRegisterName(unsigned size, bool isFloat, unsigned id)
+        {
+            // Register::GetName() distinguishes the single and double
+            // precision uses of XMM registers, which assemblers don't.
+            static char const * const c_xmmNames[] =
+            {
+                "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7",
+                "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15"
+            };
+
+            if (isFloat)
+            {
+                LogThrowAssert(id < std::extent<decltype(c_xmmNames)>::value,
+                               "Invalid XMM register %u",
+                               id);
+                return c_xmmNames[id];
+            }
+
+            switch (size)
+            {
+            case 1:     return Register<1, false>(id).GetName();
+            case 2:     return Register<2, false>(id).GetName();
+            case 4:     return Register<4, false>(id).GetName();
+            default:    return Register<8, false>(id).GetName();
+            }
+        }
+
+
+        char const * GetPointerName(unsigned size)
+        {
+            switch (size)
+            {
+            case 1:     return "byte";
+            case 2:     return "word";
+            case 4:     return "dword";
+            case 8:     return "qword";
+            case 16:    return "xmmword";
+            default:    return "*** UNKNOWN ***";
+            }
+        }
+
+
+        // Prints the number the way MASM source is usually written: digits
+        // below ten in decimal, the rest in hex with an "h" suffix and a
+        // leading zero if the first digit is a letter.
+        void PrintNumber(std::ostream& out, uint64_t value)
+        {
+            IosMiniStateRestorer state(out);
+
+            if (value < 10)
+            {
+                out << value;
+            }
+            else
+            {
+                std::ostringstream digits;
+                digits << std::uppercase << std::hex << value;
+
+                if (!isdigit(digits.str()[0]))
+                {
+                    out << '0';
+                }
+
+                out << digits.str() << 'h';
+            }
+        }
+
+
+        void PrintSignedNumber(std::ostream& out, int64_t value)
+        {
+            if (value < 0)
+            {
+                out << '-';
+                PrintNumber(out, 0 - static_cast<uint64_t>(value));
+            }
+            else
+            {
+                PrintNumber(out, static_cast<uint64_t>(value));
+            }
+        }
+    }
+
+
+    void Instruction::Print(std::ostream& out) const
+    {
+        out << m_mnemonic;
+
+        for (unsigned i = 0; i < m_operandCount; ++i)
+        {
+            Operand const & operand = m_operands[i];
+
+            out << (i == 0 ? " " : ", ");
+
+            switch (operand.m_kind)
+            {
+            case Operand::Kind::Direct:
+                out << GetRegisterName(operand.m_size, operand.m_isFloat, operand.m_registerId);
+                break;
+
+            case Operand::Kind::Indirect:
+                {
+                    const Register<8, false> base(operand.m_registerId);
+
+                    // Print the displacement rather than the target for
+                    // RIP-relative addressing, as an assembler would expect.
+                    const int64_t displacement
+                        = base.IsRIP()
+                          ? operand.m_value - static_cast<int64_t>(m_offset + m_length)
+                          : operand.m_value;
+
+                    out << GetPointerName(operand.m_size) << " ptr [" << base.GetName();
+
+                    if (operand.m_scale != 0)
+                    {
+                        out << " + "
+                            << Register<8, false>(operand.m_indexRegisterId).GetName()
+                            << '*'
+                            << static_cast<unsigned>(operand.m_scale);
+                    }
+
+                    if (displacement > 0)
+                    {
+                        out << " + ";
+                        PrintNumber(out, displacement);
+                    }
+                    else if (displacement < 0)
+                    {
+                        out << " - ";
+                        PrintNumber(out, 0 - static_cast<uint64_t>(displacement));
+                    }
+
+                    out << ']';
+                }
+                break;
+
+            case Operand::Kind::Immediate:
+                PrintSignedNumber(out, operand.m_value);
+                break;
+
+            case Operand::Kind::Target:
+                {
+                    IosMiniStateRestorer state(out);
+
+                    out << std::setfill('0') << std::setw(8) << std::uppercase << std::hex
+                        << operand.m_value << 'h';
+                }
+                break;
+
+            default:
+                out << "???";
+                break;
+            }
+        }
+    }
+
+
+    //*************************************************************************
+    //
+    // Decoder
+    //
+    //*************************************************************************
+    namespace
+    {
+        // Group 1 instructions, indexed by bits 3-5 of the opcode or by the
+        // extension opcode. Adc and sbb are not generated.
+        char const * const c_group1Names[8] =
+        {
+            "add", "or", nullptr, nullptr, "and", "sub", "xor", "cmp"
+        };
+
+        // Group 2 instructions, indexed by the extension opcode.
+        char const * const c_group2Names[8] =
+        {
+            "rol", "ror", nullptr, nullptr, "shl", "shr", nullptr, "sar"
+        };
+
+        // Group 3 instructions, indexed by the extension opcode. Test is not
+        // generated.
+        char const * const c_group3Names[8] =
+        {
+            nullptr, nullptr, "not", "neg", "mul", "imul", "div", "idiv"
+        };
+
+        char const * const c_cmovNames[16] =
+        {
+            "cmovo", "cmovno", "cmovb", "cmovae", "cmove", "cmovne", "cmovbe", "cmova",
+            "cmovs", "cmovns", "cmovp", "cmovnp", "cmovl", "cmovnl", "cmovle", "cmovnle"
+        };
+
+        const unsigned c_ripId = 16;
+
+
+        class Decoder
+        {
+        public:
+            Decoder(uint8_t const * code,
+                    unsigned offset,
+                    unsigned endOffset,
+                    Instruction& instruction);
+
+            bool Decode();
+
+        private:
+            template <typename T>
+            bool Read(T& value);
+
+            bool DecodeOneByteOpCode(uint8_t opCode);
+            bool DecodeTwoByteOpCode(uint8_t opCode);
+
+            // Decodes the rest of an instruction with the three byte VEX
+            // prefix, the first byte of which has already been read.
+            bool DecodeVex();
+
+            // Reads the ModR/M byte and the SIB byte and displacement which
+            // follow it, if any.
+            bool ReadModRM();
+
+            // Adds the operand described by the R/M field, which is either a
+            // direct register or memory of the specified size.
+            bool AddRM(unsigned size, bool isFloat);
+
+            // Adds the register described by the reg field.
+            bool AddReg(unsigned size, bool isFloat);
+
+            bool AddRegister(unsigned size, bool isFloat, unsigned id);
+
+            // Reads an immediate of the encoded size, sign extends it and adds
+            // it as an operand of the specified size.
+            bool AddImmediate(unsigned encodedSize, unsigned size);
+
+            // Reads a relative jump displacement of the specified size (1 or
+            // 4 bytes) and adds the target as an operand.
+            bool AddTarget(unsigned displacementSize);
+
+            void Add(Operand const & operand);
+
+            // Returns the size of general purpose register operands according
+            // to the prefixes.
+            unsigned GetOperandSize() const;
+
+            bool IsRexW() const;
+
+            // Returns whether the instruction has exactly the specified prefix
+            // of the ones which select scalar SSE instructions (0xf2, 0xf3)
+            // or the double precision variant (0x66). Zero for no prefix.
+            bool HasSSEPrefix(uint8_t prefix) const;
+
+            uint8_t const * m_code;
+            unsigned m_position;
+            unsigned m_endOffset;
+            Instruction& m_instruction;
+
+            bool m_operandSizeOverride;
+            uint8_t m_repeatPrefix;
+            uint8_t m_rex;
+
+            uint8_t m_mod;
+            uint8_t m_regField;
+            uint8_t m_rmField;
+            uint8_t m_indexField;
+            uint8_t m_scale;
+            bool m_isRIPRelative;
+            int32_t m_displacement;
+        };
+
+
+        Decoder::Decoder(uint8_t const * code,
+                         unsigned offset,
+                         unsigned endOffset,
+                         Instruction& instruction)
+            : m_code(code),
+              m_position(offset),
+              m_endOffset(endOffset),
+              m_instruction(instruction),
+              m_operandSizeOverride(false),
+              m_repeatPrefix(0),
+              m_rex(0),
+              m_mod(0),
+              m_regField(0),
+              m_rmField(0),
+              m_indexField(0),
+              m_scale(0),
+              m_isRIPRelative(false),
+              m_displacement(0)
+        {
+            m_instruction = Instruction();
+            m_instruction.m_offset = offset;
+        }
+
+
+        bool Decoder::Decode()
+        {
+            uint8_t byte;
+
+            if (!Read(byte))
+            {
+                return false;
+            }
+
+            // Legacy prefixes, in any order.
+            while (byte == 0x66 || byte == 0xf2 || byte == 0xf3)
+            {
+                if (byte == 0x66)
+                {
+                    m_operandSizeOverride = true;
+                }
+                else
+                {
+                    m_repeatPrefix = byte;
+                }
+
+                if (!Read(byte))
+                {
+                    return false;
+                }
+            }
+
+            bool isValid;
+
+            if (byte == 0xc4)
+            {
+                // In 64-bit mode, 0xc4 is always the three byte VEX prefix,
+                // which replaces REX and the legacy prefixes.
+                isValid = !m_operandSizeOverride && m_repeatPrefix == 0 && DecodeVex();
+            }
+            else
+            {
+                // REX must immediately precede the opcode.
+                if ((byte & 0xf0) == 0x40)
+                {
+                    m_rex = byte;
+
+                    if (!Read(byte))
+                    {
+                        return false;
+                    }
+                }
+
+                if (byte == 0x0f)
+                {
+                    isValid = Read(byte) && DecodeTwoByteOpCode(byte);
+                }
+                else
+                {
+                    isValid = DecodeOneByteOpCode(byte);
+                }
+            }
+
+            if (!isValid)
+            {
+                return false;
+            }
+
+            m_instruction.m_length = m_position - m_instruction.m_offset;
+
+            // The RIP-relative displacement is relative to the end of the
+            // instruction, which is only known now that the immediate, if any,
+            // has been read.
+            if (m_isRIPRelative)
+            {
+                for (unsigned i = 0; i < m_instruction.m_operandCount; ++i)
+                {
+                    Operand& operand = m_instruction.m_operands[i];
+
+                    if (operand.m_kind == Operand::Kind::Indirect)
+                    {
+                        operand.m_value += m_position;
+                    }
+                }
+            }
+
+            return true;
+        }
+
+
+        bool Decoder::DecodeOneByteOpCode(uint8_t opCode)
+        {
+            // The SSE prefixes are not used with any of the one byte opcodes.
+            if (m_repeatPrefix != 0)
+            {
+                return false;
+            }
+
+            auto & instruction = m_instruction;
+            const unsigned size = GetOperandSize();
+
+            // Group 1 instructions with register and R/M operands and with
+            // the accumulator and an immediate.
+            if (opCode < 0x40 && (opCode & 7) < 6)
+            {
+                instruction.m_mnemonic = c_group1Names[opCode >> 3];
+
+                if (instruction.m_mnemonic == nullptr)
+                {
+                    return false;
+                }
+
+                switch (opCode & 7)
+                {
+                case 0:
+                    return ReadModRM() && AddRM(1, false) && AddReg(1, false);
+                case 1:
+                    return ReadModRM() && AddRM(size, false) && AddReg(size, false);
+                case 2:
+                    return ReadModRM() && AddReg(1, false) && AddRM(1, false);
+                case 3:
+                    return ReadModRM() && AddReg(size, false) && AddRM(size, false);
+                case 4:
+                    return AddRegister(1, false, 0) && AddImmediate(1, 1);
+                default:
+                    return AddRegister(size, false, 0) && AddImmediate(size == 2 ? 2 : 4, size);
+                }
+            }
+
+            // Conditional jumps with an 8-bit displacement.
+            if (opCode >= 0x70 && opCode <= 0x7f)
+            {
+                instruction.m_mnemonic
+                    = X64CodeGenerator::JccName(static_cast<JccType>(opCode - 0x70));
+
+                return m_rex == 0 && !m_operandSizeOverride && m_repeatPrefix == 0 && AddTarget(1);
+            }
+
+            switch (opCode)
+            {
+            case 0x50: case 0x51: case 0x52: case 0x53:
+            case 0x54: case 0x55: case 0x56: case 0x57:
+                instruction.m_mnemonic = "push";
+                return !m_operandSizeOverride
+                       && AddRegister(8, false, (opCode & 7) | ((m_rex & 1) << 3));
+
+            case 0x58: case 0x59: case 0x5a: case 0x5b:
+            case 0x5c: case 0x5d: case 0x5e: case 0x5f:
+                instruction.m_mnemonic = "pop";
+                return !m_operandSizeOverride
+                       && AddRegister(8, false, (opCode & 7) | ((m_rex & 1) << 3));
+
+            case 0x63:
+                instruction.m_mnemonic = "movsxd";
+                return IsRexW() && ReadModRM() && AddReg(8, false) && AddRM(4, false);
+
+            case 0x69:
+                instruction.m_mnemonic = "imul";
+                return ReadModRM()
+                       && AddReg(size, false)
+                       && AddRM(size, false)
+                       && AddImmediate(size == 2 ? 2 : 4, size);
+
+            case 0x6b:
+                instruction.m_mnemonic = "imul";
+                return ReadModRM()
+                       && AddReg(size, false)
+                       && AddRM(size, false)
+                       && AddImmediate(1, size);
+
+            case 0x80:
+            case 0x81:
+            case 0x83:
+                {
+                    const unsigned targetSize = opCode == 0x80 ? 1 : size;
+                    const unsigned immediateSize = opCode == 0x81
+                                                   ? (size == 2 ? 2 : 4)
+                                                   : 1;
+
+                    if (!ReadModRM())
+                    {
+                        return false;
+                    }
+
+                    instruction.m_mnemonic = c_group1Names[m_regField & 7];
+
+                    return instruction.m_mnemonic != nullptr
+                           && AddRM(targetSize, false)
+                           && AddImmediate(immediateSize, targetSize);
+                }
+
+            case 0x88:
+                instruction.m_mnemonic = "mov";
+                return ReadModRM() && AddRM(1, false) && AddReg(1, false);
+            case 0x89:
+                instruction.m_mnemonic = "mov";
+                return ReadModRM() && AddRM(size, false) && AddReg(size, false);
+            case 0x8a:
+                instruction.m_mnemonic = "mov";
+                return ReadModRM() && AddReg(1, false) && AddRM(1, false);
+            case 0x8b:
+                instruction.m_mnemonic = "mov";
+                return ReadModRM() && AddReg(size, false) && AddRM(size, false);
+
+            case 0x8d:
+                // Lea has no direct register form. The size of the memory
+                // operand is not relevant, print it as the register size.
+                instruction.m_mnemonic = "lea";
+                return ReadModRM() && m_mod != 3 && AddReg(size, false) && AddRM(size, false);
+
+            case 0x90:
+                instruction.m_mnemonic = "nop";
+                return m_rex == 0 && !m_operandSizeOverride;
+
+            case 0x99:
+                {
+                    static char const * const c_names[] = { "cwd", "cdq", "cqo" };
+
+                    instruction.m_mnemonic = c_names[size == 2 ? 0 : (size == 4 ? 1 : 2)];
+                    return true;
+                }
+
+            case 0xb0: case 0xb1: case 0xb2: case 0xb3:
+            case 0xb4: case 0xb5: case 0xb6: case 0xb7:
+                instruction.m_mnemonic = "mov";
+                return AddRegister(1, false, (opCode & 7) | ((m_rex & 1) << 3))
+                       && AddImmediate(1, 1);
+
+            case 0xb8: case 0xb9: case 0xba: case 0xbb:
+            case 0xbc: case 0xbd: case 0xbe: case 0xbf:
+                instruction.m_mnemonic = "mov";
+                return AddRegister(size, false, (opCode & 7) | ((m_rex & 1) << 3))
+                       && AddImmediate(size, size);
+
+            case 0xc0:
+            case 0xc1:
+            case 0xd2:
+            case 0xd3:
+                {
+                    const unsigned targetSize = (opCode & 1) == 0 ? 1 : size;
+
+                    if (!ReadModRM())
+                    {
+                        return false;
+                    }
+
+                    instruction.m_mnemonic = c_group2Names[m_regField & 7];
+
+                    if (instruction.m_mnemonic == nullptr || !AddRM(targetSize, false))
+                    {
+                        return false;
+                    }
+
+                    // The shift count is either an unsigned byte or cl.
+                    if (opCode < 0xd0)
+                    {
+                        uint8_t shift;
+
+                        if (!Read(shift))
+                        {
+                            return false;
+                        }
+
+                        Add(Operand::Immediate(1, shift));
+                        return true;
+                    }
+
+                    return AddRegister(1, false, 1);
+                }
+
+            case 0xc3:
+                instruction.m_mnemonic = "ret";
+                return m_rex == 0 && !m_operandSizeOverride;
+
+            case 0xc7:
+                instruction.m_mnemonic = "mov";
+                return ReadModRM()
+                       && (m_regField & 7) == 0
+                       && AddRM(size, false)
+                       && AddImmediate(size == 2 ? 2 : 4, size);
+
+            case 0xf6:
+            case 0xf7:
+                if (!ReadModRM())
+                {
+                    return false;
+                }
+
+                instruction.m_mnemonic = c_group3Names[m_regField & 7];
+
+                return instruction.m_mnemonic != nullptr
+                       && AddRM(opCode == 0xf6 ? 1 : size, false);
+
+            case 0xe9:
+            case 0xeb:
+                instruction.m_mnemonic = "jmp";
+                return m_rex == 0 && !m_operandSizeOverride && AddTarget(opCode == 0xeb ? 1 : 4);
+
+            case 0xff:
+                // Only the call is generated from group 5.
+                instruction.m_mnemonic = "call";
+                return !m_operandSizeOverride
+                       && ReadModRM()
+                       && (m_regField & 7) == 2
+                       && AddRM(8, false);
+
+            default:
+                return false;
+            }
+        }
+
+
+        bool Decoder::DecodeTwoByteOpCode(uint8_t opCode)
+        {
+            auto & instruction = m_instruction;
+            const unsigned size = GetOperandSize();
+
+            // Conditional moves and jumps.
+            if (opCode >= 0x40 && opCode <= 0x4f)
+            {
+                instruction.m_mnemonic = c_cmovNames[opCode - 0x40];
+
+                return m_repeatPrefix == 0
+                       && size != 1
+                       && ReadModRM()
+                       && AddReg(size, false)
+                       && AddRM(size, false);
+            }
+
+            if (opCode >= 0x80 && opCode <= 0x8f)
+            {
+                instruction.m_mnemonic
+                    = X64CodeGenerator::JccName(static_cast<JccType>(opCode - 0x80));
+
+                return m_rex == 0 && !m_operandSizeOverride && m_repeatPrefix == 0 && AddTarget(4);
+            }
+
+            // Size of the floating point operation for scalar instructions.
+            const unsigned floatSize = m_repeatPrefix == 0xf2 ? 8 : 4;
+            const bool isScalar = HasSSEPrefix(0xf2) || HasSSEPrefix(0xf3);
+
+            switch (opCode)
+            {
+            case 0x10:
+            case 0x11:
+                instruction.m_mnemonic = floatSize == 8 ? "movsd" : "movss";
+
+                if (!isScalar || !ReadModRM())
+                {
+                    return false;
+                }
+
+                return opCode == 0x10
+                       ? AddReg(floatSize, true) && AddRM(floatSize, true)
+                       : m_mod != 3 && AddRM(floatSize, true) && AddReg(floatSize, true);
+
+            case 0x28:
+            case 0x29:
+                {
+                    const bool isDouble = HasSSEPrefix(0x66);
+                    const unsigned registerSize = isDouble ? 8 : 4;
+
+                    instruction.m_mnemonic = isDouble ? "movapd" : "movaps";
+
+                    if (!(isDouble || HasSSEPrefix(0)) || !ReadModRM())
+                    {
+                        return false;
+                    }
+
+                    // The memory operand is always the full 128 bits.
+                    const unsigned rmSize = m_mod == 3 ? registerSize : 16;
+
+                    return opCode == 0x28
+                           ? AddReg(registerSize, true) && AddRM(rmSize, true)
+                           : m_mod != 3 && AddRM(rmSize, true) && AddReg(registerSize, true);
+                }
+
+            case 0x2a:
+                instruction.m_mnemonic = floatSize == 8 ? "cvtsi2sd" : "cvtsi2ss";
+                return isScalar
+                       && ReadModRM()
+                       && AddReg(floatSize, true)
+                       && AddRM(IsRexW() ? 8 : 4, false);
+
+            case 0x2c:
+                instruction.m_mnemonic = floatSize == 8 ? "cvttsd2si" : "cvttss2si";
+                return isScalar
+                       && ReadModRM()
+                       && AddReg(IsRexW() ? 8 : 4, false)
+                       && AddRM(floatSize, true);
+
+            case 0x2f:
+                {
+                    const bool isDouble = HasSSEPrefix(0x66);
+                    const unsigned operandSize = isDouble ? 8 : 4;
+
+                    instruction.m_mnemonic = isDouble ? "comisd" : "comiss";
+
+                    return (isDouble || HasSSEPrefix(0))
+                           && ReadModRM()
+                           && AddReg(operandSize, true)
+                           && AddRM(operandSize, true);
+                }
+
+            case 0x57:
+                {
+                    const bool isDouble = HasSSEPrefix(0x66);
+                    const unsigned registerSize = isDouble ? 8 : 4;
+
+                    instruction.m_mnemonic = isDouble ? "xorpd" : "xorps";
+
+                    if (!(isDouble || HasSSEPrefix(0)) || !ReadModRM())
+                    {
+                        return false;
+                    }
+
+                    return AddReg(registerSize, true)
+                           && AddRM(m_mod == 3 ? registerSize : 16, true);
+                }
+
+            case 0x58:
+            case 0x59:
+            case 0x5c:
+            case 0x5e:
+                {
+                    static char const * const c_names[][2] =
+                    {
+                        { "addss", "addsd" },
+                        { "mulss", "mulsd" },
+                        { "subss", "subsd" },
+                        { "divss", "divsd" }
+                    };
+
+                    const unsigned index = opCode == 0x58
+                                           ? 0
+                                           : (opCode == 0x59 ? 1 : (opCode == 0x5c ? 2 : 3));
+                    instruction.m_mnemonic = c_names[index][floatSize == 8 ? 1 : 0];
+
+                    return isScalar
+                           && ReadModRM()
+                           && AddReg(floatSize, true)
+                           && AddRM(floatSize, true);
+                }
+
+            case 0x5a:
+                {
+                    // The prefix describes the source.
+                    const unsigned targetSize = floatSize == 8 ? 4 : 8;
+
+                    instruction.m_mnemonic = floatSize == 8 ? "cvtsd2ss" : "cvtss2sd";
+
+                    return isScalar
+                           && ReadModRM()
+                           && AddReg(targetSize, true)
+                           && AddRM(floatSize, true);
+                }
+
+            case 0x6e:
+                {
+                    const unsigned operandSize = IsRexW() ? 8 : 4;
+
+                    instruction.m_mnemonic = IsRexW() ? "movq" : "movd";
+
+                    return HasSSEPrefix(0x66)
+                           && ReadModRM()
+                           && AddReg(operandSize, true)
+                           && AddRM(operandSize, false);
+                }
+
+            case 0xa4:
+            case 0xa5:
+                instruction.m_mnemonic = "shld";
+
+                if (m_repeatPrefix != 0
+                    || size == 1
+                    || !ReadModRM()
+                    || !AddRM(size, false)
+                    || !AddReg(size, false))
+                {
+                    return false;
+                }
+
+                return opCode == 0xa4
+                       ? AddImmediate(1, 1)
+                       : AddRegister(1, false, 1);
+
+            case 0xaf:
+                instruction.m_mnemonic = "imul";
+                return m_repeatPrefix == 0
+                       && ReadModRM()
+                       && AddReg(size, false)
+                       && AddRM(size, false);
+
+            case 0xb8:
+                instruction.m_mnemonic = "popcnt";
+                return m_repeatPrefix == 0xf3
+                       && ReadModRM()
+                       && AddReg(size, false)
+                       && AddRM(size, false);
+
+            case 0xbc:
+            case 0xbd:
+                // With the 0xf3 prefix, bsf and bsr become tzcnt and lzcnt.
+                if (m_repeatPrefix == 0)
+                {
+                    instruction.m_mnemonic = opCode == 0xbc ? "bsf" : "bsr";
+                }
+                else if (m_repeatPrefix == 0xf3)
+                {
+                    instruction.m_mnemonic = opCode == 0xbc ? "tzcnt" : "lzcnt";
+                }
+                else
+                {
+                    return false;
+                }
+
+                return ReadModRM()
+                       && AddReg(size, false)
+                       && AddRM(size, false);
+
+            case 0xb6:
+            case 0xb7:
+            case 0xbe:
+            case 0xbf:
+                {
+                    const unsigned sourceSize = (opCode & 1) == 0 ? 1 : 2;
+
+                    instruction.m_mnemonic = opCode < 0xbe ? "movzx" : "movsx";
+
+                    return m_repeatPrefix == 0
+                           && size > sourceSize
+                           && ReadModRM()
+                           && AddReg(size, false)
+                           && AddRM(sourceSize, false);
+                }
+
+            default:
+                return false;
+            }
+        }
+
+
+        bool Decoder::DecodeVex()
+        {
+            uint8_t byte1;
+            uint8_t byte2;
+            uint8_t opCode;
+
+            if (!Read(byte1) || !Read(byte2) || !Read(opCode))
+            {
+                return false;
+            }
+
+            // Only the 0F 38 opcode map with the 128-bit vector length, which
+            // holds the BMI and the scalar FMA instructions, is used.
+            if ((byte1 & 0x1f) != 2 || (byte2 & 4) != 0)
+            {
+                return false;
+            }
+
+            // Set up the equivalent REX so that ReadModRM() picks up the
+            // register extensions, which are stored inverted in VEX.
+            m_rex = static_cast<uint8_t>(0x40
+                                         | ((byte2 & 0x80) >> 4)
+                                         | ((~byte1 & 0xe0) >> 5));
+
+            const unsigned vvvv = (~byte2 >> 3) & 0xf;
+            const unsigned prefix = byte2 & 3;
+            const unsigned size = IsRexW() ? 8 : 4;
+
+            auto & instruction = m_instruction;
+
+            switch (opCode)
+            {
+            case 0xb9:
+                // vfmadd231ss/sd dest, src1, src2 (0x66), VEX.W selects sd.
+                if (prefix != 1)
+                {
+                    return false;
+                }
+
+                instruction.m_mnemonic = IsRexW() ? "vfmadd231sd" : "vfmadd231ss";
+
+                return ReadModRM()
+                       && AddReg(size, true)
+                       && AddRegister(size, true, vvvv)
+                       && AddRM(size, true);
+
+            case 0xf5:
+                // pdep dest, src, mask (0xf2) and pext (0xf3).
+                if (prefix != 2 && prefix != 3)
+                {
+                    return false;
+                }
+
+                instruction.m_mnemonic = prefix == 3 ? "pdep" : "pext";
+
+                return ReadModRM()
+                       && AddReg(size, false)
+                       && AddRegister(size, false, vvvv)
+                       && AddRM(size, false);
+
+            case 0xf7:
+                // bextr dest, src, control.
+                instruction.m_mnemonic = "bextr";
+
+                return prefix == 0
+                       && ReadModRM()
+                       && AddReg(size, false)
+                       && AddRM(size, false)
+                       && AddRegister(size, false, vvvv);
+
+            default:
+                return false;
+            }
+        }
+
+
+        template <typename T>
+        bool Decoder::Read(T& value)
+        {
+            if (m_position + sizeof(T) > m_endOffset)
+            {
+                return false;
+            }
+
+            memcpy(&value, m_code + m_position, sizeof(T));
+            m_position += sizeof(T);
+
+            return true;
+        }
+
+
+        bool Decoder::ReadModRM()
+        {
+            uint8_t modRM;
+
+            if (!Read(modRM))
+            {
+                return false;
+            }
+
+            m_mod = modRM >> 6;
+            m_regField = ((modRM >> 3) & 7) | ((m_rex & 4) << 1);
+            m_rmField = (modRM & 7) | ((m_rex & 1) << 3);
+
+            if (m_mod == 3)
+            {
+                return true;
+            }
+
+            if ((m_rmField & 7) == 4)
+            {
+                uint8_t sib;
+
+                if (!Read(sib))
+                {
+                    return false;
+                }
+
+                const uint8_t index = ((sib >> 3) & 7) | ((m_rex & 2) << 2);
+                m_rmField = (sib & 7) | ((m_rex & 1) << 3);
+
+                if (index == 4)
+                {
+                    // No index. X64CodeGenerator only uses this form to encode
+                    // rsp and r12 as the base.
+                    if ((sib & 0xc7) != 4)
+                    {
+                        return false;
+                    }
+                }
+                else
+                {
+                    m_indexField = index;
+                    m_scale = static_cast<uint8_t>(1 << (sib >> 6));
+                }
+
+                // Mod 0 with base 5 would be an absolute disp32 address, which
+                // is never generated.
+                if (m_mod == 0 && (m_rmField & 7) == 5)
+                {
+                    return false;
+                }
+            }
+            else if (m_mod == 0 && (m_rmField & 7) == 5)
+            {
+                m_isRIPRelative = true;
+                m_rmField = c_ripId;
+
+                return Read(m_displacement);
+            }
+
+            if (m_mod == 1)
+            {
+                int8_t displacement;
+
+                if (!Read(displacement))
+                {
+                    return false;
+                }
+
+                m_displacement = displacement;
+            }
+            else if (m_mod == 2)
+            {
+                return Read(m_displacement);
+            }
+
+            return true;
+        }
+
+
+        bool Decoder::AddRM(unsigned size, bool isFloat)
+        {
+            if (m_mod == 3)
+            {
+                return AddRegister(size, isFloat, m_rmField);
+            }
+
+            Add(Operand::Indirect(size, m_rmField, m_indexField, m_scale, m_displacement));
+
+            return true;
+        }
+
+
+        bool Decoder::AddReg(unsigned size, bool isFloat)
+        {
+            return AddRegister(size, isFloat, m_regField);
+        }
+
+
+        bool Decoder::AddRegister(unsigned size, bool isFloat, unsigned id)
+        {
+            // Without REX, IDs 4-7 of byte registers are ah, ch, dh and bh,
+            // which X64CodeGenerator never uses.
+            if (size == 1 && !isFloat && m_rex == 0 && id >= 4)
+            {
+                return false;
+            }
+
+            Add(Operand::Direct(size, isFloat, id));
+
+            return true;
+        }
+
+
+        bool Decoder::AddImmediate(unsigned encodedSize, unsigned size)
+        {
+            int64_t value;
+
+            switch (encodedSize)
+            {
+            case 1:
+                {
+                    int8_t immediate;
+                    if (!Read(immediate)) { return false; }
+                    value = immediate;
+                }
+                break;
+
+            case 2:
+                {
+                    int16_t immediate;
+                    if (!Read(immediate)) { return false; }
+                    value = immediate;
+                }
+                break;
+
+            case 4:
+                {
+                    int32_t immediate;
+                    if (!Read(immediate)) { return false; }
+                    value = immediate;
+                }
+                break;
+
+            default:
+                if (!Read(value)) { return false; }
+                break;
+            }
+
+            Add(Operand::Immediate(size, value));
+
+            return true;
+        }
+
+
+        bool Decoder::AddTarget(unsigned displacementSize)
+        {
+            int32_t relativeOffset;
+
+            if (displacementSize == 1)
+            {
+                int8_t shortOffset;
+
+                if (!Read(shortOffset))
+                {
+                    return false;
+                }
+
+                relativeOffset = shortOffset;
+            }
+            else if (!Read(relativeOffset))
+            {
+                return false;
+            }
+
+            Add(Operand::Target(m_position + relativeOffset));
+
+            return true;
+        }
+
+
+        void Decoder::Add(Operand const & operand)
+        {
+            LogThrowAssert(m_instruction.m_operandCount < Instruction::c_maxOperandCount,
+                           "Too many operands");
+
+            m_instruction.m_operands[m_instruction.m_operandCount++] = operand;
+        }
+
+
+        unsigned Decoder::GetOperandSize() const
+        {
+            return IsRexW() ? 8 : (m_operandSizeOverride ? 2 : 4);
+        }
+
+
+        bool Decoder::IsRexW() const
+        {
+            return (m_rex & 8) != 0;
+        }
+
+
+        bool Decoder::HasSSEPrefix(uint8_t prefix) const
+        {
+            switch (prefix)
+            {
+            case 0:
+                return !m_operandSizeOverride && m_repeatPrefix == 0;
+            case 0x66:
+                return m_operandSizeOverride && m_repeatPrefix == 0;
+            default:
+                return !m_operandSizeOverride && m_repeatPrefix == prefix;
+            }
+        }
+    }
+
+
+    bool DecodeInstruction(uint8_t const * code,
+                           unsigned offset,
+                           unsigned endOffset,
+                           Instruction& instruction)
+    {
+        return Decoder(code, offset, endOffset, instruction).Decode();
+    }
+
+
+    //*************************************************************************
+    //
+    // Disassemble
+    //
+    //*************************************************************************
+    namespace
+    {
+        // The same layout as X64CodeGenerator::CodePrinter uses.
+        const unsigned c_listingDataWidth = 36;
+
+        void PrintListingBytes(std::ostream& out,
+                               uint8_t const * code,
+                               unsigned start,
+                               unsigned end)
+        {
+            IosMiniStateRestorer state(out);
+
+            out.fill('0');
+            out << " " << std::uppercase << std::hex << std::setw(8) << start << "  ";
+
+            unsigned column = 11;
+
+            for (unsigned i = start; i < end; ++i)
+            {
+                out << std::setw(2) << static_cast<unsigned>(code[i]) << " ";
+                column += 3;
+            }
+
+            while (column < c_listingDataWidth)
+            {
+                out << ' ';
+                column++;
+            }
+        }
+    }
+
+
+    bool Disassemble(FunctionBuffer const & code, std::ostream& out)
+    {
+        uint8_t const * buffer = code.BufferStart();
+        const unsigned end = code.GetFunctionCodeEndOffset();
+        unsigned offset = code.GetFunctionCodeStartOffset();
+        bool isValid = true;
+
+        while (offset < end)
+        {
+            Instruction instruction;
+
+            if (DecodeInstruction(buffer, offset, end, instruction))
+            {
+                PrintListingBytes(out, buffer, offset, offset + instruction.m_length);
+                instruction.Print(out);
+                out << std::endl;
+
+                offset += instruction.m_length;
+            }
+            else
+            {
+                PrintListingBytes(out, buffer, offset, offset + 1);
+                out << "db ";
+                PrintNumber(out, buffer[offset]);
+                out << std::endl;
+
+                isValid = false;
+                ++offset;
+            }
+        }
+
+        return isValid;
+    }
+}
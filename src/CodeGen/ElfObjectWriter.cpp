@@ -0,0 +1,630 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <cstring>          // For memcpy.
+#include <ostream>
+#include <unordered_map>
+
+#include "NativeJIT/CodeGen/ElfObjectWriter.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "Temporary/Assert.h"
+#include "UnwindCode.h"
+
+
+// ELF: http://refspecs.linuxfoundation.org/elf/gabi4+/contents.html
+// x86-64 psABI (relocations, .eh_frame): https://gitlab.com/x86-psABIs/x86-64-ABI
+// .eh_frame format: http://refspecs.linuxfoundation.org/LSB_5.0.0/LSB-Core-generic/LSB-Core-generic/ehframechpt.html
+
+
+namespace NativeJIT
+{
+    namespace
+    {
+        //
+        // ELF-64 structures. Defined here rather than taken from <elf.h>,
+        // which is not available on all platforms.
+        //
+
+        struct ElfHeader
+        {
+            uint8_t m_ident[16];
+            uint16_t m_type;
+            uint16_t m_machine;
+            uint32_t m_version;
+            uint64_t m_entry;
+            uint64_t m_programHeaderOffset;
+            uint64_t m_sectionHeaderOffset;
+            uint32_t m_flags;
+            uint16_t m_headerSize;
+            uint16_t m_programHeaderEntrySize;
+            uint16_t m_programHeaderCount;
+            uint16_t m_sectionHeaderEntrySize;
+            uint16_t m_sectionHeaderCount;
+            uint16_t m_sectionNamesIndex;
+        };
+
+        static_assert(sizeof(ElfHeader) == 64, "Invalid ElfHeader size");
+
+
+        struct ElfSectionHeader
+        {
+            uint32_t m_name;
+            uint32_t m_type;
+            uint64_t m_flags;
+            uint64_t m_address;
+            uint64_t m_offset;
+            uint64_t m_size;
+            uint32_t m_link;
+            uint32_t m_info;
+            uint64_t m_alignment;
+            uint64_t m_entrySize;
+        };
+
+        static_assert(sizeof(ElfSectionHeader) == 64, "Invalid ElfSectionHeader size");
+
+
+        struct ElfSymbol
+        {
+            uint32_t m_name;
+            uint8_t m_info;
+            uint8_t m_other;
+            uint16_t m_sectionIndex;
+            uint64_t m_value;
+            uint64_t m_size;
+        };
+
+        static_assert(sizeof(ElfSymbol) == 24, "Invalid ElfSymbol size");
+
+
+        struct ElfRelocation
+        {
+            uint64_t m_offset;
+            uint64_t m_info;
+            int64_t m_addend;
+        };
+
+        static_assert(sizeof(ElfRelocation) == 24, "Invalid ElfRelocation size");
+
+
+        const uint16_t c_elfTypeRelocatable = 1;
+        const uint16_t c_elfMachineX64 = 62;
+
+        const uint32_t c_sectionProgBits = 1;
+        const uint32_t c_sectionSymbolTable = 2;
+        const uint32_t c_sectionStringTable = 3;
+        const uint32_t c_sectionRelocations = 4;
+        const uint32_t c_sectionX64Unwind = 0x70000001;
+
+        const uint64_t c_sectionFlagAlloc = 0x2;
+        const uint64_t c_sectionFlagExecute = 0x4;
+        const uint64_t c_sectionFlagInfoLink = 0x40;
+
+        const uint8_t c_symbolBindingLocal = 0;
+        const uint8_t c_symbolBindingGlobal = 1;
+        const uint8_t c_symbolTypeNone = 0;
+        const uint8_t c_symbolTypeFunction = 2;
+        const uint8_t c_symbolTypeSection = 3;
+
+        const uint32_t c_relocationAbsolute64 = 1;
+        const uint32_t c_relocationPCRelative32 = 2;
+
+        // The section indices, in the order in which the sections are written.
+        enum Section : uint16_t
+        {
+            Null,
+            Text,
+            TextRelocations,
+            EhFrame,
+            EhFrameRelocations,
+            SymbolTable,
+            StringTable,
+            SectionNames,
+            GnuStack,
+            SectionCount
+        };
+
+        // The symbols preceding the function symbol. The external symbols
+        // follow it.
+        enum LocalSymbol : uint32_t
+        {
+            NullSymbol,
+            TextSectionSymbol,
+            FirstGlobalSymbol
+        };
+
+        //
+        // DWARF call frame instructions.
+        //
+
+        const uint8_t c_cfaAdvanceLoc = 0x40;
+        const uint8_t c_cfaOffset = 0x80;
+        const uint8_t c_cfaNop = 0x00;
+        const uint8_t c_cfaAdvanceLoc1 = 0x02;
+        const uint8_t c_cfaDefCfa = 0x0c;
+        const uint8_t c_cfaDefCfaOffset = 0x0e;
+
+        const uint8_t c_pointerEncodingPCRelativeSigned32 = 0x1b;
+
+        const unsigned c_dwarfRsp = 7;
+        const unsigned c_dwarfReturnAddress = 16;
+
+        // The data alignment factor by which the register save offsets are
+        // divided.
+        const int c_dataAlignmentFactor = -8;
+
+
+        // Maps a NativeJIT register ID (i.e. the x64 encoding) to the DWARF
+        // register number.
+        unsigned GetDwarfRegister(unsigned registerId)
+        {
+            static const unsigned c_lowRegisters[] = { 0, 2, 1, 3, 7, 6, 4, 5 };
+
+            return registerId < 8 ? c_lowRegisters[registerId] : registerId;
+        }
+
+
+        template <typename T>
+        void Append(std::vector<uint8_t>& data, T value)
+        {
+            static_assert(std::is_trivial<T>::value, "Invalid type.");
+
+            const size_t start = data.size();
+            data.resize(start + sizeof(T));
+            memcpy(&data[start], &value, sizeof(T));
+        }
+
+
+        void AppendUleb128(std::vector<uint8_t>& data, uint64_t value)
+        {
+            do
+            {
+                uint8_t byte = value & 0x7f;
+                value >>= 7;
+
+                if (value != 0)
+                {
+                    byte |= 0x80;
+                }
+
+                data.push_back(byte);
+            } while (value != 0);
+        }
+
+
+        void AppendSleb128(std::vector<uint8_t>& data, int64_t value)
+        {
+            bool more = true;
+
+            while (more)
+            {
+                uint8_t byte = value & 0x7f;
+
+                // Arithmetic shift keeps the sign.
+                value >>= 7;
+
+                more = !((value == 0 && (byte & 0x40) == 0)
+                         || (value == -1 && (byte & 0x40) != 0));
+
+                data.push_back(more ? (byte | 0x80) : byte);
+            }
+        }
+
+
+        // Pads an .eh_frame entry which started at the specified position to
+        // a multiple of 8 bytes and fills in its length.
+        void CompleteFrameEntry(std::vector<uint8_t>& data, size_t start)
+        {
+            while ((data.size() - start) % 8 != 0)
+            {
+                data.push_back(c_cfaNop);
+            }
+
+            const uint32_t length = static_cast<uint32_t>(data.size() - start - sizeof(uint32_t));
+            memcpy(&data[start], &length, sizeof(length));
+        }
+
+
+        // Appends the data aligned to the alignment and returns its offset.
+        size_t AppendAligned(std::vector<uint8_t>& file,
+                             void const * data,
+                             size_t byteLength,
+                             size_t alignment)
+        {
+            while (file.size() % alignment != 0)
+            {
+                file.push_back(0);
+            }
+
+            const size_t offset = file.size();
+            file.resize(offset + byteLength);
+
+            if (byteLength > 0)
+            {
+                memcpy(&file[offset], data, byteLength);
+            }
+
+            return offset;
+        }
+    }
+
+
+    ElfObjectWriter::ElfObjectWriter(FunctionBuffer const & code,
+                                     std::string const & functionName)
+        : m_code(code),
+          m_functionName(functionName)
+    {
+        LogThrowAssert(!functionName.empty(), "The function must have a name");
+    }
+
+
+    void ElfObjectWriter::AddExternalReference(unsigned offset, std::string const & symbolName)
+    {
+        LogThrowAssert(offset + sizeof(uint64_t) <= m_code.GetFunctionCodeEndOffset(),
+                       "Reference to %s at offset %u is outside of the code",
+                       symbolName.c_str(),
+                       offset);
+        LogThrowAssert(!symbolName.empty(), "The symbol must have a name");
+
+        m_externalReferences.push_back({ offset, symbolName });
+    }
+
+
+    std::vector<uint8_t> ElfObjectWriter::BuildEhFrame(unsigned& functionLocationOffset) const
+    {
+        std::vector<uint8_t> frame;
+
+        // Common information entry. At the function entry the CFA is RSP + 8
+        // and the return address is at CFA - 8.
+        const size_t cieStart = frame.size();
+        Append<uint32_t>(frame, 0);     // Length, filled in later.
+        Append<uint32_t>(frame, 0);     // CIE ID.
+        frame.push_back(1);             // Version.
+        frame.push_back('z');           // Augmentation string "zR".
+        frame.push_back('R');
+        frame.push_back('\0');
+        AppendUleb128(frame, 1);        // Code alignment factor.
+        AppendSleb128(frame, c_dataAlignmentFactor);
+        AppendUleb128(frame, c_dwarfReturnAddress);
+        AppendUleb128(frame, 1);        // Augmentation data length.
+        frame.push_back(c_pointerEncodingPCRelativeSigned32);
+        frame.push_back(c_cfaDefCfa);
+        AppendUleb128(frame, c_dwarfRsp);
+        AppendUleb128(frame, sizeof(void*));
+        frame.push_back(static_cast<uint8_t>(c_cfaOffset | c_dwarfReturnAddress));
+        AppendUleb128(frame, 1);
+        CompleteFrameEntry(frame, cieStart);
+
+        // Frame description entry.
+        const unsigned codeStart = m_code.GetFunctionCodeStartOffset();
+        const unsigned codeEnd = m_code.GetFunctionCodeEndOffset();
+
+        const size_t fdeStart = frame.size();
+        Append<uint32_t>(frame, 0);     // Length, filled in later.
+        Append<uint32_t>(frame, static_cast<uint32_t>(frame.size() - cieStart));
+        functionLocationOffset = static_cast<unsigned>(frame.size());
+        Append<int32_t>(frame, 0);      // Function location, relocated.
+        Append<uint32_t>(frame, codeEnd - codeStart);
+        AppendUleb128(frame, 0);        // Augmentation data length.
+
+        // The unwind codes are stored in the reverse order of the prolog
+        // instructions and some of them take more than one slot. Collect
+        // the operations first and then describe them in prolog order.
+        auto const & unwindInfo = *reinterpret_cast<UnwindInfo const *>(
+            m_code.BufferStart() + m_code.GetUnwindInfoStartOffset());
+        UnwindCode const * codes = &unwindInfo.m_firstUnwindCode;
+
+        struct Operation
+        {
+            UnwindCode m_code;
+            unsigned m_operand;
+        };
+
+        std::vector<Operation> operations;
+
+        for (unsigned i = 0; i < unwindInfo.m_countOfCodes; )
+        {
+            const UnwindCode code = codes[i];
+            const auto op = static_cast<UnwindCodeOp>(code.m_operation.m_unwindOp);
+
+            switch (op)
+            {
+            case UnwindCodeOp::UWOP_ALLOC_SMALL:
+                operations.push_back({ code, 0 });
+                i += 1;
+                break;
+
+            case UnwindCodeOp::UWOP_ALLOC_LARGE:
+            case UnwindCodeOp::UWOP_SAVE_NONVOL:
+            case UnwindCodeOp::UWOP_SAVE_XMM128:
+                LogThrowAssert(i + 1 < unwindInfo.m_countOfCodes,
+                               "Missing operand for unwind operation %u",
+                               code.m_operation.m_unwindOp);
+                LogThrowAssert(op != UnwindCodeOp::UWOP_ALLOC_LARGE
+                               || code.m_operation.m_opInfo == 0,
+                               "Unsupported UWOP_ALLOC_LARGE variant %u",
+                               code.m_operation.m_opInfo);
+
+                // The operand is in the second code.
+                operations.push_back({ code, codes[i + 1].m_frameOffset });
+                i += 2;
+                break;
+
+            default:
+                LogThrowAbort("Unsupported unwind operation %u", code.m_operation.m_unwindOp);
+                break;
+            }
+        }
+
+        unsigned location = 0;
+        unsigned cfaOffset = sizeof(void*);
+
+        for (auto it = operations.rbegin(); it != operations.rend(); ++it)
+        {
+            const UnwindCode code = it->m_code;
+            const unsigned delta = code.m_operation.m_codeOffset - location;
+
+            if (delta > 0)
+            {
+                if (delta < 0x40)
+                {
+                    frame.push_back(static_cast<uint8_t>(c_cfaAdvanceLoc | delta));
+                }
+                else
+                {
+                    // The prolog is less than 256 bytes long.
+                    frame.push_back(c_cfaAdvanceLoc1);
+                    frame.push_back(static_cast<uint8_t>(delta));
+                }
+
+                location = code.m_operation.m_codeOffset;
+            }
+
+            switch (static_cast<UnwindCodeOp>(code.m_operation.m_unwindOp))
+            {
+            case UnwindCodeOp::UWOP_ALLOC_SMALL:
+                cfaOffset = sizeof(void*) + (code.m_operation.m_opInfo + 1) * sizeof(void*);
+                frame.push_back(c_cfaDefCfaOffset);
+                AppendUleb128(frame, cfaOffset);
+                break;
+
+            case UnwindCodeOp::UWOP_ALLOC_LARGE:
+                cfaOffset = sizeof(void*) + it->m_operand * sizeof(void*);
+                frame.push_back(c_cfaDefCfaOffset);
+                AppendUleb128(frame, cfaOffset);
+                break;
+
+            case UnwindCodeOp::UWOP_SAVE_NONVOL:
+                {
+                    // The register is saved at [RSP + operand * 8] after the
+                    // stack allocation, i.e. below the CFA.
+                    const int saveOffset = static_cast<int>(it->m_operand * sizeof(void*))
+                                           - static_cast<int>(cfaOffset);
+
+                    frame.push_back(static_cast<uint8_t>(
+                        c_cfaOffset | GetDwarfRegister(code.m_operation.m_opInfo)));
+                    AppendUleb128(frame, saveOffset / c_dataAlignmentFactor);
+                }
+                break;
+
+            default:
+                // XMM registers are volatile in System V.
+                break;
+            }
+        }
+
+        CompleteFrameEntry(frame, fdeStart);
+
+        return frame;
+    }
+
+
+    void ElfObjectWriter::Write(std::ostream& out) const
+    {
+        const unsigned codeStart = m_code.GetFunctionCodeStartOffset();
+        const unsigned codeEnd = m_code.GetFunctionCodeEndOffset();
+
+        // Code and the data it refers to.
+        std::vector<uint8_t> text(m_code.BufferStart(), m_code.BufferStart() + codeEnd);
+
+        // Symbols and their names.
+        std::string names(1, '\0');
+        std::vector<ElfSymbol> symbols(FirstGlobalSymbol);
+
+        symbols[NullSymbol] = {};
+        symbols[TextSectionSymbol] = {};
+        symbols[TextSectionSymbol].m_info = (c_symbolBindingLocal << 4) | c_symbolTypeSection;
+        symbols[TextSectionSymbol].m_sectionIndex = Text;
+
+        ElfSymbol function = {};
+        function.m_name = static_cast<uint32_t>(names.size());
+        function.m_info = (c_symbolBindingGlobal << 4) | c_symbolTypeFunction;
+        function.m_sectionIndex = Text;
+        function.m_value = codeStart;
+        function.m_size = codeEnd - codeStart;
+        symbols.push_back(function);
+        names.append(m_functionName).push_back('\0');
+
+        std::unordered_map<std::string, uint32_t> externalSymbols;
+        std::vector<ElfRelocation> textRelocations;
+
+        for (auto const & reference : m_externalReferences)
+        {
+            auto it = externalSymbols.find(reference.m_symbolName);
+
+            if (it == externalSymbols.end())
+            {
+                ElfSymbol external = {};
+                external.m_name = static_cast<uint32_t>(names.size());
+                external.m_info = (c_symbolBindingGlobal << 4) | c_symbolTypeNone;
+                names.append(reference.m_symbolName).push_back('\0');
+
+                it = externalSymbols.emplace(reference.m_symbolName,
+                                             static_cast<uint32_t>(symbols.size())).first;
+                symbols.push_back(external);
+            }
+
+            const uint64_t symbolIndex = it->second;
+            textRelocations.push_back({ reference.m_offset,
+                                        (symbolIndex << 32) | c_relocationAbsolute64,
+                                        0 });
+
+            // The addend is in the relocation, so clear the address which the
+            // code had in this process.
+            memset(&text[reference.m_offset], 0, sizeof(uint64_t));
+        }
+
+        unsigned functionLocationOffset;
+        const std::vector<uint8_t> ehFrame = BuildEhFrame(functionLocationOffset);
+        const ElfRelocation ehFrameRelocation = {
+            functionLocationOffset,
+            (static_cast<uint64_t>(TextSectionSymbol) << 32) | c_relocationPCRelative32,
+            codeStart
+        };
+
+        // Section names, in the order of the Section enum.
+        static char const * const c_sectionNames[SectionCount] = {
+            "",
+            ".text",
+            ".rela.text",
+            ".eh_frame",
+            ".rela.eh_frame",
+            ".symtab",
+            ".strtab",
+            ".shstrtab",
+            ".note.GNU-stack"
+        };
+
+        std::string sectionNames;
+        uint32_t sectionNameOffsets[SectionCount];
+
+        for (unsigned i = 0; i < SectionCount; ++i)
+        {
+            sectionNameOffsets[i] = static_cast<uint32_t>(sectionNames.size());
+            sectionNames.append(c_sectionNames[i]).push_back('\0');
+        }
+
+        // Lay out the file: the header, the contents of the sections and the
+        // section header table.
+        std::vector<uint8_t> file(sizeof(ElfHeader));
+        ElfSectionHeader sections[SectionCount] = {};
+
+        auto addSection = [&](Section index,
+                              uint32_t type,
+                              uint64_t flags,
+                              void const * data,
+                              size_t byteLength,
+                              size_t alignment)
+        {
+            ElfSectionHeader& section = sections[index];
+
+            section.m_name = sectionNameOffsets[index];
+            section.m_type = type;
+            section.m_flags = flags;
+            section.m_offset = AppendAligned(file, data, byteLength, alignment);
+            section.m_size = byteLength;
+            section.m_alignment = alignment;
+
+            return &section;
+        };
+
+        // The function buffer aligns the data relative to its start, which is
+        // assumed to be 16-byte aligned.
+        addSection(Text,
+                   c_sectionProgBits,
+                   c_sectionFlagAlloc | c_sectionFlagExecute,
+                   text.data(),
+                   text.size(),
+                   16);
+
+        auto textRelocationSection = addSection(TextRelocations,
+                                                c_sectionRelocations,
+                                                c_sectionFlagInfoLink,
+                                                textRelocations.data(),
+                                                textRelocations.size() * sizeof(ElfRelocation),
+                                                8);
+        textRelocationSection->m_link = SymbolTable;
+        textRelocationSection->m_info = Text;
+        textRelocationSection->m_entrySize = sizeof(ElfRelocation);
+
+        addSection(EhFrame,
+                   c_sectionX64Unwind,
+                   c_sectionFlagAlloc,
+                   ehFrame.data(),
+                   ehFrame.size(),
+                   8);
+
+        auto ehFrameRelocationSection = addSection(EhFrameRelocations,
+                                                   c_sectionRelocations,
+                                                   c_sectionFlagInfoLink,
+                                                   &ehFrameRelocation,
+                                                   sizeof(ElfRelocation),
+                                                   8);
+        ehFrameRelocationSection->m_link = SymbolTable;
+        ehFrameRelocationSection->m_info = EhFrame;
+        ehFrameRelocationSection->m_entrySize = sizeof(ElfRelocation);
+
+        auto symbolSection = addSection(SymbolTable,
+                                        c_sectionSymbolTable,
+                                        0,
+                                        symbols.data(),
+                                        symbols.size() * sizeof(ElfSymbol),
+                                        8);
+        symbolSection->m_link = StringTable;
+        symbolSection->m_info = FirstGlobalSymbol;
+        symbolSection->m_entrySize = sizeof(ElfSymbol);
+
+        addSection(StringTable, c_sectionStringTable, 0, names.data(), names.size(), 1);
+        addSection(SectionNames,
+                   c_sectionStringTable,
+                   0,
+                   sectionNames.data(),
+                   sectionNames.size(),
+                   1);
+
+        // An empty .note.GNU-stack marks the stack as non-executable.
+        addSection(GnuStack, c_sectionProgBits, 0, nullptr, 0, 1);
+
+        sections[Null] = {};
+
+        ElfHeader header = {};
+        const uint8_t ident[] = { 0x7f, 'E', 'L', 'F',
+                                  2,        // 64-bit.
+                                  1,        // Little endian.
+                                  1 };      // Current version.
+        memcpy(header.m_ident, ident, sizeof(ident));
+        header.m_type = c_elfTypeRelocatable;
+        header.m_machine = c_elfMachineX64;
+        header.m_version = 1;
+        header.m_headerSize = sizeof(ElfHeader);
+        header.m_sectionHeaderEntrySize = sizeof(ElfSectionHeader);
+        header.m_sectionHeaderCount = SectionCount;
+        header.m_sectionNamesIndex = SectionNames;
+        header.m_sectionHeaderOffset = AppendAligned(file, sections, sizeof(sections), 8);
+
+        memcpy(file.data(), &header, sizeof(header));
+
+        out.write(reinterpret_cast<char const *>(file.data()), file.size());
+
+        LogThrowAssert(out.good(), "Failed to write the object file");
+    }
+}
@@ -21,7 +21,9 @@
 // THE SOFTWARE.
 
 
+#include <cstdint>
 #include <stdexcept>
+#include <utility>
 
 #include "NativeJIT/CodeGen/FunctionBuffer.h"
 #include "NativeJIT/CodeGen/FunctionSpecification.h"
@@ -180,7 +182,8 @@ namespace NativeJIT
     }
 
 
-    void FunctionBuffer::EndFunctionBodyGeneration(FunctionSpecification const & spec)
+    void FunctionBuffer::EndFunctionBodyGeneration(FunctionSpecification const & spec,
+                                                   LayoutOptimization layoutOptimization)
     {
         LogThrowAssert(spec.GetUnwindInfoByteLength() <= m_unwindInfoByteLength,
                        "Unwind info length of %u bytes is larger than the reserved %u bytes",
@@ -211,12 +214,64 @@ namespace NativeJIT
             m_prologLength -= delta;
         }
 
+        // Emit the epilog at the current position.
+        EmitBytes(spec.GetEpilog(), spec.GetEpilogLength());
+
+        // Move the rarely executed blocks of the body behind the epilog.
+        MoveColdBlocks(m_prologStartOffset + m_prologLength);
+
+        // Use the short forms for the jumps within the body whose targets are
+        // close enough. This moves the body and the epilog, but not the prolog.
+        if (layoutOptimization == LayoutOptimization::Enabled)
+        {
+            ShortenJumps(m_prologStartOffset + m_prologLength);
+        }
+
+        // Drop the part of the space reserved for the unwind info and the
+        // prolog that turned out to be unused, so that the prolog directly
+        // follows the unwind info. The reserve can only be sized before the
+        // body is generated, so it's trimmed here rather than reserved exactly.
+        const unsigned unwindInfoEnd = m_unwindInfoStartOffset + m_unwindInfoByteLength;
+        const unsigned unusedReserve = m_prologStartOffset - unwindInfoEnd;
+
+        RemoveBytes(unwindInfoEnd, unusedReserve);
+        m_prologStartOffset -= unusedReserve;
+
+        // Align the entry point by moving the prolog and the body forward.
+        // The gap before the prolog is never executed. Trimming the reserve
+        // brought the code closer to any data in front of the unwind info,
+        // so the entry point then also starts a new cache line to keep the
+        // data and the code apart.
+        unsigned entryAlignment = GetCodeAlignment().m_entry;
+
+        if (m_unwindInfoStartOffset > 0 && entryAlignment < c_cacheLineSize)
+        {
+            entryAlignment = c_cacheLineSize;
+        }
+
+        const uintptr_t entry = reinterpret_cast<uintptr_t>(BufferStart()) + m_prologStartOffset;
+        const unsigned entryPadding
+            = static_cast<unsigned>((entryAlignment - entry % entryAlignment) % entryAlignment);
+
+        if (entryPadding != 0)
+        {
+            InsertNops({ std::make_pair(m_prologStartOffset + m_prologLength, entryPadding) });
+            m_prologStartOffset += entryPadding;
+        }
+
         ReplaceBytes(m_prologStartOffset,
                      spec.GetProlog(),
                      spec.GetPrologLength());
 
-        // Emit the epilog at the current position.
-        EmitBytes(spec.GetEpilog(), spec.GetEpilogLength());
+        // Pad the loop heads and the join labels within the body.
+        if (layoutOptimization == LayoutOptimization::Enabled)
+        {
+            ApplyCodeAlignment();
+        }
+        else
+        {
+            DiscardCodeAlignment();
+        }
 
         // Patch any references to labels.
         PatchCallSites();
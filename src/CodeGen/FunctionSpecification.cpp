@@ -22,6 +22,7 @@
 
 
 #include <algorithm>    // For std::min.
+#include <limits>
 #include <stdexcept>
 
 #include "NativeJIT/BitOperations.h"
@@ -53,7 +54,8 @@ namespace NativeJIT
                                                  unsigned savedRxxNonVolatilesMask,
                                                  unsigned savedXmmNonVolatilesMask,
                                                  BaseRegisterType baseRegisterType,
-                                                 std::ostream* diagnosticsStream)
+                                                 std::ostream* diagnosticsStream,
+                                                 LeafFrameType leafFrameType)
         : m_stlAllocator(allocator),
           m_unwindInfoBuffer(m_stlAllocator),
           m_prologCode(m_stlAllocator),
@@ -73,6 +75,7 @@ namespace NativeJIT
                                  savedRxxNonVolatilesMask,
                                  savedXmmNonVolatilesMask,
                                  baseRegisterType,
+                                 leafFrameType,
                                  code,
                                  m_unwindInfoBuffer,
                                  m_offsetToOriginalRsp);
@@ -135,6 +138,7 @@ namespace NativeJIT
                                                          unsigned savedRxxNonVolatilesMask,
                                                          unsigned savedXmmNonVolatilesMask,
                                                          BaseRegisterType baseRegisterType,
+                                                         LeafFrameType leafFrameType,
                                                          X64CodeGenerator& prologCode,
                                                          AllocatorVector<uint8_t>& unwindInfoBuffer,
                                                          int32_t& offsetToOriginalRsp)
@@ -157,6 +161,28 @@ namespace NativeJIT
             savedRxxNonVolatilesMask |= rbp.GetMask();
         }
 
+        // A leaf function without a frame has an empty prolog and unwind
+        // info with no codes.
+        if (leafFrameType == LeafFrameType::Omitted
+            && maxFunctionCallParameters < 0
+            && localStackSlotCount == 0
+            && savedRxxNonVolatilesMask == 0
+            && savedXmmNonVolatilesMask == 0)
+        {
+            unwindInfoBuffer.resize(sizeof(UnwindInfo) - sizeof(UnwindCode));
+            UnwindInfo* unwindInfo = reinterpret_cast<UnwindInfo*>(unwindInfoBuffer.data());
+
+            unwindInfo->m_version = 1;
+            unwindInfo->m_flags = 0;
+            unwindInfo->m_sizeOfProlog = 0;
+            unwindInfo->m_countOfCodes = 0;
+            unwindInfo->m_frameRegister = 0;
+            unwindInfo->m_frameOffset = 0;
+
+            offsetToOriginalRsp = 0;
+            return;
+        }
+
         const unsigned codeStartPos = prologCode.CurrentPosition();
 
         // If there are any function calls, at least 4 parameter slots need to
@@ -90,6 +90,41 @@ namespace NativeJIT
     }
 
 
+    size_t JumpTable::GetLabelCount() const
+    {
+        return m_labels.size();
+    }
+
+
+    void JumpTable::MoveLabel(Label label, const uint8_t* address)
+    {
+        if (!LabelIsDefined(label))
+        {
+            throw std::runtime_error("CodeBuffer: attempting to move a label that hasn't been placed.");
+        }
+
+        m_labels[label.GetId()] = address;
+    }
+
+
+    size_t JumpTable::GetCallSiteCount() const
+    {
+        return m_callSites.size();
+    }
+
+
+    CallSite const & JumpTable::GetCallSite(size_t index) const
+    {
+        return m_callSites.at(index);
+    }
+
+
+    void JumpTable::ReplaceCallSite(size_t index, CallSite const & site)
+    {
+        m_callSites.at(index) = site;
+    }
+
+
     // WARNING: Non portable. Assumes little endian machine architecture.
     // WARNING: Non portable. Assumes that fixup value is labelAddress - siteAddress - size.Size().
     void JumpTable::PatchCallSites()
@@ -103,7 +138,15 @@ namespace NativeJIT
 
             // TODO: Evaluate whether special cases for size == 2 and size == 4 actually improve performance.
             size_t size = site.Size();
-            if (size == 2)
+            if (size == 1)
+            {
+                LogThrowAssert(delta <= std::numeric_limits<int8_t>::max() &&
+                               delta >= std::numeric_limits<int8_t>::min(),
+                               "Overflow/underflow in cast to int8_t.");
+                *(reinterpret_cast<int8_t*>(siteAddress)) = static_cast<int8_t>(delta);
+                siteAddress += size;
+            }
+            else if (size == 2)
             {
                 LogThrowAssert(delta <= std::numeric_limits<int16_t>::max() &&
                                delta >= std::numeric_limits<int16_t>::min(),
@@ -0,0 +1,81 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <cstddef>     // IAllocator.h uses size_t.
+#include <cstdint>
+#include <new>
+
+#include "NativeJIT/CodeGen/Trampoline.h"
+#include "Temporary/Assert.h"
+#include "Temporary/IAllocator.h"
+
+
+namespace NativeJIT
+{
+    static_assert(sizeof(std::atomic<void const *>) == sizeof(void const *),
+                  "The target slot of the stub must be a plain pointer.");
+
+
+    Trampoline::Stub::Stub(void const * target)
+        : m_jmp { 0xff, 0x25, 0x02, 0x00, 0x00, 0x00, 0xcc, 0xcc },
+          m_target(target)
+    {
+        LogThrowAssert(m_target.is_lock_free(), "Trampoline requires lock free pointers");
+    }
+
+
+    Trampoline::Trampoline(Allocators::IAllocator& codeAllocator, void const * target)
+        : m_codeAllocator(codeAllocator),
+          m_block(codeAllocator.Allocate(sizeof(Stub) + alignof(Stub) - 1))
+    {
+        const uintptr_t address = reinterpret_cast<uintptr_t>(m_block);
+        const uintptr_t aligned = (address + alignof(Stub) - 1) & ~static_cast<uintptr_t>(alignof(Stub) - 1);
+
+        m_stub = new (reinterpret_cast<void*>(aligned)) Stub(target);
+    }
+
+
+    Trampoline::~Trampoline()
+    {
+        m_stub->~Stub();
+        m_codeAllocator.Deallocate(m_block);
+    }
+
+
+    void const * Trampoline::GetEntryPoint() const
+    {
+        return m_stub->m_jmp;
+    }
+
+
+    void const * Trampoline::GetTarget() const
+    {
+        return m_stub->m_target.load(std::memory_order_acquire);
+    }
+
+
+    void const * Trampoline::Exchange(void const * target)
+    {
+        return m_stub->m_target.exchange(target, std::memory_order_acq_rel);
+    }
+}
@@ -21,8 +21,12 @@
 // THE SOFTWARE.
 
 
+#include <algorithm>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <utility>
 
 #include "NativeJIT/CodeGen/X64CodeGenerator.h"
 #include "Temporary/Assert.h"
@@ -61,11 +65,44 @@ namespace NativeJIT
     X64CodeGenerator::X64CodeGenerator(Allocators::IAllocator& codeAllocator,
                                        unsigned capacity)
         : CodeBuffer(codeAllocator, capacity),
-          m_diagnosticsStream(nullptr)
+          m_diagnosticsStream(nullptr),
+          m_cpuFeatures(CpuFeatures::GetHost()),
+          m_isInColdBlock(false)
     {
     }
 
 
+    CpuFeatures const & X64CodeGenerator::GetCpuFeatures() const
+    {
+        return m_cpuFeatures;
+    }
+
+
+    void X64CodeGenerator::SetCpuFeatures(CpuFeatures const & features)
+    {
+        m_cpuFeatures = features;
+    }
+
+
+    CodeAlignment const & X64CodeGenerator::GetCodeAlignment() const
+    {
+        return m_codeAlignment;
+    }
+
+
+    void X64CodeGenerator::SetCodeAlignment(CodeAlignment const & alignment)
+    {
+        for (unsigned value : { alignment.m_entry, alignment.m_loopHead, alignment.m_join })
+        {
+            LogThrowAssert(value != 0 && value <= 64 && (value & (value - 1)) == 0,
+                           "Invalid code alignment %u",
+                           value);
+        }
+
+        m_codeAlignment = alignment;
+    }
+
+
     void X64CodeGenerator::EnableDiagnostics(std::ostream& out)
     {
         m_diagnosticsStream = &out;
@@ -109,32 +146,644 @@ namespace NativeJIT
     }
 
 
+    void X64CodeGenerator::Reset()
+    {
+        CodeBuffer::Reset();
+        m_ripRelativeSites.clear();
+        m_coldBlocks.clear();
+        m_isInColdBlock = false;
+        m_alignmentRequests.clear();
+    }
+
+
+    namespace
+    {
+        // The multi-byte nop forms recommended by the Intel optimization
+        // manual, indexed by the length.
+        const uint8_t c_nops[][9] =
+        {
+            { },
+            { 0x90 },
+            { 0x66, 0x90 },
+            { 0x0f, 0x1f, 0x00 },
+            { 0x0f, 0x1f, 0x40, 0x00 },
+            { 0x0f, 0x1f, 0x44, 0x00, 0x00 },
+            { 0x66, 0x0f, 0x1f, 0x44, 0x00, 0x00 },
+            { 0x0f, 0x1f, 0x80, 0x00, 0x00, 0x00, 0x00 },
+            { 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+            { 0x66, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 }
+        };
+
+
+        // Fills the memory with as few nops as possible.
+        void WriteNops(uint8_t* target, unsigned length)
+        {
+            const unsigned maxLength = sizeof(c_nops) / sizeof(c_nops[0]) - 1;
+
+            while (length > 0)
+            {
+                const unsigned nopLength = (std::min)(length, maxLength);
+
+                memcpy(target, c_nops[nopLength], nopLength);
+                target += nopLength;
+                length -= nopLength;
+            }
+        }
+
+
+        // A rel32 jump emitted by Jmp() or EmitConditionalJump() which
+        // ShortenJumps() may replace with its rel8 form.
+        struct RelativeJump
+        {
+            size_t m_callSite;          // Index in the JumpTable.
+            unsigned m_position;        // Position of the first opcode byte.
+            unsigned m_length;          // 5 for jmp, 6 for jcc.
+            unsigned m_target;
+            bool m_isShort;
+
+            // The largest padding ApplyCodeAlignment() may insert between the
+            // jump and its target.
+            unsigned m_alignmentSlack;
+        };
+
+
+        // Maps a position in the code before the short jumps were compacted
+        // to its position afterwards. The jumps are sorted by position and
+        // savedBefore[i] holds the number of bytes saved by the short jumps
+        // among the first i of them.
+        unsigned ShortenedPosition(std::vector<RelativeJump> const & jumps,
+                                   std::vector<unsigned> const & savedBefore,
+                                   unsigned position)
+        {
+            // Find the number of jumps which start before the position.
+            size_t low = 0;
+            size_t high = jumps.size();
+
+            while (low < high)
+            {
+                const size_t middle = (low + high) / 2;
+
+                if (jumps[middle].m_position < position)
+                {
+                    low = middle + 1;
+                }
+                else
+                {
+                    high = middle;
+                }
+            }
+
+            return position - savedBefore[low];
+        }
+
+
+        void ComputeSavings(std::vector<RelativeJump> const & jumps,
+                            std::vector<unsigned>& savedBefore)
+        {
+            savedBefore.resize(jumps.size() + 1);
+            savedBefore[0] = 0;
+
+            for (size_t i = 0; i < jumps.size(); ++i)
+            {
+                savedBefore[i + 1] = savedBefore[i]
+                    + (jumps[i].m_isShort ? jumps[i].m_length - 2 : 0);
+            }
+        }
+    }
+
+
+    unsigned X64CodeGenerator::ShortenJumps(unsigned start)
+    {
+        JumpTable& jumpTable = GetJumpTable();
+        uint8_t* const buffer = BufferStart();
+        const unsigned end = CurrentPosition();
+
+        // Collect the rel32 jumps within the code.
+        std::vector<RelativeJump> jumps;
+
+        for (size_t i = 0; i < jumpTable.GetCallSiteCount(); ++i)
+        {
+            CallSite const & site = jumpTable.GetCallSite(i);
+            const unsigned sitePosition = static_cast<unsigned>(site.Site() - buffer);
+
+            if (site.Size() != 4 || sitePosition < start + 2 || sitePosition >= end)
+            {
+                continue;
+            }
+
+            RelativeJump jump;
+            jump.m_callSite = i;
+            jump.m_isShort = false;
+            jump.m_alignmentSlack = 0;
+
+            if (buffer[sitePosition - 2] == 0x0f && (buffer[sitePosition - 1] & 0xf0) == 0x80)
+            {
+                jump.m_position = sitePosition - 2;
+                jump.m_length = 6;
+            }
+            else if (buffer[sitePosition - 1] == 0xe9)
+            {
+                jump.m_position = sitePosition - 1;
+                jump.m_length = 5;
+            }
+            else
+            {
+                continue;
+            }
+
+            const uint8_t* target = jumpTable.AddressOfLabel(site.GetLabel());
+            jump.m_target = static_cast<unsigned>(target - buffer);
+
+            if (target < buffer + start || target > buffer + end)
+            {
+                continue;
+            }
+
+            // Padding inserted at the jump moves the target of a backward
+            // jump away, padding inserted at the target doesn't.
+            const unsigned low = (std::min)(jump.m_position, jump.m_target);
+            const unsigned high = (std::max)(jump.m_position, jump.m_target);
+
+            for (auto const & request : m_alignmentRequests)
+            {
+                if (request.first > low && request.first <= high)
+                {
+                    jump.m_alignmentSlack += request.second - 1;
+                }
+            }
+
+            jumps.push_back(jump);
+        }
+
+        // The call sites are recorded in the order of emission, but
+        // MoveColdBlocks() may have moved some of them.
+        std::sort(jumps.begin(),
+                  jumps.end(),
+                  [](RelativeJump const & left, RelativeJump const & right)
+                  {
+                      return left.m_position < right.m_position;
+                  });
+
+        // Shorten the jumps until no more targets get within reach. Shortening
+        // a jump never increases the distance covered by another jump, so the
+        // decisions made in the earlier rounds remain valid.
+        std::vector<unsigned> savedBefore;
+        bool isChanged = true;
+
+        while (isChanged)
+        {
+            isChanged = false;
+            ComputeSavings(jumps, savedBefore);
+
+            for (auto& jump : jumps)
+            {
+                if (jump.m_isShort)
+                {
+                    continue;
+                }
+
+                const int64_t position = ShortenedPosition(jumps, savedBefore, jump.m_position);
+                int64_t target = ShortenedPosition(jumps, savedBefore, jump.m_target);
+
+                if (jump.m_target > jump.m_position)
+                {
+                    // The jump itself shrinks as well.
+                    target -= jump.m_length - 2;
+                }
+
+                const int64_t delta = target - (position + 2);
+                const int64_t slack = jump.m_alignmentSlack;
+
+                if (delta - slack >= std::numeric_limits<int8_t>::min()
+                    && delta + slack <= std::numeric_limits<int8_t>::max())
+                {
+                    jump.m_isShort = true;
+                    isChanged = true;
+                }
+            }
+        }
+
+        ComputeSavings(jumps, savedBefore);
+
+        const unsigned saved = savedBefore.back();
+
+        if (saved == 0)
+        {
+            return 0;
+        }
+
+        RelocatePositions(start,
+                          end,
+                          [&](unsigned position)
+                          {
+                              return ShortenedPosition(jumps, savedBefore, position);
+                          });
+
+        // Compact the code, replacing the short jumps with their rel8 forms.
+        // The short jump call sites are one byte after the new opcode.
+        unsigned read = start;
+        unsigned write = start;
+
+        for (auto const & jump : jumps)
+        {
+            if (!jump.m_isShort)
+            {
+                continue;
+            }
+
+            memmove(buffer + write, buffer + read, jump.m_position - read);
+            write += jump.m_position - read;
+
+            const uint8_t opcode = jump.m_length == 5
+                ? 0xeb
+                : 0x70 | (buffer[jump.m_position + 1] & 0x0f);
+
+            buffer[write] = opcode;
+            buffer[write + 1] = 0;
+
+            jumpTable.ReplaceCallSite(jump.m_callSite,
+                                      CallSite(jumpTable.GetCallSite(jump.m_callSite).GetLabel(),
+                                               1,
+                                               buffer + write + 1));
+            write += 2;
+            read = jump.m_position + jump.m_length;
+        }
+
+        memmove(buffer + write, buffer + read, end - read);
+        SetCurrentPosition(end - saved);
+
+        return saved;
+    }
+
+
+    void X64CodeGenerator::BeginColdBlock()
+    {
+        LogThrowAssert(!m_isInColdBlock, "Cold blocks cannot be nested");
+
+        m_coldBlocks.push_back(std::make_pair(CurrentPosition(), CurrentPosition()));
+        m_isInColdBlock = true;
+    }
+
+
+    void X64CodeGenerator::EndColdBlock()
+    {
+        LogThrowAssert(m_isInColdBlock, "No cold block to end");
+
+        m_coldBlocks.back().second = CurrentPosition();
+        m_isInColdBlock = false;
+    }
+
+
+    unsigned X64CodeGenerator::MoveColdBlocks(unsigned start)
+    {
+        LogThrowAssert(!m_isInColdBlock, "Unterminated cold block");
+
+        uint8_t* const buffer = BufferStart();
+        const unsigned end = CurrentPosition();
+        unsigned moved = 0;
+
+        for (auto const & block : m_coldBlocks)
+        {
+            LogThrowAssert(block.first >= start && block.second <= end,
+                           "Cold block [%u, %u) outside of the code",
+                           block.first,
+                           block.second);
+            moved += block.second - block.first;
+        }
+
+        // Cold blocks at the very end are already in place.
+        if (moved == 0 || m_coldBlocks.front().first == end - moved)
+        {
+            m_coldBlocks.clear();
+            return 0;
+        }
+
+        const unsigned hotEnd = end - moved;
+
+        // The blocks are consumed here, RelocatePositions() must not move
+        // them.
+        std::vector<std::pair<unsigned, unsigned>> blocks;
+        blocks.swap(m_coldBlocks);
+
+        // Maps a position within the code to its position once the cold
+        // blocks are moved. A position at the start of a cold block belongs
+        // to the block, a position at its end belongs to the code after it.
+        auto relocate = [&](unsigned position)
+        {
+            if (position < start || position > end)
+            {
+                return position;
+            }
+
+            unsigned movedBefore = 0;
+
+            for (auto const & block : blocks)
+            {
+                if (position < block.first)
+                {
+                    break;
+                }
+                else if (position < block.second)
+                {
+                    return hotEnd + movedBefore + (position - block.first);
+                }
+
+                movedBefore += block.second - block.first;
+            }
+
+            return position - movedBefore;
+        };
+
+        RelocatePositions(start, end, relocate);
+
+        // The requests within the cold blocks are now out of order.
+        std::sort(m_alignmentRequests.begin(), m_alignmentRequests.end());
+
+        // Gather the hot code followed by the cold blocks and copy it back.
+        // The RIP-relative displacements were already updated in place.
+        std::vector<uint8_t> code;
+        code.reserve(end - start);
+
+        unsigned read = start;
+
+        for (auto const & block : blocks)
+        {
+            code.insert(code.end(), buffer + read, buffer + block.first);
+            read = block.second;
+        }
+
+        code.insert(code.end(), buffer + read, buffer + end);
+
+        for (auto const & block : blocks)
+        {
+            code.insert(code.end(), buffer + block.first, buffer + block.second);
+        }
+
+        memcpy(buffer + start, code.data(), code.size());
+
+        return moved;
+    }
+
+
+    void X64CodeGenerator::AlignCode(unsigned alignment)
+    {
+        LogThrowAssert(alignment != 0 && alignment <= 64 && (alignment & (alignment - 1)) == 0,
+                       "Invalid code alignment %u",
+                       alignment);
+
+        if (alignment > 1)
+        {
+            m_alignmentRequests.push_back(std::make_pair(CurrentPosition(), alignment));
+        }
+    }
+
+
+    unsigned X64CodeGenerator::ApplyCodeAlignment()
+    {
+        // The alignment applies to the address rather than to the position
+        // since the buffer itself need not be aligned.
+        const uintptr_t base = reinterpret_cast<uintptr_t>(BufferStart());
+        std::vector<std::pair<unsigned, unsigned>> gaps;
+        unsigned inserted = 0;
+
+        for (auto const & request : m_alignmentRequests)
+        {
+            const uintptr_t address = base + request.first + inserted;
+            const unsigned padding
+                = static_cast<unsigned>((request.second - address % request.second) % request.second);
+
+            if (padding != 0)
+            {
+                gaps.push_back(std::make_pair(request.first, padding));
+                inserted += padding;
+            }
+        }
+
+        m_alignmentRequests.clear();
+        InsertNops(gaps);
+
+        return inserted;
+    }
+
+
+    void X64CodeGenerator::DiscardCodeAlignment()
+    {
+        m_alignmentRequests.clear();
+    }
+
+
+    void X64CodeGenerator::InsertNops(std::vector<std::pair<unsigned, unsigned>> const & gaps)
+    {
+        if (gaps.empty())
+        {
+            return;
+        }
+
+        const unsigned start = gaps.front().first;
+        const unsigned end = CurrentPosition();
+        unsigned inserted = 0;
+
+        for (auto const & gap : gaps)
+        {
+            LogThrowAssert(gap.first >= start && gap.first <= end,
+                           "Gap at %u outside of the code",
+                           gap.first);
+            inserted += gap.second;
+        }
+
+        // Grow the code first, Advance() checks the capacity.
+        Advance(inserted);
+
+        uint8_t* const buffer = BufferStart();
+
+        // Maps a position to its position once the gaps are inserted.
+        auto relocate = [&](unsigned position)
+        {
+            unsigned insertedBefore = 0;
+
+            for (auto const & gap : gaps)
+            {
+                if (gap.first > position)
+                {
+                    break;
+                }
+
+                insertedBefore += gap.second;
+            }
+
+            return position + insertedBefore;
+        };
+
+        RelocatePositions(start, end, relocate);
+
+        // Move the code starting from the last gap so that nothing gets
+        // overwritten before it's moved.
+        unsigned read = end;
+
+        for (size_t i = gaps.size(); i > 0; --i)
+        {
+            auto const & gap = gaps[i - 1];
+
+            memmove(buffer + gap.first + inserted, buffer + gap.first, read - gap.first);
+            inserted -= gap.second;
+            WriteNops(buffer + gap.first + inserted, gap.second);
+            read = gap.first;
+        }
+    }
+
+
+    void X64CodeGenerator::RemoveBytes(unsigned position, unsigned length)
+    {
+        if (length == 0)
+        {
+            return;
+        }
+
+        const unsigned start = position + length;
+        const unsigned end = CurrentPosition();
+
+        LogThrowAssert(start <= end,
+                       "Cannot remove %u bytes at %u from %u bytes of code",
+                       length,
+                       position,
+                       end);
+
+        uint8_t* const buffer = BufferStart();
+
+        // Maps a position to its position once the bytes are removed.
+        auto relocate = [&](unsigned p)
+        {
+            LogThrowAssert(p < position || p >= start,
+                           "Position %u refers to removed code",
+                           p);
+
+            return p >= start ? p - length : p;
+        };
+
+        RelocatePositions(start, end, relocate);
+
+        memmove(buffer + position, buffer + start, end - start);
+        SetCurrentPosition(end - length);
+    }
+
+
+    void X64CodeGenerator::RelocatePositions(unsigned start,
+                                             unsigned end,
+                                             std::function<unsigned(unsigned)> const & mapping)
+    {
+        JumpTable& jumpTable = GetJumpTable();
+        uint8_t* const buffer = BufferStart();
+
+        // The displacements are rewritten in place, so they move along with
+        // the code. Their targets may lie outside of the range, in which
+        // case the mapping leaves them where they are.
+        for (auto& site : m_ripRelativeSites)
+        {
+            if (site >= start && site < end)
+            {
+                int32_t displacement;
+                memcpy(&displacement, buffer + site, sizeof(displacement));
+
+                const unsigned newSite = mapping(site);
+                const unsigned newTarget = mapping(site + 4 + displacement);
+
+                displacement = static_cast<int32_t>(newTarget - newSite - 4);
+                memcpy(buffer + site, &displacement, sizeof(displacement));
+                site = newSite;
+            }
+        }
+
+        for (size_t i = 0; i < jumpTable.GetCallSiteCount(); ++i)
+        {
+            CallSite const & site = jumpTable.GetCallSite(i);
+            const unsigned sitePosition = static_cast<unsigned>(site.Site() - buffer);
+
+            if (sitePosition >= start && sitePosition < end)
+            {
+                jumpTable.ReplaceCallSite(i, CallSite(site.GetLabel(),
+                                                      static_cast<unsigned>(site.Size()),
+                                                      buffer + mapping(sitePosition)));
+            }
+        }
+
+        // Unlike the sites above, a label or an alignment request can be at
+        // the very end of the code.
+        for (size_t i = 0; i < jumpTable.GetLabelCount(); ++i)
+        {
+            const Label label(i);
+
+            if (jumpTable.LabelIsDefined(label))
+            {
+                const unsigned position
+                    = static_cast<unsigned>(jumpTable.AddressOfLabel(label) - buffer);
+
+                if (position >= start && position <= end)
+                {
+                    jumpTable.MoveLabel(label, buffer + mapping(position));
+                }
+            }
+        }
+
+        for (auto& request : m_alignmentRequests)
+        {
+            if (request.first >= start && request.first <= end)
+            {
+                request.first = mapping(request.first);
+            }
+        }
+
+        for (auto& block : m_coldBlocks)
+        {
+            if (block.first >= start && block.second <= end)
+            {
+                block.first = mapping(block.first);
+                block.second = mapping(block.second);
+            }
+        }
+    }
+
+
     char const * X64CodeGenerator::OpCodeName(OpCode op)
     {
         static char const * names[] = {
             "add",
             "and",
+            "bextr",
+            "bsf",
+            "bsr",
             "call",
             "cmp",
             "cvtfp2fp",
             "cvtfp2si",
             "cvtsi2fp",
+            "div",
+            "idiv",
             "imul",
             "lea",
+            "lzcnt",
             "mov",
             "movsx",
             "movzx",
             "movap",
+            "mul",
+            "neg",
             "nop",
+            "not",
             "or",
+            "pdep",
+            "pext",
             "pop",
+            "popcnt",
             "push",
             "ret",
             "rol",
+            "sar",
             "shl",
             "shld",
             "shr",
             "sub",
+            "tzcnt",
+            "vfmadd231",
             "xor",
         };
 
@@ -232,6 +881,370 @@ namespace NativeJIT
     }
 
 
+    //
+    // AVX, AVX2 and F16C vector instructions.
+    //
+
+    namespace
+    {
+        void PrintVectorRegister(std::ostream& out, Register<4, true> r, bool is256)
+        {
+            IosMiniStateRestorer state(out);
+
+            out << (is256 ? "ymm" : "xmm") << std::dec << r.GetId();
+        }
+    }
+
+
+    void X64CodeGenerator::EmitVex(uint8_t map,
+                                   uint8_t pp,
+                                   bool is256,
+                                   unsigned reg,
+                                   unsigned vvvv,
+                                   unsigned index,
+                                   unsigned rm,
+                                   uint8_t opCode)
+    {
+        // The three byte form: C4, then inverted REX.R, REX.X, REX.B and the
+        // opcode map, then REX.W (always 0), inverted vvvv, the vector length
+        // and the implied prefix.
+        Emit8(0xc4);
+        Emit8(static_cast<uint8_t>((reg > 7 ? 0 : 0x80)
+                                   | (index > 7 ? 0 : 0x40)
+                                   | (rm > 7 ? 0 : 0x20)
+                                   | map));
+        Emit8(static_cast<uint8_t>(((~vvvv & 0xf) << 3)
+                                   | (is256 ? 4 : 0)
+                                   | pp));
+        Emit8(opCode);
+    }
+
+
+    void X64CodeGenerator::EmitVexDirect(uint8_t map,
+                                         uint8_t pp,
+                                         bool is256,
+                                         uint8_t opCode,
+                                         unsigned reg,
+                                         unsigned vvvv,
+                                         unsigned rm)
+    {
+        EmitVex(map, pp, is256, reg, vvvv, 0, rm, opCode);
+        Emit8(static_cast<uint8_t>(0xc0 | ((reg & 7) << 3) | (rm & 7)));
+    }
+
+
+    void X64CodeGenerator::EmitVectorMoveDword(Register<4, true> dest, Register<4, false> src)
+    {
+        CodePrinter printer(*this);
+
+        EmitVexDirect(1, 1, false, 0x6e, dest.GetId(), 0, src.GetId());
+
+        if (auto out = printer.PrintMnemonic("vmovd"))
+        {
+            PrintVectorRegister(*out, dest, false);
+            *out << ", " << src.GetName() << std::endl;
+        }
+    }
+
+
+    void X64CodeGenerator::EmitVectorInsertDword(Register<4, true> dest,
+                                                 Register<4, false> src,
+                                                 uint8_t lane)
+    {
+        LogThrowAssert(lane < 4, "Invalid lane %u", lane);
+
+        CodePrinter printer(*this);
+
+        EmitVexDirect(3, 1, false, 0x22, dest.GetId(), dest.GetId(), src.GetId());
+        Emit8(lane);
+
+        if (auto out = printer.PrintMnemonic("vpinsrd"))
+        {
+            PrintVectorRegister(*out, dest, false);
+            *out << ", ";
+            PrintVectorRegister(*out, dest, false);
+            *out << ", " << src.GetName() << ", " << static_cast<unsigned>(lane) << std::endl;
+        }
+    }
+
+
+    void X64CodeGenerator::EmitVectorInsertHigh(Register<4, true> dest, Register<4, true> src)
+    {
+        CodePrinter printer(*this);
+
+        EmitVexDirect(3, 1, true, 0x38, dest.GetId(), dest.GetId(), src.GetId());
+        Emit8(1);
+
+        if (auto out = printer.PrintMnemonic("vinserti128"))
+        {
+            PrintVectorRegister(*out, dest, true);
+            *out << ", ";
+            PrintVectorRegister(*out, dest, true);
+            *out << ", ";
+            PrintVectorRegister(*out, src, false);
+            *out << ", 1" << std::endl;
+        }
+    }
+
+
+    void X64CodeGenerator::EmitVectorExtractHigh(Register<4, true> dest, Register<4, true> src)
+    {
+        CodePrinter printer(*this);
+
+        // The destination is encoded in ModR/M.rm.
+        EmitVexDirect(3, 1, true, 0x19, src.GetId(), 0, dest.GetId());
+        Emit8(1);
+
+        if (auto out = printer.PrintMnemonic("vextractf128"))
+        {
+            PrintVectorRegister(*out, dest, false);
+            *out << ", ";
+            PrintVectorRegister(*out, src, true);
+            *out << ", 1" << std::endl;
+        }
+    }
+
+
+    void X64CodeGenerator::EmitVectorZero(Register<4, true> dest)
+    {
+        CodePrinter printer(*this);
+
+        EmitVexDirect(1, 0, false, 0x57, dest.GetId(), dest.GetId(), dest.GetId());
+
+        if (auto out = printer.PrintMnemonic("vxorps"))
+        {
+            for (unsigned i = 0; i < 3; ++i)
+            {
+                *out << (i == 0 ? "" : ", ");
+                PrintVectorRegister(*out, dest, false);
+            }
+            *out << std::endl;
+        }
+    }
+
+
+    void X64CodeGenerator::EmitVectorAllOnes(Register<4, true> dest)
+    {
+        CodePrinter printer(*this);
+
+        EmitVexDirect(1, 1, true, 0x76, dest.GetId(), dest.GetId(), dest.GetId());
+
+        if (auto out = printer.PrintMnemonic("vpcmpeqd"))
+        {
+            for (unsigned i = 0; i < 3; ++i)
+            {
+                *out << (i == 0 ? "" : ", ");
+                PrintVectorRegister(*out, dest, true);
+            }
+            *out << std::endl;
+        }
+    }
+
+
+    void X64CodeGenerator::EmitVectorBlendDwords(Register<4, true> dest,
+                                                 Register<4, true> src,
+                                                 uint8_t lanes)
+    {
+        CodePrinter printer(*this);
+
+        EmitVexDirect(3, 1, true, 0x02, dest.GetId(), dest.GetId(), src.GetId());
+        Emit8(lanes);
+
+        if (auto out = printer.PrintMnemonic("vpblendd"))
+        {
+            PrintVectorRegister(*out, dest, true);
+            *out << ", ";
+            PrintVectorRegister(*out, dest, true);
+            *out << ", ";
+            PrintVectorRegister(*out, src, true);
+            *out << ", " << static_cast<unsigned>(lanes) << std::endl;
+        }
+    }
+
+
+    void X64CodeGenerator::EmitVectorAddFloats(Register<4, true> dest, Register<4, true> src)
+    {
+        CodePrinter printer(*this);
+
+        EmitVexDirect(1, 0, false, 0x58, dest.GetId(), dest.GetId(), src.GetId());
+
+        if (auto out = printer.PrintMnemonic("vaddps"))
+        {
+            PrintVectorRegister(*out, dest, false);
+            *out << ", ";
+            PrintVectorRegister(*out, dest, false);
+            *out << ", ";
+            PrintVectorRegister(*out, src, false);
+            *out << std::endl;
+        }
+    }
+
+
+    void X64CodeGenerator::EmitVectorHorizontalAddFloats(Register<4, true> dest, Register<4, true> src)
+    {
+        CodePrinter printer(*this);
+
+        EmitVexDirect(1, 3, false, 0x7c, dest.GetId(), dest.GetId(), src.GetId());
+
+        if (auto out = printer.PrintMnemonic("vhaddps"))
+        {
+            PrintVectorRegister(*out, dest, false);
+            *out << ", ";
+            PrintVectorRegister(*out, dest, false);
+            *out << ", ";
+            PrintVectorRegister(*out, src, false);
+            *out << std::endl;
+        }
+    }
+
+
+    void X64CodeGenerator::EmitConvertHalfToFloat(Register<4, true> dest, Register<4, true> src)
+    {
+        CodePrinter printer(*this);
+
+        EmitVexDirect(2, 1, false, 0x13, dest.GetId(), 0, src.GetId());
+
+        if (auto out = printer.PrintMnemonic("vcvtph2ps"))
+        {
+            PrintVectorRegister(*out, dest, false);
+            *out << ", ";
+            PrintVectorRegister(*out, src, false);
+            *out << std::endl;
+        }
+    }
+
+
+    void X64CodeGenerator::EmitGatherFloats(Register<4, true> dest,
+                                            Register<8, false> base,
+                                            Register<4, true> indices,
+                                            int32_t offset,
+                                            Register<4, true> mask)
+    {
+        LogThrowAssert(!base.IsRIP(), "RIP-relative base cannot be indexed");
+        LogThrowAssert(dest.GetId() != indices.GetId()
+                       && dest.GetId() != mask.GetId()
+                       && indices.GetId() != mask.GetId(),
+                       "The gather registers must be distinct");
+
+        CodePrinter printer(*this);
+
+        EmitVex(2, 1, true, dest.GetId(), mask.GetId(), indices.GetId(), base.GetId(), 0x92);
+
+        // The vector index requires the SIB byte, so the ModR/M.rm is 100b.
+        // [rbp] and [r13] without displacement have no mod 00 encoding.
+        const bool hasNoDisplacement = offset == 0 && base.GetId8() != 5;
+        const bool hasByteDisplacement = offset >= -128 && offset <= 127;
+        const uint8_t mod = hasNoDisplacement ? 0 : (hasByteDisplacement ? 0x40 : 0x80);
+
+        Emit8(static_cast<uint8_t>(mod | (dest.GetId8() << 3) | 4));
+        Emit8(static_cast<uint8_t>((2 << 6) | (indices.GetId8() << 3) | base.GetId8()));
+
+        if (mod == 0x40)
+        {
+            Emit8(static_cast<uint8_t>(offset));
+        }
+        else if (mod == 0x80)
+        {
+            Emit32(offset);
+        }
+
+        if (auto out = printer.PrintMnemonic("vgatherdps"))
+        {
+            IosMiniStateRestorer state(*out);
+
+            PrintVectorRegister(*out, dest, true);
+            *out << ", dword ptr [" << base.GetName() << " + ";
+            PrintVectorRegister(*out, indices, true);
+            *out << "*4";
+
+            if (offset != 0)
+            {
+                *out << std::uppercase << std::hex
+                     << (offset > 0 ? " + " : " - ")
+                     << (offset > 0 ? static_cast<int64_t>(offset) : -static_cast<int64_t>(offset))
+                     << "h";
+            }
+
+            *out << "], ";
+            PrintVectorRegister(*out, mask, true);
+            *out << std::endl;
+        }
+    }
+
+
+    void X64CodeGenerator::EmitNops(unsigned length)
+    {
+        CodePrinter printer(*this);
+
+        WriteNops(Advance(length), length);
+
+        if (auto out = printer.PrintMnemonic("nop"))
+        {
+            *out << std::endl;
+        }
+    }
+
+
+    void X64CodeGenerator::EmitVzeroupper()
+    {
+        CodePrinter printer(*this);
+
+        Emit8(0xc5);
+        Emit8(0xf8);
+        Emit8(0x77);
+
+        if (auto out = printer.PrintMnemonic("vzeroupper"))
+        {
+            *out << std::endl;
+        }
+    }
+
+
+    void X64CodeGenerator::EmitPrefetch(PrefetchLocality locality,
+                                        Register<8, false> base,
+                                        int32_t offset)
+    {
+        static char const * const c_mnemonics[] =
+        {
+            "prefetchnta",
+            "prefetcht0",
+            "prefetcht1",
+            "prefetcht2"
+        };
+
+        const uint8_t hint = static_cast<uint8_t>(locality);
+        LogThrowAssert(hint < sizeof(c_mnemonics) / sizeof(c_mnemonics[0]),
+                       "Invalid prefetch locality %u",
+                       hint);
+
+        CodePrinter printer(*this);
+
+        // The opcode extension goes into ModR/M.reg, the register standing
+        // for it must not set REX.R.
+        EmitRexIndirect<4, false>(base);
+        Emit8(0x0f);
+        Emit8(0x18);
+        EmitModRMOffset(Register<4, false>(hint), base, offset);
+
+        if (auto out = printer.PrintMnemonic(c_mnemonics[hint]))
+        {
+            IosMiniStateRestorer state(*out);
+
+            *out << "byte ptr [" << base.GetName();
+
+            if (offset != 0)
+            {
+                *out << std::uppercase << std::hex
+                     << (offset > 0 ? " + " : " - ")
+                     << (offset > 0 ? static_cast<int64_t>(offset) : -static_cast<int64_t>(offset))
+                     << "h";
+            }
+
+            *out << "]" << std::endl;
+        }
+    }
+
+
     //*************************************************************************
     //
     // X64CodeGenerator::Helper<Op> methods.
@@ -305,11 +1318,38 @@ namespace NativeJIT
         X64CodeGenerator& code,
         Register<8, false> dest,
         Register<8, false> src,
-        int32_t srcOffset)
+        int32_t srcOffset,
+        ScaledIndex index)
     {
         const Register<4, false> dest4(dest);
 
-        Helper<OpCode::Mov>::ArgTypes1<false>::Emit<4>(code, dest4, src, srcOffset);
+        Helper<OpCode::Mov>::ArgTypes1<false>::Emit<4>(code, dest4, src, srcOffset, index);
+    }
+
+
+    //
+    // ScaledIndex
+    //
+
+    X64CodeGenerator::ScaledIndex::ScaledIndex()
+        : m_scale(0)
+    {
+    }
+
+
+    X64CodeGenerator::ScaledIndex::ScaledIndex(Register<8, false> base,
+                                               Register<8, false> index,
+                                               uint8_t scale)
+        : m_index(index),
+          m_scale(scale)
+    {
+        LogThrowAssert(scale == 1 || scale == 2 || scale == 4 || scale == 8,
+                       "Invalid scale %u",
+                       scale);
+        LogThrowAssert(!base.IsRIP(), "RIP-relative base cannot be indexed");
+        LogThrowAssert(!index.IsRIP() && !index.IsStackPointer(),
+                       "Invalid index register %s",
+                       index.GetName());
     }
 
 
@@ -401,6 +1441,30 @@ namespace NativeJIT
     }
 
 
+    void X64CodeGenerator::CodePrinter::PrintSignExtendAccumulator(unsigned size)
+    {
+        if (m_out != nullptr)
+        {
+            PrintBytes(m_startPosition, m_code.CurrentPosition());
+
+            *m_out << (size == 2 ? "cwd" : (size == 4 ? "cdq" : "cqo")) << std::endl;
+        }
+    }
+
+
+    std::ostream* X64CodeGenerator::CodePrinter::PrintMnemonic(char const * mnemonic)
+    {
+        if (m_out != nullptr)
+        {
+            PrintBytes(m_startPosition, m_code.CurrentPosition());
+
+            *m_out << mnemonic << " ";
+        }
+
+        return m_out;
+    }
+
+
     char const * X64CodeGenerator::CodePrinter::GetPointerName(unsigned pointerSize)
     {
         switch (pointerSize)
@@ -414,6 +1478,64 @@ namespace NativeJIT
     }
 
 
+    void X64CodeGenerator::CodePrinter::PrintIndirect(std::ostream& out,
+                                                      unsigned pointerSize,
+                                                      Register<8, false> base,
+                                                      int32_t offset)
+    {
+        IosMiniStateRestorer state(out);
+
+        out << GetPointerName(pointerSize)
+            << " ptr ["
+            << base.GetName()
+            << std::uppercase
+            << std::hex;
+
+        if (offset > 0)
+        {
+            out << " + " << offset << "h";
+        }
+        else if (offset < 0)
+        {
+            out << " - " << -static_cast<int64_t>(offset) << "h";
+        }
+
+        out << "]";
+    }
+
+
+    void X64CodeGenerator::CodePrinter::PrintIndirect(std::ostream& out,
+                                                      unsigned pointerSize,
+                                                      Register<8, false> base,
+                                                      Register<8, false> index,
+                                                      uint8_t scale,
+                                                      int32_t offset)
+    {
+        IosMiniStateRestorer state(out);
+
+        out << GetPointerName(pointerSize)
+            << " ptr ["
+            << base.GetName()
+            << " + "
+            << index.GetName()
+            << "*"
+            << static_cast<unsigned>(scale)
+            << std::uppercase
+            << std::hex;
+
+        if (offset > 0)
+        {
+            out << " + " << offset << "h";
+        }
+        else if (offset < 0)
+        {
+            out << " - " << -static_cast<int64_t>(offset) << "h";
+        }
+
+        out << "]";
+    }
+
+
     const unsigned c_asmDataWidth = 36;
 
     void X64CodeGenerator::CodePrinter::PrintBytes(unsigned start, unsigned end)
@@ -0,0 +1,147 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <algorithm>      // For std::fill, std::min.
+
+#include "NativeJIT/BranchProfile.h"
+#include "NativeJIT/Nodes/Node.h"
+#include "Temporary/Assert.h"
+
+
+namespace NativeJIT
+{
+    BranchProfile::BranchProfile()
+        : m_isInitialized(false)
+    {
+    }
+
+
+    void BranchProfile::Initialize(unsigned nodeCount, unsigned preconditionCount)
+    {
+        if (m_isInitialized)
+        {
+            LogThrowAssert(m_nodeCounts.size() == nodeCount
+                           && m_preconditionCounts.size() == preconditionCount,
+                           "Profile was collected for a different tree: "
+                           "expected %u nodes and %u preconditions, found %u and %u",
+                           static_cast<unsigned>(m_nodeCounts.size()),
+                           static_cast<unsigned>(m_preconditionCounts.size()),
+                           nodeCount,
+                           preconditionCount);
+        }
+        else
+        {
+            m_nodeCounts.resize(nodeCount);
+            m_preconditionCounts.resize(preconditionCount);
+            m_isInitialized = true;
+            Reset();
+        }
+    }
+
+
+    bool BranchProfile::IsInitialized() const
+    {
+        return m_isInitialized;
+    }
+
+
+    void BranchProfile::Reset()
+    {
+        const BranchCounts zero = { 0, 0 };
+
+        std::fill(m_nodeCounts.begin(), m_nodeCounts.end(), zero);
+        std::fill(m_preconditionCounts.begin(), m_preconditionCounts.end(), zero);
+    }
+
+
+    BranchCounts& BranchProfile::GetCounts(NodeBase const & node)
+    {
+        LogThrowAssert(node.GetId() < m_nodeCounts.size(),
+                       "Node ID %u out of range",
+                       node.GetId());
+
+        return m_nodeCounts[node.GetId()];
+    }
+
+
+    BranchCounts const & BranchProfile::GetCounts(NodeBase const & node) const
+    {
+        LogThrowAssert(node.GetId() < m_nodeCounts.size(),
+                       "Node ID %u out of range",
+                       node.GetId());
+
+        return m_nodeCounts[node.GetId()];
+    }
+
+
+    BranchCounts& BranchProfile::GetPreconditionCounts(unsigned position)
+    {
+        LogThrowAssert(position < m_preconditionCounts.size(),
+                       "Precondition %u out of range",
+                       position);
+
+        return m_preconditionCounts[position];
+    }
+
+
+    BranchCounts const & BranchProfile::GetPreconditionCounts(unsigned position) const
+    {
+        LogThrowAssert(position < m_preconditionCounts.size(),
+                       "Precondition %u out of range",
+                       position);
+
+        return m_preconditionCounts[position];
+    }
+
+
+    BranchLayout BranchProfile::GetPreferredLayout(BranchCounts const & counts)
+    {
+        const uint64_t total = counts.m_taken + counts.m_notTaken;
+        const uint64_t minority = (std::min)(counts.m_taken, counts.m_notTaken);
+
+        if (total == 0)
+        {
+            return BranchLayout::Default;
+        }
+        else if (minority * c_branchlessMinorityDivisor >= total)
+        {
+            return BranchLayout::Branchless;
+        }
+        else
+        {
+            return counts.m_taken > counts.m_notTaken
+                ? BranchLayout::TrueFallThrough
+                : BranchLayout::FalseFallThrough;
+        }
+    }
+
+
+    double BranchProfile::GetNotTakenRatio(BranchCounts const & counts)
+    {
+        const uint64_t total = counts.m_taken + counts.m_notTaken;
+
+        return total == 0
+            ? 0.0
+            : static_cast<double>(counts.m_notTaken) / static_cast<double>(total);
+    }
+}
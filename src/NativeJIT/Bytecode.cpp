@@ -0,0 +1,299 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include "NativeJIT/Bytecode.h"
+#include "NativeJIT/Nodes/Node.h"
+#include "Temporary/Assert.h"
+
+
+namespace NativeJIT
+{
+    const unsigned Bytecode::c_maxParameterCount;
+    const unsigned Bytecode::c_maxOperandCount;
+    const unsigned Bytecode::c_maxStackSlotCount;
+    const unsigned Bytecode::c_invalidSlot;
+
+
+    Bytecode::Bytecode()
+        : m_initialSlots(c_maxParameterCount, 0),
+          m_resultSlot(c_invalidSlot),
+          m_unsupportedNodeId(0),
+          m_canEvaluate(true)
+    {
+    }
+
+
+    bool Bytecode::TryGetSlot(NodeBase const & node, unsigned& slot) const
+    {
+        const unsigned id = node.GetId();
+
+        if (id < m_nodeSlots.size() && m_nodeSlots[id] != c_invalidSlot)
+        {
+            slot = m_nodeSlots[id];
+            return true;
+        }
+
+        return false;
+    }
+
+
+    void Bytecode::SetSlot(NodeBase const & node, unsigned slot)
+    {
+        const unsigned id = node.GetId();
+
+        if (id >= m_nodeSlots.size())
+        {
+            m_nodeSlots.resize(id + 1, c_invalidSlot);
+        }
+
+        LogThrowAssert(m_nodeSlots[id] == c_invalidSlot,
+                       "Node with ID %u has already been lowered",
+                       id);
+        m_nodeSlots[id] = slot;
+        m_loweredNodeIds.push_back(id);
+    }
+
+
+    unsigned Bytecode::GetParameterSlot(unsigned position) const
+    {
+        LogThrowAssert(position < c_maxParameterCount,
+                       "Invalid parameter position %u",
+                       position);
+
+        return position;
+    }
+
+
+    unsigned Bytecode::AddVariable()
+    {
+        return AllocateSlot(0);
+    }
+
+
+    unsigned Bytecode::Emit(Handler handler,
+                            std::initializer_list<unsigned> operands,
+                            Slot immediate)
+    {
+        return Emit(handler,
+                    operands.begin(),
+                    static_cast<unsigned>(operands.size()),
+                    immediate);
+    }
+
+
+    unsigned Bytecode::Emit(Handler handler,
+                            unsigned const * operands,
+                            unsigned operandCount,
+                            Slot immediate)
+    {
+        LogThrowAssert(operandCount <= c_maxOperandCount,
+                       "Too many operands: %u",
+                       operandCount);
+
+        Instruction instruction = {};
+        instruction.m_handler = handler;
+        instruction.m_result = AllocateSlot(0);
+        instruction.m_immediate = immediate;
+
+        for (unsigned i = 0; i < operandCount; ++i)
+        {
+            instruction.m_operands[i] = operands[i];
+        }
+
+        m_instructions.push_back(instruction);
+
+        return instruction.m_result;
+    }
+
+
+    void Bytecode::EmitCopy(unsigned source, unsigned destination)
+    {
+        Instruction instruction = {};
+        instruction.m_handler = &Copy;
+        instruction.m_result = destination;
+        instruction.m_operands[0] = source;
+
+        m_instructions.push_back(instruction);
+    }
+
+
+    void Bytecode::BeginSkip(unsigned condition, bool skipIf)
+    {
+        Instruction instruction = {};
+        instruction.m_handler = nullptr;
+        instruction.m_result = c_invalidSlot;
+        instruction.m_operands[0] = condition;
+        instruction.m_operands[1] = skipIf ? 1 : 0;
+
+        m_openSkips.push_back(std::make_pair(GetInstructionCount(), m_loweredNodeIds.size()));
+        m_instructions.push_back(instruction);
+    }
+
+
+    void Bytecode::EndSkip()
+    {
+        LogThrowAssert(!m_openSkips.empty(), "No skipped sequence to end");
+
+        const auto skip = m_openSkips.back();
+        m_openSkips.pop_back();
+
+        m_instructions[skip.first].m_immediate = GetInstructionCount() - skip.first - 1;
+
+        for (size_t i = skip.second; i < m_loweredNodeIds.size(); ++i)
+        {
+            m_nodeSlots[m_loweredNodeIds[i]] = c_invalidSlot;
+        }
+
+        m_loweredNodeIds.resize(skip.second);
+    }
+
+
+    bool Bytecode::IsInSkip() const
+    {
+        return !m_openSkips.empty();
+    }
+
+
+    void Bytecode::ReportUnsupportedNode(NodeBase const & node)
+    {
+        if (m_canEvaluate)
+        {
+            m_canEvaluate = false;
+            m_unsupportedNodeId = node.GetId();
+        }
+    }
+
+
+    void Bytecode::SetResultSlot(unsigned slot)
+    {
+        m_resultSlot = slot;
+    }
+
+
+    bool Bytecode::CanEvaluate() const
+    {
+        return m_canEvaluate && m_resultSlot != c_invalidSlot && m_openSkips.empty();
+    }
+
+
+    unsigned Bytecode::GetUnsupportedNodeId() const
+    {
+        return m_unsupportedNodeId;
+    }
+
+
+    unsigned Bytecode::GetInstructionCount() const
+    {
+        return static_cast<unsigned>(m_instructions.size());
+    }
+
+
+    unsigned Bytecode::GetSlotCount() const
+    {
+        return static_cast<unsigned>(m_initialSlots.size());
+    }
+
+
+    bool Bytecode::Copy(Slot* slots, Instruction const & instruction)
+    {
+        slots[instruction.m_result] = slots[instruction.m_operands[0]];
+
+        return true;
+    }
+
+
+    bool Bytecode::AddOffset(Slot* slots, Instruction const & instruction)
+    {
+        slots[instruction.m_result] = slots[instruction.m_operands[0]]
+                                      + static_cast<int64_t>(instruction.m_immediate);
+
+        return true;
+    }
+
+
+    bool Bytecode::AddressOfVariable(Slot* slots, Instruction const & instruction)
+    {
+        Write<Slot*>(slots, instruction.m_result, slots + instruction.m_immediate);
+
+        return true;
+    }
+
+
+    bool Bytecode::IsConditionMet(JccType jcc, Flags const & flags)
+    {
+        switch (jcc)
+        {
+        case JccType::JO:   return flags.m_overflow;
+        case JccType::JNO:  return !flags.m_overflow;
+        case JccType::JB:   return flags.m_carry;
+        case JccType::JAE:  return !flags.m_carry;
+        case JccType::JE:   return flags.m_zero;
+        case JccType::JNE:  return !flags.m_zero;
+        case JccType::JBE:  return flags.m_carry || flags.m_zero;
+        case JccType::JA:   return !flags.m_carry && !flags.m_zero;
+        case JccType::JS:   return flags.m_sign;
+        case JccType::JNS:  return !flags.m_sign;
+        case JccType::JP:   return flags.m_parity;
+        case JccType::JNP:  return !flags.m_parity;
+        case JccType::JL:   return flags.m_sign != flags.m_overflow;
+        case JccType::JNL:  return flags.m_sign == flags.m_overflow;
+        case JccType::JLE:  return flags.m_zero || flags.m_sign != flags.m_overflow;
+        case JccType::JNLE: return !flags.m_zero && flags.m_sign == flags.m_overflow;
+        default:
+            LogThrowAbort("Invalid JCC %u", static_cast<unsigned>(jcc));
+            return false;
+        }
+    }
+
+
+    unsigned Bytecode::AllocateSlot(Slot initialValue)
+    {
+        m_initialSlots.push_back(initialValue);
+
+        return static_cast<unsigned>(m_initialSlots.size() - 1);
+    }
+
+
+    void Bytecode::RunInstructions(Slot* slots, unsigned& result) const
+    {
+        const size_t count = m_instructions.size();
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            Instruction const & instruction = m_instructions[i];
+
+            if (instruction.m_handler == nullptr)
+            {
+                if (Read<bool>(slots, instruction.m_operands[0]) == (instruction.m_operands[1] != 0))
+                {
+                    i += static_cast<size_t>(instruction.m_immediate);
+                }
+            }
+            else if (!instruction.m_handler(slots, instruction))
+            {
+                result = instruction.m_result;
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,151 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <algorithm>
+
+#include "NativeJIT/CompilerPool.h"
+#include "Temporary/Assert.h"
+
+
+namespace NativeJIT
+{
+    //
+    // CompiledCode
+    //
+
+    CompiledCode::CompiledCode(unsigned capacity)
+        : m_codeAllocator(capacity),
+          m_code(m_codeAllocator, capacity)
+    {
+    }
+
+
+    FunctionBuffer& CompiledCode::GetCode()
+    {
+        return m_code;
+    }
+
+
+    //
+    // CompilerPool
+    //
+
+    CompilerPool::CompilerPool(unsigned workerCount,
+                               size_t allocatorCapacity,
+                               unsigned codeCapacity)
+        : m_codeCapacity(codeCapacity),
+          m_isStopping(false),
+          m_statistics()
+    {
+        LogThrowAssert(workerCount > 0, "CompilerPool requires at least one worker");
+
+        for (unsigned i = 0; i < workerCount; ++i)
+        {
+            m_workers.emplace_back(&CompilerPool::RunWorker, this, allocatorCapacity);
+        }
+    }
+
+
+    CompilerPool::~CompilerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_isStopping = true;
+        }
+
+        m_jobAvailable.notify_all();
+
+        for (auto & worker : m_workers)
+        {
+            worker.join();
+        }
+    }
+
+
+    CompilerPool::Statistics CompilerPool::GetStatistics() const
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+
+        return m_statistics;
+    }
+
+
+    void CompilerPool::Enqueue(Job job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+
+            m_queue.push_back({ std::move(job), Clock::now() });
+            m_statistics.m_queueDepth = m_queue.size();
+            m_statistics.m_maxQueueDepth = (std::max)(m_statistics.m_maxQueueDepth,
+                                                      m_statistics.m_queueDepth);
+        }
+
+        m_jobAvailable.notify_one();
+    }
+
+
+    void CompilerPool::RunWorker(size_t allocatorCapacity)
+    {
+        Allocator allocator(allocatorCapacity);
+
+        for (;;)
+        {
+            QueuedJob job;
+
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+
+                m_jobAvailable.wait(lock, [this] { return m_isStopping || !m_queue.empty(); });
+
+                // The queued jobs are completed before stopping.
+                if (m_queue.empty())
+                {
+                    return;
+                }
+
+                job = std::move(m_queue.front());
+                m_queue.pop_front();
+                m_statistics.m_queueDepth = m_queue.size();
+            }
+
+            // The job captures any exception for its future.
+            auto complete = job.m_job(allocator);
+            allocator.Reset();
+
+            const auto latency
+                = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now()
+                                                                        - job.m_queueTime);
+
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+
+                ++m_statistics.m_completedCount;
+                m_statistics.m_totalLatency += latency;
+                m_statistics.m_maxLatency = (std::max)(m_statistics.m_maxLatency, latency);
+            }
+
+            complete();
+        }
+    }
+}
@@ -0,0 +1,173 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <algorithm>
+#include <cstring>
+
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/ConstantPool.h"
+#include "NativeJIT/ExpressionTree.h"
+#include "Temporary/Assert.h"
+
+
+namespace NativeJIT
+{
+    ConstantPool::ConstantPool(Allocators::StlAllocator<void*> const & allocator)
+        : m_data(allocator),
+          m_entries(allocator),
+          m_order(allocator),
+          m_byteCount(0)
+    {
+    }
+
+
+    void ConstantPool::Clear()
+    {
+        m_data.clear();
+        m_entries.clear();
+        m_order.clear();
+        m_byteCount = 0;
+    }
+
+
+    void ConstantPool::Add(void const * data,
+                           unsigned size,
+                           unsigned alignment,
+                           bool isAddress,
+                           int32_t& offset)
+    {
+        LogThrowAssert(size > 0 && alignment > 0,
+                       "Invalid constant size %u or alignment %u",
+                       size,
+                       alignment);
+
+        Entry entry;
+        entry.m_start = static_cast<unsigned>(m_data.size());
+        entry.m_size = size;
+        entry.m_alignment = alignment;
+        entry.m_isAddress = isAddress;
+        entry.m_offset = &offset;
+
+        auto bytes = static_cast<uint8_t const *>(data);
+        m_data.insert(m_data.end(), bytes, bytes + size);
+        m_entries.push_back(entry);
+    }
+
+
+    void ConstantPool::Emit(ExpressionTree& tree)
+    {
+        // Sort the entries so that the identical ones are adjacent and the
+        // alignments decrease.
+        m_order.clear();
+
+        for (unsigned i = 0; i < m_entries.size(); ++i)
+        {
+            m_order.push_back(i);
+        }
+
+        std::sort(m_order.begin(),
+                  m_order.end(),
+                  [this](unsigned left, unsigned right) { return IsLess(left, right); });
+
+        auto & code = tree.GetCodeGenerator();
+        const unsigned start = code.CurrentPosition();
+
+        for (unsigned i = 0; i < m_order.size(); ++i)
+        {
+            Entry const & entry = m_entries[m_order[i]];
+
+            if (i > 0 && IsSame(m_order[i - 1], m_order[i]))
+            {
+                *entry.m_offset = *m_entries[m_order[i - 1]].m_offset;
+                continue;
+            }
+
+            while (code.CurrentPosition() % entry.m_alignment != 0)
+            {
+                code.Emit8(0xaa);
+            }
+
+            *entry.m_offset = code.CurrentPosition();
+            code.EmitBytes(&m_data[entry.m_start], entry.m_size);
+
+            if (entry.m_isAddress)
+            {
+                tree.AddAbsoluteAddress(*entry.m_offset);
+            }
+        }
+
+        m_byteCount = code.CurrentPosition() - start;
+    }
+
+
+    unsigned ConstantPool::GetConstantCount() const
+    {
+        return static_cast<unsigned>(m_entries.size());
+    }
+
+
+    unsigned ConstantPool::GetByteCount() const
+    {
+        return m_byteCount;
+    }
+
+
+    bool ConstantPool::IsLess(unsigned left, unsigned right) const
+    {
+        Entry const & l = m_entries[left];
+        Entry const & r = m_entries[right];
+
+        if (l.m_alignment != r.m_alignment)
+        {
+            return l.m_alignment > r.m_alignment;
+        }
+
+        if (l.m_size != r.m_size)
+        {
+            return l.m_size > r.m_size;
+        }
+
+        if (l.m_isAddress != r.m_isAddress)
+        {
+            return r.m_isAddress;
+        }
+
+        const int bytes = memcmp(&m_data[l.m_start], &m_data[r.m_start], l.m_size);
+
+        // Keep the order of addition for the identical constants, so that
+        // the layout doesn't depend on the sort implementation.
+        return bytes != 0 ? bytes < 0 : left < right;
+    }
+
+
+    bool ConstantPool::IsSame(unsigned left, unsigned right) const
+    {
+        Entry const & l = m_entries[left];
+        Entry const & r = m_entries[right];
+
+        return l.m_alignment == r.m_alignment
+               && l.m_size == r.m_size
+               && l.m_isAddress == r.m_isAddress
+               && memcmp(&m_data[l.m_start], &m_data[r.m_start], l.m_size) == 0;
+    }
+}
@@ -22,6 +22,7 @@
 
 
 #include "NativeJIT/ExpressionNodeFactory.h"
+#include "NativeJIT/Nodes/TreeEnsembleNode.h"
 
 
 namespace NativeJIT
@@ -31,4 +32,11 @@ namespace NativeJIT
         : ExpressionTree(allocator, code)
     {
     }
+
+
+    Node<float>& ExpressionNodeFactory::EvaluateEnsemble(Node<float const *>& features,
+                                                         TreeEnsemble const & ensemble)
+    {
+        return PlacementConstruct<TreeEnsembleNode>(*this, features, ensemble);
+    }
 }
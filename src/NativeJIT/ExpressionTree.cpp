@@ -21,6 +21,10 @@
 // THE SOFTWARE.
 
 
+#include <algorithm>                // For std::find, std::swap.
+#include <limits>
+
+#include "NativeJIT/Bytecode.h"
 #include "NativeJIT/CodeGen/CallingConvention.h"
 #include "NativeJIT/CodeGen/FunctionBuffer.h"
 #include "NativeJIT/CodeGen/FunctionSpecification.h"
@@ -33,6 +37,20 @@
 
 namespace NativeJIT
 {
+    //*************************************************************************
+    //
+    // CompileBudget
+    //
+    //*************************************************************************
+    CompileBudget::CompileBudget()
+        : m_baselineNodeCount((std::numeric_limits<unsigned>::max)()),
+          m_baselineDuration((std::chrono::microseconds::max)()),
+          m_maxNodeCount((std::numeric_limits<unsigned>::max)()),
+          m_maxDuration((std::chrono::microseconds::max)())
+    {
+    }
+
+
     //*************************************************************************
     //
     // ExpressionTree
@@ -42,13 +60,21 @@ namespace NativeJIT
         : m_allocator(allocator),
           m_stlAllocator(allocator),
           m_code(code),
+          m_cpuFeatures(code.GetCpuFeatures()),
+          m_reassociationMode(ReassociationMode::Disabled),
+          m_compilationTier(CompilationTier::Optimized),
           m_diagnosticsStream(nullptr),
           // Note: there is a member initialization order dependency on
           // m_stlAllocator for multiple members below.
           m_topologicalSort(m_stlAllocator),
           m_parameters(m_stlAllocator),
           m_ripRelatives(m_stlAllocator),
+          m_constantPool(m_stlAllocator),
+          m_absoluteAddresses(m_stlAllocator),
           m_preconditionTests(m_stlAllocator),
+          m_preconditionOrder(m_stlAllocator),
+          m_branchProfile(nullptr),
+          m_branchProfileMode(BranchProfileMode::Instrument),
           m_rxxFreeList(allocator),
           m_xmmFreeList(allocator),
           m_reservedRxxRegisterStorages(m_stlAllocator),
@@ -198,12 +224,176 @@ namespace NativeJIT
     }
 
 
+    void ExpressionTree::AddConstant(void const * data,
+                                     unsigned size,
+                                     unsigned alignment,
+                                     bool isAddress,
+                                     int32_t& offset)
+    {
+        m_constantPool.Add(data, size, alignment, isAddress, offset);
+    }
+
+
+    ConstantPool const & ExpressionTree::GetConstantPool() const
+    {
+        return m_constantPool;
+    }
+
+
+    void ExpressionTree::AddAbsoluteAddress(unsigned offset)
+    {
+        m_absoluteAddresses.push_back(offset);
+    }
+
+
+    AllocatorVector<unsigned> const & ExpressionTree::GetAbsoluteAddresses() const
+    {
+        return m_absoluteAddresses;
+    }
+
+
     void ExpressionTree::AddExecutionPreconditionTest(ExecutionPreconditionTest& test)
     {
         m_preconditionTests.push_back(&test);
     }
 
 
+    void ExpressionTree::SetBranchProfile(BranchProfile& profile, BranchProfileMode mode)
+    {
+        m_branchProfile = &profile;
+        m_branchProfileMode = mode;
+    }
+
+
+    CpuFeatures const & ExpressionTree::GetCpuFeatures() const
+    {
+        return m_cpuFeatures;
+    }
+
+
+    void ExpressionTree::SetCpuFeatures(CpuFeatures const & features)
+    {
+        m_cpuFeatures = features;
+    }
+
+
+    ReassociationMode ExpressionTree::GetReassociationMode() const
+    {
+        return m_reassociationMode;
+    }
+
+
+    void ExpressionTree::SetReassociationMode(ReassociationMode mode)
+    {
+        m_reassociationMode = mode;
+    }
+
+
+    CompileBudget const & ExpressionTree::GetCompileBudget() const
+    {
+        return m_compileBudget;
+    }
+
+
+    void ExpressionTree::SetCompileBudget(CompileBudget const & budget)
+    {
+        m_compileBudget = budget;
+    }
+
+
+    CompilationTier ExpressionTree::GetCompilationTier() const
+    {
+        return m_compilationTier;
+    }
+
+
+    bool ExpressionTree::HasCompileTimeExceeded(std::chrono::microseconds duration) const
+    {
+        // Compare in microseconds as the conversion of the unlimited duration
+        // to the clock's resolution would overflow.
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now() - m_compileStartTime)
+               >= duration;
+    }
+
+
+    BranchCounts* ExpressionTree::GetInstrumentationCounts(NodeBase const & node)
+    {
+        return (m_branchProfile != nullptr && m_branchProfileMode == BranchProfileMode::Instrument)
+            ? &m_branchProfile->GetCounts(node)
+            : nullptr;
+    }
+
+
+    BranchCounts* ExpressionTree::GetInstrumentationCounts(ExecutionPreconditionTest const & test)
+    {
+        if (m_branchProfile == nullptr || m_branchProfileMode != BranchProfileMode::Instrument)
+        {
+            return nullptr;
+        }
+
+        // The position in which the test was added identifies the counters
+        // regardless of the order in which the tests are evaluated.
+        auto it = std::find(m_preconditionTests.begin(), m_preconditionTests.end(), &test);
+        LogThrowAssert(it != m_preconditionTests.end(), "Unknown precondition test");
+
+        return &m_branchProfile->GetPreconditionCounts(
+            static_cast<unsigned>(it - m_preconditionTests.begin()));
+    }
+
+
+    BranchLayout ExpressionTree::GetBranchLayout(NodeBase const & node) const
+    {
+        return (m_branchProfile != nullptr && m_branchProfileMode == BranchProfileMode::Optimize)
+            ? BranchProfile::GetPreferredLayout(m_branchProfile->GetCounts(node))
+            : BranchLayout::Default;
+    }
+
+
+    bool ExpressionTree::IsInstrumented() const
+    {
+        return m_branchProfile != nullptr
+            && m_branchProfileMode == BranchProfileMode::Instrument;
+    }
+
+
+    void ExpressionTree::OrderPreconditionTestsByProfile()
+    {
+        // Precondition positions are small numbers, so a simple insertion sort
+        // is used. Since a test moves ahead of another only if it fails more
+        // often, is independent of the earlier tests and returns the same
+        // value, the result of the function is unchanged for every input.
+        for (unsigned i = 1; i < m_preconditionOrder.size(); ++i)
+        {
+            const unsigned position = m_preconditionOrder[i];
+            ExecutionPreconditionTest const & test = *m_preconditionTests[position];
+
+            if (test.GetOrder() != PreconditionOrder::Independent)
+            {
+                continue;
+            }
+
+            const double failureRatio = BranchProfile::GetNotTakenRatio(
+                m_branchProfile->GetPreconditionCounts(position));
+
+            for (unsigned j = i; j > 0; --j)
+            {
+                const unsigned previous = m_preconditionOrder[j - 1];
+
+                if (failureRatio <= BranchProfile::GetNotTakenRatio(
+                                        m_branchProfile->GetPreconditionCounts(previous))
+                    || &test.GetOtherwiseValue()
+                       != &m_preconditionTests[previous]->GetOtherwiseValue())
+                {
+                    break;
+                }
+
+                std::swap(m_preconditionOrder[j], m_preconditionOrder[j - 1]);
+            }
+        }
+    }
+
+
     void ExpressionTree::ReportFunctionCallNode(unsigned parameterCount)
     {
         if (static_cast<int>(parameterCount) > m_maxFunctionCallParameters)
@@ -215,10 +405,46 @@ namespace NativeJIT
 
     void ExpressionTree::Compile()
     {
+        m_compileStartTime = std::chrono::steady_clock::now();
+
         // Note: the call to Reset() clears all allocated labels, so start of
         // epilogue label must be allocated after that point.
         m_code.Reset();
         m_startOfEpilogue = m_code.AllocateLabel();
+        m_absoluteAddresses.clear();
+        m_constantPool.Clear();
+
+        const size_t nodeCount = m_topologicalSort.size();
+
+        if (nodeCount > m_compileBudget.m_maxNodeCount)
+        {
+            m_compilationTier = CompilationTier::NotCompiled;
+            return;
+        }
+
+        m_compilationTier = nodeCount > m_compileBudget.m_baselineNodeCount
+                            ? CompilationTier::Baseline
+                            : CompilationTier::Optimized;
+
+        m_preconditionOrder.clear();
+
+        for (unsigned i = 0; i < m_preconditionTests.size(); ++i)
+        {
+            m_preconditionOrder.push_back(i);
+        }
+
+        // The profile needs to know the number of branch sites before any
+        // code referring to its counters is generated.
+        if (m_branchProfile != nullptr)
+        {
+            m_branchProfile->Initialize(static_cast<unsigned>(m_topologicalSort.size()),
+                                        static_cast<unsigned>(m_preconditionTests.size()));
+
+            if (m_branchProfileMode == BranchProfileMode::Optimize)
+            {
+                OrderPreconditionTestsByProfile();
+            }
+        }
 
         // Generate constants.
         Pass0();
@@ -227,26 +453,53 @@ namespace NativeJIT
         m_code.BeginFunctionBodyGeneration();
 
         Pass1();
-        Pass2();
+
+        if (HasCompileTimeExceeded(m_compileBudget.m_maxDuration) || !Pass2())
+        {
+            // Nothing refers to the partially generated code.
+            m_compilationTier = CompilationTier::NotCompiled;
+            m_code.Reset();
+            return;
+        }
+
         Print();
         Pass3();
 
+        if (HasCompileTimeExceeded(m_compileBudget.m_baselineDuration))
+        {
+            m_compilationTier = CompilationTier::Baseline;
+        }
+
+        // The base register is only needed to address temporaries. Without
+        // them and without calls, the function runs without a frame. The
+        // base register is reserved rather than used by the body, so it's
+        // saved only if the prolog sets it up.
+        const FunctionSpecification::BaseRegisterType baseRegisterType
+            = m_temporaryCount > 0
+              ? FunctionSpecification::BaseRegisterType::SetRbpToOriginalRsp
+              : FunctionSpecification::BaseRegisterType::Unused;
+
         const FunctionSpecification spec(m_allocator,
                                          m_maxFunctionCallParameters,
                                          m_temporaryCount,
                                          m_rxxFreeList.GetLifetimeUsedMask()
                                             & CallingConvention::c_rxxNonVolatileRegistersMask
-                                            & CallingConvention::c_rxxWritableRegistersMask,
+                                            & CallingConvention::c_rxxWritableRegistersMask
+                                            & ~m_basePointer.GetMask(),
                                          m_xmmFreeList.GetLifetimeUsedMask()
                                             & CallingConvention::c_xmmNonVolatileRegistersMask
                                             & CallingConvention::c_xmmWritableRegistersMask,
-                                         FunctionSpecification::BaseRegisterType::SetRbpToOriginalRsp,
+                                         baseRegisterType,
                                          m_code.IsDiagnosticsStreamAvailable()
                                          ? &m_code.GetDiagnosticsStream()
-                                         : nullptr);
+                                         : nullptr,
+                                         FunctionSpecification::LeafFrameType::Omitted);
 
         m_code.PlaceLabel(m_startOfEpilogue);
-        m_code.EndFunctionBodyGeneration(spec);
+        m_code.EndFunctionBodyGeneration(spec,
+                                         m_compilationTier == CompilationTier::Optimized
+                                         ? FunctionBuffer::LayoutOptimization::Enabled
+                                         : FunctionBuffer::LayoutOptimization::Disabled);
 
         // Release the reserved registers.
         m_reservedRegistersPins.clear();
@@ -266,7 +519,9 @@ namespace NativeJIT
 
     void const * ExpressionTree::GetUntypedEntryPoint() const
     {
-        return m_code.GetEntryPoint();
+        return m_compilationTier == CompilationTier::NotCompiled
+               ? nullptr
+               : m_code.GetEntryPoint();
     }
 
 
@@ -277,7 +532,8 @@ namespace NativeJIT
                        temporarySlot,
                        m_temporaryCount);
 
-        // Expression tree asks for BaseRegisterType::SetRbpToOriginalRsp. That
+        // Expression tree asks for BaseRegisterType::SetRbpToOriginalRsp
+        // whenever any temporaries are allocated. That
         // means that [rbp] holds return address, [rbp + 8] home for function's
         // first argument etc, whereas [rbp - 8] holds the first temporary etc.
         return -static_cast<int32_t>(temporarySlot + 1)
@@ -305,6 +561,29 @@ namespace NativeJIT
     }
 
 
+    void ExpressionTree::Lower(Bytecode& code, NodeBase& expression)
+    {
+        for (auto test : m_preconditionTests)
+        {
+            test->Lower(code);
+        }
+
+        // Like Pass2(), evaluate the common subexpressions before the rest of
+        // the tree so that each of them runs once, regardless of the paths of
+        // the conditionals which use it. The loads are left to their uses
+        // since the generated code defers them as well.
+        for (auto node : m_topologicalSort)
+        {
+            if (node->GetParentCount() > 1 && !node->IsLoadedOnUse())
+            {
+                node->Lower(code);
+            }
+        }
+
+        code.SetResultSlot(expression.Lower(code));
+    }
+
+
     void ExpressionTree::Pass0()
     {
         if (IsDiagnosticsStreamAvailable())
@@ -312,12 +591,24 @@ namespace NativeJIT
             GetDiagnosticsStream() << "=== Pass0 ===" << std::endl;
         }
 
-        // Emit RIP-relative constants.
+        // Emit RIP-relative constants. The nodes add their constants to the
+        // pool, which is laid out once all of them are known.
         for (unsigned i = 0 ; i < m_ripRelatives.size(); ++i)
         {
             m_ripRelatives[i]->EmitStaticData(*this);
         }
 
+        m_constantPool.Emit(*this);
+
+        if (IsDiagnosticsStreamAvailable())
+        {
+            GetDiagnosticsStream() << "Constant pool: "
+                                   << m_constantPool.GetConstantCount()
+                                   << " constants in "
+                                   << m_constantPool.GetByteCount()
+                                   << " bytes" << std::endl;
+        }
+
         // Walk the nodes in reverse order of creation (i.e. in potential order
         // of execution) to see whether they can be optimized away.
         //
@@ -371,14 +662,14 @@ namespace NativeJIT
         }
 
         // Execute any return-early tests before compiling the expression further.
-        for (auto test : m_preconditionTests)
+        for (auto position : m_preconditionOrder)
         {
-            test->Evaluate(*this);
+            m_preconditionTests[position]->Evaluate(*this);
         }
     }
 
 
-    void ExpressionTree::Pass2()
+    bool ExpressionTree::Pass2()
     {
         if (IsDiagnosticsStreamAvailable())
         {
@@ -391,9 +682,16 @@ namespace NativeJIT
 
             if (node.GetParentCount() > 1 && !node.HasBeenEvaluated())
             {
+                if (HasCompileTimeExceeded(m_compileBudget.m_maxDuration))
+                {
+                    return false;
+                }
+
                 node.CodeGenCache(*this);
             }
         }
+
+        return true;
     }
 
 
@@ -23,6 +23,7 @@
 
 #include <algorithm>    // For std::max
 
+#include "NativeJIT/Bytecode.h"
 #include "NativeJIT/ExpressionTree.h"
 #include "NativeJIT/Nodes/Node.h"
 #include "Temporary/Assert.h"
@@ -99,6 +100,20 @@ namespace NativeJIT
     }
 
 
+    unsigned NodeBase::Lower(Bytecode& code)
+    {
+        unsigned slot;
+
+        if (!code.TryGetSlot(*this, slot))
+        {
+            slot = LowerValue(code);
+            code.SetSlot(*this, slot);
+        }
+
+        return slot;
+    }
+
+
     unsigned NodeBase::GetParentCount() const
     {
         return m_parentCount;
@@ -128,4 +143,50 @@ namespace NativeJIT
     {
         return false;
     }
+
+
+    bool NodeBase::GetBaseIndexAndOffset(NodeBase*& /* base */,
+                                         NodeBase*& /* index */,
+                                         uint8_t& /* scale */,
+                                         int32_t& /* offset */) const
+    {
+        return false;
+    }
+
+
+    bool NodeBase::GetFactors(NodeBase*& /* left */, NodeBase*& /* right */) const
+    {
+        return false;
+    }
+
+
+    bool NodeBase::GetAssociativeOperands(OpCode /* op */,
+                                          NodeBase*& /* left */,
+                                          NodeBase*& /* right */) const
+    {
+        return false;
+    }
+
+
+    bool NodeBase::GetInsertedComponent(unsigned& /* index */,
+                                        NodeBase*& /* packed */,
+                                        NodeBase*& /* value */) const
+    {
+        return false;
+    }
+
+
+    bool NodeBase::IsLoadedOnUse() const
+    {
+        return false;
+    }
+
+
+    unsigned NodeBase::LowerValue(Bytecode& code)
+    {
+        code.ReportUnsupportedNode(*this);
+
+        // The slot is never read since the bytecode cannot be evaluated.
+        return code.GetParameterSlot(0);
+    }
 }
@@ -0,0 +1,428 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <cstring>          // For memcpy.
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+#ifdef NATIVEJIT_PLATFORM_WINDOWS
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "NativeJIT/CodeGen/ElfObjectWriter.h"
+#include "NativeJIT/ExpressionTree.h"
+#include "NativeJIT/ObjectFile.h"
+#include "Temporary/Assert.h"
+
+
+namespace NativeJIT
+{
+    //*************************************************************************
+    //
+    // SymbolTable
+    //
+    //*************************************************************************
+    void SymbolTable::Add(std::string const & name, uint64_t address)
+    {
+        LogThrowAssert(m_addresses.find(name) == m_addresses.end(),
+                       "Symbol %s has already been added",
+                       name.c_str());
+        LogThrowAssert(m_names.find(address) == m_names.end(),
+                       "Address of symbol %s has already been added as %s",
+                       name.c_str(),
+                       m_names.find(address)->second.c_str());
+
+        m_addresses.emplace(name, address);
+        m_names.emplace(address, name);
+    }
+
+
+    std::string const * SymbolTable::FindName(uint64_t address) const
+    {
+        auto it = m_names.find(address);
+
+        return it != m_names.end() ? &it->second : nullptr;
+    }
+
+
+    bool SymbolTable::TryGetAddress(std::string const & name, uint64_t& address) const
+    {
+        auto it = m_addresses.find(name);
+
+        if (it == m_addresses.end())
+        {
+            return false;
+        }
+
+        address = it->second;
+        return true;
+    }
+
+
+    //*************************************************************************
+    //
+    // ObjectFile
+    //
+    //*************************************************************************
+
+    // "NJIT" when read as bytes.
+    const uint32_t ObjectFile::c_magic = 0x54494a4e;
+    const uint32_t ObjectFile::c_version = 1;
+    const unsigned ObjectFile::c_imageAlignment;
+
+
+    void ObjectFile::Write(std::ostream& out,
+                           ExpressionTree const & tree,
+                           SymbolTable const & symbols)
+    {
+        FunctionBuffer const & code = tree.GetCodeGenerator();
+        uint8_t const * buffer = code.BufferStart();
+
+        Header header = {};
+        header.m_magic = c_magic;
+        header.m_version = c_version;
+        header.m_codeStartOffset = code.GetFunctionCodeStartOffset();
+        header.m_codeEndOffset = code.GetFunctionCodeEndOffset();
+        header.m_unwindInfoStartOffset = code.GetUnwindInfoStartOffset();
+        header.m_imageByteLength = header.m_codeEndOffset;
+
+        // The relocated addresses are cleared in the image so that the file
+        // doesn't depend on where the symbols were in the writing process.
+        std::vector<uint8_t> image(buffer, buffer + header.m_imageByteLength);
+        std::vector<Relocation> relocations;
+        std::string names;
+
+        for (auto const & reference : FindReferences(tree, symbols))
+        {
+            Relocation relocation;
+            relocation.m_imageOffset = reference.first;
+            relocation.m_nameOffset = static_cast<uint32_t>(names.size());
+            relocations.push_back(relocation);
+
+            names.append(*reference.second);
+            names.push_back('\0');
+
+            memset(&image[reference.first], 0, sizeof(uint64_t));
+        }
+
+        header.m_relocationCount = static_cast<uint32_t>(relocations.size());
+        header.m_namesByteLength = static_cast<uint32_t>(names.size());
+
+        const size_t imageOffset = sizeof(Header)
+                                   + relocations.size() * sizeof(Relocation)
+                                   + names.size();
+        const size_t padding = (c_imageAlignment - imageOffset % c_imageAlignment) % c_imageAlignment;
+        header.m_imageOffset = static_cast<uint32_t>(imageOffset + padding);
+
+        out.write(reinterpret_cast<char const *>(&header), sizeof(header));
+
+        if (!relocations.empty())
+        {
+            out.write(reinterpret_cast<char const *>(relocations.data()),
+                      relocations.size() * sizeof(Relocation));
+        }
+
+        out.write(names.data(), names.size());
+
+        for (size_t i = 0; i < padding; ++i)
+        {
+            out.put(0);
+        }
+
+        out.write(reinterpret_cast<char const *>(image.data()), image.size());
+
+        LogThrowAssert(out.good(), "Failed to write the object file");
+    }
+
+
+    void ObjectFile::WriteElf(std::ostream& out,
+                              ExpressionTree const & tree,
+                              SymbolTable const & symbols,
+                              std::string const & functionName)
+    {
+        ElfObjectWriter writer(tree.GetCodeGenerator(), functionName);
+
+        for (auto const & reference : FindReferences(tree, symbols))
+        {
+            writer.AddExternalReference(reference.first, *reference.second);
+        }
+
+        writer.Write(out);
+    }
+
+
+    ObjectFile::References ObjectFile::FindReferences(ExpressionTree const & tree,
+                                                      SymbolTable const & symbols)
+    {
+        LogThrowAssert(!tree.IsInstrumented(),
+                       "Instrumented functions refer to the profile counters and cannot be saved");
+
+        FunctionBuffer const & code = tree.GetCodeGenerator();
+        uint8_t const * buffer = code.BufferStart();
+        const unsigned imageByteLength = code.GetFunctionCodeEndOffset();
+
+        References references;
+
+        for (unsigned offset : tree.GetAbsoluteAddresses())
+        {
+            LogThrowAssert(offset + sizeof(uint64_t) <= imageByteLength,
+                           "Absolute address at offset %u is outside of the code",
+                           offset);
+
+            uint64_t address;
+            memcpy(&address, buffer + offset, sizeof(address));
+
+            // Null pointers don't need to be relocated.
+            if (address == 0)
+            {
+                continue;
+            }
+
+            std::string const * name = symbols.FindName(address);
+
+            LogThrowAssert(name != nullptr,
+                           "Address %llx at offset %u is not in the symbol table",
+                           static_cast<unsigned long long>(address),
+                           offset);
+
+            references.emplace_back(offset, name);
+        }
+
+        return references;
+    }
+
+
+#ifdef NATIVEJIT_PLATFORM_WINDOWS
+    ObjectFile::ObjectFile(char const * path, SymbolTable const & symbols)
+        : m_file(nullptr),
+          m_fileByteLength(0),
+          m_image(nullptr),
+          m_mapping(nullptr),
+          m_runtimeFunction()
+    {
+        HANDLE file = CreateFileA(path,
+                                  GENERIC_READ | GENERIC_EXECUTE,
+                                  FILE_SHARE_READ,
+                                  nullptr,
+                                  OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL,
+                                  nullptr);
+        LogThrowAssert(file != INVALID_HANDLE_VALUE, "Cannot open %s", path);
+
+        LARGE_INTEGER size;
+        const bool hasSize = GetFileSizeEx(file, &size) != 0;
+
+        // The copy-on-write mapping allows the relocations to be applied
+        // without modifying the file.
+        m_mapping = hasSize
+            ? CreateFileMappingA(file, nullptr, PAGE_EXECUTE_WRITECOPY, 0, 0, nullptr)
+            : nullptr;
+        CloseHandle(file);
+
+        LogThrowAssert(m_mapping != nullptr, "Cannot map %s", path);
+
+        m_fileByteLength = static_cast<size_t>(size.QuadPart);
+        m_file = static_cast<uint8_t*>(
+            MapViewOfFile(m_mapping, FILE_MAP_COPY | FILE_MAP_EXECUTE, 0, 0, 0));
+
+        if (m_file == nullptr)
+        {
+            CloseHandle(m_mapping);
+            LogThrowAbort("Cannot map %s", path);
+        }
+
+        try
+        {
+            Load(symbols);
+        }
+        catch (...)
+        {
+            Unmap();
+            throw;
+        }
+
+        if (!RtlAddFunctionTable(&m_runtimeFunction,
+                                 1,
+                                 reinterpret_cast<DWORD64>(m_image)))
+        {
+            Unmap();
+            throw std::runtime_error("Couldn't add function table");
+        }
+    }
+
+
+    ObjectFile::~ObjectFile()
+    {
+        RtlDeleteFunctionTable(&m_runtimeFunction);
+        Unmap();
+    }
+
+
+    void ObjectFile::Unmap()
+    {
+        UnmapViewOfFile(m_file);
+        CloseHandle(m_mapping);
+    }
+#else
+    ObjectFile::ObjectFile(char const * path, SymbolTable const & symbols)
+        : m_file(nullptr),
+          m_fileByteLength(0),
+          m_image(nullptr),
+          m_runtimeFunction()
+    {
+        const int fd = open(path, O_RDONLY);
+        LogThrowAssert(fd >= 0, "Cannot open %s", path);
+
+        struct stat status;
+        void* file = MAP_FAILED;
+
+        if (fstat(fd, &status) == 0 && status.st_size > 0)
+        {
+            m_fileByteLength = static_cast<size_t>(status.st_size);
+
+            // The private mapping allows the relocations to be applied
+            // without modifying the file.
+            file = mmap(nullptr,
+                        m_fileByteLength,
+                        PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE,
+                        fd,
+                        0);
+        }
+
+        close(fd);
+
+        LogThrowAssert(file != MAP_FAILED, "Cannot map %s", path);
+        m_file = static_cast<uint8_t*>(file);
+
+        try
+        {
+            Load(symbols);
+
+            // The code is not modified after the relocation.
+            LogThrowAssert(mprotect(m_file, m_fileByteLength, PROT_READ | PROT_EXEC) == 0,
+                           "Cannot make %s executable",
+                           path);
+        }
+        catch (...)
+        {
+            Unmap();
+            throw;
+        }
+    }
+
+
+    ObjectFile::~ObjectFile()
+    {
+        Unmap();
+    }
+
+
+    void ObjectFile::Unmap()
+    {
+        munmap(m_file, m_fileByteLength);
+    }
+#endif
+
+
+    void const * ObjectFile::GetEntryPoint() const
+    {
+        return m_image + m_runtimeFunction.BeginAddress;
+    }
+
+
+    void ObjectFile::Load(SymbolTable const & symbols)
+    {
+        LogThrowAssert(m_fileByteLength >= sizeof(Header), "Object file is truncated");
+
+        Header header;
+        memcpy(&header, m_file, sizeof(header));
+
+        LogThrowAssert(header.m_magic == c_magic, "Not an object file");
+        LogThrowAssert(header.m_version == c_version,
+                       "Unsupported object file version %u",
+                       header.m_version);
+
+        // The sizes are 32-bit, so the sums below can't overflow 64 bits.
+        const uint64_t relocationsEnd = sizeof(Header)
+            + static_cast<uint64_t>(header.m_relocationCount) * sizeof(Relocation);
+        const uint64_t namesEnd = relocationsEnd + header.m_namesByteLength;
+
+        LogThrowAssert(namesEnd <= header.m_imageOffset
+                       && header.m_imageOffset % c_imageAlignment == 0
+                       && static_cast<uint64_t>(header.m_imageOffset) + header.m_imageByteLength
+                          <= m_fileByteLength,
+                       "Object file is truncated or corrupt");
+
+        LogThrowAssert(header.m_codeStartOffset < header.m_codeEndOffset
+                       && header.m_codeEndOffset <= header.m_imageByteLength
+                       && header.m_unwindInfoStartOffset < header.m_codeStartOffset,
+                       "Invalid code range [%u, %u) in object file",
+                       header.m_codeStartOffset,
+                       header.m_codeEndOffset);
+
+        uint8_t* image = m_file + header.m_imageOffset;
+        char const * names = reinterpret_cast<char const *>(m_file + relocationsEnd);
+
+        for (uint32_t i = 0; i < header.m_relocationCount; ++i)
+        {
+            Relocation relocation;
+            memcpy(&relocation,
+                   m_file + sizeof(Header) + i * sizeof(Relocation),
+                   sizeof(relocation));
+
+            LogThrowAssert(static_cast<uint64_t>(relocation.m_imageOffset) + sizeof(uint64_t)
+                               <= header.m_imageByteLength
+                           && relocation.m_nameOffset < header.m_namesByteLength,
+                           "Invalid relocation %u in object file",
+                           i);
+
+            // The name must be terminated within the names section.
+            char const * name = names + relocation.m_nameOffset;
+            const size_t maxLength = header.m_namesByteLength - relocation.m_nameOffset;
+            LogThrowAssert(memchr(name, '\0', maxLength) != nullptr,
+                           "Invalid name in relocation %u",
+                           i);
+
+            uint64_t address = 0;
+
+            if (!symbols.TryGetAddress(name, address))
+            {
+                LogThrowAbort("Symbol %s is not in the symbol table", name);
+            }
+
+            memcpy(image + relocation.m_imageOffset, &address, sizeof(address));
+        }
+
+        m_image = image;
+        m_runtimeFunction.BeginAddress = header.m_codeStartOffset;
+        m_runtimeFunction.EndAddress = header.m_codeEndOffset;
+        m_runtimeFunction.UnwindData = header.m_unwindInfoStartOffset;
+    }
+}
@@ -0,0 +1,141 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include "NativeJIT/TreeEnsemble.h"
+#include "Temporary/Assert.h"
+
+
+namespace NativeJIT
+{
+    //*************************************************************************
+    //
+    // DecisionTreeNode
+    //
+    //*************************************************************************
+    bool DecisionTreeNode::IsLeaf() const
+    {
+        return m_left == 0;
+    }
+
+
+    //*************************************************************************
+    //
+    // TreeEnsemble
+    //
+    //*************************************************************************
+    TreeEnsemble::TreeEnsemble()
+        : m_featureCount(0)
+    {
+    }
+
+
+    void TreeEnsemble::AddTree(DecisionTreeNode const * nodes, unsigned nodeCount)
+    {
+        LogThrowAssert(nodeCount > 0, "A tree must have at least one node");
+
+        for (unsigned i = 0; i < nodeCount; ++i)
+        {
+            auto const & node = nodes[i];
+
+            if (!node.IsLeaf())
+            {
+                // Children that follow their parent make the tree acyclic.
+                LogThrowAssert(node.m_left > i && node.m_left < nodeCount
+                               && node.m_right > i && node.m_right < nodeCount,
+                               "Invalid children %u and %u of node %u in a tree of %u nodes",
+                               node.m_left,
+                               node.m_right,
+                               i,
+                               nodeCount);
+                LogThrowAssert(node.m_feature < c_maxFeatureCount,
+                               "Feature index %u out of range",
+                               node.m_feature);
+
+                if (node.m_feature >= m_featureCount)
+                {
+                    m_featureCount = node.m_feature + 1;
+                }
+            }
+        }
+
+        m_treeStarts.push_back(static_cast<unsigned>(m_nodes.size()));
+        m_nodes.insert(m_nodes.end(), nodes, nodes + nodeCount);
+    }
+
+
+    unsigned TreeEnsemble::GetTreeCount() const
+    {
+        return static_cast<unsigned>(m_treeStarts.size());
+    }
+
+
+    DecisionTreeNode const * TreeEnsemble::GetNodes() const
+    {
+        return m_nodes.data();
+    }
+
+
+    unsigned TreeEnsemble::GetNodeCount() const
+    {
+        return static_cast<unsigned>(m_nodes.size());
+    }
+
+
+    unsigned TreeEnsemble::GetTreeStart(unsigned tree) const
+    {
+        LogThrowAssert(tree < m_treeStarts.size(), "Tree %u out of range", tree);
+
+        return m_treeStarts[tree];
+    }
+
+
+    unsigned TreeEnsemble::GetFeatureCount() const
+    {
+        return m_featureCount;
+    }
+
+
+    float TreeEnsemble::Evaluate(float const * features) const
+    {
+        float sum = 0;
+
+        for (unsigned tree = 0; tree < m_treeStarts.size(); ++tree)
+        {
+            DecisionTreeNode const * nodes = &m_nodes[m_treeStarts[tree]];
+            unsigned i = 0;
+
+            while (!nodes[i].IsLeaf())
+            {
+                i = features[nodes[i].m_feature] > nodes[i].m_threshold
+                    ? nodes[i].m_right
+                    : nodes[i].m_left;
+            }
+
+            // The first leaf is loaded rather than added to zero, which
+            // preserves the sign of a zero leaf.
+            sum = tree == 0 ? nodes[i].m_leaf : sum + nodes[i].m_leaf;
+        }
+
+        return sum;
+    }
+}
@@ -0,0 +1,191 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <vector>
+
+#include "NativeJIT/ExpressionTree.h"
+#include "NativeJIT/Nodes/TreeEnsembleNode.h"
+#include "NativeJIT/TreeEnsemble.h"
+#include "Temporary/Assert.h"
+
+
+namespace NativeJIT
+{
+    TreeEnsembleNode::TreeEnsembleNode(ExpressionTree& tree,
+                                       Node<float const *>& features,
+                                       TreeEnsemble const & ensemble)
+        : Node<float>(tree),
+          m_features(features),
+          m_ensemble(ensemble),
+          m_offset(0)
+    {
+        LogThrowAssert(ensemble.GetTreeCount() > 0, "The ensemble has no trees");
+
+        tree.AddRIPRelative(*this);
+        m_features.IncrementParentCount();
+    }
+
+
+    ExpressionTree::Storage<float> TreeEnsembleNode::CodeGenValue(ExpressionTree& tree)
+    {
+        auto & code = tree.GetCodeGenerator();
+        auto features = m_features.CodeGen(tree);
+
+        // All the registers are allocated before the first jump since a
+        // spill on one path would not happen on the others.
+        auto featuresRegister = features.ConvertToDirect(false);
+        ReferenceCounter featuresPin = features.GetPin();
+
+        auto result = tree.Direct<float>();
+        ReferenceCounter resultPin = result.GetPin();
+
+        auto value = tree.Direct<float>();
+
+        for (unsigned i = 0; i < m_ensemble.GetTreeCount(); ++i)
+        {
+            Label treeEnd = code.AllocateLabel();
+
+            CodeGenSubtree(code,
+                           featuresRegister,
+                           result.GetDirectRegister(),
+                           value.GetDirectRegister(),
+                           m_ensemble.GetTreeStart(i),
+                           0,
+                           i == 0,
+                           true,
+                           treeEnd);
+
+            code.AlignCode(code.GetCodeAlignment().m_join);
+            code.PlaceLabel(treeEnd);
+        }
+
+        return result;
+    }
+
+
+    void TreeEnsembleNode::CodeGenSubtree(X64CodeGenerator& code,
+                                          Register<8, false> features,
+                                          Register<4, true> result,
+                                          Register<4, true> value,
+                                          unsigned treeStart,
+                                          unsigned index,
+                                          bool isFirstTree,
+                                          bool isLastInTree,
+                                          Label treeEnd) const
+    {
+        auto const & node = m_ensemble.GetNodes()[treeStart + index];
+        const int32_t constant = GetConstantOffset(treeStart + index);
+
+        if (node.IsLeaf())
+        {
+            if (isFirstTree)
+            {
+                code.Emit<OpCode::Mov>(result, rip, constant);
+            }
+            else
+            {
+                code.Emit<OpCode::Add>(result, rip, constant);
+            }
+
+            if (!isLastInTree)
+            {
+                code.Jmp(treeEnd);
+            }
+        }
+        else
+        {
+            Label right = code.AllocateLabel();
+
+            // comiss sets the flags like an unsigned comparison and an
+            // unordered result (NaN) clears neither CF nor ZF, so ja takes
+            // the right branch only if the feature is greater.
+            code.Emit<OpCode::Mov>(value, features, static_cast<int32_t>(node.m_feature * sizeof(float)));
+            code.Emit<OpCode::Cmp>(value, rip, constant);
+            code.EmitConditionalJump<JccType::JA>(right);
+
+            CodeGenSubtree(code, features, result, value, treeStart, node.m_left, isFirstTree, false, treeEnd);
+            code.PlaceLabel(right);
+            CodeGenSubtree(code, features, result, value, treeStart, node.m_right, isFirstTree, isLastInTree, treeEnd);
+        }
+    }
+
+
+    int32_t TreeEnsembleNode::GetConstantOffset(unsigned index) const
+    {
+        return m_offset + static_cast<int32_t>(index * sizeof(float));
+    }
+
+
+    void TreeEnsembleNode::EmitStaticData(ExpressionTree& tree)
+    {
+        // The values of all nodes form a single constant, so that an ensemble
+        // evaluated more than once in the tree is only stored once.
+        auto nodes = m_ensemble.GetNodes();
+        std::vector<float> values(m_ensemble.GetNodeCount());
+
+        for (unsigned i = 0; i < m_ensemble.GetNodeCount(); ++i)
+        {
+            values[i] = nodes[i].IsLeaf() ? nodes[i].m_leaf : nodes[i].m_threshold;
+        }
+
+        tree.AddConstant(values.data(),
+                         static_cast<unsigned>(values.size() * sizeof(float)),
+                         sizeof(float),
+                         false,
+                         m_offset);
+    }
+
+
+    unsigned TreeEnsembleNode::LowerValue(Bytecode& code)
+    {
+        const unsigned features = m_features.Lower(code);
+
+        return code.Emit(&Interpret,
+                         { features },
+                         reinterpret_cast<Bytecode::Slot>(&m_ensemble));
+    }
+
+
+    bool TreeEnsembleNode::Interpret(Bytecode::Slot* slots,
+                                     Bytecode::Instruction const & instruction)
+    {
+        auto ensemble = reinterpret_cast<TreeEnsemble const *>(instruction.m_immediate);
+
+        Bytecode::Write<float>(
+            slots,
+            instruction.m_result,
+            ensemble->Evaluate(Bytecode::Read<float const *>(slots, instruction.m_operands[0])));
+
+        return true;
+    }
+
+
+    void TreeEnsembleNode::Print(std::ostream& out) const
+    {
+        PrintCoreProperties(out, "TreeEnsembleNode");
+
+        out << ", features = " << m_features.GetId()
+            << ", trees = " << m_ensemble.GetTreeCount()
+            << ", nodes = " << m_ensemble.GetNodeCount();
+    }
+}
@@ -636,6 +636,74 @@ namespace NativeJIT
             buffer.Emit<OpCode::Shld>(r12, rbp);
             buffer.Emit<OpCode::Shld>(rbp, r12);
 
+            // Indirect-immediate.
+            buffer.EmitImmediate<OpCode::Add, 8>(rax, 0, 1);
+            buffer.EmitImmediate<OpCode::Add, 8>(rcx, 8, 0x12345678);
+            buffer.EmitImmediate<OpCode::Add, 4>(r12, 0x10, 0x80);
+            buffer.EmitImmediate<OpCode::Add, 2>(rbp, 0, static_cast<uint16_t>(0x1234));
+            buffer.EmitImmediate<OpCode::Add, 1>(r13, -4, static_cast<uint8_t>(0x80));
+            buffer.EmitImmediate<OpCode::Sub, 8>(rsp, 0x100, -1);
+
+            // cmovcc
+            buffer.EmitConditionalMove<JccType::JNE>(rax, rbx);
+            buffer.EmitConditionalMove<JccType::JAE>(r12d, ecx);
+            buffer.EmitConditionalMove<JccType::JL>(cx, r9w);
+            buffer.EmitConditionalMove<JccType::JG>(rbx, rbp, -8);
+            buffer.EmitConditionalMove<JccType::JO>(r10d, r12, 0x12);
+
+            // Group 3 - div, idiv, mul, imul (one operand), neg and not.
+            buffer.Emit<OpCode::Div>(ecx);
+            buffer.Emit<OpCode::Div>(r9);
+            buffer.Emit<OpCode::IDiv>(rbx);
+            buffer.Emit<OpCode::IDiv>(r10w);
+            buffer.Emit<OpCode::Mul>(rsi);
+            buffer.Emit<OpCode::IMul>(r11);
+            buffer.Emit<OpCode::Neg>(al);
+            buffer.Emit<OpCode::Neg>(r12);
+            buffer.Emit<OpCode::Not>(edx);
+            buffer.Emit<OpCode::Not>(sil);
+
+            // cwd, cdq and cqo.
+            buffer.EmitSignExtendAccumulator<2>();
+            buffer.EmitSignExtendAccumulator<4>();
+            buffer.EmitSignExtendAccumulator<8>();
+
+            // Arithmetic shift right.
+            buffer.Emit<OpCode::Sar>(rdx);
+            buffer.EmitImmediate<OpCode::Sar>(r13d, static_cast<uint8_t>(7));
+
+            // Floating point division and xor.
+            buffer.Emit<OpCode::Div>(xmm1s, xmm2s);
+            buffer.Emit<OpCode::Div>(xmm9, r9, 0x20);
+            buffer.Emit<OpCode::Xor>(xmm1s, xmm1s);
+            buffer.Emit<OpCode::Xor>(xmm10, xmm3);
+
+            // Bit scan and count.
+            buffer.Emit<OpCode::Popcnt>(eax, ebx);
+            buffer.Emit<OpCode::Popcnt>(r9, rsi);
+            buffer.Emit<OpCode::Popcnt>(cx, r12w);
+            buffer.Emit<OpCode::Popcnt>(r10d, rbp, 0x10);
+            buffer.Emit<OpCode::Lzcnt>(rax, r13);
+            buffer.Emit<OpCode::Lzcnt>(dx, cx);
+            buffer.Emit<OpCode::Tzcnt>(r8d, esp);
+            buffer.Emit<OpCode::Tzcnt>(rbx, r12, -8);
+            buffer.Emit<OpCode::Bsf>(ecx, edx);
+            buffer.Emit<OpCode::Bsr>(r11, rdi);
+
+            // BMI1 and BMI2.
+            buffer.Emit<OpCode::Bextr>(eax, ebx, ecx);
+            buffer.Emit<OpCode::Bextr>(r9, r10, r11);
+            buffer.Emit<OpCode::Bextr>(rdx, r13, rsi);
+            buffer.Emit<OpCode::Pdep>(eax, ebx, ecx);
+            buffer.Emit<OpCode::Pdep>(r12, r14, rdi);
+            buffer.Emit<OpCode::Pext>(esi, r8d, r15d);
+            buffer.Emit<OpCode::Pext>(rbx, rcx, rdx);
+
+            // FMA.
+            buffer.Emit<OpCode::Vfmadd231>(xmm1s, xmm2s, xmm3s);
+            buffer.Emit<OpCode::Vfmadd231>(xmm0, xmm9, xmm15);
+            buffer.Emit<OpCode::Vfmadd231>(xmm12, xmm4, xmm10);
+
             // floating point
             // signed
 
@@ -1415,7 +1483,109 @@ namespace NativeJIT
                 " 0000068E  66| 0F A5 D8         shld ax, bx, cl                                                    \n"
                 " 00000692  0F A5 F2             shld edx, esi, cl                                                  \n"
                 " 00000695  49/ 0F A5 EC         shld r12, rbp, cl                                                  \n"
-                " 00000699  4C/ 0F A5 E5         shld rbp, r12, cl                                                  \n";
+                " 00000699  4C/ 0F A5 E5         shld rbp, r12, cl                                                  \n"
+                "                                                                                                   \n"
+                "                                ;                                                                  \n"
+                "                                ; Indirect-immediate                                               \n"
+                "                                ;                                                                  \n"
+                "                                                                                                   \n"
+                " 0000069D  48/ 83 00 01         add qword ptr [rax], 1                                             \n"
+                " 000006A1  48/ 81 41 08         add qword ptr [rcx + 8], 12345678h                                 \n"
+                "           12345678                                                                                \n"
+                " 000006A9  41/ 81 44 24         add dword ptr [r12 + 10h], 80h                                     \n"
+                "           10 00000080                                                                             \n"
+                " 000006B2  66| 81 45 00         add word ptr [rbp], 1234h                                          \n"
+                "           1234                                                                                    \n"
+                " 000006B8  41/ 80 45 FC         add byte ptr [r13 - 4], 80h                                        \n"
+                "           80                                                                                      \n"
+                " 000006BD  48/ 83 AC 24         sub qword ptr [rsp + 100h], -1                                     \n"
+                "           00000100 FF                                                                             \n"
+                "                                                                                                   \n"
+                "                                ;                                                                  \n"
+                "                                ; cmovcc                                                           \n"
+                "                                ;                                                                  \n"
+                "                                                                                                   \n"
+                " 000006C6  48/ 0F 45 C3         cmovne rax, rbx                                                    \n"
+                " 000006CA  44/ 0F 43 E1         cmovae r12d, ecx                                                   \n"
+                " 000006CE  66| 41/ 0F 4C C9     cmovl cx, r9w                                                      \n"
+                " 000006D3  48/ 0F 4F 5D F8      cmovg rbx, qword ptr [rbp - 8]                                     \n"
+                " 000006D8  45/ 0F 40 54 24      cmovo r10d, dword ptr [r12 + 12h]                                  \n"
+                "           12                                                                                      \n"
+                "                                                                                                   \n"
+                "                                ;                                                                  \n"
+                "                                ; Group 3 - div, idiv, mul, imul, neg and not                      \n"
+                "                                ;                                                                  \n"
+                "                                                                                                   \n"
+                " 000006DE  F7 F1                div ecx                                                            \n"
+                " 000006E0  49/ F7 F1            div r9                                                             \n"
+                " 000006E3  48/ F7 FB            idiv rbx                                                           \n"
+                " 000006E6  66| 41/ F7 FA        idiv r10w                                                          \n"
+                " 000006EA  48/ F7 E6            mul rsi                                                            \n"
+                " 000006ED  49/ F7 EB            imul r11                                                           \n"
+                " 000006F0  F6 D8                neg al                                                             \n"
+                " 000006F2  49/ F7 DC            neg r12                                                            \n"
+                " 000006F5  F7 D2                not edx                                                            \n"
+                " 000006F7  40/ F6 D6            not sil                                                            \n"
+                "                                                                                                   \n"
+                "                                ;                                                                  \n"
+                "                                ; cwd, cdq and cqo                                                 \n"
+                "                                ;                                                                  \n"
+                "                                                                                                   \n"
+                " 000006FA  66| 99               cwd                                                                \n"
+                " 000006FC  99                   cdq                                                                \n"
+                " 000006FD  48/ 99               cqo                                                                \n"
+                "                                                                                                   \n"
+                "                                ;                                                                  \n"
+                "                                ; Arithmetic shift right                                           \n"
+                "                                ;                                                                  \n"
+                "                                                                                                   \n"
+                " 000006FF  48/ D3 FA            sar rdx, cl                                                        \n"
+                " 00000702  41/ C1 FD 07         sar r13d, 7                                                        \n"
+                "                                                                                                   \n"
+                "                                ;                                                                  \n"
+                "                                ; Floating point division and xor                                  \n"
+                "                                ;                                                                  \n"
+                "                                                                                                   \n"
+                " 00000706  F3/ 0F 5E CA         divss xmm1, xmm2                                                   \n"
+                " 0000070A  F2/ 45/ 0F 5E 49 20  divsd xmm9, qword ptr [r9 + 20h]                                   \n"
+                " 00000710  0F 57 C9             xorps xmm1, xmm1                                                   \n"
+                " 00000713  66| 44/ 0F 57 D3     xorpd xmm10, xmm3                                                  \n"
+                "                                                                                                   \n"
+                "                                ;                                                                  \n"
+                "                                ; Bit scan and count                                               \n"
+                "                                ;                                                                  \n"
+                "                                                                                                   \n"
+                " 00000718  F3/ 0F B8 C3         popcnt eax, ebx                                                    \n"
+                " 0000071C  F3/ 4C/ 0F B8 CE     popcnt r9, rsi                                                     \n"
+                " 00000721  66| F3/ 41/ 0F B8 CC popcnt cx, r12w                                                    \n"
+                " 00000727  F3/ 44/ 0F B8 55 10  popcnt r10d, dword ptr [rbp + 10h]                                 \n"
+                " 0000072D  F3/ 49/ 0F BD C5     lzcnt rax, r13                                                     \n"
+                " 00000732  66| F3/ 0F BD D1     lzcnt dx, cx                                                       \n"
+                " 00000737  F3/ 44/ 0F BC C4     tzcnt r8d, esp                                                     \n"
+                " 0000073C  F3/ 49/ 0F BC 5C 24  tzcnt rbx, qword ptr [r12 - 8]                                     \n"
+                "           F8                                                                                      \n"
+                " 00000743  0F BC CA             bsf ecx, edx                                                       \n"
+                " 00000746  4C/ 0F BD DF         bsr r11, rdi                                                       \n"
+                "                                                                                                   \n"
+                "                                ;                                                                  \n"
+                "                                ; BMI1 and BMI2                                                    \n"
+                "                                ;                                                                  \n"
+                "                                                                                                   \n"
+                " 0000074A  C4 E2 70 F7 C3       bextr eax, ebx, ecx                                                \n"
+                " 0000074F  C4 42 A0 F7 CA       bextr r9, r10, r11                                                 \n"
+                " 00000754  C4 C2 C8 F7 D5       bextr rdx, r13, rsi                                                \n"
+                " 00000759  C4 E2 63 F5 C1       pdep eax, ebx, ecx                                                 \n"
+                " 0000075E  C4 62 8B F5 E7       pdep r12, r14, rdi                                                 \n"
+                " 00000763  C4 C2 3A F5 F7       pext esi, r8d, r15d                                                \n"
+                " 00000768  C4 E2 F2 F5 DA       pext rbx, rcx, rdx                                                 \n"
+                "                                                                                                   \n"
+                "                                ;                                                                  \n"
+                "                                ; FMA                                                              \n"
+                "                                ;                                                                  \n"
+                "                                                                                                   \n"
+                " 0000076D  C4 E2 69 B9 CB       vfmadd231ss xmm1, xmm2, xmm3                                       \n"
+                " 00000772  C4 C2 B1 B9 C7       vfmadd231sd xmm0, xmm9, xmm15                                      \n"
+                " 00000777  C4 42 D9 B9 E2       vfmadd231sd xmm12, xmm4, xmm10                                     \n";
 
             ML64Verifier v(ml64Output.c_str(), start);
         }
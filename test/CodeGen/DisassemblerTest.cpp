@@ -0,0 +1,721 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <utility>              // For std::integer_sequence.
+#include <vector>
+
+#include "NativeJIT/CodeGen/Disassembler.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/CodeGen/FunctionSpecification.h"
+#include "TestSetup.h"
+
+
+namespace NativeJIT
+{
+    namespace CodeGenUnitTest
+    {
+        TEST_FIXTURE_START(DisassemblerTest)
+
+        public:
+            DisassemblerTest()
+                : m_code(nullptr),
+                  m_rng(c_seed)
+            {
+            }
+
+        protected:
+            static const unsigned c_seed = 1234;
+            static const unsigned c_iterationCount = 500;
+
+            //
+            // Random operands.
+            //
+
+            template <unsigned SIZE, bool ISFLOAT>
+            Register<SIZE, ISFLOAT> RandomRegister()
+            {
+                return Register<SIZE, ISFLOAT>(m_rng() % 16);
+            }
+
+
+            // Any general purpose register can be the base, including the ones
+            // which need special encodings (rsp, rbp, r12 and r13).
+            Register<8, false> RandomBase()
+            {
+                return RandomRegister<8, false>();
+            }
+
+
+            // Zero, 8-bit or 32-bit displacement.
+            int32_t RandomOffset()
+            {
+                switch (m_rng() % 3)
+                {
+                case 0:     return 0;
+                case 1:     return static_cast<int8_t>(m_rng());
+                default:    return static_cast<int32_t>(m_rng());
+                }
+            }
+
+
+            // Half of the values fit in a signed byte so that the short forms
+            // of the instructions get exercised.
+            template <typename T>
+            T RandomValue()
+            {
+                return (m_rng() % 2 == 0)
+                    ? static_cast<T>(static_cast<int8_t>(m_rng()))
+                    : static_cast<T>((static_cast<uint64_t>(m_rng()) << 32) | m_rng());
+            }
+
+
+            //
+            // Expected operands.
+            //
+
+            // Any general purpose register other than rsp can be the index.
+            Register<8, false> RandomIndex()
+            {
+                const unsigned id = m_rng() % 15;
+
+                return Register<8, false>(id < 4 ? id : id + 1);
+            }
+
+
+            uint8_t RandomScale()
+            {
+                return static_cast<uint8_t>(1 << (m_rng() % 4));
+            }
+
+
+            template <unsigned SIZE, bool ISFLOAT>
+            static Operand Direct(Register<SIZE, ISFLOAT> r)
+            {
+                return Operand::Direct(SIZE, ISFLOAT, r.GetId());
+            }
+
+
+            static Operand Indirect(unsigned size, Register<8, false> base, int32_t offset)
+            {
+                return Operand::Indirect(size, base.GetId(), offset);
+            }
+
+
+            static Operand Indirect(unsigned size,
+                                    Register<8, false> base,
+                                    Register<8, false> index,
+                                    uint8_t scale,
+                                    int32_t offset)
+            {
+                return Operand::Indirect(size, base.GetId(), index.GetId(), scale, offset);
+            }
+
+
+            template <typename T>
+            static Operand Immediate(unsigned size, T value)
+            {
+                return Operand::Immediate(size, static_cast<int64_t>(value));
+            }
+
+
+            // Emits an instruction and verifies that it decodes to the
+            // mnemonic and operands.
+            template <typename EMIT>
+            void Check(char const * mnemonic,
+                       std::vector<Operand> expected,
+                       EMIT emit)
+            {
+                const unsigned start = m_code->CurrentPosition();
+                emit();
+                const unsigned end = m_code->CurrentPosition();
+
+                std::ostringstream bytes;
+                bytes << std::hex << std::setfill('0');
+
+                for (unsigned i = start; i < end; ++i)
+                {
+                    bytes << std::setw(2) << static_cast<unsigned>(m_code->BufferStart()[i]) << ' ';
+                }
+
+                Instruction instruction;
+                ASSERT_TRUE(DecodeInstruction(m_code->BufferStart(), start, end, instruction))
+                    << "Failed to decode " << mnemonic << ": " << bytes.str();
+
+                std::ostringstream text;
+                instruction.Print(text);
+
+                ASSERT_EQ(end - start, instruction.m_length) << text.str() << ": " << bytes.str();
+                ASSERT_STREQ(mnemonic, instruction.m_mnemonic) << text.str() << ": " << bytes.str();
+                ASSERT_EQ(expected.size(), instruction.m_operandCount) << text.str();
+
+                for (unsigned i = 0; i < expected.size(); ++i)
+                {
+                    Operand actual = instruction.m_operands[i];
+
+                    // Immediates only need to agree in the bits that the
+                    // operation uses, since the encoder picks the size.
+                    if (actual.m_kind == Operand::Kind::Immediate)
+                    {
+                        actual.m_value = Truncate(actual.m_value, actual.m_size);
+                        expected[i].m_value = Truncate(expected[i].m_value, expected[i].m_size);
+                    }
+
+                    ASSERT_TRUE(expected[i] == actual)
+                        << "Operand " << i << " of " << text.str() << ": " << bytes.str();
+                }
+            }
+
+
+            static int64_t Truncate(int64_t value, unsigned size)
+            {
+                return size >= 8
+                    ? value
+                    : static_cast<int64_t>(static_cast<uint64_t>(value) & ((1ull << (size * 8)) - 1));
+            }
+
+
+            //
+            // Instruction forms, by the X64CodeGenerator method which emits
+            // them.
+            //
+
+            template <OpCode OP, unsigned SIZE>
+            void Group1(char const * mnemonic)
+            {
+                const auto dest = RandomRegister<SIZE, false>();
+                const auto src = RandomRegister<SIZE, false>();
+                const auto base = RandomBase();
+                const int32_t offset = RandomOffset();
+                auto & code = *m_code;
+
+                Check(mnemonic, { Direct(dest), Direct(src) },
+                      [&] { code.Emit<OP>(dest, src); });
+                Check(mnemonic, { Direct(dest), Indirect(SIZE, base, offset) },
+                      [&] { code.Emit<OP>(dest, base, offset); });
+                Check(mnemonic, { Indirect(SIZE, base, offset), Direct(src) },
+                      [&] { code.Emit<OP>(base, offset, src); });
+
+                const auto value = RandomValue<typename std::conditional<SIZE == 1, int8_t, int32_t>::type>();
+
+                // Immediates of the operand size, except for 64-bit operands
+                // which take sign extended 32-bit immediates.
+                const auto sizedValue = static_cast<typename std::conditional<SIZE == 1, int8_t,
+                                                    typename std::conditional<SIZE == 2, int16_t, int32_t>::type>::type>(value);
+
+                Check(mnemonic, { Direct(dest), Immediate(SIZE, sizedValue) },
+                      [&] { code.EmitImmediate<OP>(dest, sizedValue); });
+            }
+
+
+            template <OpCode OP, unsigned SIZE>
+            void Group1Indirect(char const * mnemonic)
+            {
+                const auto base = RandomBase();
+                const int32_t offset = RandomOffset();
+                const auto value = static_cast<typename std::conditional<SIZE == 1, int8_t,
+                                                 typename std::conditional<SIZE == 2, int16_t, int32_t>::type>::type>(
+                                                     RandomValue<int32_t>());
+                auto & code = *m_code;
+
+                Check(mnemonic, { Indirect(SIZE, base, offset), Immediate(SIZE, value) },
+                      [&] { code.EmitImmediate<OP, SIZE>(base, offset, value); });
+            }
+
+
+            template <unsigned SIZE>
+            void Integer()
+            {
+                Group1<OpCode::Add, SIZE>("add");
+                Group1<OpCode::And, SIZE>("and");
+                Group1<OpCode::Cmp, SIZE>("cmp");
+                Group1<OpCode::Mov, SIZE>("mov");
+                Group1<OpCode::Or, SIZE>("or");
+                Group1<OpCode::Sub, SIZE>("sub");
+                Group1<OpCode::Xor, SIZE>("xor");
+
+                Group1Indirect<OpCode::Add, SIZE>("add");
+                Group1Indirect<OpCode::And, SIZE>("and");
+                Group1Indirect<OpCode::Cmp, SIZE>("cmp");
+                Group1Indirect<OpCode::Or, SIZE>("or");
+                Group1Indirect<OpCode::Sub, SIZE>("sub");
+                Group1Indirect<OpCode::Xor, SIZE>("xor");
+
+                const auto dest = RandomRegister<SIZE, false>();
+                const auto shift = static_cast<uint8_t>(m_rng() % (SIZE * 8));
+                auto & code = *m_code;
+
+                Check("rol", { Direct(dest), Immediate(1, shift) },
+                      [&] { code.EmitImmediate<OpCode::Rol>(dest, shift); });
+                Check("shl", { Direct(dest), Immediate(1, shift) },
+                      [&] { code.EmitImmediate<OpCode::Shl>(dest, shift); });
+                Check("shr", { Direct(dest), Immediate(1, shift) },
+                      [&] { code.EmitImmediate<OpCode::Shr>(dest, shift); });
+                Check("sar", { Direct(dest), Immediate(1, shift) },
+                      [&] { code.EmitImmediate<OpCode::Sar>(dest, shift); });
+                Check("shl", { Direct(dest), Direct(cl) },
+                      [&] { code.Emit<OpCode::Shl>(dest); });
+
+                Check("div", { Direct(dest) }, [&] { code.Emit<OpCode::Div>(dest); });
+                Check("idiv", { Direct(dest) }, [&] { code.Emit<OpCode::IDiv>(dest); });
+                Check("mul", { Direct(dest) }, [&] { code.Emit<OpCode::Mul>(dest); });
+                Check("imul", { Direct(dest) }, [&] { code.Emit<OpCode::IMul>(dest); });
+                Check("neg", { Direct(dest) }, [&] { code.Emit<OpCode::Neg>(dest); });
+                Check("not", { Direct(dest) }, [&] { code.Emit<OpCode::Not>(dest); });
+
+                // Full width immediate.
+                const auto value = RandomValue<typename std::conditional<SIZE == 1, uint8_t,
+                                                   typename std::conditional<SIZE == 2, uint16_t,
+                                                       typename std::conditional<SIZE == 4, uint32_t, uint64_t>::type>::type>::type>();
+
+                Check("mov", { Direct(dest), Immediate(SIZE, value) },
+                      [&] { code.EmitImmediate<OpCode::Mov>(dest, value); });
+            }
+
+
+            template <unsigned SIZE>
+            void Multiword()
+            {
+                const auto dest = RandomRegister<SIZE, false>();
+                const auto src = RandomRegister<SIZE, false>();
+                const auto base = RandomBase();
+                const int32_t offset = RandomOffset();
+                const auto value = static_cast<typename std::conditional<SIZE == 2, int16_t, int32_t>::type>(
+                                       RandomValue<int32_t>());
+                const auto shift = static_cast<uint8_t>(m_rng() % (SIZE * 8));
+                auto & code = *m_code;
+
+                Check("imul", { Direct(dest), Direct(src) },
+                      [&] { code.Emit<OpCode::IMul>(dest, src); });
+                Check("imul", { Direct(dest), Indirect(SIZE, base, offset) },
+                      [&] { code.Emit<OpCode::IMul>(dest, base, offset); });
+                Check("imul", { Direct(dest), Direct(dest), Immediate(SIZE, value) },
+                      [&] { code.EmitImmediate<OpCode::IMul>(dest, value); });
+
+                Check("shld", { Direct(dest), Direct(src), Immediate(1, shift) },
+                      [&] { code.EmitImmediate<OpCode::Shld>(dest, src, shift); });
+                Check("shld", { Direct(dest), Direct(src), Direct(cl) },
+                      [&] { code.Emit<OpCode::Shld>(dest, src); });
+
+                Check(SIZE == 2 ? "cwd" : (SIZE == 4 ? "cdq" : "cqo"), {},
+                      [&] { code.EmitSignExtendAccumulator<SIZE>(); });
+
+                ConditionalMoves<SIZE>(std::make_integer_sequence<unsigned, 16>());
+            }
+
+
+            template <unsigned SIZE, unsigned... JCC>
+            void ConditionalMoves(std::integer_sequence<unsigned, JCC...>)
+            {
+                // Expands to one call per condition.
+                int unused[] = { (ConditionalMove<static_cast<JccType>(JCC), SIZE>(), 0)... };
+                (void)unused;
+            }
+
+
+            template <JccType JCC, unsigned SIZE>
+            void ConditionalMove()
+            {
+                const auto dest = RandomRegister<SIZE, false>();
+                const auto src = RandomRegister<SIZE, false>();
+                const auto base = RandomBase();
+                const int32_t offset = RandomOffset();
+                auto & code = *m_code;
+
+                const std::string mnemonic
+                    = std::string("cmov") + (X64CodeGenerator::JccName(JCC) + 1);
+
+                Check(mnemonic.c_str(), { Direct(dest), Direct(src) },
+                      [&] { code.EmitConditionalMove<JCC>(dest, src); });
+                Check(mnemonic.c_str(), { Direct(dest), Indirect(SIZE, base, offset) },
+                      [&] { code.EmitConditionalMove<JCC>(dest, base, offset); });
+            }
+
+
+            template <unsigned SIZE>
+            void BitScan()
+            {
+                const auto dest = RandomRegister<SIZE, false>();
+                const auto src = RandomRegister<SIZE, false>();
+                const auto base = RandomBase();
+                const int32_t offset = RandomOffset();
+                auto & code = *m_code;
+
+                Check("bsf", { Direct(dest), Direct(src) },
+                      [&] { code.Emit<OpCode::Bsf>(dest, src); });
+                Check("bsr", { Direct(dest), Indirect(SIZE, base, offset) },
+                      [&] { code.Emit<OpCode::Bsr>(dest, base, offset); });
+                Check("lzcnt", { Direct(dest), Direct(src) },
+                      [&] { code.Emit<OpCode::Lzcnt>(dest, src); });
+                Check("popcnt", { Direct(dest), Direct(src) },
+                      [&] { code.Emit<OpCode::Popcnt>(dest, src); });
+                Check("popcnt", { Direct(dest), Indirect(SIZE, base, offset) },
+                      [&] { code.Emit<OpCode::Popcnt>(dest, base, offset); });
+                Check("tzcnt", { Direct(dest), Direct(src) },
+                      [&] { code.Emit<OpCode::Tzcnt>(dest, src); });
+            }
+
+
+            template <unsigned SIZE>
+            void Bmi()
+            {
+                const auto dest = RandomRegister<SIZE, false>();
+                const auto src1 = RandomRegister<SIZE, false>();
+                const auto src2 = RandomRegister<SIZE, false>();
+                auto & code = *m_code;
+
+                Check("bextr", { Direct(dest), Direct(src1), Direct(src2) },
+                      [&] { code.Emit<OpCode::Bextr>(dest, src1, src2); });
+                Check("pdep", { Direct(dest), Direct(src1), Direct(src2) },
+                      [&] { code.Emit<OpCode::Pdep>(dest, src1, src2); });
+                Check("pext", { Direct(dest), Direct(src1), Direct(src2) },
+                      [&] { code.Emit<OpCode::Pext>(dest, src1, src2); });
+            }
+
+
+            template <unsigned SIZE1, unsigned SIZE2>
+            void Extend()
+            {
+                const auto dest = RandomRegister<SIZE1, false>();
+                const auto src = RandomRegister<SIZE2, false>();
+                const auto base = RandomBase();
+                const int32_t offset = RandomOffset();
+                auto & code = *m_code;
+
+                // There is no movzx from 32 bits, X64CodeGenerator uses a
+                // 32-bit mov which clears the upper bits.
+                if (SIZE2 == 4)
+                {
+                    const Register<4, false> dest4(dest);
+
+                    Check("mov", { Direct(dest4), Direct(src) },
+                          [&] { code.Emit<OpCode::MovZX>(dest, src); });
+                    Check("mov", { Direct(dest4), Indirect(4, base, offset) },
+                          [&] { code.Emit<OpCode::MovZX, SIZE1, false, SIZE2, false>(dest, base, offset); });
+                    Check("movsxd", { Direct(dest), Direct(src) },
+                          [&] { code.Emit<OpCode::MovSX>(dest, src); });
+                    Check("movsxd", { Direct(dest), Indirect(4, base, offset) },
+                          [&] { code.Emit<OpCode::MovSX, SIZE1, false, SIZE2, false>(dest, base, offset); });
+                }
+                else
+                {
+                    Check("movzx", { Direct(dest), Direct(src) },
+                          [&] { code.Emit<OpCode::MovZX>(dest, src); });
+                    Check("movzx", { Direct(dest), Indirect(SIZE2, base, offset) },
+                          [&] { code.Emit<OpCode::MovZX, SIZE1, false, SIZE2, false>(dest, base, offset); });
+                    Check("movsx", { Direct(dest), Direct(src) },
+                          [&] { code.Emit<OpCode::MovSX>(dest, src); });
+                    Check("movsx", { Direct(dest), Indirect(SIZE2, base, offset) },
+                          [&] { code.Emit<OpCode::MovSX, SIZE1, false, SIZE2, false>(dest, base, offset); });
+                }
+            }
+
+
+            template <unsigned SIZE>
+            void Float(char const * suffix)
+            {
+                const auto dest = RandomRegister<SIZE, true>();
+                const auto src = RandomRegister<SIZE, true>();
+                const auto src2 = RandomRegister<SIZE, true>();
+                const auto base = RandomBase();
+                const int32_t offset = RandomOffset();
+                auto & code = *m_code;
+
+                const std::string scalar(suffix);
+                const std::string packed(SIZE == 8 ? "pd" : "ps");
+
+                Check(("add" + scalar).c_str(), { Direct(dest), Direct(src) },
+                      [&] { code.Emit<OpCode::Add>(dest, src); });
+                Check(("add" + scalar).c_str(), { Direct(dest), Indirect(SIZE, base, offset) },
+                      [&] { code.Emit<OpCode::Add>(dest, base, offset); });
+                Check(("sub" + scalar).c_str(), { Direct(dest), Direct(src) },
+                      [&] { code.Emit<OpCode::Sub>(dest, src); });
+                Check(("mul" + scalar).c_str(), { Direct(dest), Indirect(SIZE, base, offset) },
+                      [&] { code.Emit<OpCode::IMul>(dest, base, offset); });
+                Check(("div" + scalar).c_str(), { Direct(dest), Direct(src) },
+                      [&] { code.Emit<OpCode::Div>(dest, src); });
+                Check(("div" + scalar).c_str(), { Direct(dest), Indirect(SIZE, base, offset) },
+                      [&] { code.Emit<OpCode::Div>(dest, base, offset); });
+                Check(("xor" + packed).c_str(), { Direct(dest), Direct(src) },
+                      [&] { code.Emit<OpCode::Xor>(dest, src); });
+                Check(("comi" + scalar).c_str(), { Direct(dest), Direct(src) },
+                      [&] { code.Emit<OpCode::Cmp>(dest, src); });
+                Check(("comi" + scalar).c_str(), { Direct(dest), Indirect(SIZE, base, offset) },
+                      [&] { code.Emit<OpCode::Cmp>(dest, base, offset); });
+                Check(("vfmadd231" + scalar).c_str(), { Direct(dest), Direct(src), Direct(src2) },
+                      [&] { code.Emit<OpCode::Vfmadd231>(dest, src, src2); });
+
+                Check(("mov" + scalar).c_str(), { Direct(dest), Direct(src) },
+                      [&] { code.Emit<OpCode::Mov>(dest, src); });
+                Check(("mov" + scalar).c_str(), { Direct(dest), Indirect(SIZE, base, offset) },
+                      [&] { code.Emit<OpCode::Mov>(dest, base, offset); });
+                Check(("mov" + scalar).c_str(), { Indirect(SIZE, base, offset), Direct(src) },
+                      [&] { code.Emit<OpCode::Mov>(base, offset, src); });
+
+                // The memory forms of the aligned moves always access 16 bytes.
+                Check(("mova" + packed).c_str(), { Direct(dest), Direct(src) },
+                      [&] { code.Emit<OpCode::MovAP>(dest, src); });
+                Check(("mova" + packed).c_str(), { Direct(dest), Indirect(16, base, offset) },
+                      [&] { code.Emit<OpCode::MovAP>(dest, base, offset); });
+                Check(("mova" + packed).c_str(), { Indirect(16, base, offset), Direct(src) },
+                      [&] { code.Emit<OpCode::MovAP>(base, offset, src); });
+
+                const auto gpr = RandomRegister<SIZE, false>();
+
+                Check(SIZE == 8 ? "movq" : "movd", { Direct(dest), Direct(gpr) },
+                      [&] { code.Emit<OpCode::Mov>(dest, gpr); });
+            }
+
+
+            template <unsigned FLOATSIZE, unsigned INTSIZE>
+            void Conversion()
+            {
+                const auto xmm = RandomRegister<FLOATSIZE, true>();
+                const auto gpr = RandomRegister<INTSIZE, false>();
+                const auto base = RandomBase();
+                const int32_t offset = RandomOffset();
+                auto & code = *m_code;
+
+                char const * toFloat = FLOATSIZE == 8 ? "cvtsi2sd" : "cvtsi2ss";
+                char const * toInt = FLOATSIZE == 8 ? "cvttsd2si" : "cvttss2si";
+
+                Check(toFloat, { Direct(xmm), Direct(gpr) },
+                      [&] { code.Emit<OpCode::CvtSI2FP>(xmm, gpr); });
+                Check(toFloat, { Direct(xmm), Indirect(INTSIZE, base, offset) },
+                      [&] { code.Emit<OpCode::CvtSI2FP, FLOATSIZE, true, INTSIZE, false>(xmm, base, offset); });
+                Check(toInt, { Direct(gpr), Direct(xmm) },
+                      [&] { code.Emit<OpCode::CvtFP2SI>(gpr, xmm); });
+                Check(toInt, { Direct(gpr), Indirect(FLOATSIZE, base, offset) },
+                      [&] { code.Emit<OpCode::CvtFP2SI, INTSIZE, false, FLOATSIZE, true>(gpr, base, offset); });
+
+                const auto other = RandomRegister<12 - FLOATSIZE, true>();
+
+                Check(FLOATSIZE == 8 ? "cvtss2sd" : "cvtsd2ss", { Direct(xmm), Direct(other) },
+                      [&] { code.Emit<OpCode::CvtFP2FP>(xmm, other); });
+                Check(FLOATSIZE == 8 ? "cvtss2sd" : "cvtsd2ss", { Direct(xmm), Indirect(12 - FLOATSIZE, base, offset) },
+                      [&] { code.Emit<OpCode::CvtFP2FP, FLOATSIZE, true, 12 - FLOATSIZE, true>(xmm, base, offset); });
+            }
+
+
+            void Miscellaneous()
+            {
+                const auto r = RandomRegister<8, false>();
+                const auto r4 = RandomRegister<4, false>();
+                const auto base = RandomBase();
+                const int32_t offset = RandomOffset();
+                auto & code = *m_code;
+
+                Check("push", { Direct(r) }, [&] { code.Emit<OpCode::Push>(r); });
+                Check("pop", { Direct(r) }, [&] { code.Emit<OpCode::Pop>(r); });
+                Check("call", { Direct(r) }, [&] { code.Emit<OpCode::Call>(r); });
+                Check("ret", {}, [&] { code.Emit<OpCode::Ret>(); });
+
+                Check("lea", { Direct(r), Indirect(8, base, offset) },
+                      [&] { code.Emit<OpCode::Lea>(r, base, offset); });
+                Check("lea", { Direct(r4), Indirect(4, base, offset) },
+                      [&] { code.Emit<OpCode::Lea>(r4, base, offset); });
+
+                // RIP-relative operands are described by the target offset.
+                const unsigned target = m_rng() % (code.CurrentPosition() + 1);
+                const auto xmm = RandomRegister<8, true>();
+
+                Check("mov", { Direct(r), Indirect(8, rip, target) },
+                      [&] { code.Emit<OpCode::Mov>(r, rip, target); });
+                Check("movsd", { Direct(xmm), Indirect(8, rip, target) },
+                      [&] { code.Emit<OpCode::Mov>(xmm, rip, target); });
+            }
+
+
+            // Memory operands with a scaled index, which use the same helpers
+            // as the other memory operands except for the REX and SIB bytes.
+            template <unsigned SIZE>
+            void Indexed()
+            {
+                const auto r = RandomRegister<SIZE, false>();
+                const auto r8 = RandomRegister<8, false>();
+                const auto base = RandomBase();
+                const auto index = RandomIndex();
+                const uint8_t scale = RandomScale();
+                const int32_t offset = RandomOffset();
+                auto & code = *m_code;
+
+                Check("mov", { Direct(r), Indirect(SIZE, base, index, scale, offset) },
+                      [&] { code.Emit<OpCode::Mov>(r, base, index, scale, offset); });
+                Check("mov", { Indirect(SIZE, base, index, scale, offset), Direct(r) },
+                      [&] { code.Emit<OpCode::Mov>(base, index, scale, offset, r); });
+                Check("add", { Direct(r), Indirect(SIZE, base, index, scale, offset) },
+                      [&] { code.Emit<OpCode::Add>(r, base, index, scale, offset); });
+
+                Check("movzx", { Direct(r8), Indirect(2, base, index, scale, offset) },
+                      [&] { code.Emit<OpCode::MovZX, 8, false, 2, false>(r8, base, index, scale, offset); });
+            }
+
+
+            template <unsigned SIZE>
+            void IndexedFloat()
+            {
+                const auto r = RandomRegister<SIZE, false>();
+                const auto xmm = RandomRegister<SIZE, true>();
+                const auto base = RandomBase();
+                const auto index = RandomIndex();
+                const uint8_t scale = RandomScale();
+                const int32_t offset = RandomOffset();
+                auto & code = *m_code;
+
+                char const * mnemonic = SIZE == 8 ? "movsd" : "movss";
+
+                Check("lea", { Direct(r), Indirect(SIZE, base, index, scale, offset) },
+                      [&] { code.Emit<OpCode::Lea>(r, base, index, scale, offset); });
+                Check(mnemonic, { Direct(xmm), Indirect(SIZE, base, index, scale, offset) },
+                      [&] { code.Emit<OpCode::Mov>(xmm, base, index, scale, offset); });
+                Check(mnemonic, { Indirect(SIZE, base, index, scale, offset), Direct(xmm) },
+                      [&] { code.Emit<OpCode::Mov>(base, index, scale, offset, xmm); });
+            }
+
+
+            FunctionBuffer* m_code;
+            std::mt19937 m_rng;
+
+        TEST_FIXTURE_END_TEST_CASES_BEGIN
+
+
+        // Encodes instructions with random operands in all the forms which
+        // X64CodeGenerator supports and verifies that they decode back to
+        // the same operands.
+        TEST_F(DisassemblerTest, RoundTrip)
+        {
+            auto setup = GetSetup();
+            m_code = &setup->GetCode();
+
+            for (unsigned i = 0; i < c_iterationCount && !HasFatalFailure(); ++i)
+            {
+                m_code->Reset();
+
+                Integer<1>();
+                Integer<2>();
+                Integer<4>();
+                Integer<8>();
+
+                Multiword<2>();
+                Multiword<4>();
+                Multiword<8>();
+
+                BitScan<2>();
+                BitScan<4>();
+                BitScan<8>();
+                Bmi<4>();
+                Bmi<8>();
+
+                Extend<2, 1>();
+                Extend<4, 1>();
+                Extend<8, 1>();
+                Extend<4, 2>();
+                Extend<8, 2>();
+                Extend<8, 4>();
+
+                Float<4>("ss");
+                Float<8>("sd");
+
+                Conversion<4, 4>();
+                Conversion<4, 8>();
+                Conversion<8, 4>();
+                Conversion<8, 8>();
+
+                Miscellaneous();
+
+                Indexed<1>();
+                Indexed<2>();
+                Indexed<4>();
+                Indexed<8>();
+                IndexedFloat<4>();
+                IndexedFloat<8>();
+            }
+        }
+
+
+        TEST_F(DisassemblerTest, Function)
+        {
+            auto setup = GetSetup();
+            auto & code = setup->GetCode();
+
+            FunctionSpecification spec(setup->GetAllocator(),
+                                       2,
+                                       2,
+                                       rbx.GetMask(),
+                                       0,
+                                       FunctionSpecification::BaseRegisterType::SetRbpToOriginalRsp,
+                                       GetDiagnosticsStream());
+
+            code.BeginFunctionBodyGeneration(spec);
+
+            Label end = code.AllocateLabel();
+            code.Emit<OpCode::Cmp>(rcx, rdx);
+            code.EmitConditionalJump<JccType::JE>(end);
+            code.EmitImmediate<OpCode::Add>(rcx, 1);
+            code.Jmp(end);
+            code.PlaceLabel(end);
+            // Both jumps get shortened to their 2-byte forms, which moves the
+            // label back by 4 bytes for the je and by 3 bytes for the jmp.
+            const unsigned endOffset = code.CurrentPosition() - 7;
+            code.Emit<OpCode::Mov>(rax, rcx);
+
+            code.EndFunctionBodyGeneration(spec);
+
+            std::ostringstream out;
+            ASSERT_TRUE(Disassemble(code, out)) << out.str();
+
+            std::ostringstream target;
+            target << std::hex << std::uppercase << std::setfill('0') << std::setw(8) << endOffset << 'h';
+
+            const std::string listing = out.str();
+
+            ASSERT_NE(std::string::npos, listing.find("sub rsp, ")) << listing;
+            ASSERT_NE(std::string::npos, listing.find("mov qword ptr [rsp + ")) << listing;
+            ASSERT_NE(std::string::npos, listing.find("je " + target.str())) << listing;
+            ASSERT_NE(std::string::npos, listing.find("jmp " + target.str())) << listing;
+            ASSERT_NE(std::string::npos, listing.find("add rcx, 1\n")) << listing;
+            ASSERT_NE(std::string::npos, listing.find("ret\n")) << listing;
+        }
+
+
+        TEST_F(DisassemblerTest, InvalidCode)
+        {
+            // ud2 and adc al, al are valid instructions, but X64CodeGenerator
+            // never generates them.
+            const uint8_t code[] = { 0x0f, 0x0b, 0x10, 0xc0, 0x8a, 0xe0 };
+            Instruction instruction;
+
+            ASSERT_FALSE(DecodeInstruction(code, 0, 2, instruction));
+            ASSERT_FALSE(DecodeInstruction(code, 2, 4, instruction));
+
+            // mov ah, al uses a high byte register, which needs no REX.
+            ASSERT_FALSE(DecodeInstruction(code, 4, 6, instruction));
+
+            // Truncated instruction.
+            const uint8_t truncated[] = { 0x48, 0x8b, 0x80, 0x00, 0x01 };
+            ASSERT_FALSE(DecodeInstruction(truncated, 0, sizeof(truncated), instruction));
+        }
+    }
+}
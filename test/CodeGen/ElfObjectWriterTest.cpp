@@ -0,0 +1,218 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <cstring>
+#include <sstream>
+#include <string>
+
+#include "NativeJIT/CodeGen/ElfObjectWriter.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/CodeGen/FunctionSpecification.h"
+#include "TestSetup.h"
+
+
+namespace NativeJIT
+{
+    namespace CodeGenUnitTest
+    {
+        TEST_FIXTURE_START(ElfObjectWriterTest)
+
+        protected:
+            // Reads a little endian value of type T at the offset in the file.
+            template <typename T>
+            static T Read(std::string const & file, size_t offset)
+            {
+                T value;
+
+                EXPECT_LE(offset + sizeof(T), file.size());
+                memcpy(&value, file.data() + offset, sizeof(T));
+
+                return value;
+            }
+
+
+            // Returns the file offset of the named section and sets its size,
+            // or returns 0 if there is no such section.
+            static size_t FindSection(std::string const & file,
+                                      char const * name,
+                                      size_t& size)
+            {
+                const auto headersOffset = Read<uint64_t>(file, 0x28);
+                const auto headerSize = Read<uint16_t>(file, 0x3a);
+                const auto sectionCount = Read<uint16_t>(file, 0x3c);
+                const auto namesIndex = Read<uint16_t>(file, 0x3e);
+                const auto namesOffset
+                    = Read<uint64_t>(file, headersOffset + namesIndex * headerSize + 0x18);
+
+                for (unsigned i = 0; i < sectionCount; ++i)
+                {
+                    const size_t header = headersOffset + i * headerSize;
+                    const auto nameOffset = Read<uint32_t>(file, header);
+
+                    if (strcmp(file.c_str() + namesOffset + nameOffset, name) == 0)
+                    {
+                        size = Read<uint64_t>(file, header + 0x20);
+                        return Read<uint64_t>(file, header + 0x18);
+                    }
+                }
+
+                return 0;
+            }
+
+
+            // Returns the name of the symbol with the specified index.
+            static std::string GetSymbolName(std::string const & file, uint32_t index)
+            {
+                size_t size;
+                const size_t symbols = FindSection(file, ".symtab", size);
+                const size_t names = FindSection(file, ".strtab", size);
+
+                return file.c_str() + names + Read<uint32_t>(file, symbols + index * 24);
+            }
+
+        TEST_FIXTURE_END_TEST_CASES_BEGIN
+
+
+        TEST_F(ElfObjectWriterTest, Basic)
+        {
+            auto setup = GetSetup();
+            auto & code = setup->GetCode();
+
+            const uint64_t address = 0x123456789abcdef0;
+
+            FunctionSpecification spec(setup->GetAllocator(),
+                                       -1,
+                                       3,
+                                       rbx.GetMask() | r12.GetMask(),
+                                       0,
+                                       FunctionSpecification::BaseRegisterType::Unused,
+                                       GetDiagnosticsStream());
+
+            code.BeginFunctionBodyGeneration(spec);
+            code.EmitImmediate<OpCode::Mov>(rax, address);
+            const unsigned referenceOffset = code.CurrentPosition() - sizeof(uint64_t);
+            code.EndFunctionBodyGeneration(spec);
+
+            const unsigned codeStart = code.GetFunctionCodeStartOffset();
+            const unsigned codeEnd = code.GetFunctionCodeEndOffset();
+
+            ElfObjectWriter writer(code, "TestFunction");
+            writer.AddExternalReference(referenceOffset, "ExternalObject");
+            writer.AddExternalReference(referenceOffset, "ExternalObject");
+
+            std::ostringstream out;
+            writer.Write(out);
+            const std::string file = out.str();
+
+            // Relocatable x86-64 object.
+            ASSERT_EQ(0, memcmp(file.data(), "\x7f" "ELF", 4));
+            ASSERT_EQ(2, file[4]);
+            ASSERT_EQ(1, Read<uint16_t>(file, 0x10));
+            ASSERT_EQ(62, Read<uint16_t>(file, 0x12));
+
+            // The code is copied up to the end of the function, with the
+            // absolute address cleared.
+            size_t textSize;
+            const size_t text = FindSection(file, ".text", textSize);
+            ASSERT_NE(0u, text);
+            ASSERT_EQ(codeEnd, textSize);
+            ASSERT_EQ(0, memcmp(file.data() + text + codeStart,
+                                code.BufferStart() + codeStart,
+                                referenceOffset - codeStart));
+            ASSERT_EQ(0u, Read<uint64_t>(file, text + referenceOffset));
+
+            // The function symbol.
+            size_t symbolsSize;
+            const size_t symbols = FindSection(file, ".symtab", symbolsSize);
+            ASSERT_NE(0u, symbols);
+            ASSERT_EQ(4u * 24, symbolsSize) << "Duplicate external symbol?";
+            ASSERT_EQ("TestFunction", GetSymbolName(file, 2));
+            ASSERT_EQ(codeStart, Read<uint64_t>(file, symbols + 2 * 24 + 8));
+            ASSERT_EQ(codeEnd - codeStart, Read<uint64_t>(file, symbols + 2 * 24 + 16));
+            ASSERT_EQ("ExternalObject", GetSymbolName(file, 3));
+
+            // Both references are R_X86_64_64 relocations against the external
+            // symbol.
+            size_t relocationsSize;
+            const size_t relocations = FindSection(file, ".rela.text", relocationsSize);
+            ASSERT_NE(0u, relocations);
+            ASSERT_EQ(2u * 24, relocationsSize);
+
+            for (unsigned i = 0; i < 2; ++i)
+            {
+                const size_t relocation = relocations + i * 24;
+
+                ASSERT_EQ(referenceOffset, Read<uint64_t>(file, relocation));
+                ASSERT_EQ((3ull << 32) | 1, Read<uint64_t>(file, relocation + 8));
+                ASSERT_EQ(0, Read<int64_t>(file, relocation + 16));
+            }
+
+            // The FDE follows the 24 byte CIE and covers the function. Its
+            // instructions set the CFA to the original RSP plus the return
+            // address, i.e. DW_CFA_def_cfa_offset, and describe the saves of
+            // RBX and R12 with DW_CFA_offset.
+            size_t ehFrameSize;
+            const size_t ehFrame = FindSection(file, ".eh_frame", ehFrameSize);
+            ASSERT_NE(0u, ehFrame);
+            ASSERT_EQ(20u, Read<uint32_t>(file, ehFrame));
+
+            const size_t fde = ehFrame + 24;
+            const uint32_t fdeLength = Read<uint32_t>(file, fde);
+            ASSERT_EQ(ehFrameSize, 24 + sizeof(uint32_t) + fdeLength);
+            ASSERT_EQ(codeEnd - codeStart, Read<uint32_t>(file, fde + 12));
+
+            const std::string instructions = file.substr(fde + 17, fdeLength - 13);
+            const unsigned cfaOffset = spec.GetOffsetToOriginalRsp() + sizeof(void*);
+
+            ASSERT_LT(cfaOffset, 0x80u);
+            ASSERT_NE(std::string::npos,
+                      instructions.find(std::string("\x0e") + static_cast<char>(cfaOffset)));
+            ASSERT_NE(std::string::npos, instructions.find('\x83'));
+            ASSERT_NE(std::string::npos, instructions.find('\x8c'));
+        }
+
+
+        TEST_F(ElfObjectWriterTest, ReferenceOutsideOfCode)
+        {
+            auto setup = GetSetup();
+            auto & code = setup->GetCode();
+
+            FunctionSpecification spec(setup->GetAllocator(),
+                                       -1,
+                                       0,
+                                       0,
+                                       0,
+                                       FunctionSpecification::BaseRegisterType::Unused,
+                                       GetDiagnosticsStream());
+
+            code.BeginFunctionBodyGeneration(spec);
+            code.EndFunctionBodyGeneration(spec);
+
+            ElfObjectWriter writer(code, "TestFunction");
+
+            ASSERT_THROW(writer.AddExternalReference(code.GetFunctionCodeEndOffset() - 4,
+                                                     "ExternalObject"),
+                         std::runtime_error);
+        }
+    }
+}
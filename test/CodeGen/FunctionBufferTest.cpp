@@ -300,6 +300,65 @@ namespace NativeJIT
         }
 
 
+        TEST_F(FunctionBufferTest, LeafFrame)
+        {
+            auto setup = GetSetup();
+            auto & code = setup->GetCode();
+
+            // Same as Trivial, but with the frame left out.
+            FunctionSpecification spec(setup->GetAllocator(), -1, 0, 0, 0, FunctionSpecification::BaseRegisterType::Unused, GetDiagnosticsStream(), FunctionSpecification::LeafFrameType::Omitted);
+
+            ASSERT_EQ(0, spec.GetOffsetToOriginalRsp());
+            ASSERT_EQ(0u, spec.GetPrologLength());
+
+            auto & unwindInfo = *reinterpret_cast<UnwindInfo const *>(spec.GetUnwindInfoBuffer());
+
+            ASSERT_EQ(sizeof(UnwindInfo) - sizeof(UnwindCode), spec.GetUnwindInfoByteLength());
+            ASSERT_EQ(1, unwindInfo.m_version);
+            ASSERT_EQ(0, unwindInfo.m_sizeOfProlog);
+            ASSERT_EQ(0, unwindInfo.m_countOfCodes);
+
+            code.Reset();
+            code.Emit<OpCode::Ret>();
+
+            VerifyEpilog(spec, code);
+
+            // The frame is only omitted for leaf functions.
+            FunctionSpecification callerSpec(setup->GetAllocator(), 1, 0, 0, 0, FunctionSpecification::BaseRegisterType::Unused, GetDiagnosticsStream(), FunctionSpecification::LeafFrameType::Omitted);
+            ASSERT_NO_FATAL_FAILURE(ValidateUnwindInfo(callerSpec));
+            ASSERT_EQ(40, callerSpec.GetOffsetToOriginalRsp());
+
+            // Generate a function with the maximum reserve for the unwind info
+            // and the prolog. The unused part of it is removed, so the body
+            // starts on the cache line following the constant and the unwind
+            // info.
+            code.Reset();
+            code.AdvanceToAlignment<uint64_t>();
+            const int32_t constant = code.CurrentPosition();
+            code.EmitBytes<uint64_t>(7);
+
+            code.BeginFunctionBodyGeneration();
+
+            Label done = code.AllocateLabel();
+
+            code.Emit<OpCode::Mov>(rax, rip, constant);
+            code.Jmp(done);
+            code.EmitImmediate<OpCode::Mov>(rax, 100);
+            code.PlaceLabel(done);
+
+            code.EndFunctionBodyGeneration(spec);
+
+            const unsigned unwindInfoEnd
+                = code.GetUnwindInfoStartOffset() + spec.GetUnwindInfoByteLength();
+
+            ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(code.GetEntryPoint()) % 64);
+            ASSERT_LT(code.GetFunctionCodeStartOffset() - unwindInfoEnd, 64u);
+
+            auto function = reinterpret_cast<uint64_t (*)()>(const_cast<void*>(code.GetEntryPoint()));
+            ASSERT_EQ(7u, function());
+        }
+
+
         TEST_F(FunctionBufferTest, FunctionWithCalls)
         {
             auto setup = GetSetup();
@@ -665,6 +724,160 @@ namespace NativeJIT
             }
         }
 
+
+        TEST_F(FunctionBufferTest, ShortJumps)
+        {
+            auto setup = GetSetup();
+            auto & code = setup->GetCode();
+
+            // A constant for the RIP-relative operands, which need to be
+            // adjusted when the code moves.
+            code.AdvanceToAlignment<uint64_t>();
+            const int32_t constant = code.CurrentPosition();
+            code.EmitBytes<uint64_t>(7);
+
+            FunctionSpecification spec(setup->GetAllocator(), -1, 0, 0, 0, FunctionSpecification::BaseRegisterType::Unused, GetDiagnosticsStream());
+
+            code.BeginFunctionBodyGeneration(spec);
+            const unsigned bodyStart = code.CurrentPosition();
+
+            // Returns 5 * 7 + 7. The je and the backward jmp are close to
+            // their targets and get shortened, the jmp over the nops does not.
+            Label loop = code.AllocateLabel();
+            Label done = code.AllocateLabel();
+            Label far = code.AllocateLabel();
+
+            code.EmitImmediate<OpCode::Mov>(rcx, 5);
+            code.EmitImmediate<OpCode::Mov>(rax, 0);
+            code.PlaceLabel(loop);
+            code.EmitImmediate<OpCode::Cmp>(rcx, 0);
+            code.EmitConditionalJump<JccType::JE>(done);
+            code.Emit<OpCode::Add>(rax, rip, constant);
+            code.EmitImmediate<OpCode::Sub>(rcx, 1);
+            code.Jmp(loop);
+            code.PlaceLabel(done);
+            code.Jmp(far);
+
+            for (unsigned i = 0; i < 200; ++i)
+            {
+                code.Emit8(0x90);
+            }
+
+            code.PlaceLabel(far);
+            code.Emit<OpCode::Add>(rax, rip, constant);
+
+            const unsigned bodyEnd = code.CurrentPosition();
+            code.EndFunctionBodyGeneration(spec);
+
+            // The two short jumps save 7 bytes. The function itself starts on
+            // the cache line following the constant.
+            ASSERT_EQ(bodyEnd - bodyStart + spec.GetEpilogLength() - 7,
+                      code.CurrentPosition()
+                      - code.GetFunctionCodeStartOffset()
+                      - spec.GetPrologLength());
+
+            auto function = reinterpret_cast<uint64_t (*)()>(const_cast<void*>(code.GetEntryPoint()));
+            ASSERT_EQ(42u, function());
+        }
+
+
+        TEST_F(FunctionBufferTest, ColdBlocks)
+        {
+            auto setup = GetSetup();
+            auto & code = setup->GetCode();
+
+            code.AdvanceToAlignment<uint64_t>();
+            const int32_t constant = code.CurrentPosition();
+            code.EmitBytes<uint64_t>(7);
+
+            FunctionSpecification spec(setup->GetAllocator(), -1, 0, 0, 0, FunctionSpecification::BaseRegisterType::Unused, GetDiagnosticsStream());
+
+            code.BeginFunctionBodyGeneration(spec);
+
+            // Returns (1 + 7 + 7) + 20. The first cold block is skipped, the
+            // second one is taken and jumps back into the hot code. Both get
+            // moved behind the epilog.
+            Label firstCold = code.AllocateLabel();
+            Label secondCold = code.AllocateLabel();
+            Label back = code.AllocateLabel();
+            Label done = code.AllocateLabel();
+
+            code.EmitImmediate<OpCode::Mov>(rax, 1);
+            code.EmitImmediate<OpCode::Cmp>(rax, 1);
+            code.EmitConditionalJump<JccType::JNE>(firstCold);
+
+            code.BeginColdBlock();
+            code.PlaceLabel(firstCold);
+            code.EmitImmediate<OpCode::Mov>(rax, 100);
+            code.Jmp(done);
+            code.EndColdBlock();
+
+            code.Emit<OpCode::Add>(rax, rip, constant);
+            code.EmitImmediate<OpCode::Cmp>(rax, 8);
+            code.EmitConditionalJump<JccType::JE>(secondCold);
+            code.EmitImmediate<OpCode::Add>(rax, 1000);
+            code.PlaceLabel(back);
+            code.EmitImmediate<OpCode::Add>(rax, 20);
+            code.Jmp(done);
+
+            code.BeginColdBlock();
+            code.PlaceLabel(secondCold);
+            code.Emit<OpCode::Add>(rax, rip, constant);
+            code.Jmp(back);
+            code.EndColdBlock();
+
+            code.PlaceLabel(done);
+
+            code.EndFunctionBodyGeneration(spec);
+
+            // The function ends with the short jump back from the second
+            // cold block rather than with the ret of the epilog.
+            ASSERT_EQ(0xeb, code.BufferStart()[code.CurrentPosition() - 2]);
+
+            auto function = reinterpret_cast<uint64_t (*)()>(const_cast<void*>(code.GetEntryPoint()));
+            ASSERT_EQ(35u, function());
+        }
+
+
+        TEST_F(FunctionBufferTest, CodeAlignment)
+        {
+            auto setup = GetSetup();
+            auto & code = setup->GetCode();
+
+            CodeAlignment alignment;
+            alignment.m_entry = 64;
+            alignment.m_loopHead = 32;
+            code.SetCodeAlignment(alignment);
+
+            code.AdvanceToAlignment<uint64_t>();
+            const int32_t constant = code.CurrentPosition();
+            code.EmitBytes<uint64_t>(7);
+
+            FunctionSpecification spec(setup->GetAllocator(), -1, 0, 0, 0, FunctionSpecification::BaseRegisterType::Unused, GetDiagnosticsStream());
+
+            code.BeginFunctionBodyGeneration(spec);
+
+            // Returns 5 * 7. The backward jne must remain in reach of the
+            // loop head with the largest possible padding in between.
+            Label loop = code.AllocateLabel();
+
+            code.EmitImmediate<OpCode::Mov>(rcx, 5);
+            code.EmitImmediate<OpCode::Mov>(rax, 0);
+            code.AlignCode(code.GetCodeAlignment().m_loopHead);
+            code.PlaceLabel(loop);
+            code.Emit<OpCode::Add>(rax, rip, constant);
+            code.EmitImmediate<OpCode::Sub>(rcx, 1);
+            code.EmitConditionalJump<JccType::JNE>(loop);
+
+            code.EndFunctionBodyGeneration(spec);
+            code.SetCodeAlignment(CodeAlignment());
+
+            ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(code.GetEntryPoint()) % 64);
+
+            auto function = reinterpret_cast<uint64_t (*)()>(const_cast<void*>(code.GetEntryPoint()));
+            ASSERT_EQ(35u, function());
+        }
+
         TEST_CASES_END
     }
 }
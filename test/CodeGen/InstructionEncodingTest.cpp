@@ -27,6 +27,7 @@
 #include <vector>
 
 #include "ML64Verifier.h"
+#include "NativeJIT/CodeGen/Disassembler.h"
 #include "NativeJIT/CodeGen/ExecutionBuffer.h"
 #include "NativeJIT/CodeGen/X64CodeGenerator.h"
 #include "Temporary/Allocator.h"
@@ -43,6 +44,55 @@ namespace NativeJIT
             InstructionEnconding() : TestFixture(64 * 1024, TestFixture::c_defaultGeneralAllocatorCapacity, TestFixture::c_defaultDiagnosticsStream)
             {
             }
+
+        protected:
+            // Verifies that each instruction in the ML64 listing decodes at
+            // its offset to the same text as in the listing and that the
+            // decoded lengths match the offsets.
+            static void VerifyDisassembly(std::string const & listing, uint8_t const * code)
+            {
+                // Instruction lines start with the offset and the encoded
+                // bytes, f. ex. " 00000000  B0 01                mov al, 1".
+                // The bytes are in upper case and the instruction in lower
+                // case, which separates them even where the listing lacks
+                // the spaces in between.
+                const size_t c_bytesColumn = 11;
+
+                std::istringstream lines(listing);
+                std::string line;
+                unsigned expectedOffset = 0;
+                unsigned instructionCount = 0;
+
+                while (std::getline(lines, line))
+                {
+                    if (line.size() <= c_bytesColumn
+                        || !isxdigit(line[1])
+                        || line[c_bytesColumn] == ' ')
+                    {
+                        continue;
+                    }
+
+                    const unsigned offset = std::stoul(line.substr(1, 8), nullptr, 16);
+                    std::string text = line.substr(line.find_first_of("abcdefghijklmnopqrstuvwxyz",
+                                                                      c_bytesColumn));
+                    text.erase(text.find_last_not_of(' ') + 1);
+
+                    Instruction instruction;
+                    ASSERT_TRUE(DecodeInstruction(code, offset, offset + 16, instruction))
+                        << "Failed to decode \"" << line << "\"";
+
+                    std::ostringstream decoded;
+                    instruction.Print(decoded);
+
+                    ASSERT_EQ(expectedOffset, offset);
+                    ASSERT_EQ(text, decoded.str());
+
+                    expectedOffset = offset + instruction.m_length;
+                    ++instructionCount;
+                }
+
+                ASSERT_GT(instructionCount, 0u);
+            }
         TEST_FIXTURE_END_TEST_CASES_BEGIN
 
 
@@ -39054,6 +39104,118 @@ namespace NativeJIT
                 "";
 
             ML64Verifier v(ml64Output.c_str(), start);
+            VerifyDisassembly(ml64Output, start);
+        }
+
+
+        // The vector instructions are not described by an OpCode and the
+        // disassembler doesn't decode them, so only the bytes are verified.
+        TEST_F(InstructionEnconding, VectorInstructions)
+        {
+            auto setup = GetSetup();
+            auto& buffer = setup->GetCode();
+
+            uint8_t const * start =  buffer.BufferStart() + buffer.CurrentPosition();
+
+            buffer.EmitVectorMoveDword(xmm1s, r9d);
+            buffer.EmitVectorInsertDword(xmm12s, eax, 3);
+            buffer.EmitVectorInsertHigh(xmm1s, xmm14s);
+            buffer.EmitVectorExtractHigh(xmm9s, xmm2s);
+            buffer.EmitVectorZero(xmm15s);
+            buffer.EmitVectorAllOnes(xmm3s);
+            buffer.EmitVectorBlendDwords(xmm3s, xmm10s, 0xf8);
+            buffer.EmitVectorAddFloats(xmm0s, xmm8s);
+            buffer.EmitVectorHorizontalAddFloats(xmm11s, xmm1s);
+
+            // [rbp] needs a displacement, [r12] needs the SIB byte anyway.
+            buffer.EmitGatherFloats(xmm0s, rbp, xmm9s, 0, xmm2s);
+            buffer.EmitGatherFloats(xmm10s, r12, xmm1s, 16, xmm13s);
+            buffer.EmitGatherFloats(xmm0s, rax, xmm1s, 0x1000, xmm2s);
+            buffer.EmitGatherFloats(xmm0s, r13, xmm1s, -8, xmm2s);
+            buffer.EmitConvertHalfToFloat(xmm10s, xmm3s);
+            buffer.EmitVzeroupper();
+
+            std::string ml64Output =
+                " 00000000  C4 C1 79 6E C9           vmovd xmm1, r9d                                                \n"
+                " 00000005  C4 63 19 22 E0 03        vpinsrd xmm12, xmm12, eax, 3                                   \n"
+                " 0000000B  C4 C3 75 38 CE 01        vinserti128 ymm1, ymm1, xmm14, 1                               \n"
+                " 00000011  C4 C3 7D 19 D1 01        vextractf128 xmm9, ymm2, 1                                     \n"
+                " 00000017  C4 41 00 57 FF           vxorps xmm15, xmm15, xmm15                                     \n"
+                " 0000001C  C4 E1 65 76 DB           vpcmpeqd ymm3, ymm3, ymm3                                      \n"
+                " 00000021  C4 C3 65 02 DA F8        vpblendd ymm3, ymm3, ymm10, 248                                \n"
+                " 00000027  C4 C1 78 58 C0           vaddps xmm0, xmm0, xmm8                                        \n"
+                " 0000002C  C4 61 23 7C D9           vhaddps xmm11, xmm11, xmm1                                     \n"
+                " 00000031  C4 A2 6D 92 44 8D 00     vgatherdps ymm0, dword ptr [rbp + ymm9*4], ymm2                \n"
+                " 00000038  C4 42 15 92 54 8C 10     vgatherdps ymm10, dword ptr [r12 + ymm1*4 + 10h], ymm13        \n"
+                " 0000003F  C4 E2 6D 92 84 88 00     vgatherdps ymm0, dword ptr [rax + ymm1*4 + 1000h], ymm2        \n"
+                "           10 00 00                                                                                \n"
+                " 00000049  C4 C2 6D 92 44 8D F8     vgatherdps ymm0, dword ptr [r13 + ymm1*4 - 8h], ymm2           \n"
+                " 00000050  C4 62 79 13 D3           vcvtph2ps xmm10, xmm3                                          \n"
+                " 00000055  C5 F8 77                 vzeroupper                                                     \n"
+                "";
+
+            ML64Verifier v(ml64Output.c_str(), start);
+        }
+
+
+        // The prefetch instructions are not described by an OpCode either.
+        TEST_F(InstructionEnconding, Prefetch)
+        {
+            auto setup = GetSetup();
+            auto& buffer = setup->GetCode();
+
+            uint8_t const * start =  buffer.BufferStart() + buffer.CurrentPosition();
+
+            buffer.EmitPrefetch(PrefetchLocality::AllLevels, rax, 0);
+            buffer.EmitPrefetch(PrefetchLocality::NonTemporal, r12, 16);
+            buffer.EmitPrefetch(PrefetchLocality::Level2, rbp, 0);
+            buffer.EmitPrefetch(PrefetchLocality::Level3, r13, -8);
+            buffer.EmitPrefetch(PrefetchLocality::AllLevels, rsp, 0x1000);
+
+            std::string ml64Output =
+                " 00000000  0F 18 08                 prefetcht0 byte ptr [rax]                                      \n"
+                " 00000003  41 0F 18 44 24 10        prefetchnta byte ptr [r12 + 10h]                               \n"
+                " 00000009  0F 18 55 00              prefetcht1 byte ptr [rbp]                                      \n"
+                " 0000000D  41 0F 18 5D F8           prefetcht2 byte ptr [r13 - 8h]                                 \n"
+                " 00000012  0F 18 8C 24 00 10 00     prefetcht0 byte ptr [rsp + 1000h]                              \n"
+                "           00                                                                                      \n"
+                "";
+
+            ML64Verifier v(ml64Output.c_str(), start);
+        }
+
+
+        // The padding emitted for the code alignment.
+        TEST_F(InstructionEnconding, Nops)
+        {
+            auto setup = GetSetup();
+            auto& buffer = setup->GetCode();
+
+            uint8_t const * start =  buffer.BufferStart() + buffer.CurrentPosition();
+
+            for (unsigned length = 1; length <= 10; ++length)
+            {
+                buffer.EmitNops(length);
+            }
+
+            std::string ml64Output =
+                " 00000000  90                       nop                                                            \n"
+                " 00000001  66 90                    xchg ax, ax                                                    \n"
+                " 00000003  0F 1F 00                 nop dword ptr [rax]                                            \n"
+                " 00000006  0F 1F 40 00              nop dword ptr [rax]                                            \n"
+                " 0000000A  0F 1F 44 00 00           nop dword ptr [rax + rax]                                      \n"
+                " 0000000F  66 0F 1F 44 00 00        nop word ptr [rax + rax]                                       \n"
+                " 00000015  0F 1F 80 00 00 00 00     nop dword ptr [rax]                                            \n"
+                " 0000001C  0F 1F 84 00 00 00 00     nop dword ptr [rax + rax]                                      \n"
+                "           00                                                                                      \n"
+                " 00000024  66 0F 1F 84 00 00 00     nop word ptr [rax + rax]                                       \n"
+                "           00 00                                                                                   \n"
+                " 0000002D  66 0F 1F 84 00 00 00     nop word ptr [rax + rax]                                       \n"
+                "           00 00                                                                                   \n"
+                " 00000036  90                       nop                                                            \n"
+                "";
+
+            ML64Verifier v(ml64Output.c_str(), start);
         }
 
 
@@ -0,0 +1,449 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "NativeJIT/CodeGen/ExecutionBuffer.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/Function.h"
+#include "Temporary/Allocator.h"
+#include "TestSetup.h"
+#include "TierVerifier.h"
+
+
+namespace NativeJIT
+{
+    namespace ArithmeticUnitTest
+    {
+        TEST_FIXTURE_START(Arithmetic)
+
+        protected:
+            // Returns the interesting dividends for T: the extremes, the
+            // values around the divisor and its multiples and a sequence of
+            // pseudo-random values spread over the whole range.
+            template <typename T>
+            static std::vector<T> GetDividends(T divisor)
+            {
+                // Unsigned arithmetic avoids the signed overflow around the
+                // extreme divisors.
+                typedef typename std::make_unsigned<T>::type Unsigned;
+                const Unsigned d = static_cast<Unsigned>(divisor);
+
+                std::vector<T> dividends = {
+                    0,
+                    1,
+                    static_cast<T>(-1),
+                    (std::numeric_limits<T>::min)(),
+                    static_cast<T>((std::numeric_limits<T>::min)() + 1),
+                    (std::numeric_limits<T>::max)(),
+                    static_cast<T>((std::numeric_limits<T>::max)() - 1),
+                    divisor,
+                    static_cast<T>(d - 1u),
+                    static_cast<T>(d + 1u),
+                    static_cast<T>(d * 7u),
+                    static_cast<T>(d * 7u - 1u),
+                    static_cast<T>(0u - d),
+                    static_cast<T>(1u - d)
+                };
+
+                uint64_t random = 0x123456789abcdefull;
+
+                for (unsigned i = 0; i < 64; ++i)
+                {
+                    random = random * 6364136223846793005ull + 1442695040888963407ull;
+                    dividends.push_back(static_cast<T>(random >> (i % (64 - sizeof(T) * 8 + 1))));
+                    dividends.push_back(static_cast<T>(random >> (64 - sizeof(T) * 8 + i % (sizeof(T) * 8))));
+                }
+
+                // INT_MIN / -1 is not representable.
+                if (std::is_signed<T>::value && divisor == static_cast<T>(-1))
+                {
+                    dividends.erase(dividends.begin() + 3);
+                }
+
+                return dividends;
+            }
+
+
+            template <typename T>
+            void VerifyDivImmediate(T divisor)
+            {
+                const auto dividends = GetDividends(divisor);
+
+                {
+                    auto setup = GetSetup();
+                    Function<T, T> expression(setup->GetAllocator(), setup->GetCode());
+
+                    auto & root = expression.DivImmediate(expression.GetP1(), divisor);
+                    auto function = expression.Compile(root);
+
+                    for (auto dividend : dividends)
+                    {
+                        ASSERT_EQ(static_cast<T>(dividend / divisor), function(dividend))
+                            << dividend << " / " << divisor;
+                    }
+                }
+
+                {
+                    auto setup = GetSetup();
+                    Function<T, T> expression(setup->GetAllocator(), setup->GetCode());
+
+                    auto & root = expression.ModImmediate(expression.GetP1(), divisor);
+                    auto function = expression.Compile(root);
+
+                    for (auto dividend : dividends)
+                    {
+                        ASSERT_EQ(static_cast<T>(dividend % divisor), function(dividend))
+                            << dividend << " % " << divisor;
+                    }
+                }
+            }
+
+        TEST_FIXTURE_END_TEST_CASES_BEGIN
+
+
+        //
+        // Division by a value
+        //
+
+        TEST_F(Arithmetic, DivInt32)
+        {
+            auto setup = GetSetup();
+
+            {
+                Function<int32_t, int32_t, int32_t> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & a = expression.Div(expression.GetP1(), expression.GetP2());
+                auto function = expression.Compile(a);
+
+                ASSERT_EQ(7, function(100, 14));
+                ASSERT_EQ(-7, function(-100, 14));
+                ASSERT_EQ(-7, function(100, -14));
+                ASSERT_EQ(7, function(-100, -14));
+                ASSERT_EQ((std::numeric_limits<int32_t>::min)(),
+                          function((std::numeric_limits<int32_t>::min)(), 1));
+            }
+        }
+
+
+        TEST_F(Arithmetic, ModInt64)
+        {
+            auto setup = GetSetup();
+
+            {
+                Function<int64_t, int64_t, int64_t> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & a = expression.Mod(expression.GetP1(), expression.GetP2());
+                auto function = expression.Compile(a);
+
+                ASSERT_EQ(2, function(100, 14));
+                ASSERT_EQ(-2, function(-100, 14));
+                ASSERT_EQ(2, function(100, -14));
+                ASSERT_EQ(-2, function(-100, -14));
+                ASSERT_EQ(0x123456789ll % 0x9876ll, function(0x123456789ll, 0x9876ll));
+            }
+        }
+
+
+        TEST_F(Arithmetic, DivModUnsigned)
+        {
+            auto setup = GetSetup();
+
+            {
+                Function<uint64_t, uint64_t, uint64_t> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & p1 = expression.GetP1();
+                auto & p2 = expression.GetP2();
+                auto & a = expression.Add(expression.Mul(expression.Div(p1, p2),
+                                                         expression.Immediate<uint64_t>(1000)),
+                                          expression.Mod(p1, p2));
+                auto function = expression.Compile(a);
+
+                const uint64_t p1Value = 0xfedcba9876543210ull;
+                const uint64_t p2Value = 0x123456789ull;
+
+                auto expected = (p1Value / p2Value) * 1000 + p1Value % p2Value;
+                auto observed = function(p1Value, p2Value);
+
+                ASSERT_EQ(expected, observed);
+            }
+        }
+
+
+        // The operands and other live values occupy rax and rdx which the
+        // division must claim.
+        TEST_F(Arithmetic, DivWithLiveAccumulatorAndData)
+        {
+            auto setup = GetSetup();
+
+            {
+                Function<int64_t, int64_t, int64_t, int64_t, int64_t> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & p1 = expression.GetP1();
+                auto & p2 = expression.GetP2();
+                auto & p3 = expression.GetP3();
+                auto & p4 = expression.GetP4();
+
+                auto & quotient1 = expression.Div(p3, p4);
+                auto & quotient2 = expression.Div(p4, p3);
+                auto & remainder = expression.Mod(p1, p3);
+                auto & sum = expression.Add(expression.Add(quotient1, quotient2),
+                                            expression.Add(remainder, expression.Add(p1, p2)));
+                auto & a = expression.Add(sum, expression.Mul(p3, p4));
+                auto function = expression.Compile(a);
+
+                const int64_t a1 = 1000003;
+                const int64_t a2 = -77;
+                const int64_t a3 = -4242;
+                const int64_t a4 = 99;
+
+                auto expected = (a3 / a4 + a4 / a3) + (a1 % a3 + (a1 + a2)) + a3 * a4;
+                auto observed = function(a1, a2, a3, a4);
+
+                ASSERT_EQ(expected, observed);
+            }
+        }
+
+
+        TEST_F(Arithmetic, DivModNarrow)
+        {
+            auto setup = GetSetup();
+
+            {
+                Function<int8_t, int8_t, int8_t> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & a = expression.Add(expression.Div(expression.GetP1(), expression.GetP2()),
+                                          expression.Mod(expression.GetP1(), expression.GetP2()));
+                auto function = expression.Compile(a);
+
+                ASSERT_EQ(static_cast<int8_t>(-128 / 3 + -128 % 3), function(-128, 3));
+                ASSERT_EQ(static_cast<int8_t>(100 / -7 + 100 % -7), function(100, -7));
+            }
+
+            {
+                Function<uint16_t, uint16_t, uint16_t> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & a = expression.Div(expression.GetP1(), expression.GetP2());
+                auto function = expression.Compile(a);
+
+                ASSERT_EQ(65535 / 255, function(65535, 255));
+                ASSERT_EQ(0, function(3, 40000));
+            }
+        }
+
+
+        //
+        // Division by a constant
+        //
+
+        TEST_F(Arithmetic, DivImmediateUnsigned32)
+        {
+            const uint32_t divisors[] = {
+                1, 2, 3, 5, 6, 7, 10, 11, 16, 25, 125, 641, 1000, 65535, 65536,
+                0x7fffffff, 0x80000000, 0x80000001, 0xfffffffe, 0xffffffff
+            };
+
+            for (auto divisor : divisors)
+            {
+                VerifyDivImmediate(divisor);
+            }
+        }
+
+
+        TEST_F(Arithmetic, DivImmediateUnsigned64)
+        {
+            const uint64_t divisors[] = {
+                1, 3, 7, 10, 64, 1000, 0x123456789ull, 0x7fffffffffffffffull,
+                0x8000000000000000ull, 0x8000000000000001ull, 0xffffffffffffffffull
+            };
+
+            for (auto divisor : divisors)
+            {
+                VerifyDivImmediate(divisor);
+            }
+        }
+
+
+        TEST_F(Arithmetic, DivImmediateSigned32)
+        {
+            const int32_t divisors[] = {
+                1, -1, 2, -2, 3, -3, 5, -5, 6, 7, -7, 8, -16, 100, -1000, 65536,
+                0x7fffffff, -0x7fffffff, (std::numeric_limits<int32_t>::min)()
+            };
+
+            for (auto divisor : divisors)
+            {
+                VerifyDivImmediate(divisor);
+            }
+        }
+
+
+        TEST_F(Arithmetic, DivImmediateSigned64)
+        {
+            const int64_t divisors[] = {
+                1, -1, 2, 3, -3, 7, -8, 10, 1ll << 40, -(1ll << 40), 0x123456789ll,
+                -0x123456789ll, 0x7fffffffffffffffll, (std::numeric_limits<int64_t>::min)()
+            };
+
+            for (auto divisor : divisors)
+            {
+                VerifyDivImmediate(divisor);
+            }
+        }
+
+
+        TEST_F(Arithmetic, DivImmediateNarrow)
+        {
+            const int8_t signedDivisors[] = { 3, -3, 4, -128, 127 };
+
+            for (auto divisor : signedDivisors)
+            {
+                VerifyDivImmediate(divisor);
+            }
+
+            const uint16_t unsignedDivisors[] = { 3, 8, 1000, 65535 };
+
+            for (auto divisor : unsignedDivisors)
+            {
+                VerifyDivImmediate(divisor);
+            }
+        }
+
+
+        TEST_F(Arithmetic, ModImmediateByOne)
+        {
+            auto setup = GetSetup();
+
+            // The dividend is not a parameter, so it's referenced only
+            // through the remainder.
+            {
+                Function<int64_t, int64_t> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & dividend = expression.Add(expression.GetP1(), expression.Immediate<int64_t>(5));
+                auto & root = expression.Add(expression.ModImmediate(dividend, static_cast<int64_t>(1)),
+                                             expression.ModImmediate(dividend, static_cast<int64_t>(-1)));
+                auto function = expression.Compile(root);
+
+                ASSERT_EQ(0, function(12));
+                ASSERT_EQ(0, function(-12));
+            }
+
+            {
+                Function<int16_t, int16_t> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & dividend = expression.Add(expression.GetP1(), expression.Immediate<int16_t>(5));
+                auto & root = expression.Add(expression.ModImmediate(dividend, static_cast<int16_t>(1)),
+                                             expression.ModImmediate(dividend, static_cast<int16_t>(-1)));
+                auto function = expression.Compile(root);
+
+                ASSERT_EQ(0, function(12));
+                ASSERT_EQ(0, function(-12));
+            }
+        }
+
+
+        //
+        // Unary and bitwise operations
+        //
+
+        TEST_F(Arithmetic, NegNot)
+        {
+            auto setup = GetSetup();
+
+            {
+                Function<int32_t, int32_t> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & a = expression.Neg(expression.GetP1());
+                auto function = expression.Compile(a);
+
+                ASSERT_EQ(-12345, function(12345));
+                ASSERT_EQ(7, function(-7));
+            }
+
+            {
+                Function<uint16_t, uint16_t> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & a = expression.Not(expression.GetP1());
+                auto function = expression.Compile(a);
+
+                ASSERT_EQ(0xedcb, function(0x1234));
+            }
+
+            {
+                Function<int64_t, int64_t> expression(setup->GetAllocator(), setup->GetCode());
+
+                // The child is shared, so the node must not modify it in place.
+                auto & p1 = expression.GetP1();
+                auto & a = expression.Add(expression.Not(p1), p1);
+                auto function = expression.Compile(a);
+
+                ASSERT_EQ(-1, function(0x123456789ll));
+            }
+        }
+
+
+        TEST_F(Arithmetic, Xor)
+        {
+            auto setup = GetSetup();
+
+            {
+                Function<uint64_t, uint64_t, uint64_t> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & a = expression.Xor(expression.GetP1(), expression.GetP2());
+                auto function = expression.Compile(a);
+
+                const uint64_t p1 = 0xff00ff00ff00ff00ull;
+                const uint64_t p2 = 0x0ff00ff00ff00ff0ull;
+
+                ASSERT_EQ(p1 ^ p2, function(p1, p2));
+            }
+        }
+
+
+        TEST_F(Arithmetic, DivModTiers)
+        {
+            auto setup = GetSetup();
+
+            Function<int64_t, int64_t, int64_t> expression(setup->GetAllocator(), setup->GetCode());
+
+            auto & p1 = expression.GetP1();
+            auto & p2 = expression.GetP2();
+            auto & quotients = expression.Add(expression.Div(p1, p2),
+                                              expression.DivImmediate(p1, -7));
+            auto & remainders = expression.Xor(expression.Mod(p1, p2),
+                                               expression.ModImmediate(p1, 1000));
+            auto & root = expression.Sub(expression.Neg(quotients),
+                                         expression.Not(remainders));
+
+            TieredFunction<int64_t, int64_t, int64_t> function(expression, root, c_tierPromotionThreshold);
+
+            const int64_t a = -123456789012ll;
+            const int64_t b = 4321;
+            const int64_t expected = -(a / b + a / -7) - ~((a % b) ^ (a % 1000));
+
+            VerifyTiers(function, expected, a, b);
+        }
+    }
+}
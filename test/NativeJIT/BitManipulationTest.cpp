@@ -0,0 +1,450 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "NativeJIT/CodeGen/CpuFeatures.h"
+#include "NativeJIT/CodeGen/ExecutionBuffer.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/Function.h"
+#include "Temporary/Allocator.h"
+#include "TestSetup.h"
+#include "TierVerifier.h"
+
+
+namespace NativeJIT
+{
+    namespace BitManipulationUnitTest
+    {
+        TEST_FIXTURE_START(BitManipulation)
+
+        protected:
+            // The features of the host, which may use the extended
+            // instructions, and the baseline x64 which uses the fallbacks.
+            static std::vector<CpuFeatures> GetFeatureSets()
+            {
+                return { CpuFeatures::GetHost(), CpuFeatures() };
+            }
+
+
+            // Returns zero, all ones, the extremes, single bits and a
+            // sequence of pseudo-random values with varying density.
+            template <typename T>
+            static std::vector<T> GetValues()
+            {
+                const unsigned bitCount = sizeof(T) * 8;
+
+                std::vector<T> values = {
+                    0,
+                    static_cast<T>(-1),
+                    (std::numeric_limits<T>::min)(),
+                    (std::numeric_limits<T>::max)()
+                };
+
+                for (unsigned i = 0; i < bitCount; i += 3)
+                {
+                    values.push_back(static_cast<T>(1ull << i));
+                }
+
+                uint64_t random = 0x123456789abcdefull;
+
+                for (unsigned i = 0; i < 32; ++i)
+                {
+                    random = random * 6364136223846793005ull + 1442695040888963407ull;
+                    values.push_back(static_cast<T>(random >> (i % 32)));
+                    values.push_back(static_cast<T>((random >> 7) & (random >> 32)));
+                }
+
+                return values;
+            }
+
+
+            //
+            // Reference implementations, one bit at a time.
+            //
+
+            template <typename T>
+            static T ExpectedPopcnt(T value)
+            {
+                const uint64_t v = static_cast<typename std::make_unsigned<T>::type>(value);
+                T count = 0;
+
+                for (unsigned i = 0; i < sizeof(T) * 8; ++i)
+                {
+                    count += static_cast<T>((v >> i) & 1);
+                }
+
+                return count;
+            }
+
+
+            template <typename T>
+            static T ExpectedLzcnt(T value)
+            {
+                const unsigned bitCount = sizeof(T) * 8;
+                const uint64_t v = static_cast<typename std::make_unsigned<T>::type>(value);
+
+                for (unsigned i = 0; i < bitCount; ++i)
+                {
+                    if (((v >> (bitCount - 1 - i)) & 1) != 0)
+                    {
+                        return static_cast<T>(i);
+                    }
+                }
+
+                return static_cast<T>(bitCount);
+            }
+
+
+            template <typename T>
+            static T ExpectedTzcnt(T value)
+            {
+                const unsigned bitCount = sizeof(T) * 8;
+                const uint64_t v = static_cast<typename std::make_unsigned<T>::type>(value);
+
+                for (unsigned i = 0; i < bitCount; ++i)
+                {
+                    if (((v >> i) & 1) != 0)
+                    {
+                        return static_cast<T>(i);
+                    }
+                }
+
+                return static_cast<T>(bitCount);
+            }
+
+
+            template <typename T>
+            static T ExpectedBextr(T value, unsigned start, unsigned length)
+            {
+                const uint64_t v = static_cast<typename std::make_unsigned<T>::type>(value);
+                uint64_t result = 0;
+
+                for (unsigned i = 0; i < length && start + i < sizeof(T) * 8; ++i)
+                {
+                    result |= ((v >> (start + i)) & 1) << i;
+                }
+
+                return static_cast<T>(result);
+            }
+
+
+            template <typename T>
+            static T ExpectedPdep(T value, T mask)
+            {
+                const uint64_t v = static_cast<typename std::make_unsigned<T>::type>(value);
+                const uint64_t m = static_cast<typename std::make_unsigned<T>::type>(mask);
+                uint64_t result = 0;
+                unsigned k = 0;
+
+                for (unsigned i = 0; i < sizeof(T) * 8; ++i)
+                {
+                    if (((m >> i) & 1) != 0)
+                    {
+                        result |= ((v >> k++) & 1) << i;
+                    }
+                }
+
+                return static_cast<T>(result);
+            }
+
+
+            template <typename T>
+            static T ExpectedPext(T value, T mask)
+            {
+                const uint64_t v = static_cast<typename std::make_unsigned<T>::type>(value);
+                const uint64_t m = static_cast<typename std::make_unsigned<T>::type>(mask);
+                uint64_t result = 0;
+                unsigned k = 0;
+
+                for (unsigned i = 0; i < sizeof(T) * 8; ++i)
+                {
+                    if (((m >> i) & 1) != 0)
+                    {
+                        result |= ((v >> i) & 1) << k++;
+                    }
+                }
+
+                return static_cast<T>(result);
+            }
+
+
+            //
+            // Verification for all the values and feature sets.
+            //
+
+            // Compiles the expression built by build(expression, p1) and
+            // compares it with expected(p1) for all the values.
+            template <typename T, typename BUILD, typename EXPECTED>
+            void VerifyUnary(BUILD build, EXPECTED expected)
+            {
+                for (auto const & features : GetFeatureSets())
+                {
+                    auto setup = GetSetup();
+                    Function<T, T> expression(setup->GetAllocator(), setup->GetCode());
+                    expression.SetCpuFeatures(features);
+
+                    auto & root = build(expression, expression.GetP1());
+                    auto function = expression.Compile(root);
+
+                    for (auto value : GetValues<T>())
+                    {
+                        ASSERT_EQ(expected(value), function(value))
+                            << "Value " << static_cast<int64_t>(value);
+                    }
+                }
+            }
+
+
+            // Same as VerifyUnary() with the second parameter taking all the
+            // values as well.
+            template <typename T, typename BUILD, typename EXPECTED>
+            void VerifyBinary(BUILD build, EXPECTED expected)
+            {
+                for (auto const & features : GetFeatureSets())
+                {
+                    auto setup = GetSetup();
+                    Function<T, T, T> expression(setup->GetAllocator(), setup->GetCode());
+                    expression.SetCpuFeatures(features);
+
+                    auto & root = build(expression, expression.GetP1(), expression.GetP2());
+                    auto function = expression.Compile(root);
+
+                    for (auto value1 : GetValues<T>())
+                    {
+                        for (auto value2 : GetValues<T>())
+                        {
+                            ASSERT_EQ(expected(value1, value2), function(value1, value2))
+                                << "Values " << static_cast<int64_t>(value1)
+                                << ", " << static_cast<int64_t>(value2);
+                        }
+                    }
+                }
+            }
+
+
+            template <typename T>
+            void VerifyBitCounts()
+            {
+                VerifyUnary<T>([](auto & e, auto & v) -> Node<T>& { return e.Popcnt(v); },
+                               [](T v) { return ExpectedPopcnt(v); });
+                VerifyUnary<T>([](auto & e, auto & v) -> Node<T>& { return e.Lzcnt(v); },
+                               [](T v) { return ExpectedLzcnt(v); });
+                VerifyUnary<T>([](auto & e, auto & v) -> Node<T>& { return e.Tzcnt(v); },
+                               [](T v) { return ExpectedTzcnt(v); });
+            }
+
+
+            template <typename T>
+            void VerifyBextr(uint8_t start, uint8_t length)
+            {
+                VerifyUnary<T>([=](auto & e, auto & v) -> Node<T>& { return e.Bextr(v, start, length); },
+                               [=](T v) { return ExpectedBextr(v, start, length); });
+            }
+
+
+            template <typename T>
+            void VerifyParallelBits()
+            {
+                VerifyBinary<T>([](auto & e, auto & v, auto & m) -> Node<T>& { return e.Pdep(v, m); },
+                                [](T v, T m) { return ExpectedPdep(v, m); });
+                VerifyBinary<T>([](auto & e, auto & v, auto & m) -> Node<T>& { return e.Pext(v, m); },
+                                [](T v, T m) { return ExpectedPext(v, m); });
+            }
+
+
+            // The masks known at compile time use the shift and and
+            // replacement for the masks with a single run of set bits.
+            template <typename T>
+            void VerifyParallelBitsImmediate(T mask)
+            {
+                VerifyUnary<T>([=](auto & e, auto & v) -> Node<T>& { return e.Pdep(v, e.Immediate(mask)); },
+                               [=](T v) { return ExpectedPdep(v, mask); });
+                VerifyUnary<T>([=](auto & e, auto & v) -> Node<T>& { return e.Pext(v, e.Immediate(mask)); },
+                               [=](T v) { return ExpectedPext(v, mask); });
+            }
+
+        TEST_FIXTURE_END_TEST_CASES_BEGIN
+
+
+        TEST_F(BitManipulation, BitCounts)
+        {
+            VerifyBitCounts<uint8_t>();
+            VerifyBitCounts<int8_t>();
+            VerifyBitCounts<uint16_t>();
+            VerifyBitCounts<int16_t>();
+            VerifyBitCounts<uint32_t>();
+            VerifyBitCounts<int32_t>();
+            VerifyBitCounts<uint64_t>();
+            VerifyBitCounts<int64_t>();
+        }
+
+
+        TEST_F(BitManipulation, Bextr)
+        {
+            VerifyBextr<uint32_t>(0, 1);
+            VerifyBextr<uint32_t>(3, 5);
+            VerifyBextr<uint32_t>(0, 32);
+            VerifyBextr<uint32_t>(31, 1);
+            VerifyBextr<int32_t>(20, 12);
+            VerifyBextr<int32_t>(28, 10);
+            VerifyBextr<uint64_t>(0, 33);
+            VerifyBextr<uint64_t>(40, 24);
+            VerifyBextr<int64_t>(63, 1);
+            VerifyBextr<int64_t>(17, 200);
+            VerifyBextr<uint8_t>(2, 3);
+            VerifyBextr<int16_t>(4, 12);
+            VerifyBextr<int16_t>(12, 8);
+
+            // Empty fields.
+            VerifyBextr<uint32_t>(5, 0);
+            VerifyBextr<uint64_t>(64, 3);
+            VerifyBextr<uint16_t>(16, 1);
+        }
+
+
+        TEST_F(BitManipulation, PdepPext)
+        {
+            VerifyParallelBits<uint32_t>();
+            VerifyParallelBits<int32_t>();
+            VerifyParallelBits<uint64_t>();
+            VerifyParallelBits<int64_t>();
+            VerifyParallelBits<uint8_t>();
+            VerifyParallelBits<int16_t>();
+        }
+
+
+        TEST_F(BitManipulation, PdepPextImmediate)
+        {
+            // Contiguous.
+            VerifyParallelBitsImmediate<uint32_t>(0);
+            VerifyParallelBitsImmediate<uint32_t>(1);
+            VerifyParallelBitsImmediate<uint32_t>(0xff0);
+            VerifyParallelBitsImmediate<uint32_t>(0x80000000);
+            VerifyParallelBitsImmediate<uint32_t>(0xffffffff);
+            VerifyParallelBitsImmediate<int32_t>(-16);
+            VerifyParallelBitsImmediate<uint16_t>(0x3f80);
+
+            // Non-contiguous.
+            VerifyParallelBitsImmediate<uint32_t>(0xf0f0);
+            VerifyParallelBitsImmediate<int32_t>(static_cast<int32_t>(0x80000001u));
+
+            // 64-bit immediates are not inline.
+            VerifyParallelBitsImmediate<uint64_t>(0xfff000000ull);
+            VerifyParallelBitsImmediate<uint64_t>(0x8000000000000001ull);
+        }
+
+
+        TEST_F(BitManipulation, CpuFeatures)
+        {
+            CpuFeatures features;
+
+            for (unsigned i = 0; i < static_cast<unsigned>(CpuFeature::FeatureCount); ++i)
+            {
+                ASSERT_FALSE(features.IsSupported(static_cast<CpuFeature>(i)));
+            }
+
+            features.Add(CpuFeature::Bmi2).Add(CpuFeature::PopCnt);
+
+            ASSERT_TRUE(features.IsSupported(CpuFeature::Bmi2));
+            ASSERT_TRUE(features.IsSupported(CpuFeature::PopCnt));
+            ASSERT_FALSE(features.IsSupported(CpuFeature::Bmi1));
+
+            features.Remove(CpuFeature::Bmi2);
+
+            ASSERT_FALSE(features.IsSupported(CpuFeature::Bmi2));
+            ASSERT_STREQ("bmi2", CpuFeatures::GetName(CpuFeature::Bmi2));
+            ASSERT_STREQ("avx512f", CpuFeatures::GetName(CpuFeature::Avx512F));
+        }
+
+
+        TEST_F(BitManipulation, HostCpuFeatures)
+        {
+            auto & host = CpuFeatures::GetHost();
+
+            // The extensions which build on AVX are only reported together
+            // with it since they share the requirement for the ymm state.
+            if (host.IsSupported(CpuFeature::Avx2) || host.IsSupported(CpuFeature::Fma))
+            {
+                ASSERT_TRUE(host.IsSupported(CpuFeature::Avx));
+            }
+
+            if (host.IsSupported(CpuFeature::Avx))
+            {
+                ASSERT_TRUE(host.IsSupported(CpuFeature::Sse41));
+            }
+        }
+
+
+        TEST_F(BitManipulation, ExpressionTreeCpuFeatures)
+        {
+            auto setup = GetSetup();
+            setup->GetCode().SetCpuFeatures(CpuFeatures().Add(CpuFeature::Bmi1));
+
+            Function<uint64_t, uint64_t> expression(setup->GetAllocator(), setup->GetCode());
+
+            // The tree starts with the features of the code generator.
+            ASSERT_TRUE(expression.GetCpuFeatures().IsSupported(CpuFeature::Bmi1));
+            ASSERT_FALSE(expression.GetCpuFeatures().IsSupported(CpuFeature::PopCnt));
+
+            expression.SetCpuFeatures(CpuFeatures().Add(CpuFeature::PopCnt));
+
+            ASSERT_FALSE(expression.GetCpuFeatures().IsSupported(CpuFeature::Bmi1));
+            ASSERT_TRUE(expression.GetCpuFeatures().IsSupported(CpuFeature::PopCnt));
+            ASSERT_TRUE(setup->GetCode().GetCpuFeatures().IsSupported(CpuFeature::Bmi1));
+        }
+
+
+        TEST_F(BitManipulation, Tiers)
+        {
+            auto setup = GetSetup();
+
+            Function<uint64_t, uint64_t, uint64_t> expression(setup->GetAllocator(), setup->GetCode());
+
+            auto & p1 = expression.GetP1();
+            auto & p2 = expression.GetP2();
+            auto & counts = expression.Add(expression.Popcnt(p1),
+                                           expression.Shl(expression.Add(expression.Lzcnt(p2),
+                                                                         expression.Tzcnt(p2)),
+                                                          static_cast<uint8_t>(8)));
+            auto & bits = expression.Xor(expression.Pdep(expression.Bextr(p1, 4, 12), p2),
+                                         expression.Pext(p1, p2));
+            auto & root = expression.Add(counts, expression.Shl(bits, static_cast<uint8_t>(16)));
+
+            TieredFunction<uint64_t, uint64_t, uint64_t> function(expression, root, c_tierPromotionThreshold);
+
+            // b has two runs of 4 set bits, at bits 40 and 52. The low 8 bits
+            // of bextr(a, 4, 12) = 0xdef get deposited into them and the
+            // nibbles 10 and 13 of a get extracted from them.
+            const uint64_t a = 0x123456789abcdef0ull;
+            const uint64_t b = 0x00f00f0000000000ull;
+            const uint64_t expected = 32 + ((8 + 40) << 8) + ((0x00e00f0000000000ull ^ 0x36) << 16);
+
+            VerifyTiers(function, expected, a, b);
+        }
+
+        TEST_CASES_END
+    }
+}
@@ -0,0 +1,554 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <vector>
+
+#include "NativeJIT/BranchProfile.h"
+#include "NativeJIT/Bytecode.h"
+#include "NativeJIT/CodeGen/ExecutionBuffer.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/Function.h"
+#include "Temporary/Allocator.h"
+#include "TestSetup.h"
+
+
+namespace NativeJIT
+{
+    namespace BranchProfileUnitTest
+    {
+        TEST_FIXTURE_START(BranchProfileTest)
+
+        public:
+            BranchProfileTest()
+                : TestFixture(c_defaultCodeAllocatorCapacity,
+                              64 * 1024,
+                              c_defaultDiagnosticsStream)
+            {
+            }
+
+        protected:
+            typedef Function<int64_t, int64_t, int64_t> BinaryFunction;
+
+            // Builds (p1 > p2) ? p1 - p2 : p2 + 3. The same sequence of calls
+            // produces the same node IDs, which is what allows a profile to be
+            // applied to a tree that is built again.
+            static Node<int64_t>& BuildConditional(BinaryFunction& expression)
+            {
+                auto & p1 = expression.GetP1();
+                auto & p2 = expression.GetP2();
+
+                auto & condition = expression.Compare<JccType::JG>(p1, p2);
+                auto & difference = expression.Sub(p1, p2);
+                auto & sum = expression.Add(p2, expression.Immediate<int64_t>(3));
+
+                return expression.Conditional(condition, difference, sum);
+            }
+
+
+            static int64_t ExpectedConditional(int64_t p1, int64_t p2)
+            {
+                return p1 > p2 ? p1 - p2 : p2 + 3;
+            }
+
+
+            // Runs the instrumented build on inputs where (p1 > p2) holds for
+            // trueCount out of 100 calls and then checks the layout and the
+            // results of the build that uses the profile.
+            void VerifyRecompilation(unsigned trueCount, BranchLayout expectedLayout)
+            {
+                auto setup = GetSetup();
+                BranchProfile profile;
+
+                {
+                    BinaryFunction expression(setup->GetAllocator(), setup->GetCode());
+                    expression.SetBranchProfile(profile, BranchProfileMode::Instrument);
+
+                    auto function = expression.Compile(BuildConditional(expression));
+
+                    for (unsigned i = 0; i < 100; ++i)
+                    {
+                        const int64_t p1 = i;
+                        const int64_t p2 = i < trueCount ? -1 : 1000;
+
+                        ASSERT_EQ(ExpectedConditional(p1, p2), function(p1, p2));
+                    }
+                }
+
+                BinaryFunction expression(setup->GetAllocator(), setup->GetCode());
+                expression.SetBranchProfile(profile, BranchProfileMode::Optimize);
+
+                auto & root = BuildConditional(expression);
+                auto function = expression.Compile(root);
+
+                ASSERT_EQ(expectedLayout, expression.GetBranchLayout(root));
+
+                const int64_t values[] = { -5, 0, 1, 7, 1000 };
+
+                for (auto p1 : values)
+                {
+                    for (auto p2 : values)
+                    {
+                        ASSERT_EQ(ExpectedConditional(p1, p2), function(p1, p2));
+                    }
+                }
+            }
+
+
+            // Values passed to Record() in the order of the calls.
+            static std::vector<int64_t> s_recorded;
+
+            static int64_t Record(int64_t value)
+            {
+                s_recorded.push_back(value);
+                return value;
+            }
+
+
+            // Adds the preconditions p1 != 0 and p2 != 0, each of which passes
+            // its parameter through Record(), and returns p1 + p2. The second
+            // precondition is independent of the first one.
+            static Node<int64_t>& BuildRecordedPreconditions(BinaryFunction& expression)
+            {
+                auto & zero = expression.Immediate<int64_t>(0);
+                auto & otherwise = expression.Immediate<int64_t>(-1);
+                expression.AddExecuteOnlyIfStatement(
+                    expression.Compare<JccType::JNE>(
+                        expression.Call(expression.Immediate(&Record), expression.GetP1()),
+                        zero),
+                    otherwise);
+                expression.AddExecuteOnlyIfStatement(
+                    expression.Compare<JccType::JNE>(
+                        expression.Call(expression.Immediate(&Record), expression.GetP2()),
+                        zero),
+                    otherwise,
+                    BranchHint::None,
+                    PreconditionOrder::Independent);
+
+                return expression.Add(expression.GetP1(), expression.GetP2());
+            }
+
+        TEST_FIXTURE_END_TEST_CASES_BEGIN
+
+
+        std::vector<int64_t> BranchProfileTest::s_recorded;
+
+
+        TEST_F(BranchProfileTest, ConditionalCounts)
+        {
+            auto setup = GetSetup();
+            BranchProfile profile;
+
+            BinaryFunction expression(setup->GetAllocator(), setup->GetCode());
+            expression.SetBranchProfile(profile, BranchProfileMode::Instrument);
+
+            auto & root = BuildConditional(expression);
+            auto function = expression.Compile(root);
+
+            ASSERT_EQ(ExpectedConditional(5, 4), function(5, 4));
+            ASSERT_EQ(ExpectedConditional(6, 4), function(6, 4));
+            ASSERT_EQ(ExpectedConditional(7, 4), function(7, 4));
+            ASSERT_EQ(ExpectedConditional(3, 4), function(3, 4));
+            ASSERT_EQ(ExpectedConditional(4, 4), function(4, 4));
+
+            auto & counts = profile.GetCounts(root);
+            ASSERT_EQ(3u, counts.m_taken);
+            ASSERT_EQ(2u, counts.m_notTaken);
+
+            profile.Reset();
+            ASSERT_EQ(0u, counts.m_taken);
+            ASSERT_EQ(0u, counts.m_notTaken);
+        }
+
+
+        TEST_F(BranchProfileTest, PreconditionCounts)
+        {
+            auto setup = GetSetup();
+            BranchProfile profile;
+
+            BinaryFunction expression(setup->GetAllocator(), setup->GetCode());
+            expression.SetBranchProfile(profile, BranchProfileMode::Instrument);
+
+            auto & zero = expression.Immediate<int64_t>(0);
+            expression.AddExecuteOnlyIfStatement(
+                expression.Compare<JccType::JNE>(expression.GetP1(), zero),
+                expression.Immediate<int64_t>(-1));
+
+            auto function = expression.Compile(expression.Add(expression.GetP1(),
+                                                               expression.GetP2()));
+
+            ASSERT_EQ(3, function(1, 2));
+            ASSERT_EQ(-1, function(0, 2));
+            ASSERT_EQ(-1, function(0, 5));
+            ASSERT_EQ(-1, function(0, 7));
+
+            auto & counts = profile.GetPreconditionCounts(0);
+            ASSERT_EQ(1u, counts.m_taken);
+            ASSERT_EQ(3u, counts.m_notTaken);
+        }
+
+
+        TEST_F(BranchProfileTest, RecompileFalseFallThrough)
+        {
+            VerifyRecompilation(2, BranchLayout::FalseFallThrough);
+        }
+
+
+        TEST_F(BranchProfileTest, RecompileTrueFallThrough)
+        {
+            VerifyRecompilation(98, BranchLayout::TrueFallThrough);
+        }
+
+
+        TEST_F(BranchProfileTest, RecompileBranchless)
+        {
+            VerifyRecompilation(50, BranchLayout::Branchless);
+        }
+
+
+        // The second precondition fails more often, but it must not be moved
+        // ahead of the first one since the function would then return a
+        // different value when both fail.
+        TEST_F(BranchProfileTest, PreconditionOrderPreservesResult)
+        {
+            auto setup = GetSetup();
+            BranchProfile profile;
+
+            for (auto mode : { BranchProfileMode::Instrument, BranchProfileMode::Optimize })
+            {
+                BinaryFunction expression(setup->GetAllocator(), setup->GetCode());
+                expression.SetBranchProfile(profile, mode);
+
+                auto & zero = expression.Immediate<int64_t>(0);
+                expression.AddExecuteOnlyIfStatement(
+                    expression.Compare<JccType::JNE>(expression.GetP1(), zero),
+                    expression.Immediate<int64_t>(-1));
+                expression.AddExecuteOnlyIfStatement(
+                    expression.Compare<JccType::JNE>(expression.GetP2(), zero),
+                    expression.Immediate<int64_t>(-2));
+
+                auto function = expression.Compile(expression.Add(expression.GetP1(),
+                                                                  expression.GetP2()));
+
+                for (int64_t i = 0; i < 10; ++i)
+                {
+                    ASSERT_EQ(i < 2 ? -2 : 3, function(1, i < 2 ? 0 : 2));
+                }
+
+                ASSERT_EQ(-1, function(0, 0));
+                ASSERT_EQ(3, function(1, 2));
+            }
+        }
+
+
+        // Both preconditions return the same node and the second one is
+        // independent of the first, so the one that fails more often is
+        // evaluated first.
+        TEST_F(BranchProfileTest, PreconditionOrderShared)
+        {
+            auto setup = GetSetup();
+            BranchProfile profile;
+
+            for (auto mode : { BranchProfileMode::Instrument, BranchProfileMode::Optimize })
+            {
+                BinaryFunction expression(setup->GetAllocator(), setup->GetCode());
+                expression.SetBranchProfile(profile, mode);
+
+                auto & zero = expression.Immediate<int64_t>(0);
+                auto & otherwise = expression.Immediate<int64_t>(-1);
+                expression.AddExecuteOnlyIfStatement(
+                    expression.Compare<JccType::JNE>(expression.GetP1(), zero),
+                    otherwise);
+                expression.AddExecuteOnlyIfStatement(
+                    expression.Compare<JccType::JNE>(expression.GetP2(), zero),
+                    otherwise,
+                    BranchHint::None,
+                    PreconditionOrder::Independent);
+
+                auto function = expression.Compile(expression.Add(expression.GetP1(),
+                                                                  expression.GetP2()));
+
+                ASSERT_EQ(-1, function(1, 0));
+                ASSERT_EQ(-1, function(1, 0));
+                ASSERT_EQ(-1, function(0, 1));
+                ASSERT_EQ(-1, function(0, 0));
+                ASSERT_EQ(5, function(2, 3));
+            }
+
+            ASSERT_EQ(2u, profile.GetPreconditionCounts(0).m_notTaken);
+            ASSERT_EQ(2u, profile.GetPreconditionCounts(1).m_notTaken);
+        }
+
+
+        // The second precondition dereferences the pointer checked by the first
+        // one. It fails more often, but since it isn't marked as independent
+        // it must stay behind the null check.
+        TEST_F(BranchProfileTest, PreconditionOrderDependent)
+        {
+            auto setup = GetSetup();
+            BranchProfile profile;
+            int64_t negative = -3;
+            int64_t positive = 5;
+
+            for (auto mode : { BranchProfileMode::Instrument, BranchProfileMode::Optimize })
+            {
+                Function<int64_t, int64_t*> expression(setup->GetAllocator(), setup->GetCode());
+                expression.SetBranchProfile(profile, mode);
+
+                auto & pointer = expression.GetP1();
+                auto & otherwise = expression.Immediate<int64_t>(-1);
+                expression.AddExecuteOnlyIfStatement(
+                    expression.Compare<JccType::JNE>(pointer,
+                                                     expression.Immediate<int64_t*>(nullptr)),
+                    otherwise);
+                expression.AddExecuteOnlyIfStatement(
+                    expression.Compare<JccType::JG>(expression.Deref(pointer),
+                                                    expression.Immediate<int64_t>(0)),
+                    otherwise);
+
+                auto function = expression.Compile(expression.Deref(pointer));
+
+                if (mode == BranchProfileMode::Instrument)
+                {
+                    for (unsigned i = 0; i < 10; ++i)
+                    {
+                        ASSERT_EQ(-1, function(&negative));
+                    }
+                }
+
+                ASSERT_EQ(-1, function(nullptr));
+                ASSERT_EQ(5, function(&positive));
+            }
+
+            ASSERT_EQ(1u, profile.GetPreconditionCounts(0).m_notTaken);
+            ASSERT_EQ(10u, profile.GetPreconditionCounts(1).m_notTaken);
+        }
+
+
+        // The profile changes the order in which the compiled code evaluates
+        // the tests, but not the order of the tests in the tree: the bytecode
+        // lowered after the compilation evaluates them in the order in which
+        // they were added.
+        TEST_F(BranchProfileTest, PreconditionOrderLowerAfterCompile)
+        {
+            auto setup = GetSetup();
+            BranchProfile profile;
+
+            for (auto mode : { BranchProfileMode::Instrument, BranchProfileMode::Optimize })
+            {
+                BinaryFunction expression(setup->GetAllocator(), setup->GetCode());
+                expression.SetBranchProfile(profile, mode);
+
+                auto & root = BuildRecordedPreconditions(expression);
+                auto function = expression.Compile(root);
+
+                if (mode == BranchProfileMode::Instrument)
+                {
+                    for (unsigned i = 0; i < 10; ++i)
+                    {
+                        ASSERT_EQ(-1, function(1, 0));
+                    }
+
+                    continue;
+                }
+
+                // The second test fails more often, so it's evaluated first.
+                s_recorded.clear();
+                ASSERT_EQ(7, function(3, 4));
+                ASSERT_EQ((std::vector<int64_t> { 4, 3 }), s_recorded);
+
+                Bytecode bytecode;
+                expression.Lower(bytecode, root);
+                ASSERT_TRUE(bytecode.CanEvaluate());
+
+                const Bytecode::Slot parameters[Bytecode::c_maxParameterCount] = { 3, 4 };
+
+                s_recorded.clear();
+                ASSERT_EQ(7, bytecode.Evaluate<int64_t>(parameters));
+                ASSERT_EQ((std::vector<int64_t> { 3, 4 }), s_recorded);
+            }
+
+            ASSERT_EQ(10u, profile.GetPreconditionCounts(1).m_notTaken);
+        }
+
+
+        // Without a profile, the hints move the unlikely value into a cold
+        // block. The results must not depend on the hint.
+        // Whatever the profile, the pointer is only dereferenced if the
+        // condition guarding it against null holds.
+        TEST_F(BranchProfileTest, NullGuardedLoad)
+        {
+            auto setup = GetSetup();
+            int64_t value = 5;
+
+            for (unsigned nonNullCount : { 2u, 50u, 98u })
+            {
+                BranchProfile profile;
+
+                for (auto mode : { BranchProfileMode::Instrument, BranchProfileMode::Optimize })
+                {
+                    Function<int64_t, int64_t*> expression(setup->GetAllocator(), setup->GetCode());
+                    expression.SetBranchProfile(profile, mode);
+
+                    auto & pointer = expression.GetP1();
+                    auto & root = expression.Conditional(
+                        expression.Compare<JccType::JNE>(pointer,
+                                                         expression.Immediate<int64_t*>(nullptr)),
+                        expression.Deref(pointer),
+                        expression.Immediate<int64_t>(-1));
+
+                    auto function = expression.Compile(root);
+
+                    if (mode == BranchProfileMode::Instrument)
+                    {
+                        for (unsigned i = 0; i < 100; ++i)
+                        {
+                            ASSERT_EQ(i < nonNullCount ? 5 : -1,
+                                      function(i < nonNullCount ? &value : nullptr));
+                        }
+                    }
+
+                    ASSERT_EQ(-1, function(nullptr));
+                    ASSERT_EQ(5, function(&value));
+                }
+            }
+        }
+
+
+        TEST_F(BranchProfileTest, ConditionalHints)
+        {
+            auto setup = GetSetup();
+
+            for (auto hint : { BranchHint::None, BranchHint::Likely, BranchHint::Unlikely })
+            {
+                BinaryFunction expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & p1 = expression.GetP1();
+                auto & p2 = expression.GetP2();
+
+                auto & condition = expression.Compare<JccType::JG>(p1, p2);
+                auto & difference = expression.Sub(p1, p2);
+                auto & sum = expression.Add(p2, expression.Immediate<int64_t>(3));
+
+                auto function = expression.Compile(
+                    expression.Conditional(condition, difference, sum, hint));
+
+                ASSERT_EQ(4, function(7, 3));
+                ASSERT_EQ(10, function(3, 7));
+                ASSERT_EQ(10, function(7, 7));
+            }
+        }
+
+
+        // Neither the hot nor the cold path reads the value of the other one,
+        // so a pointer can be guarded against null with either hint.
+        TEST_F(BranchProfileTest, ConditionalHintsNullGuardedLoad)
+        {
+            auto setup = GetSetup();
+            int64_t value = 5;
+
+            for (auto hint : { BranchHint::Likely, BranchHint::Unlikely })
+            {
+                Function<int64_t, int64_t*> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & pointer = expression.GetP1();
+                auto & isNull = expression.Compare<JccType::JE>(
+                    pointer,
+                    expression.Immediate<int64_t*>(nullptr));
+
+                auto function = expression.Compile(
+                    expression.Conditional(isNull,
+                                           expression.Immediate<int64_t>(-1),
+                                           expression.Deref(pointer),
+                                           hint));
+
+                ASSERT_EQ(-1, function(nullptr));
+                ASSERT_EQ(5, function(&value));
+            }
+        }
+
+
+        TEST_F(BranchProfileTest, PreconditionHint)
+        {
+            auto setup = GetSetup();
+            BranchProfile profile;
+
+            for (bool isInstrumented : { false, true })
+            {
+                BinaryFunction expression(setup->GetAllocator(), setup->GetCode());
+
+                if (isInstrumented)
+                {
+                    expression.SetBranchProfile(profile, BranchProfileMode::Instrument);
+                }
+
+                // The early return is placed in a cold block.
+                auto & zero = expression.Immediate<int64_t>(0);
+                expression.AddExecuteOnlyIfStatement(
+                    expression.Compare<JccType::JNE>(expression.GetP1(), zero),
+                    expression.Immediate<int64_t>(-1),
+                    BranchHint::Likely);
+
+                auto function = expression.Compile(expression.Add(expression.GetP1(),
+                                                                   expression.GetP2()));
+
+                ASSERT_EQ(3, function(1, 2));
+                ASSERT_EQ(5, function(2, 3));
+                ASSERT_EQ(-1, function(0, 2));
+            }
+
+            auto & counts = profile.GetPreconditionCounts(0);
+            ASSERT_EQ(2u, counts.m_taken);
+            ASSERT_EQ(1u, counts.m_notTaken);
+        }
+
+
+        // The padding at the join labels must not change the results.
+        TEST_F(BranchProfileTest, AlignedJoins)
+        {
+            auto setup = GetSetup();
+            auto & code = setup->GetCode();
+
+            CodeAlignment alignment;
+            alignment.m_entry = 32;
+            alignment.m_join = 16;
+            code.SetCodeAlignment(alignment);
+
+            BinaryFunction expression(setup->GetAllocator(), code);
+
+            auto & zero = expression.Immediate<int64_t>(0);
+            expression.AddExecuteOnlyIfStatement(
+                expression.Compare<JccType::JNE>(expression.GetP1(), zero),
+                expression.Immediate<int64_t>(-1));
+
+            auto function = expression.Compile(BuildConditional(expression));
+            code.SetCodeAlignment(CodeAlignment());
+
+            ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(code.GetEntryPoint()) % 32);
+            ASSERT_EQ(4, function(7, 3));
+            ASSERT_EQ(10, function(3, 7));
+            ASSERT_EQ(-1, function(0, 7));
+        }
+
+        TEST_CASES_END
+    }
+}
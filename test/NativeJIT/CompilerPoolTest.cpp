@@ -0,0 +1,152 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <future>
+#include <stdexcept>
+#include <vector>
+
+#include "NativeJIT/CompilerPool.h"
+#include "NativeJIT/Function.h"
+#include "TestSetup.h"
+
+
+namespace NativeJIT
+{
+    namespace CompilerPoolUnitTest
+    {
+        const size_t c_allocatorCapacity = 8192;
+        const unsigned c_codeCapacity = 4096;
+
+
+        TEST_FIXTURE_START(CompilerPoolTest)
+        TEST_FIXTURE_END_TEST_CASES_BEGIN
+
+
+        TEST_F(CompilerPoolTest, Compile)
+        {
+            CompilerPool pool(1, c_allocatorCapacity, c_codeCapacity);
+
+            auto future = pool.Compile<uint64_t, uint64_t, uint64_t>(
+                [](Function<uint64_t, uint64_t, uint64_t>& expression) -> Node<uint64_t>&
+                {
+                    return expression.Mul(expression.Add(expression.GetP1(), expression.GetP2()),
+                                          expression.Immediate(3ull));
+                });
+
+            auto function = future.get();
+
+            ASSERT_EQ(15u, function(2, 3));
+            ASSERT_EQ(15u, function.GetEntryPoint()(2, 3));
+
+            auto statistics = pool.GetStatistics();
+
+            ASSERT_EQ(1u, statistics.m_completedCount);
+            ASSERT_EQ(0u, statistics.m_queueDepth);
+            ASSERT_EQ(1u, statistics.m_maxQueueDepth);
+            ASSERT_LE(statistics.m_maxLatency, statistics.m_totalLatency);
+        }
+
+
+        TEST_F(CompilerPoolTest, ManyFunctions)
+        {
+            const unsigned c_functionCount = 32;
+
+            CompilerPool pool(3, c_allocatorCapacity, c_codeCapacity);
+            std::vector<std::future<CompiledFunction<int32_t, int32_t>>> futures;
+
+            for (int32_t i = 0; i < static_cast<int32_t>(c_functionCount); ++i)
+            {
+                futures.push_back(pool.Compile<int32_t, int32_t>(
+                    [i](Function<int32_t, int32_t>& expression) -> Node<int32_t>&
+                    {
+                        return expression.Sub(expression.GetP1(), expression.Immediate(i));
+                    }));
+            }
+
+            // Each function keeps its code after the workers move on.
+            std::vector<CompiledFunction<int32_t, int32_t>> functions;
+
+            for (auto & future : futures)
+            {
+                functions.push_back(future.get());
+            }
+
+            for (int32_t i = 0; i < static_cast<int32_t>(c_functionCount); ++i)
+            {
+                ASSERT_EQ(100 - i, functions[i](100));
+            }
+
+            auto statistics = pool.GetStatistics();
+
+            ASSERT_EQ(c_functionCount, statistics.m_completedCount);
+            ASSERT_EQ(0u, statistics.m_queueDepth);
+            ASSERT_GE(statistics.m_maxQueueDepth, 1u);
+        }
+
+
+        TEST_F(CompilerPoolTest, Exception)
+        {
+            CompilerPool pool(1, c_allocatorCapacity, c_codeCapacity);
+
+            auto failed = pool.Compile<int32_t, int32_t>(
+                [](Function<int32_t, int32_t>&) -> Node<int32_t>&
+                {
+                    throw std::runtime_error("Cannot build the expression");
+                });
+
+            // The worker remains usable after a failure.
+            auto succeeded = pool.Compile<int32_t, int32_t>(
+                [](Function<int32_t, int32_t>& expression) -> Node<int32_t>&
+                {
+                    return expression.Neg(expression.GetP1());
+                });
+
+            ASSERT_THROW(failed.get(), std::runtime_error);
+            ASSERT_EQ(-7, succeeded.get()(7));
+            ASSERT_EQ(2u, pool.GetStatistics().m_completedCount);
+        }
+
+
+        TEST_F(CompilerPoolTest, NotCompiled)
+        {
+            CompilerPool pool(1, c_allocatorCapacity, c_codeCapacity);
+
+            // A compilation abandoned because of the budget fails the future
+            // rather than completing it with a null entry point.
+            auto abandoned = pool.Compile<int32_t, int32_t>(
+                [](Function<int32_t, int32_t>& expression) -> Node<int32_t>&
+                {
+                    CompileBudget budget;
+                    budget.m_maxNodeCount = 1;
+                    expression.SetCompileBudget(budget);
+
+                    return expression.Neg(expression.GetP1());
+                });
+
+            ASSERT_THROW(abandoned.get(), std::runtime_error);
+            ASSERT_EQ(1u, pool.GetStatistics().m_completedCount);
+        }
+
+        TEST_CASES_END
+    }
+}
@@ -28,6 +28,7 @@
 #include "NativeJIT/Function.h"
 #include "Temporary/Allocator.h"
 #include "TestSetup.h"
+#include "TierVerifier.h"
 
 
 namespace NativeJIT
@@ -477,6 +478,133 @@ namespace NativeJIT
         }
 
 
+        TEST_F(ExpressionTree, ConstantPool)
+        {
+            auto setup = GetSetup();
+            Function<double, double> expression(setup->GetAllocator(), setup->GetCode());
+
+            // The two occurrences of 1.5 share a single copy.
+            auto & left = expression.Mul(expression.GetP1(), expression.Immediate(1.5));
+            auto & right = expression.Mul(expression.GetP1(), expression.Immediate(1.5));
+            auto & sum = expression.Add(expression.Add(left, right),
+                                        expression.Immediate(2.5));
+
+            auto function = expression.Compile(sum);
+
+            ASSERT_EQ(3u, expression.GetConstantPool().GetConstantCount());
+            ASSERT_EQ(2 * sizeof(double), expression.GetConstantPool().GetByteCount());
+
+            // The pool, which precedes the unwind info, doesn't share a cache
+            // line with the code.
+            auto & code = setup->GetCode();
+            ASSERT_LT(0u, code.GetUnwindInfoStartOffset());
+            ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(code.GetEntryPoint()) % 64);
+
+            ASSERT_EQ(8.5, function(2.0));
+        }
+
+
+        TEST_F(ExpressionTree, LeafFunctionFrame)
+        {
+            auto setup = GetSetup();
+            auto & code = setup->GetCode();
+            Function<uint64_t, uint64_t, uint64_t> expression(setup->GetAllocator(), code);
+
+            auto & sum = expression.Add(expression.GetP1(), expression.GetP2());
+            auto function = expression.Compile(sum);
+
+            ASSERT_EQ(5u, function(2, 3));
+
+            // Without calls and temporaries there is no prolog and the unwind
+            // info consists of its 4 byte header only, directly followed by
+            // the body.
+            ASSERT_EQ(code.GetUnwindInfoStartOffset() + 4, code.GetFunctionCodeStartOffset());
+
+            // The body is not preceded by sub rsp, imm8.
+            const uint8_t subRsp[] = { 0x48, 0x83, 0xec };
+            ASSERT_NE(0, memcmp(code.GetEntryPoint(), subRsp, sizeof(subRsp)));
+        }
+
+
+        TEST_F(ExpressionTree, CompileBudget)
+        {
+            auto setup = GetSetup();
+            auto & code = setup->GetCode();
+
+            // Compiles max(p1, p2) with the budget and returns the code size.
+            auto compile = [&setup, &code](CompileBudget const & budget,
+                                           CompilationTier expectedTier) -> unsigned
+            {
+                Function<int64_t, int64_t, int64_t> expression(setup->GetAllocator(), code);
+                expression.SetCompileBudget(budget);
+
+                auto & p1 = expression.GetP1();
+                auto & p2 = expression.GetP2();
+                auto & root = expression.Conditional(expression.Compare<JccType::JG>(p1, p2), p1, p2);
+                auto function = expression.Compile(root);
+
+                EXPECT_EQ(expectedTier, expression.GetCompilationTier());
+
+                if (expectedTier == CompilationTier::NotCompiled)
+                {
+                    EXPECT_EQ(nullptr, function);
+                    return 0;
+                }
+
+                EXPECT_EQ(5, function(5, -3));
+                EXPECT_EQ(8, function(2, 8));
+
+                return code.GetFunctionCodeEndOffset() - code.GetFunctionCodeStartOffset();
+            };
+
+            const unsigned optimizedSize = compile(CompileBudget(), CompilationTier::Optimized);
+
+            // The baseline tier keeps the long forms of the jumps.
+            CompileBudget budget;
+            budget.m_baselineNodeCount = 1;
+            ASSERT_LT(optimizedSize, compile(budget, CompilationTier::Baseline));
+
+            budget = CompileBudget();
+            budget.m_baselineDuration = std::chrono::microseconds(0);
+            ASSERT_LT(optimizedSize, compile(budget, CompilationTier::Baseline));
+
+            budget = CompileBudget();
+            budget.m_maxNodeCount = 1;
+            compile(budget, CompilationTier::NotCompiled);
+
+            budget = CompileBudget();
+            budget.m_maxDuration = std::chrono::microseconds(0);
+            compile(budget, CompilationTier::NotCompiled);
+        }
+
+
+        TEST_F(ExpressionTree, CompileBudgetTiers)
+        {
+            auto setup = GetSetup();
+
+            Function<int32_t, int32_t, int32_t> expression(setup->GetAllocator(), setup->GetCode());
+
+            CompileBudget budget;
+            budget.m_maxNodeCount = 1;
+            expression.SetCompileBudget(budget);
+
+            auto & root = expression.Mul(expression.GetP1(), expression.GetP2());
+
+            TieredFunction<int32_t, int32_t, int32_t> function(expression, root, c_tierPromotionThreshold);
+
+            for (uint64_t i = 0; i <= c_tierPromotionThreshold; ++i)
+            {
+                ASSERT_EQ(-42, function(6, -7));
+            }
+
+            // The abandoned compilation leaves the calls in the interpreter.
+            function.WaitForPromotion();
+
+            ASSERT_EQ(CompilationTier::NotCompiled, expression.GetCompilationTier());
+            ASSERT_FALSE(function.IsCompiled());
+            ASSERT_EQ(-42, function(6, -7));
+        }
+
         TEST_CASES_END
     }
 }
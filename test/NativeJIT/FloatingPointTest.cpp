@@ -22,11 +22,15 @@
 
 
 
+#include <cmath>
+
 #include "NativeJIT/Function.h"
+#include "NativeJIT/CodeGen/CpuFeatures.h"
 #include "NativeJIT/CodeGen/ExecutionBuffer.h"
 #include "NativeJIT/CodeGen/FunctionBuffer.h"
 #include "Temporary/Allocator.h"
 #include "TestSetup.h"
+#include "TierVerifier.h"
 
 
 namespace NativeJIT
@@ -34,6 +38,54 @@ namespace NativeJIT
     namespace FloatingPointUnitTest
     {
         TEST_FIXTURE_START(FloatingPoint)
+
+        protected:
+            // Returns a * b + c with the separate roundings of the product and
+            // the sum. The product is stored to prevent the compiler from
+            // contracting the expression.
+            template <typename T>
+            static T MulAdd(T a, T b, T c)
+            {
+                volatile T product = a * b;
+                return product + c;
+            }
+
+
+            // Verifies Add(p3, Mul(p1, p2)) with and without FMA. The values
+            // are chosen so that the product is not exact and the results of
+            // the fused and the separate operations differ.
+            template <typename T>
+            void VerifyFusedMultiplyAdd(T p1, T p2, T p3)
+            {
+                ASSERT_NE(std::fma(p1, p2, p3), MulAdd(p1, p2, p3));
+
+                for (bool isFused : { true, false })
+                {
+                    CpuFeatures features = CpuFeatures::GetHost();
+
+                    if (!isFused)
+                    {
+                        features.Remove(CpuFeature::Fma);
+                    }
+                    else if (!features.IsSupported(CpuFeature::Fma))
+                    {
+                        continue;
+                    }
+
+                    auto setup = GetSetup();
+                    Function<T, T, T, T> expression(setup->GetAllocator(), setup->GetCode());
+                    expression.SetCpuFeatures(features);
+
+                    auto & a = expression.Add(expression.GetP3(),
+                                              expression.Mul(expression.GetP1(), expression.GetP2()));
+                    auto function = expression.Compile(a);
+
+                    const T expected = isFused ? std::fma(p1, p2, p3) : MulAdd(p1, p2, p3);
+
+                    ASSERT_EQ(expected, function(p1, p2, p3));
+                }
+            }
+
         TEST_FIXTURE_END_TEST_CASES_BEGIN
 
         TEST_F(FloatingPoint, ImmediateDouble)
@@ -76,6 +128,26 @@ namespace NativeJIT
         }
 
 
+        TEST_F(FloatingPoint, ArrayOfDoubleWithVariableIndex)
+        {
+            auto setup = GetSetup();
+
+            {
+                Function<double, double*, uint8_t> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & element = expression.Deref(expression.Add(expression.GetP1(), expression.GetP2()));
+                auto & sum = expression.Add(element, expression.Deref(expression.GetP1(), 1));
+
+                auto function = expression.Compile(sum);
+
+                double array[] = { 0.5, 1.25, 2.5, 3.75 };
+
+                ASSERT_EQ(array[3] + array[1], function(array, 3));
+                ASSERT_EQ(array[1] + array[1], function(array, 1));
+            }
+        }
+
+
         //
         // Binary operations
         //
@@ -168,6 +240,194 @@ namespace NativeJIT
             }
         }
 
+
+
+        TEST_F(FloatingPoint, DivDouble)
+        {
+            auto setup = GetSetup();
+
+            {
+                Function<double, double, double> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & a = expression.Div(expression.GetP1(), expression.GetP2());
+                auto function = expression.Compile(a);
+
+                double p1 = 12340000.0;
+                double p2 = -5678.0;
+
+                auto expected = p1 / p2;
+                auto observed = function(p1, p2);
+
+                ASSERT_EQ(observed, expected);
+            }
+        }
+
+
+        TEST_F(FloatingPoint, DivImmediateFloat)
+        {
+            auto setup = GetSetup();
+
+            {
+                Function<float, float> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & a = expression.Div(expression.GetP1(), expression.Immediate(3.0f));
+                auto function = expression.Compile(a);
+
+                float p1 = 1.0f;
+
+                auto expected = p1 / 3.0f;
+                auto observed = function(p1);
+
+                ASSERT_EQ(observed, expected);
+            }
+        }
+
+
+        //
+        // Unary operations
+        //
+
+        TEST_F(FloatingPoint, NegDouble)
+        {
+            auto setup = GetSetup();
+
+            {
+                Function<double, double> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & a = expression.Neg(expression.GetP1());
+                auto function = expression.Compile(a);
+
+                ASSERT_EQ(-1.5, function(1.5));
+                ASSERT_EQ(2.25, function(-2.25));
+
+                // Unlike 0.0 - x, negation flips the sign of zero.
+                ASSERT_TRUE(std::signbit(function(0.0)));
+                ASSERT_FALSE(std::signbit(function(-0.0)));
+            }
+        }
+
+
+        TEST_F(FloatingPoint, NegFloatSharedChild)
+        {
+            auto setup = GetSetup();
+
+            {
+                Function<float, float> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & p1 = expression.GetP1();
+                auto & a = expression.Mul(expression.Neg(p1), p1);
+                auto function = expression.Compile(a);
+
+                ASSERT_EQ(-6.25f, function(2.5f));
+            }
+        }
+
+
+        //
+        // Fused multiply-add
+        //
+
+        TEST_F(FloatingPoint, FusedMultiplyAdd)
+        {
+            // (1 + 2^-30) * (1 - 2^-30) = 1 - 2^-60 rounds to 1.0 as a double.
+            VerifyFusedMultiplyAdd(1.0 + std::ldexp(1.0, -30),
+                                   1.0 - std::ldexp(1.0, -30),
+                                   -1.0);
+
+            // Same with 2^-13 and 1 - 2^-26 for floats.
+            VerifyFusedMultiplyAdd(1.0f + std::ldexp(1.0f, -13),
+                                   1.0f - std::ldexp(1.0f, -13),
+                                   -1.0f);
+        }
+
+
+        TEST_F(FloatingPoint, FusedMultiplyAddSharedProduct)
+        {
+            auto setup = GetSetup();
+
+            {
+                Function<double, double, double, double> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & p1 = expression.GetP1();
+                auto & p2 = expression.GetP2();
+                auto & p3 = expression.GetP3();
+
+                // The product is used both as an addend of a fused operation
+                // and, on the left, as the product to fuse. The product on
+                // the right of Sub() keeps it from being optimized away.
+                auto & product = expression.Mul(p1, p2);
+                auto & sum = expression.Add(product, expression.Add(p3, product));
+                auto & a = expression.Sub(sum, product);
+                auto function = expression.Compile(a);
+
+                // The values are exact, so the result doesn't depend on
+                // whether the operations are fused.
+                ASSERT_EQ(2.5 * 4.0 + 1.5, function(2.5, 4.0, 1.5));
+                ASSERT_EQ(-3.0 * 0.5 - 2.0, function(-3.0, 0.5, -2.0));
+            }
+        }
+
+
+        TEST_F(FloatingPoint, FusedMultiplyAddChain)
+        {
+            auto setup = GetSetup();
+
+            {
+                Function<float, float*, float*> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & weights = expression.GetP1();
+                auto & values = expression.GetP2();
+
+                // A dot product like the ones of the linear scoring models.
+                Node<float>* sum = &expression.Immediate(0.25f);
+
+                for (int32_t i = 0; i < 6; ++i)
+                {
+                    sum = &expression.Add(*sum,
+                                          expression.Mul(expression.Deref(weights, i),
+                                                         expression.Deref(values, i)));
+                }
+
+                auto function = expression.Compile(*sum);
+
+                float weightValues[] = { 1.0f, -2.0f, 0.5f, 4.0f, 0.25f, 3.0f };
+                float valueValues[] = { 2.0f, 1.5f, -8.0f, 0.75f, 16.0f, -1.0f };
+
+                float expected = 0.25f;
+
+                for (unsigned i = 0; i < 6; ++i)
+                {
+                    expected += weightValues[i] * valueValues[i];
+                }
+
+                ASSERT_EQ(expected, function(weightValues, valueValues));
+            }
+        }
+
+
+        TEST_F(FloatingPoint, FusedMultiplyAddTiers)
+        {
+            auto setup = GetSetup();
+
+            Function<double, double, double, double> expression(setup->GetAllocator(), setup->GetCode());
+
+            auto & root = expression.Add(expression.GetP3(),
+                                         expression.Mul(expression.GetP1(), expression.GetP2()));
+
+            TieredFunction<double, double, double, double> function(expression, root, c_tierPromotionThreshold);
+
+            // The product 1 - 2^-60 is exact only in the fused operation, so
+            // the interpreter has to round it the same way as the compiled
+            // code does.
+            const double a = 1.0 + std::ldexp(1.0, -30);
+            const double b = 1.0 - std::ldexp(1.0, -30);
+            const double expected = CpuFeatures::GetHost().IsSupported(CpuFeature::Fma)
+                                    ? -std::ldexp(1.0, -60)
+                                    : 0.0;
+
+            VerifyTiers(function, expected, a, b, -1.0);
+        }
+
         TEST_CASES_END
     }
 }
@@ -30,6 +30,7 @@
 #include "NativeJIT/Function.h"
 #include "Temporary/Allocator.h"
 #include "TestSetup.h"
+#include "TierVerifier.h"
 
 
 #ifndef _MSC_VER
@@ -946,6 +947,137 @@ namespace NativeJIT
             ASSERT_EQ(0.0f, observed);
         }
 
+
+        TEST_F(FunctionTest, StoreAndSequence)
+        {
+            struct Scores
+            {
+                int32_t m_sum;
+                float m_scaled;
+                int64_t m_product;
+            };
+
+            auto setup = GetSetup();
+
+            Function<int32_t, int32_t, int32_t, Scores*> e(setup->GetAllocator(), setup->GetCode());
+
+            // Fill in all fields of the output in a single function. The sum
+            // is a common subexpression of two stores.
+            auto & sum = e.Add(e.GetP1(), e.GetP2());
+
+            auto & storeSum = e.Store(e.FieldPointer(e.GetP3(), &Scores::m_sum), sum);
+            auto & storeScaled = e.Store(e.FieldPointer(e.GetP3(), &Scores::m_scaled),
+                                         e.Mul(e.Cast<float>(sum), e.Immediate(0.5f)));
+            auto & storeProduct = e.Store(e.FieldPointer(e.GetP3(), &Scores::m_product),
+                                          e.Cast<int64_t>(e.Mul(e.GetP1(), e.GetP2())));
+
+            auto & root = e.Sequence(storeSum,
+                                     e.Sequence(storeScaled,
+                                                e.Sequence(storeProduct,
+                                                           e.Sub(e.GetP1(), e.GetP2()))));
+
+            auto function = e.Compile(root);
+
+            Scores scores = { 0, 0.0f, 0 };
+            ASSERT_EQ(-1, function(3, 4, &scores));
+
+            ASSERT_EQ(7, scores.m_sum);
+            ASSERT_EQ(3.5f, scores.m_scaled);
+            ASSERT_EQ(12, scores.m_product);
+        }
+
+
+        TEST_F(FunctionTest, StoresToSameField)
+        {
+            struct Output
+            {
+                int32_t m_value;
+            };
+
+            auto setup = GetSetup();
+
+            // The stores happen in the order of the Sequence, the last one
+            // wins.
+            {
+                Function<int32_t, int32_t, int32_t, Output*> e(setup->GetAllocator(), setup->GetCode());
+
+                auto & first = e.Store(e.FieldPointer(e.GetP3(), &Output::m_value), e.GetP1());
+                auto & second = e.Store(e.FieldPointer(e.GetP3(), &Output::m_value), e.GetP2());
+
+                auto function = e.Compile(e.Sequence(first, second));
+
+                Output output = { 0 };
+                ASSERT_EQ(4, function(3, 4, &output));
+                ASSERT_EQ(4, output.m_value);
+            }
+
+            // Sharing the second store would evaluate it before the first
+            // one, so it's rejected.
+            {
+                Function<int32_t, int32_t, int32_t, Output*> e(setup->GetAllocator(), setup->GetCode());
+
+                auto & first = e.Store(e.FieldPointer(e.GetP3(), &Output::m_value), e.GetP1());
+                auto & second = e.Store(e.FieldPointer(e.GetP3(), &Output::m_value), e.GetP2());
+
+                auto & root = e.Sequence(first, e.Add(second, second));
+
+                ASSERT_THROW(e.Compile(root), std::runtime_error);
+            }
+        }
+
+
+        TEST_F(FunctionTest, Prefetch)
+        {
+            struct Document
+            {
+                int32_t m_padding[20];
+                int32_t m_score;
+            };
+
+            auto setup = GetSetup();
+
+            Function<int32_t, Document*, Document*> e(setup->GetAllocator(), setup->GetCode());
+
+            // Prefetch the field of the next document that the next call
+            // will read while the current document is scored.
+            auto & current = e.Prefetch(e.GetP1(), PrefetchLocality::NonTemporal);
+            auto & prefetchNext = e.Prefetch(e.FieldPointer(e.GetP2(), &Document::m_score));
+
+            auto & root = e.Sequence(prefetchNext,
+                                     e.Deref(e.FieldPointer(current, &Document::m_score)));
+
+            auto function = e.Compile(root);
+
+            Document documents[2];
+            documents[0].m_score = 5;
+            documents[1].m_score = 7;
+
+            ASSERT_EQ(5, function(&documents[0], &documents[1]));
+
+            // The prefetch does not fault on invalid addresses.
+            ASSERT_EQ(7, function(&documents[1], nullptr));
+        }
+
+
+        TEST_F(FunctionTest, StoreAndSequenceTiers)
+        {
+            auto setup = GetSetup();
+
+            Function<int32_t, int32_t, int32_t*> expression(setup->GetAllocator(), setup->GetCode());
+
+            auto & doubled = expression.Mul(expression.GetP1(), expression.Immediate(2));
+            auto & root = expression.Sequence(expression.Store(expression.GetP2(), doubled),
+                                              expression.Add(expression.GetP1(),
+                                                             expression.Immediate(1)));
+
+            TieredFunction<int32_t, int32_t, int32_t*> function(expression, root, c_tierPromotionThreshold);
+
+            int32_t output = 0;
+            VerifyTiers(function, 8, 7, &output);
+
+            ASSERT_EQ(14, output);
+        }
+
         TEST_CASES_END
 
         int FunctionTest::s_sampleFunctionCalls;
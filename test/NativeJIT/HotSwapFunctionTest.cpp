@@ -0,0 +1,178 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "NativeJIT/CodeGen/ExecutionBuffer.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/Function.h"
+#include "NativeJIT/HotSwapFunction.h"
+#include "Temporary/Allocator.h"
+#include "TestSetup.h"
+
+
+namespace NativeJIT
+{
+    namespace HotSwapFunctionUnitTest
+    {
+        TEST_FIXTURE_START(HotSwapFunctionTest)
+
+        public:
+            HotSwapFunctionTest()
+                : m_swapCodeAllocator(8192),
+                  m_swapCode(m_swapCodeAllocator, 4096)
+            {
+            }
+
+        protected:
+            // Executable memory for the replacement code and the trampolines.
+            ExecutionBuffer m_swapCodeAllocator;
+            FunctionBuffer m_swapCode;
+
+        TEST_FIXTURE_END_TEST_CASES_BEGIN
+
+
+        TEST_F(HotSwapFunctionTest, Swap)
+        {
+            auto setup = GetSetup();
+
+            Function<uint64_t, uint64_t> original(setup->GetAllocator(), setup->GetCode());
+            auto originalCode = original.Compile(original.Add(original.GetP1(),
+                                                              original.Immediate(1ull)));
+
+            Function<uint64_t, uint64_t> replacement(setup->GetAllocator(), m_swapCode);
+            auto replacementCode = replacement.Compile(replacement.Add(replacement.GetP1(),
+                                                                       replacement.Immediate(2ull)));
+
+            HotSwapFunction<uint64_t, uint64_t> function(m_swapCodeAllocator, originalCode);
+
+            // Callers may cache the entry point, which never changes.
+            auto entryPoint = function.GetEntryPoint();
+
+            ASSERT_EQ(originalCode, function.GetTarget());
+            ASSERT_EQ(11u, function(10));
+            ASSERT_EQ(11u, entryPoint(10));
+
+            ASSERT_EQ(originalCode, function.Swap(replacementCode));
+
+            ASSERT_EQ(replacementCode, function.GetTarget());
+            ASSERT_EQ(entryPoint, function.GetEntryPoint());
+            ASSERT_EQ(12u, function(10));
+            ASSERT_EQ(12u, entryPoint(10));
+        }
+
+
+        TEST_F(HotSwapFunctionTest, SwapWaitsForGuards)
+        {
+            auto setup = GetSetup();
+
+            Function<uint64_t, uint64_t> original(setup->GetAllocator(), setup->GetCode());
+            auto originalCode = original.Compile(original.GetP1());
+
+            Function<uint64_t, uint64_t> replacement(setup->GetAllocator(), m_swapCode);
+            auto replacementCode = replacement.Compile(replacement.Shl(replacement.GetP1(),
+                                                                       static_cast<uint8_t>(1)));
+
+            HotSwapFunction<uint64_t, uint64_t> function(m_swapCodeAllocator, originalCode);
+            std::future<HotSwapFunction<uint64_t, uint64_t>::FunctionType> swap;
+
+            {
+                // A call which may have passed the trampoline before the swap.
+                HotSwapFunction<uint64_t, uint64_t>::Guard guard(function);
+                ASSERT_EQ(3u, function.GetEntryPoint()(3));
+
+                swap = std::async(std::launch::async,
+                                  [&function, replacementCode] { return function.Swap(replacementCode); });
+
+                // The new code gets published right away, but the replaced
+                // code is not returned while the guard exists.
+                while (function.GetTarget() != replacementCode)
+                {
+                    std::this_thread::yield();
+                }
+
+                ASSERT_EQ(6u, function.GetEntryPoint()(3));
+                ASSERT_EQ(std::future_status::timeout,
+                          swap.wait_for(std::chrono::milliseconds(10)));
+            }
+
+            ASSERT_EQ(originalCode, swap.get());
+        }
+
+
+        TEST_F(HotSwapFunctionTest, ConcurrentCalls)
+        {
+            auto setup = GetSetup();
+
+            Function<uint64_t, uint64_t> first(setup->GetAllocator(), setup->GetCode());
+            auto firstCode = first.Compile(first.Add(first.GetP1(), first.Immediate(1ull)));
+
+            Function<uint64_t, uint64_t> second(setup->GetAllocator(), m_swapCode);
+            auto secondCode = second.Compile(second.Add(second.GetP1(), second.Immediate(2ull)));
+
+            HotSwapFunction<uint64_t, uint64_t> function(m_swapCodeAllocator, firstCode);
+
+            const unsigned c_threadCount = 4;
+            const unsigned c_swapCount = 100;
+            std::atomic<bool> done(false);
+            std::vector<std::future<bool>> callers;
+
+            for (unsigned i = 0; i < c_threadCount; ++i)
+            {
+                callers.push_back(std::async(std::launch::async, [&function, &done] {
+                    bool isValid = true;
+
+                    while (!done.load())
+                    {
+                        const uint64_t result = function(100);
+                        isValid = isValid && (result == 101 || result == 102);
+                    }
+
+                    return isValid;
+                }));
+            }
+
+            // Each swap returns the code published by the previous one. Not
+            // asserting in the loop to let the callers finish on failure.
+            for (unsigned i = 0; i < c_swapCount; ++i)
+            {
+                const bool toSecond = (i % 2) == 0;
+
+                EXPECT_EQ(toSecond ? firstCode : secondCode,
+                          function.Swap(toSecond ? secondCode : firstCode));
+            }
+
+            done = true;
+
+            for (auto & caller : callers)
+            {
+                ASSERT_TRUE(caller.get());
+            }
+        }
+
+        TEST_CASES_END
+    }
+}
@@ -0,0 +1,233 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <cstdio>           // For std::remove.
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "NativeJIT/CodeGen/ExecutionBuffer.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/Function.h"
+#include "NativeJIT/ObjectFile.h"
+#include "Temporary/Allocator.h"
+#include "TestSetup.h"
+
+
+namespace NativeJIT
+{
+    namespace ObjectFileUnitTest
+    {
+        TEST_FIXTURE_START(ObjectFileTest)
+
+        public:
+            ObjectFileTest()
+                : m_path("ObjectFileTest.bin")
+            {
+            }
+
+            ~ObjectFileTest()
+            {
+                std::remove(m_path.c_str());
+            }
+
+        protected:
+            typedef Function<double, int64_t, double> BinaryFunction;
+
+            static int64_t Scale(int64_t value)
+            {
+                return value * 10;
+            }
+
+            static int64_t Negate(int64_t value)
+            {
+                return -value;
+            }
+
+            static const double c_table[3];
+
+            // Builds Callback(p1) + table[1] * p2, which refers to a function,
+            // an array and a floating point constant.
+            static Node<double>& Build(BinaryFunction& expression,
+                                       int64_t (*callback)(int64_t))
+            {
+                auto & called = expression.Call(expression.Immediate(callback),
+                                                expression.GetP1());
+                auto & element = expression.Deref(expression.Immediate(c_table), 1);
+                auto & product = expression.Mul(element, expression.GetP2());
+
+                return expression.Add(expression.Add(expression.Cast<double>(called), product),
+                                      expression.Immediate(0.5));
+            }
+
+            void WriteFile(BinaryFunction& expression, SymbolTable const & symbols)
+            {
+                std::ofstream out(m_path, std::ios::binary);
+                ObjectFile::Write(out, expression, symbols);
+            }
+
+            std::string m_path;
+
+        TEST_FIXTURE_END_TEST_CASES_BEGIN
+
+
+        const double ObjectFileTest::c_table[3] = { 1.0, 2.0, 3.0 };
+
+
+        TEST_F(ObjectFileTest, RoundTrip)
+        {
+            auto setup = GetSetup();
+
+            SymbolTable symbols;
+            symbols.Add("Scale", &Scale);
+            symbols.Add("table", &c_table);
+
+            {
+                BinaryFunction expression(setup->GetAllocator(), setup->GetCode());
+                auto function = expression.Compile(Build(expression, &Scale));
+
+                ASSERT_EQ(30 + 2.0 * 1.5 + 0.5, function(3, 1.5));
+
+                WriteFile(expression, symbols);
+            }
+
+            ObjectFile file(m_path.c_str(), symbols);
+            auto function = file.GetFunction<BinaryFunction::FunctionType>();
+
+            ASSERT_EQ(30 + 2.0 * 1.5 + 0.5, function(3, 1.5));
+            ASSERT_EQ(-70 + 2.0 * 2.0 + 0.5, function(-7, 2.0));
+        }
+
+
+        TEST_F(ObjectFileTest, RelocationUsesLoadingSymbolTable)
+        {
+            auto setup = GetSetup();
+
+            {
+                SymbolTable symbols;
+                symbols.Add("callback", &Scale);
+                symbols.Add("table", &c_table);
+
+                BinaryFunction expression(setup->GetAllocator(), setup->GetCode());
+                expression.Compile(Build(expression, &Scale));
+
+                WriteFile(expression, symbols);
+            }
+
+            // The same names bound to other addresses, as if the symbols moved
+            // between the runs of the process.
+            static const double otherTable[3] = { 0.0, 100.0, 0.0 };
+
+            SymbolTable symbols;
+            symbols.Add("callback", &Negate);
+            symbols.Add("table", &otherTable);
+
+            ObjectFile file(m_path.c_str(), symbols);
+            auto function = file.GetFunction<BinaryFunction::FunctionType>();
+
+            ASSERT_EQ(-3 + 100.0 * 1.5 + 0.5, function(3, 1.5));
+        }
+
+
+        TEST_F(ObjectFileTest, UnknownAddress)
+        {
+            auto setup = GetSetup();
+
+            SymbolTable symbols;
+            symbols.Add("Scale", &Scale);
+
+            BinaryFunction expression(setup->GetAllocator(), setup->GetCode());
+            expression.Compile(Build(expression, &Scale));
+
+            std::ofstream out(m_path, std::ios::binary);
+            ASSERT_THROW(ObjectFile::Write(out, expression, symbols), std::runtime_error);
+        }
+
+
+        TEST_F(ObjectFileTest, MissingSymbol)
+        {
+            auto setup = GetSetup();
+
+            SymbolTable symbols;
+            symbols.Add("Scale", &Scale);
+            symbols.Add("table", &c_table);
+
+            {
+                BinaryFunction expression(setup->GetAllocator(), setup->GetCode());
+                expression.Compile(Build(expression, &Scale));
+
+                WriteFile(expression, symbols);
+            }
+
+            SymbolTable incomplete;
+            incomplete.Add("Scale", &Scale);
+
+            ASSERT_THROW(ObjectFile(m_path.c_str(), incomplete), std::runtime_error);
+        }
+
+
+        TEST_F(ObjectFileTest, Elf)
+        {
+            auto setup = GetSetup();
+
+            SymbolTable symbols;
+            symbols.Add("Scale", &Scale);
+            symbols.Add("table", &c_table);
+
+            BinaryFunction expression(setup->GetAllocator(), setup->GetCode());
+            expression.Compile(Build(expression, &Scale));
+
+            std::ostringstream out;
+            ObjectFile::WriteElf(out, expression, symbols, "Function");
+            const std::string file = out.str();
+
+            ASSERT_EQ(0u, file.find("\x7f" "ELF"));
+
+            // The external symbols and the function are named in .strtab.
+            ASSERT_NE(std::string::npos, file.find(std::string("\0Function\0", 10)));
+            ASSERT_NE(std::string::npos, file.find(std::string("\0Scale\0", 7)));
+            ASSERT_NE(std::string::npos, file.find(std::string("\0table\0", 7)));
+
+            SymbolTable incomplete;
+            incomplete.Add("Scale", &Scale);
+
+            std::ostringstream unused;
+            ASSERT_THROW(ObjectFile::WriteElf(unused, expression, incomplete, "Function"),
+                         std::runtime_error);
+        }
+
+
+        TEST_F(ObjectFileTest, InvalidFile)
+        {
+            SymbolTable symbols;
+
+            {
+                std::ofstream out(m_path, std::ios::binary);
+                out << "This is not an object file, but it's long enough to hold a header.";
+            }
+
+            ASSERT_THROW(ObjectFile(m_path.c_str(), symbols), std::runtime_error);
+            ASSERT_THROW(ObjectFile((m_path + ".missing").c_str(), symbols), std::runtime_error);
+        }
+    }
+}
@@ -22,6 +22,9 @@
 
 
 
+#include <cmath>        // For std::fma, std::ldexp.
+
+#include "NativeJIT/CodeGen/CpuFeatures.h"
 #include "NativeJIT/CodeGen/ExecutionBuffer.h"
 #include "NativeJIT/CodeGen/FunctionBuffer.h"
 #include "NativeJIT/Function.h"
@@ -29,6 +32,7 @@
 #include "NativeJIT/Packed.h"
 #include "Temporary/Allocator.h"
 #include "TestSetup.h"
+#include "TierVerifier.h"
 
 
 namespace NativeJIT
@@ -36,6 +40,14 @@ namespace NativeJIT
     namespace PackedUnitTest
     {
         TEST_FIXTURE_START(PackedTest)
+        public:
+            PackedTest()
+                : TestFixture(c_defaultCodeAllocatorCapacity,
+                              64 * 1024,
+                              c_defaultDiagnosticsStream)
+            {
+            }
+
         protected:
             typedef Packed<3, 4, 5> PackedType;
 
@@ -46,6 +58,73 @@ namespace NativeJIT
                 return PackedType::FromComponents(threeBitValue, fourBitValue, fiveBitValue);
             }
 
+
+            // Verifies the extraction and the replacement of the component
+            // with the extended instructions, if the host has them, and with
+            // the baseline x64 ones.
+            template <unsigned INDEX>
+            void VerifyComponent(PackedType packed, PackedUnderlyingType newValue)
+            {
+                typedef PackedComponentPosition<PackedType, INDEX> Position;
+
+                const PackedUnderlyingType mask = ((1u << Position::c_bitCount) - 1) << Position::c_startBit;
+                const PackedUnderlyingType expectedComponent = (packed.m_bits & mask) >> Position::c_startBit;
+                const PackedUnderlyingType expectedBits = (packed.m_bits & ~mask)
+                                                          | ((newValue << Position::c_startBit) & mask);
+
+                for (auto const & features : { CpuFeatures::GetHost(), CpuFeatures() })
+                {
+                    {
+                        auto setup = GetSetup();
+                        Function<PackedUnderlyingType, PackedType> expression(setup->GetAllocator(), setup->GetCode());
+                        expression.SetCpuFeatures(features);
+
+                        auto & a = expression.PackedComponent<INDEX>(expression.GetP1());
+                        auto function = expression.Compile(a);
+
+                        ASSERT_EQ(expectedComponent, function(packed));
+                    }
+
+                    {
+                        auto setup = GetSetup();
+                        Function<PackedType, PackedType, PackedUnderlyingType> expression(setup->GetAllocator(), setup->GetCode());
+                        expression.SetCpuFeatures(features);
+
+                        auto & a = expression.PackedWithComponent<INDEX>(expression.GetP1(), expression.GetP2());
+                        auto function = expression.Compile(a);
+
+                        ASSERT_EQ(expectedBits, function(packed, newValue).m_bits);
+                    }
+                }
+            }
+
+
+            // Sums the entries like ApplyModelSum(): groups of eight keys,
+            // each added in the order of the horizontal sum of the gather.
+            static float SumModel(Model<PackedType> const & model,
+                                  PackedType const * keys,
+                                  unsigned keyCount)
+            {
+                float sum = 0;
+
+                for (unsigned start = 0; start < keyCount; start += 8)
+                {
+                    float lanes[8] = {};
+
+                    for (unsigned i = start; i < keyCount && i < start + 8; ++i)
+                    {
+                        lanes[i - start] = model.Apply(keys[i]);
+                    }
+
+                    const float group = ((lanes[0] + lanes[4]) + (lanes[1] + lanes[5]))
+                                        + ((lanes[2] + lanes[6]) + (lanes[3] + lanes[7]));
+
+                    sum = start == 0 ? group : sum + group;
+                }
+
+                return sum;
+            }
+
         TEST_FIXTURE_END_TEST_CASES_BEGIN
 
 
@@ -120,6 +199,176 @@ namespace NativeJIT
         }
 
 
+        TEST_F(PackedTest, ModelApplySum)
+        {
+            typedef Model<PackedType> ModelType;
+
+            ModelType model;
+
+            for (unsigned i = 0; i < ModelType::c_size; ++i)
+            {
+                // Values of different magnitudes make the result depend on
+                // the order of the additions.
+                model[i] = (i % 7 == 0 ? 1e6f : 1.0f) * (static_cast<float>(i) + 0.1f);
+            }
+
+            PackedType keys[12];
+
+            for (unsigned i = 0; i < 12; ++i)
+            {
+                keys[i] = MakePacked(static_cast<uint8_t>(i % 8),
+                                     static_cast<uint8_t>((3 * i) % 16),
+                                     static_cast<uint8_t>((7 * i + 1) % 32));
+            }
+
+            for (auto const & features : { CpuFeatures::GetHost(), CpuFeatures() })
+            {
+                for (unsigned keyCount : { 1u, 3u, 4u, 5u, 8u, 12u })
+                {
+                    auto setup = GetSetup();
+                    Function<float, ModelType*, PackedType*> expression(setup->GetAllocator(), setup->GetCode());
+                    expression.SetCpuFeatures(features);
+
+                    Node<PackedType>* keyNodes[12];
+
+                    for (unsigned i = 0; i < keyCount; ++i)
+                    {
+                        keyNodes[i] = &expression.Deref(expression.GetP2(), static_cast<int32_t>(i));
+                    }
+
+                    auto & a = expression.ApplyModelSum(expression.GetP1(), keyNodes, keyCount);
+                    auto function = expression.Compile(a);
+
+                    ASSERT_EQ(SumModel(model, keys, keyCount), function(&model, keys))
+                        << "Key count " << keyCount;
+                }
+            }
+        }
+
+
+        TEST_F(PackedTest, ModelApplyQuantized)
+        {
+            typedef QuantizedModel<PackedType, uint8_t> ModelType;
+
+            ModelType model;
+            model.m_scale = 0.1f;
+            model.m_offset = -3.0f;
+
+            for (unsigned i = 0; i < ModelType::c_size; ++i)
+            {
+                model.Set(i, static_cast<float>(i % 300) * 0.1f - 3.0f);
+            }
+
+            // Clamped to the range of the entries.
+            ASSERT_EQ(255u, model[299]);
+
+            for (auto const & features : { CpuFeatures::GetHost(), CpuFeatures() })
+            {
+                auto setup = GetSetup();
+                Function<float, ModelType*, PackedType> expression(setup->GetAllocator(), setup->GetCode());
+                expression.SetCpuFeatures(features);
+
+                auto & a = expression.ApplyModel(expression.GetP1(), expression.GetP2());
+                auto function = expression.Compile(a);
+
+                for (auto packed : { MakePacked(0, 0, 0), MakePacked(7, 6, 5), MakePacked(7, 15, 31) })
+                {
+                    // The scale and the offset are applied with a single
+                    // rounding if the code uses a fused multiply-add.
+                    const float entry = static_cast<float>(model.m_data[packed.m_bits]);
+                    const float expected = features.IsSupported(CpuFeature::Fma)
+                        ? std::fma(model.m_scale, entry, model.m_offset)
+                        : model.Apply(packed);
+
+                    ASSERT_EQ(expected, function(&model, packed));
+                }
+            }
+        }
+
+
+        TEST_F(PackedTest, ModelApplyHalf)
+        {
+            typedef HalfModel<PackedType, HalfFormat::Half> HalfModelType;
+            typedef HalfModel<PackedType, HalfFormat::BFloat16> BFloat16ModelType;
+
+            HalfModelType halfModel;
+            BFloat16ModelType bfloat16Model;
+
+            for (unsigned i = 0; i < HalfModelType::c_size; ++i)
+            {
+                const float value = (static_cast<float>(i) - 1000.0f) / 3.0f;
+
+                halfModel.Set(i, value);
+                bfloat16Model.Set(i, value);
+            }
+
+            const PackedType keys[] = { MakePacked(0, 0, 0), MakePacked(3, 14, 17), MakePacked(7, 15, 31) };
+
+            for (auto const & features : { CpuFeatures::GetHost(), CpuFeatures() })
+            {
+                {
+                    auto setup = GetSetup();
+                    Function<float, HalfModelType*, PackedType> expression(setup->GetAllocator(), setup->GetCode());
+                    expression.SetCpuFeatures(features);
+
+                    auto & a = expression.ApplyModel(expression.GetP1(), expression.GetP2());
+                    auto function = expression.Compile(a);
+
+                    for (auto packed : keys)
+                    {
+                        ASSERT_EQ(halfModel.Apply(packed), function(&halfModel, packed));
+                    }
+                }
+
+                {
+                    auto setup = GetSetup();
+                    Function<float, BFloat16ModelType*, PackedType> expression(setup->GetAllocator(), setup->GetCode());
+                    expression.SetCpuFeatures(features);
+
+                    auto & a = expression.ApplyModel(expression.GetP1(), expression.GetP2());
+                    auto function = expression.Compile(a);
+
+                    for (auto packed : keys)
+                    {
+                        ASSERT_EQ(bfloat16Model.Apply(packed), function(&bfloat16Model, packed));
+                    }
+                }
+            }
+        }
+
+
+        TEST_F(PackedTest, HalfPrecision)
+        {
+            typedef HalfPrecision<HalfFormat::Half> Half;
+            typedef HalfPrecision<HalfFormat::BFloat16> BFloat16;
+
+            ASSERT_EQ(0x3c00u, Half::FromFloat(1.0f));
+            ASSERT_EQ(0xc000u, Half::FromFloat(-2.0f));
+            ASSERT_EQ(0x7bffu, Half::FromFloat(65504.0f));
+            ASSERT_EQ(0x7c00u, Half::FromFloat(65520.0f));
+            ASSERT_EQ(0x0001u, Half::FromFloat(std::ldexp(1.0f, -24)));
+            ASSERT_EQ(0x0000u, Half::FromFloat(std::ldexp(1.0f, -25)));
+            ASSERT_EQ(0x3555u, Half::FromFloat(1.0f / 3.0f));
+
+            ASSERT_EQ(1.0f, Half::ToFloat(0x3c00));
+            ASSERT_EQ(std::ldexp(1.0f, -24), Half::ToFloat(0x0001));
+            ASSERT_TRUE(std::isinf(Half::ToFloat(0xfc00)));
+            ASSERT_TRUE(std::isnan(Half::ToFloat(Half::FromFloat(std::nanf("")))));
+
+            ASSERT_EQ(0x3f80u, BFloat16::FromFloat(1.0f));
+            ASSERT_EQ(0x3eabu, BFloat16::FromFloat(1.0f / 3.0f));
+            ASSERT_EQ(-2.0f, BFloat16::ToFloat(0xc000));
+            ASSERT_TRUE(std::isnan(BFloat16::ToFloat(BFloat16::FromFloat(std::nanf("")))));
+
+            // Every finite half survives the round trip.
+            for (unsigned bits = 0; bits < 0x7c00; ++bits)
+            {
+                ASSERT_EQ(bits, Half::FromFloat(Half::ToFloat(static_cast<uint16_t>(bits))));
+                ASSERT_EQ(bits | 0x8000u, Half::FromFloat(Half::ToFloat(static_cast<uint16_t>(bits | 0x8000))));
+            }
+        }
+
+
         TEST_F(PackedTest, PackedMax)
         {
             auto setup = GetSetup();
@@ -157,6 +406,129 @@ namespace NativeJIT
             ASSERT_EQ(expected.m_bits, observed.m_bits);
         }
 
+
+
+        TEST_F(PackedTest, Components)
+        {
+            const auto packed = MakePacked(5, 9, 22);
+
+            static_assert(PackedComponentPosition<PackedType, 0>::c_startBit == 9, "Invalid start bit");
+            static_assert(PackedComponentPosition<PackedType, 1>::c_bitCount == 4, "Invalid bit count");
+            static_assert(PackedComponentPosition<PackedType, 2>::c_startBit == 0, "Invalid start bit");
+
+            VerifyComponent<0>(packed, 2);
+            VerifyComponent<1>(packed, 6);
+            VerifyComponent<2>(packed, 17);
+
+            // The bits of the new value which don't fit are discarded.
+            VerifyComponent<0>(packed, 0xfffffff9);
+            VerifyComponent<2>(packed, 0x12345);
+        }
+
+
+        TEST_F(PackedTest, ComponentFolding)
+        {
+            const auto packed = MakePacked(5, 9, 22);
+            const PackedUnderlyingType value = 0x1236;
+
+            for (auto const & features : { CpuFeatures::GetHost(), CpuFeatures() })
+            {
+                {
+                    // The components are taken from the value and from the
+                    // original packed, so the insertion is never evaluated.
+                    auto setup = GetSetup();
+                    Function<PackedUnderlyingType, PackedType, PackedUnderlyingType> expression(setup->GetAllocator(), setup->GetCode());
+                    expression.SetCpuFeatures(features);
+
+                    auto & inserted = expression.PackedWithComponent<1>(expression.GetP1(), expression.GetP2());
+                    auto & replaced = expression.PackedComponent<1>(inserted);
+                    auto & kept = expression.PackedComponent<0>(inserted);
+
+                    auto & a = expression.Add(expression.Mul(replaced, expression.Immediate<PackedUnderlyingType>(100)),
+                                              kept);
+                    auto function = expression.Compile(a);
+
+                    ASSERT_EQ((value & 0xf) * 100 + 5, function(packed, value));
+                }
+
+                {
+                    // The first replacement of the component is skipped.
+                    auto setup = GetSetup();
+                    Function<PackedType, PackedType, PackedUnderlyingType> expression(setup->GetAllocator(), setup->GetCode());
+                    expression.SetCpuFeatures(features);
+
+                    auto & first = expression.PackedWithComponent<2>(expression.GetP1(), expression.GetP2());
+                    auto & second = expression.PackedWithComponent<2>(first, expression.Immediate<PackedUnderlyingType>(3));
+                    auto function = expression.Compile(second);
+
+                    ASSERT_EQ(MakePacked(5, 9, 3).m_bits, function(packed, value).m_bits);
+                }
+            }
+        }
+
+
+        TEST_F(PackedTest, ModelApplySumTiers)
+        {
+            typedef Packed<4> PackedType;
+            typedef Model<PackedType> ModelType;
+
+            auto setup = GetSetup();
+
+            Function<float, ModelType*, PackedType*> expression(setup->GetAllocator(), setup->GetCode());
+
+            Node<PackedType>* keys[6];
+
+            for (int32_t i = 0; i < 6; ++i)
+            {
+                keys[i] = &expression.Deref(expression.GetP2(), i);
+            }
+
+            auto & sum = expression.ApplyModelSum(expression.GetP1(), keys, 6);
+
+            TieredFunction<float, ModelType*, PackedType*> function(expression, sum, c_tierPromotionThreshold);
+
+            ModelType model;
+
+            for (unsigned i = 0; i < ModelType::c_size; ++i)
+            {
+                model[i] = i == 9 ? 1e8f : static_cast<float>(i) + 0.5f;
+            }
+
+            PackedType packed[6];
+            const unsigned bits[6] = { 9, 1, 2, 3, 14, 15 };
+
+            for (unsigned i = 0; i < 6; ++i)
+            {
+                packed[i] = PackedType::FromBits(bits[i]);
+            }
+
+            // The interpreter has to add the entries in the order of the
+            // gather's horizontal sum.
+            const float expected = ((model[9u] + model[14u]) + (model[1u] + model[15u]))
+                                   + (model[2u] + model[3u]);
+
+            VerifyTiers(function, expected, &model, packed);
+        }
+
+
+        TEST_F(PackedTest, PackedWithComponentTiers)
+        {
+            auto setup = GetSetup();
+
+            typedef Packed<5, 5, 6> PackedType;
+
+            Function<PackedUnderlyingType, PackedType, PackedUnderlyingType> expression(setup->GetAllocator(), setup->GetCode());
+
+            auto & inserted = expression.PackedWithComponent<1>(expression.GetP1(), expression.GetP2());
+            auto & root = expression.Cast<PackedUnderlyingType>(inserted);
+
+            TieredFunction<PackedUnderlyingType, PackedType, PackedUnderlyingType> function(expression, root, c_tierPromotionThreshold);
+
+            const auto packed = PackedType::FromComponents(3, 17, 40);
+
+            VerifyTiers(function, PackedType::FromComponents(3, 9, 40).m_bits, packed, 0x29u);
+        }
+
         TEST_CASES_END
     }
 }
@@ -0,0 +1,228 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <cstdint>
+#include <vector>
+
+#include "NativeJIT/CodeGen/ExecutionBuffer.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/Function.h"
+#include "Temporary/Allocator.h"
+#include "TestSetup.h"
+#include "TierVerifier.h"
+
+
+namespace NativeJIT
+{
+    namespace ReassociationUnitTest
+    {
+        TEST_FIXTURE_START(Reassociation)
+
+        public:
+            // The long chains need more than the default allocator capacity.
+            Reassociation()
+                : TestFixture(16 * 1024,
+                              256 * 1024,
+                              c_defaultDiagnosticsStream)
+            {
+            }
+
+        protected:
+            // Combines values[begin, end) with op like AssociativeNode does,
+            // i.e. as a balanced tree.
+            template <typename T, typename OP>
+            static T CombineBalanced(std::vector<T> const & values, size_t begin, size_t end, OP op)
+            {
+                if (end - begin == 1)
+                {
+                    return values[begin];
+                }
+
+                const size_t middle = begin + (end - begin) / 2;
+
+                return op(CombineBalanced(values, begin, middle, op),
+                          CombineBalanced(values, middle, end, op));
+            }
+
+
+            // Builds build(...build(build(p1[0], p1[1]), p1[2])..., p1[count - 1]),
+            // the left-deep chain a builder naturally produces.
+            template <typename T, typename BUILD>
+            static Node<T>& BuildChain(Function<T, T*>& expression, unsigned count, BUILD build)
+            {
+                Node<T>* result = &expression.Deref(expression.GetP1(), 0);
+
+                for (unsigned i = 1; i < count; ++i)
+                {
+                    result = &build(*result, expression.Deref(expression.GetP1(), static_cast<int32_t>(i)));
+                }
+
+                return *result;
+            }
+
+        TEST_FIXTURE_END_TEST_CASES_BEGIN
+
+
+        TEST_F(Reassociation, IntegerChains)
+        {
+            const unsigned c_count = 200;
+            std::vector<uint32_t> values;
+
+            for (unsigned i = 0; i < c_count; ++i)
+            {
+                values.push_back(0x9e3779b9u * (i + 1));
+            }
+
+            uint32_t expectedSum = 0;
+            uint32_t expectedProduct = 1;
+            uint32_t expectedBits = values[0];
+
+            for (unsigned i = 0; i < c_count; ++i)
+            {
+                expectedSum += values[i];
+            }
+
+            for (unsigned i = 0; i < 10; ++i)
+            {
+                expectedProduct *= values[i];
+            }
+
+            for (unsigned i = 1; i < 20; ++i)
+            {
+                expectedBits = (expectedBits | values[i]) ^ (expectedBits & values[i]);
+            }
+
+            for (auto mode : { ReassociationMode::Disabled, ReassociationMode::Integer })
+            {
+                auto setup = GetSetup();
+                Function<uint32_t, uint32_t*> expression(setup->GetAllocator(), setup->GetCode());
+                expression.SetReassociationMode(mode);
+
+                auto & sum = BuildChain(expression, c_count,
+                                        [&](Node<uint32_t>& a, Node<uint32_t>& b) -> Node<uint32_t>&
+                                        { return expression.Add(a, b); });
+                auto & product = BuildChain(expression, 10,
+                                            [&](Node<uint32_t>& a, Node<uint32_t>& b) -> Node<uint32_t>&
+                                            { return expression.Mul(a, b); });
+                auto & bits = BuildChain(expression, 20,
+                                         [&](Node<uint32_t>& a, Node<uint32_t>& b) -> Node<uint32_t>&
+                                         { return expression.Xor(expression.Or(a, b), expression.And(a, b)); });
+                auto & root = expression.Add(expression.Add(sum, product), bits);
+                auto function = expression.Compile(root);
+
+                ASSERT_EQ(expectedSum + expectedProduct + expectedBits, function(values.data()));
+            }
+        }
+
+
+        TEST_F(Reassociation, SharedPartialResult)
+        {
+            auto setup = GetSetup();
+
+            {
+                Function<int64_t, int64_t, int64_t, int64_t> expression(setup->GetAllocator(), setup->GetCode());
+                expression.SetReassociationMode(ReassociationMode::Integer);
+
+                auto & p1 = expression.GetP1();
+                auto & p2 = expression.GetP2();
+                auto & p3 = expression.GetP3();
+
+                // The partial sum is absorbed into the longer chain but is
+                // also used by itself, so it must still be evaluated.
+                auto & partial = expression.Add(p1, p2);
+                auto & sum = expression.Add(expression.Add(partial, p3), p1);
+                auto & root = expression.Mul(expression.Sub(sum, partial), partial);
+                auto function = expression.Compile(root);
+
+                ASSERT_EQ((3 + 5) * (5 + 7), function(5, 7, 3));
+                ASSERT_EQ((-9 - 4) * (-4 + 100), function(-4, 100, -9));
+            }
+        }
+
+
+        TEST_F(Reassociation, FloatOnlyWithFastMath)
+        {
+            // The ones are lost when added one by one to 1e8, but not when
+            // they're first summed in the balanced tree.
+            std::vector<float> values(16, 1.0f);
+            values[0] = 1e8f;
+
+            float sequential = 0;
+
+            for (auto value : values)
+            {
+                sequential += value;
+            }
+
+            const float balanced = CombineBalanced(values,
+                                                   0,
+                                                   values.size(),
+                                                   [](float a, float b) { return a + b; });
+
+            ASSERT_NE(sequential, balanced);
+
+            for (auto mode : { ReassociationMode::Integer, ReassociationMode::FastMath })
+            {
+                auto setup = GetSetup();
+                Function<float, float*> expression(setup->GetAllocator(), setup->GetCode());
+                expression.SetReassociationMode(mode);
+
+                auto & root = BuildChain(expression,
+                                         static_cast<unsigned>(values.size()),
+                                         [&](Node<float>& a, Node<float>& b) -> Node<float>&
+                                         { return expression.Add(a, b); });
+                auto function = expression.Compile(root);
+
+                ASSERT_EQ(mode == ReassociationMode::FastMath ? balanced : sequential,
+                          function(values.data()));
+            }
+        }
+
+
+        TEST_F(Reassociation, FloatSumTiers)
+        {
+            auto setup = GetSetup();
+
+            Function<float, float*> expression(setup->GetAllocator(), setup->GetCode());
+            expression.SetReassociationMode(ReassociationMode::FastMath);
+
+            Node<float>* sum = &expression.Deref(expression.GetP1(), 0);
+
+            for (int32_t i = 1; i < 16; ++i)
+            {
+                sum = &expression.Add(*sum, expression.Deref(expression.GetP1(), i));
+            }
+
+            TieredFunction<float, float*> function(expression, *sum, c_tierPromotionThreshold);
+
+            // Added in sequence, the ones would be lost. The interpreter has
+            // to combine the terms in the same balanced order as the
+            // compiled code to get the same result.
+            float values[16] = { 1e8f, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 };
+
+            VerifyTiers(function, 1e8f + 8, values);
+        }
+
+        TEST_CASES_END
+    }
+}
@@ -0,0 +1,60 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+
+#include "NativeJIT/TieredFunction.h"
+#include "TestSetup.h"
+
+
+namespace NativeJIT
+{
+    // The promotion threshold of the tiered functions built by the tests.
+    const uint64_t c_tierPromotionThreshold = 4;
+
+
+    // Calls the function, which must have been built with
+    // c_tierPromotionThreshold, enough times to promote it in the bytecode
+    // interpreter, waits for the promotion and then calls it in the compiled
+    // code, verifying that both tiers return the expected value.
+    template <typename FUNCTION, typename EXPECTED, typename... ARGS>
+    void VerifyTiers(FUNCTION& function, EXPECTED expected, ARGS... args)
+    {
+        ASSERT_TRUE(function.GetBytecode().CanEvaluate());
+        ASSERT_FALSE(function.IsCompiled());
+
+        for (uint64_t i = 0; i < c_tierPromotionThreshold; ++i)
+        {
+            ASSERT_EQ(expected, function(args...));
+        }
+
+        function.WaitForPromotion();
+
+        ASSERT_TRUE(function.IsCompiled());
+        ASSERT_EQ(c_tierPromotionThreshold, function.GetCallCount());
+        ASSERT_EQ(expected, function(args...));
+        ASSERT_EQ(c_tierPromotionThreshold, function.GetCallCount());
+    }
+}
@@ -0,0 +1,481 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include "NativeJIT/CodeGen/ExecutionBuffer.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/Function.h"
+#include "NativeJIT/Packed.h"
+#include "NativeJIT/TieredFunction.h"
+#include "Temporary/Allocator.h"
+#include "TestSetup.h"
+#include "TierVerifier.h"
+
+
+namespace NativeJIT
+{
+    namespace TieredFunctionUnitTest
+    {
+        TEST_FIXTURE_START(TieredFunctionTest)
+
+        protected:
+            static int64_t Callback(int64_t a, int32_t b, uint8_t c)
+            {
+                return a * b + c;
+            }
+
+
+            static bool StoreValue(int32_t value, int32_t& target)
+            {
+                target = value;
+                return true;
+            }
+
+            struct Inner
+            {
+                int32_t m_a;
+                double m_b;
+            };
+
+            struct Outer
+            {
+                uint64_t m_padding;
+                Inner* m_inner;
+                uint16_t m_c;
+            };
+
+        TEST_FIXTURE_END_TEST_CASES_BEGIN
+
+
+        TEST_F(TieredFunctionTest, Arithmetic)
+        {
+            auto setup = GetSetup();
+
+            Function<uint32_t, uint32_t, uint32_t> expression(setup->GetAllocator(), setup->GetCode());
+
+            auto & p1 = expression.GetP1();
+            auto & p2 = expression.GetP2();
+            auto & shifted = expression.Shr(expression.Shl(p1, static_cast<uint8_t>(3)),
+                                            static_cast<uint8_t>(1));
+            auto & mixed = expression.Or(expression.Mul(p1, p2),
+                                         expression.And(expression.Rol(p2, static_cast<uint8_t>(7)),
+                                                        expression.Immediate(0xFF00FF00u)));
+            auto & root = expression.Sub(expression.Add(shifted, mixed),
+                                         expression.Immediate(5u));
+
+            TieredFunction<uint32_t, uint32_t, uint32_t> function(expression, root, c_tierPromotionThreshold);
+
+            const uint32_t a = 0xF0000123;
+            const uint32_t b = 0x9876;
+            const uint32_t expected = ((a << 3) >> 1)
+                + ((a * b) | (((b << 7) | (b >> 25)) & 0xFF00FF00u))
+                - 5u;
+
+            VerifyTiers(function, expected, a, b);
+        }
+
+
+        TEST_F(TieredFunctionTest, SignedNarrowArithmetic)
+        {
+            auto setup = GetSetup();
+
+            Function<int16_t, int16_t, int16_t> expression(setup->GetAllocator(), setup->GetCode());
+
+            auto & root = expression.Mul(expression.Sub(expression.GetP1(), expression.GetP2()),
+                                         expression.Immediate<int16_t>(300));
+
+            TieredFunction<int16_t, int16_t, int16_t> function(expression, root, c_tierPromotionThreshold);
+
+            const int16_t a = -1234;
+            const int16_t b = 4321;
+            const int16_t expected = static_cast<int16_t>((a - b) * 300);
+
+            VerifyTiers(function, expected, a, b);
+        }
+
+
+        TEST_F(TieredFunctionTest, Casts)
+        {
+            auto setup = GetSetup();
+
+            Function<double, int8_t, float> expression(setup->GetAllocator(), setup->GetCode());
+
+            // The int8 to double cast is a composite cast.
+            auto & wide = expression.Cast<double>(expression.GetP1());
+            auto & truncated = expression.Cast<int32_t>(expression.GetP2());
+            auto & root = expression.Add(wide, expression.Cast<double>(truncated));
+
+            TieredFunction<double, int8_t, float> function(expression, root, c_tierPromotionThreshold);
+
+            VerifyTiers(function, -120.0 + 3.0, static_cast<int8_t>(-120), 3.75f);
+        }
+
+
+        TEST_F(TieredFunctionTest, Conditionals)
+        {
+            auto setup = GetSetup();
+
+            Function<int64_t, int64_t, double> expression(setup->GetAllocator(), setup->GetCode());
+
+            auto & p1 = expression.GetP1();
+            auto & p2 = expression.GetP2();
+
+            auto & signedTest = expression.Conditional(
+                expression.Compare<JccType::JL>(p1, expression.Immediate<int64_t>(-3)),
+                expression.Immediate<int64_t>(100),
+                expression.Immediate<int64_t>(200));
+            auto & floatTest = expression.Conditional(
+                expression.Compare<JccType::JA>(p2, expression.Immediate(1.5)),
+                expression.Immediate<int64_t>(10),
+                expression.Immediate<int64_t>(20));
+            auto & root = expression.Add(signedTest, floatTest);
+
+            TieredFunction<int64_t, int64_t, double> function(expression, root, c_tierPromotionThreshold);
+
+            VerifyTiers(function, static_cast<int64_t>(110), static_cast<int64_t>(-5), 2.0);
+        }
+
+
+        TEST_F(TieredFunctionTest, ConditionalsMatchNativeCode)
+        {
+            auto setup = GetSetup();
+
+            Function<int32_t, int32_t, int32_t> expression(setup->GetAllocator(), setup->GetCode());
+
+            auto & p1 = expression.GetP1();
+            auto & p2 = expression.GetP2();
+
+            auto & root = expression.Add(
+                expression.Conditional(expression.Compare<JccType::JG>(p1, p2), p1, p2),
+                expression.Conditional(expression.Compare<JccType::JB>(p1, p2),
+                                       expression.Immediate(1),
+                                       expression.Immediate(2)));
+
+            TieredFunction<int32_t, int32_t, int32_t> function(expression, root, 1000);
+
+            const int32_t values[] = { -7, -1, 0, 1, 7 };
+            int32_t expected[5][5];
+
+            for (unsigned i = 0; i < 5; ++i)
+            {
+                for (unsigned j = 0; j < 5; ++j)
+                {
+                    expected[i][j] = function(values[i], values[j]);
+                }
+            }
+
+            function.WaitForPromotion();
+            ASSERT_FALSE(function.IsCompiled());
+
+            // Compile the expression separately to check the interpreted
+            // results against the native code, including the unsigned JB.
+            Function<int32_t, int32_t, int32_t> native(setup->GetAllocator(), setup->GetCode());
+            auto & n1 = native.GetP1();
+            auto & n2 = native.GetP2();
+            auto entry = native.Compile(native.Add(
+                native.Conditional(native.Compare<JccType::JG>(n1, n2), n1, n2),
+                native.Conditional(native.Compare<JccType::JB>(n1, n2),
+                                   native.Immediate(1),
+                                   native.Immediate(2))));
+
+            for (unsigned i = 0; i < 5; ++i)
+            {
+                for (unsigned j = 0; j < 5; ++j)
+                {
+                    ASSERT_EQ(entry(values[i], values[j]), expected[i][j])
+                        << values[i] << ", " << values[j];
+                }
+            }
+        }
+
+
+        // The pointer is dereferenced only if the condition checks that it's
+        // not null, also when the dereferenced value has two parents.
+        TEST_F(TieredFunctionTest, NullGuardedLoad)
+        {
+            auto setup = GetSetup();
+
+            Function<int64_t, int64_t*> expression(setup->GetAllocator(), setup->GetCode());
+
+            auto & pointer = expression.GetP1();
+            auto & null = expression.Immediate<int64_t*>(nullptr);
+            auto & value = expression.Deref(pointer);
+
+            auto & root = expression.Add(
+                expression.Conditional(expression.Compare<JccType::JE>(pointer, null),
+                                       expression.Immediate<int64_t>(-1),
+                                       value),
+                expression.Conditional(expression.Compare<JccType::JNE>(pointer, null),
+                                       value,
+                                       expression.Immediate<int64_t>(-2)));
+
+            TieredFunction<int64_t, int64_t*> function(expression, root, c_tierPromotionThreshold);
+
+            int64_t target = 5;
+
+            for (uint64_t i = 0; i < c_tierPromotionThreshold / 2; ++i)
+            {
+                ASSERT_EQ(-3, function(nullptr));
+                ASSERT_EQ(10, function(&target));
+            }
+
+            function.WaitForPromotion();
+
+            ASSERT_TRUE(function.IsCompiled());
+            ASSERT_EQ(-3, function(nullptr));
+            ASSERT_EQ(10, function(&target));
+        }
+
+
+        // Each path of the conditional loads through a pointer which is only
+        // valid if that path is taken, after a store which is made on both.
+        TEST_F(TieredFunctionTest, GuardedLoadsWithStore)
+        {
+            auto setup = GetSetup();
+
+            Function<int32_t, int32_t*, int32_t*, uint64_t, uint64_t*> expression(setup->GetAllocator(), setup->GetCode());
+
+            auto & index = expression.GetP3();
+            auto & element = expression.Deref(expression.Add(expression.GetP1(), index));
+            auto & fallback = expression.Deref(expression.GetP2());
+            auto & root = expression.Sequence(
+                expression.Store(expression.GetP4(), index),
+                expression.Conditional(expression.Compare<JccType::JB>(index, expression.Immediate<uint64_t>(3)),
+                                       element,
+                                       fallback));
+
+            TieredFunction<int32_t, int32_t*, int32_t*, uint64_t, uint64_t*> function(expression, root, c_tierPromotionThreshold);
+
+            int32_t values[] = { 10, 11, 12 };
+            int32_t defaultValue = 7;
+            uint64_t output = 0;
+
+            for (uint64_t i = 0; i < c_tierPromotionThreshold / 2; ++i)
+            {
+                ASSERT_EQ(12, function(values, nullptr, 2, &output));
+                ASSERT_EQ(2u, output);
+                ASSERT_EQ(7, function(nullptr, &defaultValue, 1ull << 40, &output));
+                ASSERT_EQ(1ull << 40, output);
+            }
+
+            function.WaitForPromotion();
+
+            ASSERT_TRUE(function.IsCompiled());
+            ASSERT_EQ(12, function(values, nullptr, 2, &output));
+            ASSERT_EQ(2u, output);
+            ASSERT_EQ(7, function(nullptr, &defaultValue, 1ull << 40, &output));
+            ASSERT_EQ(1ull << 40, output);
+        }
+
+
+        TEST_F(TieredFunctionTest, Call)
+        {
+            auto setup = GetSetup();
+
+            Function<int64_t, int64_t, int32_t> expression(setup->GetAllocator(), setup->GetCode());
+
+            auto & callback = expression.Immediate(&Callback);
+            auto & root = expression.Call(callback,
+                                          expression.GetP1(),
+                                          expression.GetP2(),
+                                          expression.Immediate<uint8_t>(200));
+
+            TieredFunction<int64_t, int64_t, int32_t> function(expression, root, c_tierPromotionThreshold);
+
+            VerifyTiers(function, Callback(1000, -3, 200), static_cast<int64_t>(1000), -3);
+        }
+
+
+        TEST_F(TieredFunctionTest, FieldAccess)
+        {
+            auto setup = GetSetup();
+
+            Function<double, Outer*> expression(setup->GetAllocator(), setup->GetCode());
+
+            auto & outer = expression.GetP1();
+            auto & inner = expression.Deref(expression.FieldPointer(outer, &Outer::m_inner));
+            auto & a = expression.Deref(expression.FieldPointer(inner, &Inner::m_a));
+            auto & b = expression.Deref(expression.FieldPointer(inner, &Inner::m_b));
+            auto & c = expression.Deref(expression.FieldPointer(outer, &Outer::m_c));
+
+            auto & root = expression.Add(expression.Add(b, expression.Cast<double>(a)),
+                                         expression.Cast<double>(c));
+
+            TieredFunction<double, Outer*> function(expression, root, c_tierPromotionThreshold);
+
+            Inner innerValue = { -7, 0.25 };
+            Outer outerValue = { 0, &innerValue, 1000 };
+
+            VerifyTiers(function, 0.25 - 7 + 1000, &outerValue);
+        }
+
+
+        TEST_F(TieredFunctionTest, ArrayIndexing)
+        {
+            auto setup = GetSetup();
+
+            Function<uint64_t, uint64_t*, uint32_t> expression(setup->GetAllocator(), setup->GetCode());
+
+            auto & element = expression.Deref(expression.Add(expression.GetP1(), expression.GetP2()));
+            auto & root = expression.Add(element, expression.Deref(expression.GetP1(), 1));
+
+            TieredFunction<uint64_t, uint64_t*, uint32_t> function(expression, root, c_tierPromotionThreshold);
+
+            uint64_t values[] = { 5, 10, 1000, 20000 };
+
+            VerifyTiers(function, static_cast<uint64_t>(20010), values, 3u);
+        }
+
+
+        TEST_F(TieredFunctionTest, StackVariable)
+        {
+            auto setup = GetSetup();
+
+            Function<int32_t, int32_t> expression(setup->GetAllocator(), setup->GetCode());
+
+            // Round trip the parameter through a stack variable.
+            auto & variable = expression.StackVariable<int32_t>();
+            auto & store = expression.Call(expression.Immediate(&StoreValue),
+                                           expression.GetP1(),
+                                           variable);
+            auto & root = expression.If(store,
+                                        expression.Dependent(expression.Deref(variable), store),
+                                        expression.Immediate(-1));
+
+            TieredFunction<int32_t, int32_t> function(expression, root, c_tierPromotionThreshold);
+
+            VerifyTiers(function, 31, 31);
+        }
+
+
+        TEST_F(TieredFunctionTest, Precondition)
+        {
+            auto setup = GetSetup();
+
+            Function<float, float, float> expression(setup->GetAllocator(), setup->GetCode());
+
+            auto & p1 = expression.GetP1();
+            auto & p2 = expression.GetP2();
+
+            expression.AddExecuteOnlyIfStatement(expression.Compare<JccType::JAE>(p1, expression.Immediate(0.0f)),
+                                                 expression.Immediate(-1.0f));
+
+            auto & root = expression.Mul(p1, p2);
+
+            TieredFunction<float, float, float> function(expression, root, c_tierPromotionThreshold);
+
+            ASSERT_EQ(-1.0f, function(-2.0f, 3.0f));
+            ASSERT_EQ(6.0f, function(2.0f, 3.0f));
+            ASSERT_EQ(-1.0f, function(-0.5f, 3.0f));
+            ASSERT_EQ(0.0f, function(0.0f, 3.0f));
+
+            function.WaitForPromotion();
+
+            ASSERT_TRUE(function.IsCompiled());
+            ASSERT_EQ(-1.0f, function(-2.0f, 3.0f));
+            ASSERT_EQ(6.0f, function(2.0f, 3.0f));
+        }
+
+
+        TEST_F(TieredFunctionTest, ZeroThresholdCompilesImmediately)
+        {
+            auto setup = GetSetup();
+
+            Function<int32_t, int32_t> expression(setup->GetAllocator(), setup->GetCode());
+
+            auto & root = expression.Add(expression.GetP1(), expression.Immediate(1));
+
+            TieredFunction<int32_t, int32_t> function(expression, root, 0);
+
+            ASSERT_TRUE(function.IsCompiled());
+            ASSERT_EQ(2, function(1));
+            ASSERT_EQ(0u, function.GetCallCount());
+        }
+
+
+        TEST_F(TieredFunctionTest, UnsupportedNodeCompilesImmediately)
+        {
+            auto setup = GetSetup();
+
+            typedef Packed<5, 5, 6> PackedType;
+
+            Function<PackedType, PackedType, PackedType> expression(setup->GetAllocator(), setup->GetCode());
+
+            auto & root = expression.PackedMax(expression.GetP1(), expression.GetP2());
+
+            TieredFunction<PackedType, PackedType, PackedType> function(expression, root, c_tierPromotionThreshold);
+
+            ASSERT_FALSE(function.GetBytecode().CanEvaluate());
+            ASSERT_EQ(root.GetId(), function.GetBytecode().GetUnsupportedNodeId());
+            ASSERT_TRUE(function.IsCompiled());
+        }
+
+        // The compiled code makes a store or a call on one path of a
+        // conditional even if the other path is taken, so the interpreter
+        // must not run such trees.
+        TEST_F(TieredFunctionTest, SideEffectOnConditionalPathCompilesImmediately)
+        {
+            auto setup = GetSetup();
+
+            {
+                Function<int32_t, int32_t, int32_t*> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & store = expression.Store(expression.GetP2(), expression.GetP1());
+                auto & root = expression.Conditional(
+                    expression.Compare<JccType::JG>(expression.GetP1(), expression.Immediate(0)),
+                    store,
+                    expression.Immediate(0));
+
+                TieredFunction<int32_t, int32_t, int32_t*> function(expression, root, c_tierPromotionThreshold);
+
+                ASSERT_FALSE(function.GetBytecode().CanEvaluate());
+                ASSERT_EQ(store.GetId(), function.GetBytecode().GetUnsupportedNodeId());
+                ASSERT_TRUE(function.IsCompiled());
+
+                int32_t output = 0;
+                ASSERT_EQ(5, function(5, &output));
+                ASSERT_EQ(5, output);
+            }
+
+            {
+                Function<int64_t, int64_t, int32_t> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & call = expression.Call(expression.Immediate(&Callback),
+                                              expression.GetP1(),
+                                              expression.GetP2(),
+                                              expression.Immediate<uint8_t>(200));
+                auto & root = expression.Conditional(
+                    expression.Compare<JccType::JG>(expression.GetP1(), expression.Immediate<int64_t>(0)),
+                    call,
+                    expression.Immediate<int64_t>(-1));
+
+                TieredFunction<int64_t, int64_t, int32_t> function(expression, root, c_tierPromotionThreshold);
+
+                ASSERT_FALSE(function.GetBytecode().CanEvaluate());
+                ASSERT_EQ(call.GetId(), function.GetBytecode().GetUnsupportedNodeId());
+                ASSERT_TRUE(function.IsCompiled());
+                ASSERT_EQ(Callback(1000, -3, 200), function(1000, -3));
+                ASSERT_EQ(-1, function(-1000, -3));
+            }
+        }
+    }
+}
@@ -0,0 +1,235 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2016, Microsoft
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include <cmath>        // For std::nanf.
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "NativeJIT/CodeGen/ExecutionBuffer.h"
+#include "NativeJIT/CodeGen/FunctionBuffer.h"
+#include "NativeJIT/Function.h"
+#include "NativeJIT/TreeEnsemble.h"
+#include "Temporary/Allocator.h"
+#include "TestSetup.h"
+#include "TierVerifier.h"
+
+
+namespace NativeJIT
+{
+    namespace TreeEnsembleUnitTest
+    {
+        TEST_FIXTURE_START(TreeEnsembleTest)
+
+        public:
+            // The random ensembles need more code than the default capacity.
+            TreeEnsembleTest()
+                : TestFixture(64 * 1024,
+                              c_defaultGeneralAllocatorCapacity,
+                              c_defaultDiagnosticsStream)
+            {
+            }
+
+        protected:
+            static const unsigned c_featureCount = 8;
+
+            // The thresholds and the features are multiples of 0.25 so that
+            // the features are often equal to the thresholds.
+            static float RandomValue(std::mt19937& random)
+            {
+                return static_cast<float>(static_cast<int>(random() % 17) - 8) * 0.25f;
+            }
+
+
+            // Appends a random subtree in preorder and returns its index.
+            static uint32_t AddRandomSubtree(std::vector<DecisionTreeNode>& nodes,
+                                             std::mt19937& random,
+                                             unsigned depth)
+            {
+                const uint32_t index = static_cast<uint32_t>(nodes.size());
+                const DecisionTreeNode leaf = { 0, 0, 0, 0, RandomValue(random) };
+
+                nodes.push_back(leaf);
+
+                if (depth > 0 && random() % 4 != 0)
+                {
+                    nodes[index].m_feature = random() % c_featureCount;
+                    nodes[index].m_threshold = RandomValue(random);
+
+                    const uint32_t left = AddRandomSubtree(nodes, random, depth - 1);
+                    nodes[index].m_left = left;
+
+                    const uint32_t right = AddRandomSubtree(nodes, random, depth - 1);
+                    nodes[index].m_right = right;
+                }
+
+                return index;
+            }
+
+
+            float Compile(TreeEnsemble const & ensemble, float const * features)
+            {
+                auto setup = GetSetup();
+                Function<float, float const *> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & value = expression.EvaluateEnsemble(expression.GetP1(), ensemble);
+                auto function = expression.Compile(value);
+
+                return function(features);
+            }
+
+        TEST_FIXTURE_END_TEST_CASES_BEGIN
+
+
+        TEST_F(TreeEnsembleTest, SingleTree)
+        {
+            // if (f0 > 0.5) 10 else (if (f1 > -1) 2 else 1)
+            const DecisionTreeNode nodes[] =
+            {
+                { 0, 0.5f, 1, 2, 0 },
+                { 1, -1.0f, 3, 4, 0 },
+                { 0, 0, 0, 0, 10.0f },
+                { 0, 0, 0, 0, 1.0f },
+                { 0, 0, 0, 0, 2.0f }
+            };
+
+            TreeEnsemble ensemble;
+            ensemble.AddTree(nodes, 5);
+
+            ASSERT_EQ(1u, ensemble.GetTreeCount());
+            ASSERT_EQ(2u, ensemble.GetFeatureCount());
+
+            const float nan = std::nanf("");
+            const float features[][2] =
+            {
+                { 0.0f, -2.0f },
+                { 0.5f, 0.0f },     // Equal to the threshold goes left.
+                { 0.75f, -2.0f },
+                { nan, nan }        // NaN goes left.
+            };
+            const float expected[] = { 1.0f, 2.0f, 10.0f, 1.0f };
+
+            for (unsigned i = 0; i < 4; ++i)
+            {
+                ASSERT_EQ(expected[i], ensemble.Evaluate(features[i]));
+                ASSERT_EQ(expected[i], Compile(ensemble, features[i])) << "Vector " << i;
+            }
+        }
+
+
+        TEST_F(TreeEnsembleTest, RandomEnsemble)
+        {
+            std::mt19937 random(1234);
+            TreeEnsemble ensemble;
+
+            for (unsigned i = 0; i < 30; ++i)
+            {
+                std::vector<DecisionTreeNode> nodes;
+                AddRandomSubtree(nodes, random, 4);
+                ensemble.AddTree(nodes.data(), static_cast<unsigned>(nodes.size()));
+            }
+
+            auto setup = GetSetup();
+            Function<float, float const *> expression(setup->GetAllocator(), setup->GetCode());
+
+            auto & value = expression.EvaluateEnsemble(expression.GetP1(), ensemble);
+            auto function = expression.Compile(value);
+
+            for (unsigned i = 0; i < 200; ++i)
+            {
+                float features[c_featureCount];
+
+                for (auto & feature : features)
+                {
+                    feature = RandomValue(random);
+                }
+
+                ASSERT_EQ(ensemble.Evaluate(features), function(features)) << "Vector " << i;
+            }
+        }
+
+
+        TEST_F(TreeEnsembleTest, InvalidTree)
+        {
+            TreeEnsemble ensemble;
+
+            // The children must follow the parent.
+            const DecisionTreeNode cycle[] =
+            {
+                { 0, 0, 1, 2, 0 },
+                { 0, 0, 0, 0, 1.0f },
+                { 0, 0, 1, 2, 0 }
+            };
+            ASSERT_THROW(ensemble.AddTree(cycle, 3), std::runtime_error);
+
+            const DecisionTreeNode outOfRange[] =
+            {
+                { 0, 0, 1, 2, 0 },
+                { 0, 0, 0, 0, 1.0f }
+            };
+            ASSERT_THROW(ensemble.AddTree(outOfRange, 2), std::runtime_error);
+
+            ASSERT_EQ(0u, ensemble.GetTreeCount());
+
+            auto setup = GetSetup();
+            Function<float, float const *> expression(setup->GetAllocator(), setup->GetCode());
+
+            ASSERT_THROW(expression.EvaluateEnsemble(expression.GetP1(), ensemble), std::runtime_error);
+        }
+
+
+        TEST_F(TreeEnsembleTest, Tiers)
+        {
+            const DecisionTreeNode first[] =
+            {
+                { 1, 2.0f, 1, 2, 0 },
+                { 0, 0, 0, 0, 0.25f },
+                { 0, 0, 0, 0, 4.0f }
+            };
+            const DecisionTreeNode second[] =
+            {
+                { 0, -1.0f, 1, 2, 0 },
+                { 0, 0, 0, 0, 1.0f },
+                { 0, 0, 0, 0, -8.0f }
+            };
+
+            TreeEnsemble ensemble;
+            ensemble.AddTree(first, 3);
+            ensemble.AddTree(second, 3);
+
+            auto setup = GetSetup();
+
+            Function<float, float const *> expression(setup->GetAllocator(), setup->GetCode());
+
+            auto & value = expression.EvaluateEnsemble(expression.GetP1(), ensemble);
+
+            TieredFunction<float, float const *> function(expression, value, c_tierPromotionThreshold);
+
+            const float features[] = { 0.0f, 3.0f };
+
+            VerifyTiers(function, 4.0f - 8.0f, features);
+        }
+
+        TEST_CASES_END
+    }
+}
@@ -22,6 +22,9 @@
 
 
 
+#include <sstream>
+
+#include "NativeJIT/CodeGen/Disassembler.h"
 #include "NativeJIT/CodeGen/ExecutionBuffer.h"
 #include "NativeJIT/CodeGen/FunctionBuffer.h"
 #include "NativeJIT/Function.h"
@@ -437,6 +440,100 @@ namespace NativeJIT
         }
 
 
+        TEST_F(Unsigned, ArrayFieldWithVariableIndex)
+        {
+            auto setup = GetSetup();
+
+            {
+                struct S
+                {
+                    uint64_t m_header;
+                    uint32_t m_array[10];
+                };
+
+                Function<uint32_t, S*, int32_t> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & arrayPtr = expression.FieldPointer(expression.GetP1(), &S::m_array);
+                auto & element = expression.Deref(expression.Add(arrayPtr, expression.GetP2()));
+                auto function = expression.Compile(element);
+
+                S s;
+                for (uint32_t i = 0; i < 10; ++i)
+                {
+                    s.m_array[i] = 1000 + i;
+                }
+
+                ASSERT_EQ(s.m_array[7], function(&s, 7));
+
+                // The field offset and the scaled index are folded into the
+                // operand of a single load.
+                std::ostringstream listing;
+                ASSERT_TRUE(Disassemble(setup->GetCode(), listing));
+                ASSERT_NE(std::string::npos, listing.str().find("*4 + 8]")) << listing.str();
+                ASSERT_EQ(std::string::npos, listing.str().find("imul")) << listing.str();
+            }
+        }
+
+
+        TEST_F(Unsigned, ArrayWithGuardedIndex)
+        {
+            auto setup = GetSetup();
+
+            {
+                Function<int32_t, int32_t*, uint64_t, uint64_t> expression(setup->GetAllocator(), setup->GetCode());
+
+                // The element is loaded only if the index is within bounds.
+                auto & array = expression.GetP1();
+                auto & index = expression.GetP2();
+                auto & element = expression.Deref(expression.Add(array, index));
+                auto & root = expression.Conditional(
+                    expression.Compare<JccType::JB>(index, expression.GetP3()),
+                    element,
+                    expression.Immediate<int32_t>(-1));
+
+                auto function = expression.Compile(root);
+
+                int32_t values[] = { 10, 11, 12 };
+
+                ASSERT_EQ(12, function(values, 2, 3));
+                ASSERT_EQ(-1, function(values, 1ull << 40, 3));
+                ASSERT_EQ(-1, function(nullptr, 0, 0));
+            }
+        }
+
+
+        TEST_F(Unsigned, ArrayOfOddSizedClass)
+        {
+            auto setup = GetSetup();
+
+            {
+                struct Triple
+                {
+                    uint32_t m_a;
+                    uint32_t m_b;
+                    uint32_t m_c;
+                };
+
+                Function<uint32_t, Triple*, uint64_t> expression(setup->GetAllocator(), setup->GetCode());
+
+                auto & element = expression.Add(expression.GetP1(), expression.GetP2());
+                auto & c = expression.Deref(expression.FieldPointer(element, &Triple::m_c));
+                auto function = expression.Compile(c);
+
+                Triple array[5];
+                for (uint32_t i = 0; i < 5; ++i)
+                {
+                    array[i].m_a = i;
+                    array[i].m_b = 10 * i;
+                    array[i].m_c = 100 * i;
+                }
+
+                ASSERT_EQ(array[3].m_c, function(array, 3));
+                ASSERT_EQ(array[0].m_c, function(array, 0));
+            }
+        }
+
+
         //
         // Common sub expressions
         //